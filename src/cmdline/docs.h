@@ -81,7 +81,199 @@ conventions, and the \"=\" sign may be omitted.\n\
                             (May reduce performance.)\n\
 ";
 
-// TODO: Have a layer 2 ether and "raw" (no protocol) layer 3 option.
+static const char HELP_TEXT_TRAFFIC[] = "\
+::::::::::::::::::::::::::::::::Traffic:::::::::::::::::::::::::::::::::\n\
+   --rate=<0-n>             Packets per second across all threads.\n\
+                            (Default: 0, i.e., as fast as possible.)\n\
+   --shape=<kind:params>    Shape of the traffic over time:\n\
+                              constant:<rate>  Same as \"--rate\".\n\
+                              burst:<n>@<t>    <n> back-to-back pkts\n\
+                                               every <t> (ns, us, ms\n\
+                                               or s; default: us).\n\
+                              poisson:<rate>   Random arrivals, with\n\
+                                               exponential gaps.\n\
+                            Waits are slept through and then spun out\n\
+                            on the clock, for precise gaps; each run\n\
+                            reports the achieved inter-batch gaps.\n\
+   --txtime                 Stamp every packet with its launch time\n\
+                            (SO_TXTIME) and leave the gaps to an ETF\n\
+                            (or taprio) qdisc, which must be set up on\n\
+                            the outgoing interface; for pacing that is\n\
+                            finer than userspace can sleep.  (Linux)\n\
+   --txtime-lead=<1-n>      Microseconds ahead of their launch times\n\
+                            to hand packets over to the kernel; must\n\
+                            exceed the \"delta\" of the qdisc.\n\
+                            (Default: 500.)\n\
+   --tx-timestamps=<1-n>    Sample one packet in every <n> (of each\n\
+                            thread; only one at a time overall) for\n\
+                            kernel TX timestamps (SO_TIMESTAMPING),\n\
+                            and report how long the samples took from\n\
+                            the syscall to the qdisc, to the driver,\n\
+                            and (if the NIC stamps them, and its clock\n\
+                            is kept in sync with the system's, e.g.,\n\
+                            by phc2sys) to the wire; e.g., to see what\n\
+                            larger batches or the qdisc add in\n\
+                            queueing.  (Linux)\n\
+   --responses              Match the SYN-ACKs and RSTs from the\n\
+                            destination address and port to the SYNs\n\
+                            (by source port and sequence number), and\n\
+                            report the share of SYNs answered either\n\
+                            way or not at all (within a second), and\n\
+                            the handshake latencies.  To tell the SYNs\n\
+                            apart, their sequence numbers count up\n\
+                            (unless \"--vary\" says otherwise.)\n\
+                            (TCP only; Linux)\n\
+   --duration=<0-n>         Seconds to send for (default: 0; i.e.,\n\
+                            until interrupted with Ctrl+C.)\n\
+";
+
+// (The rest of the traffic options, in a literal of their own.)
+static const char HELP_TEXT_TRAFFIC_MIX[] = "\
+   --scenario=<file>        Run the phases in <file> back-to-back; each\n\
+                            line is a name followed by the options of\n\
+                            that phase (e.g., \"ramp --rate=1000\n\
+                            --duration=10\"), on top of the command\n\
+                            line's.  Lines starting with '#' are\n\
+                            comments.\n\
+   --profile=<file|imix>    Send a mix of packets; each line of <file>\n\
+                            is a weight followed by the (packet)\n\
+                            options of that kind of packet (e.g.,\n\
+                            \"7 --len=40\" or\n\
+                            \"1 --dscp=ef --len=1500\"), on top of the\n\
+                            command line's.  \"imix\" is the 7:4:1 mix\n\
+                            of 40-, 576-, and 1500-byte packets.\n\
+   --payload-file=<file>    Take the payloads from the records of\n\
+                            <file>, in turn (without copying them);\n\
+                            the lengths and checksums follow suit.\n\
+   --payload-format=<fmt>   How the records are delimited: \"lines\"\n\
+                            (default), \"sep:<0-255>\" (by that byte)\n\
+                            or \"len16\" (each after its 16-bit, big-\n\
+                            endian length.)\n\
+   --vary=<field>=<gen>     Change a header field with every packet\n\
+                            (may be given several times); checksums\n\
+                            are patched incrementally.  Fields: tos,\n\
+                            ident, ttl, saddr, daddr (IPv4); traffic-\n\
+                            class, flow-label, hop-limit (IPv6); sport,\n\
+                            dport (TCP/UDP); seq, ack, window, urg-ptr\n\
+                            (TCP).  Generators:\n\
+                              random           Uniformly random.\n\
+                              inc[:<step>]     Counting up from the\n\
+                                               header's value (by 1).\n\
+                              list:<a,b,...>   Cycling through values\n\
+                                               (up to 16 of them.)\n\
+                              range:<lo>-<hi>  Random within [lo, hi].\n\
+                            (e.g., \"--vary=dport=range:1024-2047\")\n\
+";
+
+static const char HELP_TEXT_BENCHMARKS[] = "\
+:::::::::::::::::::::::::::::::Benchmarks:::::::::::::::::::::::::::::::\n\
+   --rfc2544                RFC 2544 throughput test: binary-search\n\
+                            the highest rate without frame loss, for\n\
+                            each frame size.  Test frames are counted\n\
+                            as they come back from the DUT (on \"rx-if\")\n\
+                            or from a reflector (addresses swapped).\n\
+                            (\"--rate\" caps the search; by default,\n\
+                            it starts at the fastest achievable rate.)\n\
+   --frame-sizes=<a,b,...>  Ethernet frame sizes (incl. 18 bytes of\n\
+                            header and FCS) to test, in [64, 1518].\n\
+                            (Default: 64,128,256,512,1024,1280,1518.)\n\
+   --trial-time=<1-n>       Seconds per trial (default: 60.)\n\
+   --rx-if=<name>           Interface that receives the test frames\n\
+                            (or packets, with \"--sink\".)\n\
+                            (Default: all interfaces.)\n\
+   --run-id=<0-4294967295>  Tag every packet with this test run ID,\n\
+                            the index of its sending thread, a 64-bit\n\
+                            sequence number, and its send time (28\n\
+                            bytes, in front of its payload), for a\n\
+                            \"--sink\" to count.\n\
+   --sink                   Receive instead of sending: count the\n\
+                            packets of \"--run-id\" (through packet\n\
+                            rings, spread over the threads) until the\n\
+                            \"--duration\" elapses or Ctrl+C; then report\n\
+                            their rate, losses (and bursts thereof),\n\
+                            duplicates, reordering, and jitter (RFC\n\
+                            3550; the clocks need not be in sync).\n\
+   --twamp                  Measure the delays (and losses) each way\n\
+                            with TWAMP-light test packets (RFC 5357)\n\
+                            over UDP, at \"--rate\" (by default, 1000\n\
+                            per second) until \"--duration\" elapses\n\
+                            or Ctrl+C.  One-way delays need the clocks\n\
+                            of both ends in sync; round trips do not.\n\
+   --reflect                Be the TWAMP-light reflector instead:\n\
+                            send the test packets of any sender back,\n\
+                            with kernel receive timestamps.\n\
+   --twamp-port=<1-65535>   UDP port of the reflector (default: 862).\n\
+   --twamp-padding=<0-1411> Bytes of padding after each test packet\n\
+                            (default: 27, which keeps the reflected\n\
+                            ones just as long.)\n\
+   --connect                Open real TCP connections to the destination\n\
+                            address and port at \"--rate\" (or as fast\n\
+                            as they finish), through ordinary sockets;\n\
+                            needs no privileges.  Reports connections\n\
+                            per second, handshake latencies and why any\n\
+                            failed.  Connections are closed with an RST\n\
+                            (so none linger in TIME_WAIT).  (Linux)\n\
+   --concurrency=<1-n>      Connections in flight per thread (default:\n\
+                            256.)\n\
+   --conn-timeout=<t>       How long a connection may take to be set up\n\
+                            (and to be answered) before it is given up\n\
+                            on (ns, us, ms or s; default: 1s).\n\
+   --request=<file>         Send the contents of <file> (up to 64 KiB)\n\
+                            on every connection, and wait for the first\n\
+                            byte of the response.\n\
+";
+
+// TODO: Have a "raw" (no protocol) layer 3 option.
+static const char HELP_TEXT_ETH[] = "\
+:::::::::::::::::::::::::L2.  Ethernet II Header::::::::::::::::::::::::\n\
+| Byte |0,1,2,3,4,5,6,7|0,1,2,3,4,5,6,7|0,1,2,3,4,5,6,7|0,1,2,3,4,5,6,7|\n\
++------+---------------+---------------+---------------+---------------+\n\
+|  0-6 |                      Destination Address                      |\n\
++------+---------------------------------------------------------------+\n\
+|  6-12|                        Source Address                         |\n\
++------+-------------------------------+-------------------------------+\n\
+: 12-20:  [TPID: 0x88A8 or 0x8100]     :  [PCP|D|VLAN ID] (up to two)  :\n\
++------+-------------------------------+-------------------------------+\n\
+| 12-14|           EtherType           |\n\
++------+-------------------------------+\n\
+-E --eth=<interface>        Ethernet II layer 2 indicator; sends whole\n\
+                            frames out of the interface (through an\n\
+                            AF_PACKET socket), which skips the route\n\
+                            and neighbour lookups of every packet.\n\
+   --src-mac=<mac>          [OVERRIDE] Source MAC address to spoof.\n\
+                            (Default: that of the interface.)\n\
+   --dest-mac=<mac>         Destination (i.e., next hop) MAC address;\n\
+                            \"ip neigh\" lists the known ones.\n\
+   --ethertype=<0-65535>    [OVERRIDE] EtherType (default: that of the\n\
+                            IPv4 or IPv6 header.)\n\
+   --vlan=<0-4095>[:<0-7>]  802.1Q VLAN ID (and priority code point);\n\
+                            given twice, the first one becomes the\n\
+                            outer (802.1ad, QinQ) tag.\n\
+";
+
+
+static const char HELP_TEXT_TUNNEL[] = "\
+::::::::::::::::::::::::::Tunnel Encapsulation::::::::::::::::::::::::::\n\
+The packets described below get wrapped in an outer IPv4 header (and,\n\
+for GRE, a GRE header; for VXLAN, UDP, VXLAN and inner Ethernet II\n\
+headers) once, when their template gets crafted; outer lengths are\n\
+only touched per packet when a payload corpus varies them.\n\
+   --encap=<ipip|gre|vxlan> Tunnel to encapsulate the packets in; IP-in-\n\
+                            IP carries IPv6 as 6in4 (protocol 41.)\n\
+   --tunnel-src=<x.x.x.x>   [OVERRIDE] Outer source address. (Default:\n\
+                            that of the route to the tunnel endpoint;\n\
+                            it also is the default inner IPv4 source.)\n\
+   --tunnel-dest=<x.x.x.x>  Outer destination (tunnel endpoint) address.\n\
+   --gre-key=<0-4294967295> GRE key; without it, no key field is sent.\n\
+   --vni=<0-16777215>       VXLAN network identifier. (Default: 0)\n\
+   --inner-src-mac=<mac>    Inner Ethernet source address of VXLAN.\n\
+                            (Default: 02:00:00:00:00:01)\n\
+   --inner-dest-mac=<mac>   Inner Ethernet destination address of\n\
+                            VXLAN. (Default: ff:ff:ff:ff:ff:ff)\n\
+The VXLAN source port is hashed from the inner flow of the template\n\
+(RFC 7348); it does not follow per-packet \"--vary\" changes.\n\
+";
+
 
 static const char HELP_TEXT_IPV4[] = "\
 ::::::::::::::::::::::::::::L3.  IPv4 Header::::::::::::::::::::::::::::\n\
@@ -100,12 +292,15 @@ static const char HELP_TEXT_IPV4[] = "\
 : 20-56:                      [options & padding]                      :\n\
 +------+---------------------------------------------------------------+\n\
 -4 --ipv4                   IPv4 layer 3 indicator.\n\
-   --src-ip=<addr>          [OVERRIDE] IPv4 source address to spoof.\n\
+   --src-ip=<addr[/n]>      [OVERRIDE] IPv4 source address to spoof;\n\
+                            a CIDR range (e.g., 10.0.0.0/8) picks a\n\
+                            random address within it per packet.\n\
    --dest-ip=<addr>         IPv4 destination address.\n\
    --ver=<4|0-15>           [OVERRIDE] IP version to spoof.\n\
    --ihl=<5|0-15>           [OVERRIDE] IPv4 header length in 32-bit\n\
                             increments; minimum \"should\" be 5 (i.e.,\n\
-                            5x32 = 160 bits = 20 bytes) by standard.\n\
+                            5x32 = 160 bits = 20 bytes) by standard,\n\
+                            plus the words of any \"--options.\"\n\
    --tos=<0-255>            Type of Service; obsolete by DSCP+ECN.\n\
    |                        ToS itself is divided into precedence,\n\
    |                        throughput, reliability, cost, and mbz:\n\
@@ -131,19 +326,42 @@ static const char HELP_TEXT_IPV4[] = "\
    --proto=<...|0-255>      [OVERRIDE] protocol number (e.g., tcp, 6)\n\
                             (\"--help=proto\" for textual entries.)\n\
    --chksum=<0-65535>       [OVERRIDE] IPv4 header checksum.\n\
-   --options=<>             [[UNFINISHED]]\n\
+   --options=<a,b,...>      IPv4 options, encoded once in the given\n\
+                            order and padded to 32 bits (up to 40\n\
+                            bytes); the IHL follows unless given:\n\
+   | rr[=<1-9>]               Record Route, with room for as many\n\
+   |                          addresses (default: all that fit);\n\
+   | ts[=<1-9>]               Timestamp (RFC 791), likewise;\n\
+   | ra                       Router Alert (RFC 2113);\n\
+   | nop                      No Operation; and\n\
+   | eol                      End of Options List.\n\
+                            (e.g., \"ra,rr=4\")\n\
 ";
 
 static const char HELP_TEXT_IPV6[] = "\
 ::::::::::::::::::::::::::::L3.  IPv6 Header::::::::::::::::::::::::::::\n\
--6 --ipv6                   IPv6 layer 3 indicator.\n\
+-6 --ipv6                   IPv6 layer 3 indicator (also implied by\n\
+                            an IPv6 destination address.)\n\
    --src-ip=<addr6>         [OVERRIDE] IPv6 source address to spoof.\n\
    --dest-ip=<addr6>        IPv6 destination address.\n\
-   --next-hdr=<...|0-255>   Next header, akin to IPv4's \"proto\" field.\n\
-                            (\"--help=next-header\" for text entries.)\n\
+   --traffic-class=<0-255|random>\n\
+                            Traffic Class (DSCP+ECN), or a random one\n\
+                            for every packet.\n\
+   --flow-label=<0-1048575|random>\n\
+                            Flow Label (RFC 6437), or a random one\n\
+                            for every packet.\n\
+   --len=<0-65535>          [OVERRIDE] Payload length (i.e., all but\n\
+                            the IPv6 header); also sizes the packet.\n\
+   --next-header=<...|0-255>\n\
+                            [OVERRIDE] Next header, akin to IPv4's\n\
+                            \"proto\" field (of the last extension\n\
+                            header, if any.)\n\
    --hop-limit=<0-255>      Similar to IPv4's \"ttl\" field.\n\
-   --flow-label=<0-1048575> Flow Label (experimental; RFC 2460).\n\
-[[UNIMPLEMENTED]]\n\
+   --ext-headers=<hop|dest|frag>[,...]\n\
+                            Extension headers to chain (in order)\n\
+                            before the L4 header: Hop-by-Hop Options,\n\
+                            Destination Options (both only padding),\n\
+                            or an atomic Fragment header.\n\
 ";
 
 // TODO: Make the bitfield also take one-letter flags
@@ -163,14 +381,17 @@ static const char HELP_TEXT_TCP[] = "\
 +------+-------------------------------+-------------------------------+\n\
 : 20-56:                      [options & padding]                      :\n\
 +------+---------------------------------------------------------------+\n\
--T --tcp                    TCP layer 4 indicator.\n\
+-T --tcp                    TCP layer 4 indicator; \"--flags,\" \"--chksum,\"\n\
+                            and \"--options\" only refer to TCP if they\n\
+                            come after it.\n\
    --src-port=<0-65535>     [OVERRIDE] Source port.\n\
    --dest-port=<0-65535>    Destination port.\n\
    --seq-num=<0-4294967295> Sequence number.\n\
    --ack-num=<0-4294967295> Acknowledgement number.\n\
-   --data-ofs=<0-15>        Data Offset (in 32-bit words).\n\
+   --data-ofs=<0-15>        [OVERRIDE] Data Offset (in 32-bit words).\n\
    --reserved=<0-15>        TCP Reserved/unused bits (default: 0000).\n\
-   --flags=<0-255>          Bitfield for TCP flags:\n\
+   --flags=<0-255>          Bitfield for TCP flags (default: SYN); any\n\
+                            of the following replace the default:\n\
    | --cwr                    [C]ongestion Window Reduced (RFC 3168);\n\
    | --ece                    [E]CN-Echo (RFC 3168);\n\
    | --urg                    [U]rgent;\n\
@@ -182,19 +403,72 @@ static const char HELP_TEXT_TCP[] = "\
    --window=<0-65535>       Window Size\n\
    --chksum=<0-65535>       [OVERRIDE] Checksum\n\
    --urg-ptr=<0-65535>      Urgent Pointer\n\
-   --options=<>             [[UNFINISHED]]\n\
+   --options=<a,b,...>      TCP options, compiled in the given order\n\
+                            and padded to 32 bits (up to 40 bytes):\n\
+   | mss=<0-65535>            Maximum Segment Size;\n\
+   | ws=<0-14>                Window Scale (RFC 7323);\n\
+   | sackok                   SACK Permitted (RFC 2018);\n\
+   | ts                       Timestamps (RFC 7323); TSval counts\n\
+   |                          milliseconds, refreshed per packet;\n\
+   | nop                      No-Operation; and\n\
+   | eol                      End of Option List.\n\
+                            (e.g., \"mss=1460,sackok,ts,nop,ws=7\")\n\
 ";
 
 static const char HELP_TEXT_UDP[] = "\
 ::::::::::::::::::::::::::::L4.  UDP Header:::::::::::::::::::::::::::::\n\
--U --udp                    UDP layer 4 indicator.\n\
-[[UNIMPLEMENTED]]\n\
+| Byte |0,1,2,3,4,5,6,7|0,1,2,3,4,5,6,7|0,1,2,3,4,5,6,7|0,1,2,3,4,5,6,7|\n\
++------+---------------+---------------+---------------+---------------+\n\
+|  0-4 |          Source Port          |       Destination Port        |\n\
++------+-------------------------------+-------------------------------+\n\
+|  4-8 |            Length             |           Checksum            |\n\
++------+-------------------------------+-------------------------------+\n\
+-U --udp                    UDP layer 4 indicator; the options below\n\
+                            only refer to UDP if they come after it.\n\
+   --src-port=<0-65535>     [OVERRIDE] Source port.\n\
+   --dest-port=<0-65535>    Destination port (default: 9.)\n\
+   --len=<0-65535>          [OVERRIDE] Length of header plus data;\n\
+                            also sizes the packet, unless the IPv4\n\
+                            \"--len\" was given (before \"--udp\").\n\
+   --chksum=<0-65535>       [OVERRIDE] Checksum (0: none.)\n\
+   --dgram                  Send just the payload (as sized by \"--len\")\n\
+                            through ordinary UDP sockets, which needs\n\
+                            no privileges; the kernel writes the\n\
+                            headers (so only the ports and addresses\n\
+                            above apply).  Where the kernel supports\n\
+                            it, each message of a batch gets segmented\n\
+                            into many datagrams (UDP GSO).  (Linux)\n\
+   --no-gso                 With \"--dgram\", one datagram per message.\n\
+   --zerocopy               With \"--dgram\", let the kernel send straight\n\
+                            from our buffers (MSG_ZEROCOPY), rather than\n\
+                            copy them; worth it for large messages.\n\
+                            Compare the CPU time per Gbit (reported at\n\
+                            the end) of runs with and without it.\n\
+   --dns=<file>             Send the DNS queries of a file (one\n\
+                            \"<name> [<type>]\" per line; A by default)\n\
+                            round-robin, as with \"--dgram\", at\n\
+                            \"--rate\"; match the responses by their\n\
+                            IDs, and report the queries per second,\n\
+                            the RCODEs and the response times.  E.g.,\n\
+                            \"--udp --dest-port=53 --dns=names.txt\".\n\
+   --dns-timeout=<t>        Until a query counts as lost (ns, us, ms\n\
+                            or s; default: 1s.)\n\
 ";
 
 static const char HELP_TEXT_ICMP[] = "\
 ::::::::::::::::::::::::::::L4.  ICMP Header::::::::::::::::::::::::::::\n\
--I --icmp                   ICMP layer 4 indicator.\n\
-[[UNIMPLEMENTED]]\n\
+-I --icmp                   Probe the round-trip latency with ICMP(v6)\n\
+                            echo requests (at \"--rate\"; by default,\n\
+                            100 per second) until \"--duration\" elapses\n\
+                            or Ctrl+C; then report the losses and the\n\
+                            percentiles of the round-trip times.  Run\n\
+                            another blitzping alongside it to see the\n\
+                            latency under load.\n\
+   --echo-id=<0-65535>      Identifier of the requests (default: the\n\
+                            process ID).\n\
+   --echo-size=<0-1452>     Bytes of data in each request (default: 56).\n\
+   --echo-timeout=<t>       How long to wait for a reply before counting\n\
+                            it lost (ns, us, ms or s; default: 1s).\n\
 ";
 
 // NOTE: These were "divided into sections because C99+ compilers
@@ -202,17 +476,23 @@ static const char HELP_TEXT_ICMP[] = "\
 //
 // NOTE: The help texts alone take up a few kilobytes of space; you
 // could change this to an empty string to save on that, if need be.
-#define HELP_TEXT_ALL "%s%s%s%s%s%s", \
-    HELP_TEXT_OVERVIEW, HELP_TEXT_IPV4, HELP_TEXT_IPV6, \
-    HELP_TEXT_TCP, HELP_TEXT_UDP, HELP_TEXT_ICMP
+#define HELP_TEXT_ALL "%s%s%s%s%s%s%s%s%s%s%s", \
+    HELP_TEXT_OVERVIEW, HELP_TEXT_TRAFFIC, HELP_TEXT_TRAFFIC_MIX, \
+    HELP_TEXT_BENCHMARKS, HELP_TEXT_ETH, HELP_TEXT_TUNNEL, \
+    HELP_TEXT_IPV4, HELP_TEXT_IPV6, HELP_TEXT_TCP, HELP_TEXT_UDP, \
+    HELP_TEXT_ICMP
 
 
 static const char HELP_PAGE_PROTO[] = "\
 IPv4/IPv6 Protocols:\n\
 \n\
   icmp   1    Internet Control Message Protocol\n\
+  ipip   4    IPv4 encapsulation (IP-in-IP)\n\
   tcp    6    Transmission Control Protocol\n\
   udp    17   User Datagram Protocol\n\
+  ipv6   41   IPv6 encapsulation (6in4)\n\
+  gre    47   Generic Routing Encapsulation\n\
+  icmpv6 58   ICMP for IPv6\n\
 ";
 
 static const char HELP_PAGE_PREC[] = "\
@@ -5,6 +5,7 @@
 
 
 #include "logger.h"
+#include "../utils/clock.h"
 
 
 static enum LogLevel CURRENT_LOG_LEVEL = LOG_DEBUG;
@@ -61,6 +62,26 @@ static int generate_timestamp(
     return 0;
 }
 
+// NOTE: localtime() (which may even consult the timezone database)
+// and strftime() cost far more than a log line deserves, so the time
+// only gets formatted again once the (cheap) coarse clock has moved on
+// to another tenth of a second; every thread keeps its own copy.
+#define TIMESTAMP_REFRESH_NS (100 * NSEC_PER_MSEC)
+
+static void cached_timestamp(char *const timestamp, const size_t size) {
+    static _Thread_local char cached[TIMESTAMP_SIZE];
+    static _Thread_local uint64_t cached_tick = UINT64_MAX;
+
+    const uint64_t tick = clock_coarse_ns() / TIMESTAMP_REFRESH_NS;
+    if (tick != cached_tick) {
+        // Failures (i.e., placeholders) are not worth keeping.
+        cached_tick = (generate_timestamp(cached, TIMESTAMP_SIZE) == 0)
+            ? tick : UINT64_MAX;
+    }
+
+    snprintf(timestamp, size, "%s", cached);
+}
+
 // NOTE: These are ordered (according to the enum LogLevel).
 static const char *const LEVEL_STRINGS[] = {
     "CRIT",
@@ -81,7 +102,7 @@ void logger(const enum LogLevel level, const char *const format, ...) {
     if (LOG_TIMESTAMPS) {
         char timestamp[TIMESTAMP_SIZE] = {0};
         // Get the current time (if possible)
-        (void)generate_timestamp(timestamp, TIMESTAMP_SIZE);
+        cached_timestamp(timestamp, TIMESTAMP_SIZE);
         fprintf(output_stream, "[%s|%s] ",
             LEVEL_STRINGS[level], timestamp);
     }
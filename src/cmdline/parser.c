@@ -5,6 +5,10 @@
 
 
 #include "parser.h"
+#include "../rfc2544.h"
+#include "../echo.h"
+#include "../twamp.h"
+#include "../connect.h"
 
 
 
@@ -155,6 +159,33 @@ static long validate_range(
     return result;
 }
 
+// Same as validate_range() over [0, 2^32 - 1], which a long (being
+// only 32 bits wide on many of our targets) cannot always hold.
+static unsigned long long validate_uint32(
+    const char *const value_str,
+    const char *const error_name,
+    bool *const error_occured
+) {
+    errno = 0;
+
+    char *endptr;
+    const unsigned long long result = strtoull(value_str, &endptr, 10);
+
+    if (errno != 0 || *endptr != '\0' || value_str[0] == '-'
+        || result > UINT32_MAX
+    ) {
+        logger(LOG_ERROR,
+            "Value of \"--%s\" must be [0, %lu].",
+            error_name, (unsigned long)UINT32_MAX
+        );
+
+        *error_occured = true;
+        return 0;
+    }
+
+    return result;
+}
+
 static long parse_text_or_int(
     const struct NameKey *const name_keys,
     const size_t num_keys,
@@ -186,8 +217,12 @@ static long parse_text_or_int(
 static const struct NameKey IP_PROTOCOLS[] = {
     {"ip", IP_PROTO_IP},
     {"icmp", IP_PROTO_ICMP},
+    {"ipip", IP_PROTO_IPIP},
     {"tcp", IP_PROTO_TCP},
-    {"udp", IP_PROTO_UDP}
+    {"udp", IP_PROTO_UDP},
+    {"ipv6", IP_PROTO_IPV6},
+    {"gre", IP_PROTO_GRE},
+    {"icmpv6", IP_PROTO_ICMPV6}
 };
 
 static const struct NameKey IP_TOS_PREC_CODES[] = {
@@ -302,6 +337,775 @@ static const char HELP_DIAGNOSTICS[] =
 ;
 
 
+// Parses an "xxx.xxx.xxx.xxx/xx" source range into its (host-order)
+// first and last addresses.
+static bool parse_ip_cidr(
+    const char *const cidr_str,
+    struct ProgramArgs *const program_args
+) {
+    if (strlen(cidr_str) > MAX_IP_CIDR_LENGTH) {
+        logger(LOG_ERROR, "IP/CIDR notation is too long: %s", cidr_str);
+        return true;
+    }
+
+    char cidr_copy[MAX_IP_CIDR_LENGTH + 1]; // +1 for null terminator
+    strcpy(cidr_copy, cidr_str);
+
+    char *const slash = strchr(cidr_copy, '/');
+    *slash = '\0';
+
+    struct in_addr ip_addr;
+    if (inet_pton(AF_INET, cidr_copy, &ip_addr) != 1) {
+        logger(LOG_ERROR, "Invalid source IPv4 address: %s", cidr_copy);
+        return true;
+    }
+
+    bool error_occured = false;
+    const long prefix_len = validate_range(
+        slash + 1, 0, 32, "src-ip", &error_occured);
+    if (error_occured) {
+        return true;
+    }
+
+    // NOTE: Shifting a 32-bit integer by 32 is undefined behavior.
+    const uint32_t mask =
+        (prefix_len == 0) ? 0 : UINT32_MAX << (32 - prefix_len);
+    const uint32_t address = ntohl(ip_addr.s_addr);
+
+    program_args->ipv4_misc.is_cidr = true;
+    program_args->ipv4_misc.source_cidr.start.address = address & mask;
+    program_args->ipv4_misc.source_cidr.end.address = address | ~mask;
+    program_args->ipv4->saddr.address = address & mask;
+
+    return false;
+}
+
+// Parses a comma-separated list of RFC 2544 frame sizes.
+static bool parse_frame_sizes(
+    const char *const list_str,
+    struct ProgramArgs *const program_args
+) {
+    char *const list_copy = duplicate_string(list_str);
+    if (list_copy == NULL) {
+        return true;
+    }
+
+    bool error_occured = false;
+    unsigned int count = 0;
+
+    for (char *size_str = strtok(list_copy, ",");
+        size_str != NULL && !error_occured;
+        size_str = strtok(NULL, ",")
+    ) {
+        if (count == RFC2544_MAX_FRAME_SIZES) {
+            logger(LOG_ERROR,
+                "At most %d frame sizes may be given.",
+                RFC2544_MAX_FRAME_SIZES
+            );
+            error_occured = true;
+            break;
+        }
+        program_args->rfc2544.frame_sizes[count++] =
+            (unsigned int)validate_range(
+                size_str, RFC2544_MIN_FRAME, RFC2544_MAX_FRAME,
+                "frame-sizes", &error_occured);
+    }
+
+    program_args->rfc2544.num_sizes = count;
+    free(list_copy);
+    return error_occured;
+}
+
+static const struct NameKey IP6_EXT_HEADERS[] = {
+    {"hop", IP6_EXT_HOP_BY_HOP},
+    {"dest", IP6_EXT_DEST_OPTS},
+    {"frag", IP6_EXT_FRAGMENT}
+};
+
+// Parses a comma-separated list of IPv6 extension headers, which get
+// chained (in the given order) between the IPv6 and L4 headers.
+static bool parse_ext_headers(
+    const char *const list_str,
+    struct ProgramArgs *const program_args
+) {
+    char *const list_copy = duplicate_string(list_str);
+    if (list_copy == NULL) {
+        return true;
+    }
+
+    bool error_occured = false;
+    unsigned int count = 0;
+
+    for (char *kind_str = strtok(list_copy, ",");
+        kind_str != NULL && !error_occured;
+        kind_str = strtok(NULL, ",")
+    ) {
+        if (count == IP6_MAX_EXT_HEADERS) {
+            logger(LOG_ERROR,
+                "At most %d extension headers may be given.",
+                IP6_MAX_EXT_HEADERS
+            );
+            error_occured = true;
+            break;
+        }
+        program_args->ipv6_misc.ext_headers[count++] =
+            (ip6_ext_kind_t)get_key_from_name(
+                IP6_EXT_HEADERS, ARRAY_SIZE(IP6_EXT_HEADERS), kind_str,
+                true, "ext-headers", &error_occured);
+    }
+
+    program_args->ipv6_misc.num_ext_headers = count;
+    free(list_copy);
+    return error_occured;
+}
+
+// Parses either a number within [0, max] or "random" (per packet).
+static long parse_number_or_random(
+    const char *const value_str,
+    const long max,
+    bool *const is_random,
+    const char *const error_name,
+    bool *const error_occured
+) {
+    *is_random = strcmp(value_str, "random") == 0;
+    if (*is_random) {
+        return 0;
+    }
+    return validate_range(value_str, 0, max, error_name, error_occured);
+}
+
+static const struct NameKey IP_OPTION_NAMES[] = {
+    {"eol", IP_OPT_KIND_EOL},
+    {"nop", IP_OPT_KIND_NOP},
+    {"rr", IP_OPT_KIND_RR},
+    {"ts", IP_OPT_KIND_TS},
+    {"ra", IP_OPT_KIND_RA}
+};
+
+// Compiles an IPv4 options spec (e.g., "ra,rr=4") into the option
+// bytes; record route and timestamp optionally take the number of
+// (empty) slots to leave for routers, which otherwise fill the rest.
+static bool parse_ip_options(
+    const char *const spec_str,
+    struct ProgramArgs *const program_args
+) {
+    char *const spec_copy = duplicate_string(spec_str);
+    if (spec_copy == NULL) {
+        return true;
+    }
+
+    uint8_t *const options = program_args->ipv4_misc.options;
+    unsigned int length = 0;
+    bool error_occured = false;
+
+    for (char *option_str = strtok(spec_copy, ",");
+        option_str != NULL && !error_occured;
+        option_str = strtok(NULL, ",")
+    ) {
+        char *const equals = strchr(option_str, '=');
+        if (equals != NULL) {
+            *equals = '\0';
+        }
+
+        const ip_option_kind_t kind = (ip_option_kind_t)
+            get_key_from_name(IP_OPTION_NAMES,
+                ARRAY_SIZE(IP_OPTION_NAMES), option_str, true,
+                "options", &error_occured);
+        if (error_occured) {
+            break;
+        }
+
+        const bool has_slots =
+            kind == IP_OPT_KIND_RR || kind == IP_OPT_KIND_TS;
+        if (equals != NULL && !has_slots) {
+            logger(LOG_ERROR,
+                "IPv4 option \"%s\" takes no value.", option_str);
+            error_occured = true;
+            break;
+        }
+
+        unsigned int option_length = 1;
+        unsigned int slots = 1;
+        switch (kind) {
+            case IP_OPT_KIND_RR:
+            case IP_OPT_KIND_TS: {
+                const unsigned int base_length = (kind == IP_OPT_KIND_RR)
+                    ? IP_OPT_LEN_RR_BASE : IP_OPT_LEN_TS_BASE;
+                const unsigned int room = (length + base_length
+                    < IP_MAX_OPTIONS_LENGTH)
+                    ? (IP_MAX_OPTIONS_LENGTH - length - base_length) / 4
+                    : 0;
+                slots = (equals != NULL)
+                    ? (unsigned int)validate_range(equals + 1,
+                        1, IP_OPT_MAX_SLOTS, "options", &error_occured)
+                    : room;
+                option_length = base_length + 4 * slots;
+                break;
+            }
+            case IP_OPT_KIND_RA: {
+                option_length = IP_OPT_LEN_RA;
+                break;
+            }
+            default: { // EOL and NOP are a single byte.
+                break;
+            }
+        }
+        if (error_occured) {
+            break;
+        }
+
+        if (slots == 0 || length + option_length
+            > IP_MAX_OPTIONS_LENGTH
+        ) {
+            logger(LOG_ERROR,
+                "IPv4 options may take up at most %d bytes.",
+                IP_MAX_OPTIONS_LENGTH
+            );
+            error_occured = true;
+            break;
+        }
+
+        // The slots (and the router alert value) start out as zeros.
+        uint8_t *const option = options + length;
+        memset(option, 0, option_length);
+        option[0] = kind;
+        if (option_length > 1) {
+            option[1] = (uint8_t)option_length;
+        }
+        if (kind == IP_OPT_KIND_RR) {
+            option[2] = IP_OPT_RR_POINTER;
+        }
+        else if (kind == IP_OPT_KIND_TS) {
+            option[2] = IP_OPT_TS_POINTER;
+            option[3] = IP_OPT_TS_FLAG_TSONLY;
+        }
+        length += option_length;
+    }
+
+    // The IHL counts 32-bit words; the rest is padded with zeros (i.e.,
+    // EOL) as per RFC 791.
+    const unsigned int padded_length = (length + 3) & ~3u;
+    memset(options + length, IP_OPT_KIND_EOL, padded_length - length);
+
+    program_args->ipv4_misc.options_length = padded_length;
+    free(spec_copy);
+    return error_occured;
+}
+
+static const struct NameKey TCP_OPTION_NAMES[] = {
+    {"eol", TCP_OPT_KIND_EOL},
+    {"nop", TCP_OPT_KIND_NOP},
+    {"mss", TCP_OPT_KIND_MSS},
+    {"ws", TCP_OPT_KIND_WS},
+    {"sackok", TCP_OPT_KIND_SACK_PERM},
+    {"ts", TCP_OPT_KIND_TIMESTAMP}
+};
+
+// Compiles a TCP options spec (e.g., "mss=1460,ws=7,sackok,ts") into
+// the option bytes themselves, once; only the timestamp value (TSval)
+// then gets patched into each packet, which is why it gets aligned
+// (with NOPs, like most stacks do) to a 32-bit boundary.
+static bool parse_tcp_options(
+    const char *const spec_str,
+    struct ProgramArgs *const program_args
+) {
+    char *const spec_copy = duplicate_string(spec_str);
+    if (spec_copy == NULL) {
+        return true;
+    }
+
+    uint8_t *const options = program_args->tcp_misc.options;
+    unsigned int length = 0;
+    unsigned int tsval_offset = 0;
+    uint32_t kinds_given = 0; // (All of the named kinds are below 32.)
+    bool error_occured = false;
+
+    for (char *option_str = strtok(spec_copy, ",");
+        option_str != NULL && !error_occured;
+        option_str = strtok(NULL, ",")
+    ) {
+        char *const equals = strchr(option_str, '=');
+        if (equals != NULL) {
+            *equals = '\0';
+        }
+
+        const tcp_option_kind_t kind = (tcp_option_kind_t)
+            get_key_from_name(TCP_OPTION_NAMES,
+                ARRAY_SIZE(TCP_OPTION_NAMES), option_str, true,
+                "options", &error_occured);
+        if (error_occured) {
+            break;
+        }
+
+        const bool takes_value =
+            kind == TCP_OPT_KIND_MSS || kind == TCP_OPT_KIND_WS;
+        if (takes_value != (equals != NULL)) {
+            logger(LOG_ERROR, takes_value
+                ? "TCP option \"%s\" needs a value (e.g., \"%s=<n>\")."
+                : "TCP option \"%s\" takes no value.",
+                option_str, option_str);
+            error_occured = true;
+            break;
+        }
+
+        // None of these means anything twice in a segment (padding
+        // aside); a second timestamp would leave the first TSval zero.
+        if (kind != TCP_OPT_KIND_EOL && kind != TCP_OPT_KIND_NOP) {
+            if ((kinds_given >> kind & 1) != 0) {
+                logger(LOG_ERROR,
+                    "TCP option \"%s\" given more than once.", option_str);
+                error_occured = true;
+                break;
+            }
+            kinds_given |= UINT32_C(1) << kind;
+        }
+
+        uint8_t bytes[TCP_OPT_LEN_TIMESTAMP] = {kind};
+        unsigned int option_length = 1;
+        unsigned int padding = 0;
+        switch (kind) {
+            case TCP_OPT_KIND_MSS: {
+                const uint16_t mss = htons((uint16_t)validate_range(
+                    equals + 1, 0, 65535, "options", &error_occured));
+                bytes[1] = option_length = TCP_OPT_LEN_MSS;
+                memcpy(&bytes[2], &mss, sizeof (mss));
+                break;
+            }
+            case TCP_OPT_KIND_WS: {
+                // RFC 7323 caps the shift count at 14.
+                bytes[1] = option_length = TCP_OPT_LEN_WS;
+                bytes[2] = (uint8_t)validate_range(
+                    equals + 1, 0, 14, "options", &error_occured);
+                break;
+            }
+            case TCP_OPT_KIND_SACK_PERM: {
+                bytes[1] = option_length = TCP_OPT_LEN_SACK_PERM;
+                break;
+            }
+            case TCP_OPT_KIND_TIMESTAMP: {
+                // TSval and TSecr stay zero until sending.
+                bytes[1] = option_length = TCP_OPT_LEN_TIMESTAMP;
+                padding = (6 - length % 4) % 4;
+                tsval_offset = length + padding + 2;
+                break;
+            }
+            default: { // EOL and NOP are a single byte.
+                break;
+            }
+        }
+
+        if (length + padding + option_length > TCP_MAX_OPTIONS_LENGTH) {
+            logger(LOG_ERROR,
+                "TCP options may take up at most %d bytes.",
+                TCP_MAX_OPTIONS_LENGTH
+            );
+            error_occured = true;
+            break;
+        }
+        memset(options + length, TCP_OPT_KIND_NOP, padding);
+        memcpy(options + length + padding, bytes, option_length);
+        length += padding + option_length;
+    }
+
+    // The data offset counts 32-bit words; the rest is padded with
+    // zeros (i.e., EOL) as per RFC 9293.
+    const unsigned int padded_length = (length + 3) & ~3u;
+    memset(options + length, TCP_OPT_KIND_EOL, padded_length - length);
+
+    program_args->tcp_misc.options_length = padded_length;
+    program_args->tcp_misc.tsval_offset = tsval_offset;
+    free(spec_copy);
+    return error_occured;
+}
+
+static const struct NameKey TRAFFIC_SHAPES[] = {
+    {"constant", SHAPE_CONSTANT},
+    {"burst", SHAPE_BURST},
+    {"poisson", SHAPE_POISSON}
+};
+
+// Indices into the nanosecond multipliers of parse_interval().
+static const struct NameKey TIME_UNITS[] = {
+    {"ns", 0},
+    {"us", 1},
+    {"ms", 2},
+    {"s", 3}
+};
+
+// Parses a "<n>[ns|us|ms|s]" interval (microseconds without a unit).
+static bool parse_interval(
+    const char *const interval_str,
+    uint64_t *const interval_ns
+) {
+    static const uint64_t MULTIPLIERS[] = {
+        1, NSEC_PER_USEC, NSEC_PER_MSEC, NSEC_PER_SEC
+    };
+
+    errno = 0;
+    char *unit_str;
+    const unsigned long long value =
+        strtoull(interval_str, &unit_str, 10);
+    if (errno != 0 || unit_str == interval_str || value == 0
+        || interval_str[0] == '-'
+    ) {
+        logger(LOG_ERROR,
+            "Invalid (or zero) interval: %s", interval_str);
+        return true;
+    }
+
+    bool error_occured = false;
+    const long unit = (*unit_str == '\0') ? 1 : get_key_from_name(
+        TIME_UNITS, ARRAY_SIZE(TIME_UNITS), unit_str, true,
+        "shape", &error_occured);
+    if (error_occured) {
+        return true;
+    }
+
+    if (value > UINT64_MAX / MULTIPLIERS[unit]) {
+        logger(LOG_ERROR, "Interval is too long: %s", interval_str);
+        return true;
+    }
+    *interval_ns = (uint64_t)value * MULTIPLIERS[unit];
+
+    return false;
+}
+
+// Parses "constant:<rate>", "burst:<n>@<interval>" or "poisson:<rate>".
+static bool parse_shape(
+    const char *const shape_str,
+    struct ProgramArgs *const program_args
+) {
+    char *const shape_copy = duplicate_string(shape_str);
+    if (shape_copy == NULL) {
+        return true;
+    }
+
+    bool error_occured = false;
+    char *const colon = strchr(shape_copy, ':');
+    if (colon == NULL) {
+        logger(LOG_ERROR,
+            "\"--shape\" needs parameters (e.g., \"poisson:1000\").");
+        free(shape_copy);
+        return true;
+    }
+    *colon = '\0';
+
+    const traffic_shape_t shape = (traffic_shape_t)get_key_from_name(
+        TRAFFIC_SHAPES, ARRAY_SIZE(TRAFFIC_SHAPES), shape_copy, true,
+        "shape", &error_occured);
+    uint64_t interval_ns = NSEC_PER_SEC;
+    char *const at = strchr(colon + 1, '@');
+
+    if (!error_occured && shape == SHAPE_BURST) {
+        if (at == NULL) {
+            logger(LOG_ERROR,
+                "Bursts are given as \"burst:<n>@<interval>\".");
+            error_occured = true;
+        }
+        else {
+            *at = '\0';
+            error_occured = parse_interval(at + 1, &interval_ns);
+        }
+    }
+    else if (!error_occured && at != NULL) {
+        logger(LOG_ERROR, "Only bursts take an interval.");
+        error_occured = true;
+    }
+
+    if (!error_occured) {
+        const uint64_t amount = (uint64_t)validate_range(
+            colon + 1, 1, LONG_MAX, "shape", &error_occured);
+
+        program_args->traffic.shape = shape;
+        program_args->traffic.rate = amount;
+        program_args->traffic.interval_ns = interval_ns;
+    }
+
+    free(shape_copy);
+    return error_occured;
+}
+
+static bool parse_mac(
+    const char *const mac_str,
+    eth_addr_t *const addr,
+    const char *const error_name
+) {
+    if (!eth_pton(mac_str, addr)) {
+        logger(LOG_ERROR,
+            "Value of \"--%s\" must be a MAC address "
+            "(e.g., 02:00:5e:10:00:01).", error_name
+        );
+        return true;
+    }
+    return false;
+}
+
+// Parses "<id>[:<pcp>]" into the TCI of another (inner) VLAN tag.
+static bool parse_vlan(
+    const char *const vlan_str,
+    struct ProgramArgs *const program_args
+) {
+    if (program_args->eth_misc.num_vlans == ETH_MAX_VLANS) {
+        logger(LOG_ERROR,
+            "At most %d VLAN tags (QinQ) may be given.", ETH_MAX_VLANS);
+        return true;
+    }
+
+    char *const vlan_copy = duplicate_string(vlan_str);
+    if (vlan_copy == NULL) {
+        return true;
+    }
+
+    bool error_occured = false;
+    char *const colon = strchr(vlan_copy, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+    }
+
+    const long id = validate_range(
+        vlan_copy, 0, ETH_VLAN_ID_MAX, "vlan", &error_occured);
+    const long pcp = (colon != NULL && !error_occured)
+        ? validate_range(
+            colon + 1, 0, ETH_VLAN_PCP_MAX, "vlan", &error_occured)
+        : 0;
+
+    if (!error_occured) {
+        const unsigned int tag = program_args->eth_misc.num_vlans++;
+        program_args->eth_misc.vlan_tci[tag] =
+            (uint16_t)(pcp << ETH_VLAN_PCP_SHIFT | id);
+    }
+    free(vlan_copy);
+    return error_occured;
+}
+
+static const struct NameKey TUNNEL_KINDS[] = {
+    {"ipip", TUNNEL_IPIP},
+    {"gre", TUNNEL_GRE},
+    {"vxlan", TUNNEL_VXLAN}
+};
+
+// Parses a (dotted-decimal) IPv4 address into host byte order.
+static bool parse_ipv4(
+    const char *const addr_str,
+    ip_addr_t *const addr,
+    const char *const error_name
+) {
+    uint32_t temp;
+    if (inet_pton(AF_INET, addr_str, &temp) != 1) {
+        logger(LOG_ERROR,
+            "Value of \"--%s\" must be an IPv4 address: %s",
+            error_name, addr_str
+        );
+        return true;
+    }
+    addr->address = ntohl(temp);
+    return false;
+}
+
+static const struct NameKey PAYLOAD_FORMATS[] = {
+    {"lines", PAYLOAD_FORMAT_LINES},
+    {"sep", PAYLOAD_FORMAT_SEPARATOR},
+    {"len16", PAYLOAD_FORMAT_LEN16}
+};
+
+// Parses "lines", "len16" or "sep:<0-255>" (the separating byte).
+static bool parse_payload_format(
+    const char *const format_str,
+    struct ProgramArgs *const program_args
+) {
+    char *const format_copy = duplicate_string(format_str);
+    if (format_copy == NULL) {
+        return true;
+    }
+
+    bool error_occured = false;
+    char *const colon = strchr(format_copy, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+    }
+
+    const payload_format_t format = (payload_format_t)get_key_from_name(
+        PAYLOAD_FORMATS, ARRAY_SIZE(PAYLOAD_FORMATS), format_copy, true,
+        "payload-format", &error_occured);
+
+    if (!error_occured && (format == PAYLOAD_FORMAT_SEPARATOR)
+        != (colon != NULL)
+    ) {
+        logger(LOG_ERROR,
+            "Only (and always) \"sep\" takes a byte (e.g., \"sep:0\").");
+        error_occured = true;
+    }
+    else if (!error_occured && colon != NULL) {
+        program_args->traffic.payload_separator = (uint8_t)validate_range(
+            colon + 1, 0, UINT8_MAX, "payload-format", &error_occured);
+    }
+    program_args->traffic.payload_format = format;
+
+    free(format_copy);
+    return error_occured;
+}
+
+static const struct NameKey VARY_FIELDS[] = {
+    {"tos", VARY_FIELD_TOS},
+    {"ident", VARY_FIELD_IDENT},
+    {"ttl", VARY_FIELD_TTL},
+    {"saddr", VARY_FIELD_SADDR},
+    {"daddr", VARY_FIELD_DADDR},
+    {"traffic-class", VARY_FIELD_TRAFFIC_CLASS},
+    {"flow-label", VARY_FIELD_FLOW_LABEL},
+    {"hop-limit", VARY_FIELD_HOP_LIMIT},
+    {"sport", VARY_FIELD_SPORT},
+    {"dport", VARY_FIELD_DPORT},
+    {"seq", VARY_FIELD_SEQ},
+    {"ack", VARY_FIELD_ACK},
+    {"window", VARY_FIELD_WINDOW},
+    {"urg-ptr", VARY_FIELD_URG_PTR}
+};
+
+static const struct NameKey VARY_GENERATORS[] = {
+    {"random", VARY_RANDOM},
+    {"inc", VARY_INC},
+    {"list", VARY_LIST},
+    {"range", VARY_RANGE}
+};
+
+// Parses a value of a field (at most `max`) for "--vary;" addresses
+// may also be given in dotted-decimal notation.
+static uint32_t parse_vary_value(
+    const char *const value_str,
+    const uint32_t max,
+    bool *const error_occured
+) {
+    struct in_addr address;
+    if (max == UINT32_MAX && strchr(value_str, '.') != NULL
+        && inet_pton(AF_INET, value_str, &address) == 1
+    ) {
+        return ntohl(address.s_addr);
+    }
+
+    const unsigned long long value =
+        validate_uint32(value_str, "vary", error_occured);
+    if (!*error_occured && value > max) {
+        logger(LOG_ERROR,
+            "Value of \"--vary\" must be [0, %lu] for that field.",
+            (unsigned long)max
+        );
+        *error_occured = true;
+    }
+    return (uint32_t)value;
+}
+
+// Parses "<field>=random", "<field>=inc[:<step>]", "<field>=list:a,b,c"
+// or "<field>=range:<lo>-<hi>"; the spec only gets compiled (against
+// the actual headers) once the template is crafted.
+static bool parse_vary(
+    const char *const vary_str,
+    struct ProgramArgs *const program_args
+) {
+    if (program_args->vary.num_specs == VARY_MAX_SPECS) {
+        logger(LOG_ERROR,
+            "\"--vary\" may be given at most %d times.", VARY_MAX_SPECS);
+        return true;
+    }
+
+    char *const vary_copy = duplicate_string(vary_str);
+    if (vary_copy == NULL) {
+        return true;
+    }
+
+    bool error_occured = false;
+    struct vary_spec spec = {.step = 1};
+
+    char *const equals = strchr(vary_copy, '=');
+    if (equals == NULL) {
+        logger(LOG_ERROR,
+            "\"--vary\" is given as <field>=<generator> (e.g., "
+            "\"ttl=range:32-64\").");
+        free(vary_copy);
+        return true;
+    }
+    *equals = '\0';
+    char *const params = strchr(equals + 1, ':');
+    if (params != NULL) {
+        *params = '\0';
+    }
+
+    spec.field = (vary_field_t)get_key_from_name(
+        VARY_FIELDS, ARRAY_SIZE(VARY_FIELDS), vary_copy, true,
+        "vary", &error_occured);
+    if (!error_occured) {
+        spec.generator = (vary_generator_t)get_key_from_name(
+            VARY_GENERATORS, ARRAY_SIZE(VARY_GENERATORS), equals + 1,
+            true, "vary", &error_occured);
+    }
+    if (error_occured) {
+        free(vary_copy);
+        return true;
+    }
+    const uint32_t max = vary_field_max(spec.field);
+
+    if (spec.generator == VARY_RANDOM) {
+        if (params != NULL) {
+            logger(LOG_ERROR, "\"random\" takes no parameters.");
+            error_occured = true;
+        }
+    }
+    else if (spec.generator == VARY_INC) {
+        if (params != NULL) {
+            spec.step = parse_vary_value(params + 1, max, &error_occured);
+        }
+    }
+    else if (params == NULL) {
+        logger(LOG_ERROR,
+            "\"list\" and \"range\" need parameters (e.g., "
+            "\"list:1,2,3\" or \"range:1-3\").");
+        error_occured = true;
+    }
+    else if (spec.generator == VARY_LIST) {
+        for (char *value_str = strtok(params + 1, ",");
+            value_str != NULL && !error_occured;
+            value_str = strtok(NULL, ",")
+        ) {
+            if (spec.list_length == VARY_MAX_LIST) {
+                logger(LOG_ERROR,
+                    "A list may hold at most %d values.", VARY_MAX_LIST);
+                error_occured = true;
+                break;
+            }
+            spec.list[spec.list_length++] =
+                parse_vary_value(value_str, max, &error_occured);
+        }
+        if (!error_occured && spec.list_length == 0) {
+            logger(LOG_ERROR, "A list needs at least one value.");
+            error_occured = true;
+        }
+    }
+    else {
+        char *const dash = strchr(params + 1, '-');
+        if (dash == NULL) {
+            logger(LOG_ERROR, "Ranges are given as \"range:<lo>-<hi>\".");
+            error_occured = true;
+        }
+        else {
+            *dash = '\0';
+            spec.lo = parse_vary_value(params + 1, max, &error_occured);
+            spec.hi = parse_vary_value(dash + 1, max, &error_occured);
+            if (!error_occured && spec.lo > spec.hi) {
+                logger(LOG_ERROR,
+                    "The start of a range may not exceed its end.");
+                error_occured = true;
+            }
+        }
+    }
+
+    if (!error_occured) {
+        program_args->vary.specs[program_args->vary.num_specs++] = spec;
+    }
+    free(vary_copy);
+    return error_occured;
+}
+
+
 enum OptionKind {
     OPTION_NONE = 0,
     // General
@@ -319,6 +1123,48 @@ enum OptionKind {
     OPTION_NO_ASYNC_SOCK,
     OPTION_NO_MEM_LOCK,
     OPTION_NO_CPU_PREFETCH,
+    // Traffic
+    OPTION_RATE,
+    OPTION_DURATION,
+    OPTION_SHAPE,
+    OPTION_TXTIME,
+    OPTION_TXTIME_LEAD,
+    OPTION_TX_TIMESTAMPS,
+    OPTION_RESPONSES,
+    OPTION_SCENARIO,
+    OPTION_PROFILE,
+    OPTION_PAYLOAD_FILE,
+    OPTION_PAYLOAD_FORMAT,
+    OPTION_VARY,
+    // Benchmarks
+    OPTION_RFC2544,
+    OPTION_FRAME_SIZES,
+    OPTION_TRIAL_TIME,
+    OPTION_RX_IF,
+    OPTION_RUN_ID,
+    OPTION_SINK,
+    OPTION_TWAMP,
+    OPTION_REFLECT,
+    OPTION_TWAMP_PORT,
+    OPTION_TWAMP_PADDING,
+    OPTION_CONNECT,
+    OPTION_CONCURRENCY,
+    OPTION_CONN_TIMEOUT,
+    OPTION_REQUEST,
+    // Ethernet II Header
+    OPTION_ETH,
+    OPTION_SRC_MAC,
+    OPTION_DEST_MAC,
+    OPTION_ETH_TYPE,
+    OPTION_VLAN,
+    // Tunnel
+    OPTION_ENCAP,
+    OPTION_TUNNEL_SRC,
+    OPTION_TUNNEL_DEST,
+    OPTION_GRE_KEY,
+    OPTION_VNI,
+    OPTION_INNER_SRC_MAC,
+    OPTION_INNER_DEST_MAC,
     // IPv4 Header
     OPTION_IPV4,
     OPTION_SRC_IP,
@@ -350,13 +1196,39 @@ enum OptionKind {
     OPTION_IP6_NEXT_HEADER,
     OPTION_IP6_HOP_LIMIT,
     OPTION_IP6_FLOW_LABEL,
+    OPTION_IP6_TRAFFIC_CLASS,
+    OPTION_IP6_EXT_HEADERS,
     // [[UNFINISHED]]
     // TCP Header
     OPTION_TCP,
+    OPTION_SRC_PORT,
+    OPTION_DEST_PORT,
+    OPTION_TCP_SEQ_NUM,
+    OPTION_TCP_ACK_NUM,
+    OPTION_TCP_DATA_OFS,
+    OPTION_TCP_RESERVED,
+    OPTION_TCP_CWR,
+    OPTION_TCP_ECE,
+    OPTION_TCP_URG,
+    OPTION_TCP_ACK,
+    OPTION_TCP_PSH,
+    OPTION_TCP_RST,
+    OPTION_TCP_SYN,
+    OPTION_TCP_FIN,
+    OPTION_TCP_WINDOW,
+    OPTION_TCP_URG_PTR,
     // UDP Header
     OPTION_UDP,
+    OPTION_DGRAM,
+    OPTION_NO_GSO,
+    OPTION_ZEROCOPY,
+    OPTION_DNS,
+    OPTION_DNS_TIMEOUT,
     // ICMP Header
     OPTION_ICMP,
+    OPTION_ECHO_ID,
+    OPTION_ECHO_SIZE,
+    OPTION_ECHO_TIMEOUT,
 };
 
 struct Option {
@@ -383,6 +1255,34 @@ static const struct Option OPTIONS[] = {
     {'\0', "no-async-sock", false, OPTION_NO_ASYNC_SOCK},
     {'\0', "no-mem-lock", false, OPTION_NO_MEM_LOCK},
     {'\0', "no-cpu-prefetch", false, OPTION_NO_CPU_PREFETCH},
+    // Traffic
+    {'\0', "rate", true, OPTION_RATE},
+    {'\0', "duration", true, OPTION_DURATION},
+    {'\0', "shape", true, OPTION_SHAPE},
+    {'\0', "txtime", false, OPTION_TXTIME},
+    {'\0', "txtime-lead", true, OPTION_TXTIME_LEAD},
+    {'\0', "tx-timestamps", true, OPTION_TX_TIMESTAMPS},
+    {'\0', "responses", false, OPTION_RESPONSES},
+    {'\0', "scenario", true, OPTION_SCENARIO},
+    {'\0', "profile", true, OPTION_PROFILE},
+    {'\0', "payload-file", true, OPTION_PAYLOAD_FILE},
+    {'\0', "payload-format", true, OPTION_PAYLOAD_FORMAT},
+    {'\0', "vary", true, OPTION_VARY},
+    // Benchmarks
+    {'\0', "rfc2544", false, OPTION_RFC2544},
+    {'\0', "frame-sizes", true, OPTION_FRAME_SIZES},
+    {'\0', "trial-time", true, OPTION_TRIAL_TIME},
+    {'\0', "rx-if", true, OPTION_RX_IF},
+    {'\0', "run-id", true, OPTION_RUN_ID},
+    {'\0', "sink", false, OPTION_SINK},
+    {'\0', "twamp", false, OPTION_TWAMP},
+    {'\0', "reflect", false, OPTION_REFLECT},
+    {'\0', "twamp-port", true, OPTION_TWAMP_PORT},
+    {'\0', "twamp-padding", true, OPTION_TWAMP_PADDING},
+    {'\0', "connect", false, OPTION_CONNECT},
+    {'\0', "concurrency", true, OPTION_CONCURRENCY},
+    {'\0', "conn-timeout", true, OPTION_CONN_TIMEOUT},
+    {'\0', "request", true, OPTION_REQUEST},
     // Multi-options (switches that may refer to multiple headers
     // and need extra processing to determine which one).
     {'\0', "src-ip", true, OPTION_SRC_IP},
@@ -390,6 +1290,22 @@ static const struct Option OPTIONS[] = {
     {'\0', "flags", true, OPTION_IP_FLAGS},
     {'\0', "chksum", true, OPTION_IP_CHECKSUM},
     {'\0', "options", true, OPTION_IP_OPTIONS},
+    {'\0', "src-port", true, OPTION_SRC_PORT},
+    {'\0', "dest-port", true, OPTION_DEST_PORT},
+    // Ethernet II Header
+    {'E', "eth", true, OPTION_ETH},
+    {'\0', "src-mac", true, OPTION_SRC_MAC},
+    {'\0', "dest-mac", true, OPTION_DEST_MAC},
+    {'\0', "ethertype", true, OPTION_ETH_TYPE},
+    {'\0', "vlan", true, OPTION_VLAN},
+    // Tunnel
+    {'\0', "encap", true, OPTION_ENCAP},
+    {'\0', "tunnel-src", true, OPTION_TUNNEL_SRC},
+    {'\0', "tunnel-dest", true, OPTION_TUNNEL_DEST},
+    {'\0', "gre-key", true, OPTION_GRE_KEY},
+    {'\0', "vni", true, OPTION_VNI},
+    {'\0', "inner-src-mac", true, OPTION_INNER_SRC_MAC},
+    {'\0', "inner-dest-mac", true, OPTION_INNER_DEST_MAC},
     // IPv4 Header
     {'4', "ipv4", false, OPTION_IPV4},
     /* src-ip */
@@ -423,32 +1339,42 @@ static const struct Option OPTIONS[] = {
     {'\0', "next-header", true, OPTION_IP6_NEXT_HEADER},
     {'\0', "hop-limit", true, OPTION_IP6_HOP_LIMIT},
     {'\0', "flow-label", true, OPTION_IP6_FLOW_LABEL},
+    {'\0', "traffic-class", true, OPTION_IP6_TRAFFIC_CLASS},
+    {'\0', "ext-headers", true, OPTION_IP6_EXT_HEADERS},
     // unfinished
     // TCP Header
     {'T', "tcp", false, OPTION_TCP},
     /* src-port */
     /* dest-port */
-    {'\0', "seq-num", true, OPTION_NONE},
-    {'\0', "ack-num", true, OPTION_NONE},
-    {'\0', "data-ofs", true, OPTION_NONE},
-    {'\0', "reserved", true, OPTION_NONE},
+    {'\0', "seq-num", true, OPTION_TCP_SEQ_NUM},
+    {'\0', "ack-num", true, OPTION_TCP_ACK_NUM},
+    {'\0', "data-ofs", true, OPTION_TCP_DATA_OFS},
+    {'\0', "reserved", true, OPTION_TCP_RESERVED},
     /* flags */
-    {'\0', "cwr", false, OPTION_NONE},
-    {'\0', "ece", false, OPTION_NONE},
-    {'\0', "urg", false, OPTION_NONE},
-    {'\0', "ack", false, OPTION_NONE},
-    {'\0', "psh", false, OPTION_NONE},
-    {'\0', "rst", false, OPTION_NONE},
-    {'\0', "syn", false, OPTION_NONE},
-    {'\0', "fin", false, OPTION_NONE},
-    {'\0', "window", true, OPTION_NONE},
+    {'\0', "cwr", false, OPTION_TCP_CWR},
+    {'\0', "ece", false, OPTION_TCP_ECE},
+    {'\0', "urg", false, OPTION_TCP_URG},
+    {'\0', "ack", false, OPTION_TCP_ACK},
+    {'\0', "psh", false, OPTION_TCP_PSH},
+    {'\0', "rst", false, OPTION_TCP_RST},
+    {'\0', "syn", false, OPTION_TCP_SYN},
+    {'\0', "fin", false, OPTION_TCP_FIN},
+    {'\0', "window", true, OPTION_TCP_WINDOW},
     /* chksum */
-    {'\0', "urg-ptr", true, OPTION_NONE},
+    {'\0', "urg-ptr", true, OPTION_TCP_URG_PTR},
     /* options */
     // UDP Header
     {'U', "udp", false, OPTION_UDP},
+    {'\0', "dgram", false, OPTION_DGRAM},
+    {'\0', "no-gso", false, OPTION_NO_GSO},
+    {'\0', "zerocopy", false, OPTION_ZEROCOPY},
+    {'\0', "dns", true, OPTION_DNS},
+    {'\0', "dns-timeout", true, OPTION_DNS_TIMEOUT},
     // ICMP Header
     {'I', "icmp", false, OPTION_ICMP},
+    {'\0', "echo-id", true, OPTION_ECHO_ID},
+    {'\0', "echo-size", true, OPTION_ECHO_SIZE},
+    {'\0', "echo-timeout", true, OPTION_ECHO_TIMEOUT},
 };
 
 
@@ -474,6 +1400,7 @@ static bool handle_option(
             program_args->general.opt_info = true;
 
             fprintf(stderr, "%s\n%s", ABOUT_TEXT, HELP_DIAGNOSTICS);
+            clock_print_diagnostics(stderr);
             break;
         }
         case OPTION_VERSION: {
@@ -532,6 +1459,206 @@ static bool handle_option(
             program_args->advanced.no_cpu_prefetch = true;
             break;
         }
+        // Traffic
+        case OPTION_RATE: {
+            program_args->traffic.rate =
+                (uint64_t)validate_range(
+                    value, 0, LONG_MAX, cmdline_option->name,
+                    &error_occured);
+            program_args->traffic.interval_ns = NSEC_PER_SEC;
+            program_args->traffic.shape = SHAPE_CONSTANT;
+            break;
+        }
+        case OPTION_DURATION: {
+            program_args->traffic.duration =
+                (unsigned int)validate_range(
+                    value, 0, INT_MAX, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_SHAPE: {
+            error_occured = parse_shape(value, program_args);
+            break;
+        }
+        case OPTION_TXTIME: {
+            program_args->traffic.txtime = true;
+            break;
+        }
+        case OPTION_TXTIME_LEAD: {
+            program_args->traffic.txtime_lead_ns = NSEC_PER_USEC
+                * (uint64_t)validate_range(
+                    value, 1, INT_MAX, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_TX_TIMESTAMPS: {
+            program_args->traffic.tx_stamp_every = (unsigned int)
+                validate_range(value, 1, INT_MAX, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_RESPONSES: {
+            program_args->traffic.responses = true;
+            break;
+        }
+        case OPTION_SCENARIO: {
+            program_args->traffic.scenario_file = value;
+            break;
+        }
+        case OPTION_PROFILE: {
+            program_args->traffic.profile_file = value;
+            break;
+        }
+        case OPTION_PAYLOAD_FILE: {
+            program_args->traffic.payload_file = value;
+            break;
+        }
+        case OPTION_PAYLOAD_FORMAT: {
+            error_occured = parse_payload_format(value, program_args);
+            break;
+        }
+        case OPTION_VARY: {
+            error_occured = parse_vary(value, program_args);
+            break;
+        }
+        // Benchmarks
+        case OPTION_RFC2544: {
+            program_args->rfc2544.enabled = true;
+            break;
+        }
+        case OPTION_FRAME_SIZES: {
+            error_occured = parse_frame_sizes(value, program_args);
+            break;
+        }
+        case OPTION_TRIAL_TIME: {
+            program_args->rfc2544.trial_time =
+                (unsigned int)validate_range(
+                    value, 1, INT_MAX, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_RX_IF: {
+            program_args->rfc2544.rx_interface = value;
+            break;
+        }
+        case OPTION_RUN_ID: {
+            program_args->run.tagged = true;
+            program_args->run.run_id = (uint32_t)validate_uint32(
+                value, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_SINK: {
+            program_args->run.sink = true;
+            break;
+        }
+        case OPTION_TWAMP: {
+            program_args->twamp.sender = true;
+            break;
+        }
+        case OPTION_REFLECT: {
+            program_args->twamp.reflector = true;
+            break;
+        }
+        case OPTION_TWAMP_PORT: {
+            program_args->twamp.port = (uint16_t)validate_range(
+                value, 1, 65535, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_TWAMP_PADDING: {
+            program_args->twamp.padding = (unsigned int)validate_range(
+                value, 0, TWAMP_MAX_PADDING, cmdline_option->name,
+                &error_occured);
+            break;
+        }
+        case OPTION_CONNECT: {
+            program_args->conn.enabled = true;
+            break;
+        }
+        case OPTION_CONCURRENCY: {
+            program_args->conn.concurrency = (unsigned int)validate_range(
+                value, 1, INT_MAX, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_CONN_TIMEOUT: {
+            error_occured = parse_interval(
+                value, &program_args->conn.timeout_ns);
+            break;
+        }
+        case OPTION_REQUEST: {
+            program_args->conn.request_file = value;
+            break;
+        }
+        // Ethernet II
+        case OPTION_ETH: {
+            program_args->parser.current_layer = LAYER_2;
+            program_args->parser.current_proto = PROTO_L2_ETH;
+
+            program_args->protocols.l2 = PROTO_L2_ETH;
+            program_args->eth_misc.interface = value;
+            break;
+        }
+        case OPTION_SRC_MAC: {
+            program_args->eth_misc.override_source = true;
+            error_occured = parse_mac(
+                value, &program_args->eth.saddr, cmdline_option->name);
+            break;
+        }
+        case OPTION_DEST_MAC: {
+            program_args->eth_misc.override_dest = true;
+            error_occured = parse_mac(
+                value, &program_args->eth.daddr, cmdline_option->name);
+            break;
+        }
+        case OPTION_ETH_TYPE: {
+            program_args->eth_misc.override_type = true;
+            program_args->eth.type = (uint16_t)validate_range(
+                value, 0, 65535, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_VLAN: {
+            error_occured = parse_vlan(value, program_args);
+            break;
+        }
+        // Tunnel
+        case OPTION_ENCAP: {
+            program_args->tunnel.kind = (tunnel_kind_t)get_key_from_name(
+                TUNNEL_KINDS, ARRAY_SIZE(TUNNEL_KINDS), value, true,
+                cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_TUNNEL_SRC: {
+            program_args->tunnel.override_source = true;
+            error_occured = parse_ipv4(value,
+                &program_args->tunnel.saddr, cmdline_option->name);
+            break;
+        }
+        case OPTION_TUNNEL_DEST: {
+            error_occured = parse_ipv4(value,
+                &program_args->tunnel.daddr, cmdline_option->name);
+            break;
+        }
+        case OPTION_GRE_KEY: {
+            program_args->tunnel.has_gre_key = true;
+            program_args->tunnel.gre_key = (uint32_t)validate_uint32(
+                value, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_VNI: {
+            program_args->tunnel.vni = (uint32_t)validate_range(
+                value, 0, VXLAN_VNI_MAX, cmdline_option->name,
+                &error_occured);
+            break;
+        }
+        case OPTION_INNER_SRC_MAC: {
+            error_occured = parse_mac(value,
+                &program_args->tunnel.inner_saddr, cmdline_option->name);
+            break;
+        }
+        case OPTION_INNER_DEST_MAC: {
+            error_occured = parse_mac(value,
+                &program_args->tunnel.inner_daddr, cmdline_option->name);
+            break;
+        }
         // IPv4
         case OPTION_IPV4: {
             program_args->parser.current_layer = LAYER_3;
@@ -539,25 +1666,62 @@ static bool handle_option(
             break;
         }
         case OPTION_SRC_IP: {
+            if (strchr(value, ':') != NULL) {
+                program_args->ipv6_misc.override_source = true;
+
+                if (strchr(value, '/') != NULL) {
+                    logger(LOG_ERROR,
+                        "Source ranges are only supported for IPv4.");
+                    error_occured = true;
+                }
+                else if (inet_pton(AF_INET6, value,
+                    program_args->ipv6.saddr.octets) != 1
+                ) {
+                    logger(LOG_ERROR,
+                        "Invalid source IPv6 address: %s", value);
+                    error_occured = true;
+                }
+                break;
+            }
+
             program_args->ipv4_misc.override_source = true;
 
+            if (strchr(value, '/') != NULL) {
+                error_occured = parse_ip_cidr(value, program_args);
+                break;
+            }
+
             uint32_t temp;
             if (inet_pton(AF_INET, value, &temp) != 1) {
                 logger(LOG_ERROR,
                     "Invalid source IPv4 address: %s", value);
                 error_occured = true;
             }
-            program_args->ipv4->saddr.address = htonl(temp);
+            program_args->ipv4->saddr.address = ntohl(temp);
             break;
         }
         case OPTION_DEST_IP: {
+            // An IPv6 destination implies "--ipv6."
+            if (strchr(value, ':') != NULL) {
+                program_args->protocols.l3 = PROTO_L3_IPV6;
+
+                if (inet_pton(AF_INET6, value,
+                    program_args->ipv6.daddr.octets) != 1
+                ) {
+                    logger(LOG_ERROR,
+                        "Invalid dest IPv6 address: %s", value);
+                    error_occured = true;
+                }
+                break;
+            }
+
             uint32_t temp;
             if (inet_pton(AF_INET, value, &temp) != 1) {
                 logger(LOG_ERROR,
                     "Invalid dest IPv4 address: %s", value);
                 error_occured = true;
             }
-            program_args->ipv4->daddr.address = htonl(temp);
+            program_args->ipv4->daddr.address = ntohl(temp);
             break;
         }
         case OPTION_IP_VER: {
@@ -566,6 +1730,8 @@ static bool handle_option(
             break;
         }
         case OPTION_IP_IHL: {
+            program_args->ipv4_misc.override_ihl = true;
+
             program_args->ipv4->ihl = (uint8_t)validate_range(
                     value, 0, 15, cmdline_option->name, &error_occured);
             break;
@@ -639,6 +1805,21 @@ static bool handle_option(
             break;
         }
         case OPTION_IP_LEN: {
+            if (program_args->parser.current_proto == PROTO_L3_IPV6) {
+                program_args->ipv6_misc.override_length = true;
+                program_args->ipv6.len = (uint16_t)validate_range(
+                    value, 0, 65535, cmdline_option->name,
+                    &error_occured);
+                break;
+            }
+            if (program_args->parser.current_proto == PROTO_L4_UDP) {
+                program_args->udp_misc.override_length = true;
+                program_args->udp.len = (uint16_t)validate_range(
+                    value, 0, 65535, cmdline_option->name,
+                    &error_occured);
+                break;
+            }
+
             program_args->ipv4_misc.override_length = true;
 
             program_args->ipv4->len =
@@ -655,6 +1836,15 @@ static bool handle_option(
             break;
         }
         case OPTION_IP_FLAGS: {
+            if (program_args->parser.current_proto == PROTO_L4_TCP) {
+                program_args->tcp_misc.override_flags = true;
+                program_args->tcp->flags.bitfield =
+                    (tcp_flag_t)validate_range(
+                        value, 0, 255, cmdline_option->name,
+                        &error_occured);
+                break;
+            }
+
             program_args->ipv4->flag_bits =
                 (ip_flag_t)validate_range(
                     value, 0, 7, cmdline_option->name,
@@ -687,6 +1877,8 @@ static bool handle_option(
             break;
         }
         case OPTION_IP_PROTO: {
+            program_args->ipv4_misc.override_proto = true;
+
             program_args->ipv4->proto = 
                 (ip_proto_t)parse_text_or_int(
                     IP_PROTOCOLS,
@@ -701,6 +1893,26 @@ static bool handle_option(
             break;
         }
         case OPTION_IP_CHECKSUM: {
+            if (program_args->parser.current_proto == PROTO_L3_IPV6) {
+                logger(LOG_ERROR, "IPv6 headers have no checksum.");
+                error_occured = true;
+                break;
+            }
+            if (program_args->parser.current_proto == PROTO_L4_TCP) {
+                program_args->tcp_misc.override_checksum = true;
+                program_args->tcp->chksum = (uint16_t)validate_range(
+                    value, 0, 65535, cmdline_option->name,
+                    &error_occured);
+                break;
+            }
+            if (program_args->parser.current_proto == PROTO_L4_UDP) {
+                program_args->udp_misc.override_checksum = true;
+                program_args->udp.chksum = (uint16_t)validate_range(
+                    value, 0, 65535, cmdline_option->name,
+                    &error_occured);
+                break;
+            }
+
             program_args->ipv4_misc.override_checksum = true;
 
             program_args->ipv4->chksum = (uint16_t)validate_range(
@@ -709,41 +1921,229 @@ static bool handle_option(
             break;
         }
         case OPTION_IP_OPTIONS: {
-            // TODO: options
+            if (program_args->parser.current_proto == PROTO_L4_TCP) {
+                error_occured = parse_tcp_options(value, program_args);
+                break;
+            }
+            if (program_args->parser.current_proto == PROTO_L4_UDP) {
+                logger(LOG_ERROR, "UDP headers have no options.");
+                error_occured = true;
+                break;
+            }
+            if (program_args->parser.current_proto == PROTO_L3_IPV6) {
+                logger(LOG_ERROR,
+                    "IPv6 headers have no options; use \"--ext-headers\" "
+                    "instead.");
+                error_occured = true;
+                break;
+            }
+            error_occured = parse_ip_options(value, program_args);
             break;
         }
         // IPv6
         case OPTION_IPV6: {
             program_args->parser.current_layer = LAYER_3;
             program_args->parser.current_proto = PROTO_L3_IPV6;
+
+            program_args->protocols.l3 = PROTO_L3_IPV6;
             break;
         }
         case OPTION_IP6_NEXT_HEADER: {
+            program_args->ipv6_misc.override_next_header = true;
+
+            program_args->ipv6.next_hdr =
+                (uint8_t)parse_text_or_int(
+                    IP_PROTOCOLS,
+                    ARRAY_SIZE(IP_PROTOCOLS),
+                    value,
+                    true,
+                    0,
+                    255,
+                    cmdline_option->name,
+                    &error_occured
+                );
             break;
         }
         case OPTION_IP6_HOP_LIMIT: {
+            program_args->ipv6.hop_limit = (uint8_t)validate_range(
+                    value, 0, 255, cmdline_option->name,
+                    &error_occured);
             break;
         }
         case OPTION_IP6_FLOW_LABEL: {
+            const uint32_t flow_label = (uint32_t)parse_number_or_random(
+                value, IP6_FLOW_LABEL_MAX,
+                &program_args->ipv6_misc.random_flow_label,
+                cmdline_option->name, &error_occured);
+            program_args->ipv6.ver_tc_flow =
+                (program_args->ipv6.ver_tc_flow & ~IP6_FLOW_LABEL_MASK)
+                | flow_label;
+            break;
+        }
+        case OPTION_IP6_TRAFFIC_CLASS: {
+            const uint32_t traffic_class = (uint32_t)parse_number_or_random(
+                value, 255,
+                &program_args->ipv6_misc.random_traffic_class,
+                cmdline_option->name, &error_occured);
+            program_args->ipv6.ver_tc_flow =
+                (program_args->ipv6.ver_tc_flow & ~IP6_TCLASS_MASK)
+                | (traffic_class << IP6_TCLASS_SHIFT);
+            break;
+        }
+        case OPTION_IP6_EXT_HEADERS: {
+            error_occured = parse_ext_headers(value, program_args);
             break;
         }
-        // unfinished
         // TCP Header
         case OPTION_TCP: {
             program_args->parser.current_layer = LAYER_4;
             program_args->parser.current_proto = PROTO_L4_TCP;
+
+            program_args->protocols.l4 = PROTO_L4_TCP;
+            if (!program_args->ipv4_misc.override_proto) {
+                program_args->ipv4->proto = IP_PROTO_TCP;
+            }
+            break;
+        }
+        case OPTION_SRC_PORT: {
+            if (program_args->parser.current_proto == PROTO_L4_UDP) {
+                program_args->udp_misc.override_sport = true;
+                program_args->udp.sport = (uint16_t)validate_range(
+                    value, PORT_MIN, PORT_MAX, cmdline_option->name,
+                    &error_occured);
+                break;
+            }
+
+            program_args->tcp_misc.override_sport = true;
+
+            program_args->tcp->sport = (uint16_t)validate_range(
+                    value, PORT_MIN, PORT_MAX, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_DEST_PORT: {
+            if (program_args->parser.current_proto == PROTO_L4_UDP) {
+                program_args->udp.dport = (uint16_t)validate_range(
+                    value, PORT_MIN, PORT_MAX, cmdline_option->name,
+                    &error_occured);
+                break;
+            }
+
+            program_args->tcp->dport = (uint16_t)validate_range(
+                    value, PORT_MIN, PORT_MAX, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_TCP_SEQ_NUM: {
+            program_args->tcp->seqnum = (uint32_t)validate_uint32(
+                    value, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_TCP_ACK_NUM: {
+            program_args->tcp->acknum = (uint32_t)validate_uint32(
+                    value, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_TCP_DATA_OFS: {
+            program_args->tcp_misc.override_data_ofs = true;
+
+            program_args->tcp->dataofs = (uint8_t)validate_range(
+                    value, 0, 15, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_TCP_RESERVED: {
+            program_args->tcp->reserved = (uint8_t)validate_range(
+                    value, 0, 15, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_TCP_CWR:
+        case OPTION_TCP_ECE:
+        case OPTION_TCP_URG:
+        case OPTION_TCP_ACK:
+        case OPTION_TCP_PSH:
+        case OPTION_TCP_RST:
+        case OPTION_TCP_SYN:
+        case OPTION_TCP_FIN: {
+            // Individual flags add up, replacing the default (SYN).
+            if (!program_args->tcp_misc.override_flags) {
+                program_args->tcp_misc.override_flags = true;
+                program_args->tcp->flags.bitfield = 0;
+            }
+            // NOTE: These options are listed in the (MSB-first) order
+            // of the bits that they stand for.
+            program_args->tcp->flags.bitfield |= (tcp_flag_t)
+                (1U << (OPTION_TCP_FIN - cmdline_option->kind));
+            break;
+        }
+        case OPTION_TCP_WINDOW: {
+            program_args->tcp->window = (uint16_t)validate_range(
+                    value, 0, 65535, cmdline_option->name,
+                    &error_occured);
+            break;
+        }
+        case OPTION_TCP_URG_PTR: {
+            program_args->tcp->urgptr = (uint16_t)validate_range(
+                    value, 0, 65535, cmdline_option->name,
+                    &error_occured);
             break;
         }
         // UDP Header
         case OPTION_UDP: {
             program_args->parser.current_layer = LAYER_4;
             program_args->parser.current_proto = PROTO_L4_UDP;
+
+            program_args->protocols.l4 = PROTO_L4_UDP;
+            if (!program_args->ipv4_misc.override_proto) {
+                program_args->ipv4->proto = IP_PROTO_UDP;
+            }
+            break;
+        }
+        case OPTION_DGRAM: {
+            program_args->dgram.enabled = true;
+            break;
+        }
+        case OPTION_NO_GSO: {
+            program_args->dgram.no_gso = true;
+            break;
+        }
+        case OPTION_ZEROCOPY: {
+            program_args->dgram.zerocopy = true;
+            break;
+        }
+        case OPTION_DNS: {
+            program_args->dns.query_file = value;
+            break;
+        }
+        case OPTION_DNS_TIMEOUT: {
+            error_occured = parse_interval(
+                value, &program_args->dns.timeout_ns);
             break;
         }
         // ICMP Header
         case OPTION_ICMP: {
             program_args->parser.current_layer = LAYER_4;
             program_args->parser.current_proto = PROTO_L4_ICMP;
+
+            program_args->protocols.l4 = PROTO_L4_ICMP;
+            break;
+        }
+        case OPTION_ECHO_ID: {
+            program_args->icmp.override_id = true;
+            program_args->icmp.id = (uint16_t)validate_range(
+                value, 0, 65535, cmdline_option->name, &error_occured);
+            break;
+        }
+        case OPTION_ECHO_SIZE: {
+            program_args->icmp.size = (unsigned int)validate_range(
+                value, 0, ECHO_MAX_SIZE, cmdline_option->name,
+                &error_occured);
+            break;
+        }
+        case OPTION_ECHO_TIMEOUT: {
+            error_occured = parse_interval(
+                value, &program_args->icmp.timeout_ns);
             break;
         }
         // Null Option (this shouldn't happen)
@@ -758,21 +2158,14 @@ static bool handle_option(
 }
 
 
-int parse_args(
+// Parses argv[first] to argv[argc-1] as options.
+static int parse_options(
+    const int first,
     const int argc,
     char *const argv[],
     struct ProgramArgs *const program_args
 ) {
-    program_args->diagnostics.executable_name = argv[0];
-
-    // If no arguments were given, print the help text and return.
-    if (argc == 1) {
-        fprintf(stderr, HELP_TEXT_ALL);
-        return 1;
-    }
-
-    // argv[0] is the program name itself.
-    for (int i = 1; i < argc; i++) {
+    for (int i = first; i < argc; i++) {
         const char *const arg = argv[i];
 
         if (arg[0] == '-' || arg[0] == '/') {
@@ -832,8 +2225,6 @@ int parse_args(
                     return 1;
                 }
             }
-
-            // Rest of your code...
         }
         else {
             // Unrecognized switch character
@@ -846,57 +2237,33 @@ int parse_args(
 }
 
 
-/*
-int parse_ip_cidr(
-    const char *cidr_str, struct ip_addr_range *ip_range
+int parse_args(
+    const int argc,
+    char *const argv[],
+    struct ProgramArgs *const program_args
 ) {
-    if (strlen(cidr_str) > MAX_IP_CIDR_LENGTH) {
-        fprintf(stderr, "IP/CIDR notation is too long: %s\n", cidr_str);
-        return 1;
-    }
-
-    char cidr_copy[MAX_IP_CIDR_LENGTH+1]; // +1 for null terminator
-    strncpy(cidr_copy, cidr_str, sizeof (cidr_copy));
-    cidr_copy[sizeof (cidr_copy) - 1] = '\0';
-
-    char *ip_str = strtok(cidr_copy, "/");
-    char *prefix_len_str = strtok(NULL, "/");
-
-    if (ip_str == NULL || prefix_len_str == NULL) {
-        fprintf(stderr, "Invalid IP/CIDR notation: %s\n", cidr_str);
-        return 1;
-    }
-
-    struct in_addr ip_addr;
-    if (inet_pton(AF_INET, ip_str, &ip_addr) != 1) {
-        fprintf(stderr, "Invalid IP address: %s\n", ip_str);
-        return 1;
-    }
+    program_args->diagnostics.executable_name = argv[0];
 
-    int prefix_len = atoi(prefix_len_str);
-    if (prefix_len < 0 || prefix_len > 32) {
-        fprintf(stderr, "Invalid prefix length: %s\n", prefix_len_str);
+    // If no arguments were given, print the help text and return.
+    if (argc == 1) {
+        fprintf(stderr, HELP_TEXT_ALL);
         return 1;
     }
 
-    uint32_t mask = htonl((uint32_t)~0 << (32 - prefix_len));
-    ip_range->start.address = ntohl(ip_addr.s_addr & mask);
-    ip_range->end.address = ntohl(ip_addr.s_addr | ~mask);
-
-    {
-        char start[INET_ADDRSTRLEN];
-        char end[INET_ADDRSTRLEN];
-
-        inet_ntop(AF_INET, &(ip_range->start), start, INET_ADDRSTRLEN);
-        inet_ntop(AF_INET, &(ip_range->end), end, INET_ADDRSTRLEN);
-
-        printf("Starting IP range: %s\n", start);
-        printf("Ending IP range: %s\n", end);
-    }
+    // argv[0] is the program name itself.
+    return parse_options(1, argc, argv, program_args);
+}
 
-    return 0;
+int parse_phase_args(
+    const int argc,
+    char *const argv[],
+    struct ProgramArgs *const program_args
+) {
+    return parse_options(0, argc, argv, program_args);
 }
 
+
+/*
 int parse_ip_port(
     const char *ip_port_str, ip_addr_t *ip, int *port
 ) {
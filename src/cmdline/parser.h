@@ -48,6 +48,13 @@ int parse_args(
     char *const argv[],
     struct ProgramArgs *const program_args
 );
+// Same as parse_args(), except that argv[0] is already an option and
+// an empty list is fine (e.g., for the phases of a scenario file).
+int parse_phase_args(
+    const int argc,
+    char *const argv[],
+    struct ProgramArgs *const program_args
+);
 
 // This indirection is necessary for eager evaluation of macros.
 // https://stackoverflow.com/a/5459929/12660750
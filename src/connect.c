@@ -0,0 +1,593 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// connect.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: IP_BIND_ADDRESS_NO_PORT (and SOCK_NONBLOCK) are only declared
+// under _GNU_SOURCE.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "connect.h"
+
+
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+typedef enum conn_state {
+    CONN_IDLE,
+    CONN_CONNECTING,
+    CONN_SENDING,    // The request, in as many pieces as it takes
+    CONN_AWAITING    // The first byte of the response
+} conn_state_t;
+
+typedef struct conn {
+    int socket;
+    conn_state_t state;
+    size_t sent;         // Bytes of the request sent so far
+    uint64_t started_ns; // Of the connect(), and then of the request
+} conn_t;
+
+// What every thread connects to (and with)
+typedef struct conn_target {
+    struct sockaddr_storage destination;
+    socklen_t destination_length;
+    bool bind_source;
+    struct sockaddr_storage source;
+    socklen_t source_length;
+    const uint8_t *request; // NULL: none
+    size_t request_length;
+} conn_target_t;
+
+typedef struct conn_worker {
+    const struct ProgramArgs *program_args;
+    const struct conn_target *target;
+    unsigned int id;
+    uint64_t rate;        // This thread's share of the connections
+    int epoll;
+    struct conn *conns;   // "--concurrency" of them
+    unsigned int *idle;   // Indices of the idle ones (a stack)
+    unsigned int num_idle;
+    bool reported_error;
+    struct conn_stats stats;
+} conn_worker_t;
+
+// Counts a failed connection by its reason.
+static void count_failure(
+    struct conn_worker *const worker, const int error
+) {
+    struct conn_stats *const stats = &worker->stats;
+
+    switch (error) {
+        case ECONNREFUSED: {
+            stats->refused++;
+            return;
+        }
+        case ETIMEDOUT: {
+            stats->timeouts++;
+            return;
+        }
+        case ECONNRESET:
+        case EPIPE: {
+            stats->closed++;
+            return;
+        }
+        case EHOSTUNREACH:
+        case ENETUNREACH: {
+            stats->unreachable++;
+            return;
+        }
+        // (EAGAIN: out of ephemeral ports, on older kernels.)
+        case EADDRNOTAVAIL:
+        case EAGAIN:
+        case EMFILE:
+        case ENFILE:
+        case ENOBUFS:
+        case ENOMEM: {
+            stats->exhausted++;
+            break;
+        }
+        default: {
+            stats->other++;
+            break;
+        }
+    }
+
+    // (Unlike the answers of the server, these are worth a word.)
+    if (!worker->reported_error) {
+        logger(LOG_ERROR,
+            "Thread %u failed to open a connection: %s",
+            worker->id, strerror(error));
+        worker->reported_error = true;
+    }
+}
+
+// Closes a connection (with an RST, rather than lingering in TIME_WAIT;
+// see open_conn()), which also takes it out of the epoll set.
+static void close_conn(
+    struct conn_worker *const worker, struct conn *const conn
+) {
+    (void)close(conn->socket);
+    conn->socket = -1;
+    conn->state = CONN_IDLE;
+    worker->idle[worker->num_idle++] =
+        (unsigned int)(conn - worker->conns);
+}
+
+static void fail_conn(
+    struct conn_worker *const worker,
+    struct conn *const conn,
+    const int error
+) {
+    count_failure(worker, error);
+    close_conn(worker, conn);
+}
+
+// Sends whatever of the request is left; once all of it went out, the
+// response is awaited.
+static void send_request(
+    struct conn_worker *const worker,
+    struct conn *const conn,
+    const uint64_t now_ns
+) {
+    const struct conn_target *const target = worker->target;
+
+    while (conn->sent < target->request_length) {
+        const ssize_t sent = send(conn->socket,
+            target->request + conn->sent,
+            target->request_length - conn->sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fail_conn(worker, conn, errno);
+            }
+            return;
+        }
+        conn->sent += (size_t)sent;
+    }
+
+    conn->state = CONN_AWAITING;
+    conn->started_ns = now_ns;
+}
+
+// Starts a connection on an idle slot.
+static void open_conn(
+    struct conn_worker *const worker, const uint64_t now_ns
+) {
+    const struct conn_target *const target = worker->target;
+    struct conn *const conn =
+        &worker->conns[worker->idle[--worker->num_idle]];
+
+    worker->stats.attempts++;
+    conn->state = CONN_IDLE;
+    conn->socket = socket(target->destination.ss_family,
+        SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (conn->socket == -1) {
+        count_failure(worker, errno);
+        worker->idle[worker->num_idle++] =
+            (unsigned int)(conn - worker->conns);
+        return;
+    }
+
+    // An abortive close spares both ends the TIME_WAIT state, which
+    // would otherwise tie up our ephemeral ports for a minute each.
+    const struct linger linger = {.l_onoff = 1, .l_linger = 0};
+    (void)setsockopt(conn->socket, SOL_SOCKET, SO_LINGER,
+        &linger, sizeof (linger));
+    if (target->request != NULL) {
+        const int enable = 1;
+        (void)setsockopt(conn->socket, IPPROTO_TCP, TCP_NODELAY,
+            &enable, sizeof (enable));
+    }
+    // (The port only gets picked by connect(), for the whole 4-tuple.)
+    if (target->bind_source) {
+        const int enable = 1;
+        (void)setsockopt(conn->socket, IPPROTO_IP,
+            IP_BIND_ADDRESS_NO_PORT, &enable, sizeof (enable));
+        if (bind(conn->socket, (const struct sockaddr *)&target->source,
+                target->source_length) != 0
+        ) {
+            fail_conn(worker, conn, errno);
+            return;
+        }
+    }
+
+    conn->state = CONN_CONNECTING;
+    conn->sent = 0;
+    conn->started_ns = now_ns;
+    if (connect(conn->socket,
+            (const struct sockaddr *)&target->destination,
+            target->destination_length) != 0
+        && errno != EINPROGRESS
+    ) {
+        fail_conn(worker, conn, errno);
+        return;
+    }
+
+    // Edge-triggered: the socket becomes writable once (when it is
+    // connected), and readable once the response starts coming in.
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLOUT | EPOLLET,
+        .data.u32 = (uint32_t)(conn - worker->conns)
+    };
+    if (epoll_ctl(worker->epoll, EPOLL_CTL_ADD, conn->socket, &event)
+        != 0
+    ) {
+        fail_conn(worker, conn, errno);
+    }
+}
+
+static void handle_event(
+    struct conn_worker *const worker,
+    const struct epoll_event *const event,
+    const uint64_t now_ns
+) {
+    struct conn *const conn = &worker->conns[event->data.u32];
+    struct conn_stats *const stats = &worker->stats;
+
+    if (conn->state == CONN_IDLE) {
+        return;
+    }
+    if (event->events & (EPOLLERR | EPOLLHUP)) {
+        int error = 0;
+        socklen_t length = sizeof (error);
+        (void)getsockopt(conn->socket, SOL_SOCKET, SO_ERROR,
+            &error, &length);
+        fail_conn(worker, conn, (error != 0) ? error : ECONNRESET);
+        return;
+    }
+
+    if (conn->state == CONN_CONNECTING && (event->events & EPOLLOUT)) {
+        stats->established++;
+        histogram_record(&stats->handshakes, now_ns - conn->started_ns);
+        if (worker->target->request == NULL) {
+            close_conn(worker, conn);
+            return;
+        }
+        conn->state = CONN_SENDING;
+        conn->started_ns = now_ns;
+    }
+    if (conn->state == CONN_SENDING && (event->events & EPOLLOUT)) {
+        send_request(worker, conn, now_ns);
+    }
+    else if (conn->state == CONN_AWAITING && (event->events & EPOLLIN)) {
+        // Only the first byte counts; the rest gets thrown away along
+        // with the connection.
+        uint8_t byte;
+        const ssize_t received =
+            recv(conn->socket, &byte, sizeof (byte), 0);
+        if (received > 0) {
+            stats->responses++;
+            histogram_record(&stats->first_bytes,
+                now_ns - conn->started_ns);
+            close_conn(worker, conn);
+        }
+        else if (received == 0) {
+            fail_conn(worker, conn, ECONNRESET);
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fail_conn(worker, conn, errno);
+        }
+    }
+}
+
+// Gives up on the connections that took too long (or, with `all`, on
+// every one that is still open).
+static void expire_conns(
+    struct conn_worker *const worker,
+    const uint64_t now_ns,
+    const bool all
+) {
+    const uint64_t timeout_ns = worker->program_args->conn.timeout_ns;
+    struct conn_stats *const stats = &worker->stats;
+
+    for (unsigned int i = 0; i < worker->program_args->conn.concurrency;
+        i++
+    ) {
+        struct conn *const conn = &worker->conns[i];
+        if (conn->state == CONN_IDLE
+            || (!all && now_ns - conn->started_ns < timeout_ns)
+        ) {
+            continue;
+        }
+        if (conn->state == CONN_CONNECTING) {
+            stats->timeouts++;
+        }
+        else {
+            stats->unanswered++;
+        }
+        close_conn(worker, conn);
+    }
+}
+
+// Thread callback
+static int worker_loop(void *arg) {
+    struct conn_worker *const worker = (struct conn_worker *)arg;
+    const struct ProgramArgs *const program_args = worker->program_args;
+    const unsigned int concurrency = program_args->conn.concurrency;
+    struct epoll_event events[CONNECT_MAX_EVENTS];
+
+    // With fewer connections per interval than threads, some threads
+    // are left without a share; they must not end up unpaced.
+    if (worker->rate == 0 && program_args->traffic.rate != 0) {
+        return thrd_success;
+    }
+
+    struct pacer pacer;
+    pacer_start(&pacer, program_args->traffic.shape, worker->rate,
+        program_args->traffic.interval_ns);
+    const uint64_t start_ns = pacer.start_ns;
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? start_ns + program_args->traffic.duration * NSEC_PER_SEC : 0;
+    // (The last connections get their timeout to finish.)
+    uint64_t drain_ns = 0;
+    uint64_t expired_ns = start_ns;
+
+    for (;;) {
+        uint64_t now_ns = clock_now_ns();
+        if (drain_ns == 0
+            && (sending_stopped()
+                || (deadline_ns != 0 && now_ns >= deadline_ns))
+        ) {
+            worker->stats.elapsed_ns = now_ns - start_ns;
+            drain_ns = now_ns + program_args->conn.timeout_ns;
+        }
+        if (drain_ns != 0
+            && (worker->num_idle == concurrency || now_ns >= drain_ns)
+        ) {
+            break;
+        }
+
+        // Start whatever is due (as far as the idle connections go),
+        // and wait for events until the next one is.
+        int timeout_ms = CONNECT_TICK_MS;
+        if (drain_ns == 0 && worker->num_idle > 0) {
+            uint64_t next_ns;
+            const unsigned int due =
+                pacer_poll(&pacer, worker->num_idle, &next_ns);
+            for (unsigned int i = 0; i < due; i++) {
+                open_conn(worker, now_ns);
+            }
+            pacer_consume(&pacer, due);
+
+            if (due > 0 && worker->num_idle > 0) {
+                timeout_ms = 0;
+            }
+            else if (due == 0 && next_ns > now_ns) {
+                const uint64_t wait_ms =
+                    (next_ns - now_ns) / NSEC_PER_MSEC;
+                if (wait_ms < CONNECT_TICK_MS) {
+                    timeout_ms = (int)wait_ms;
+                }
+            }
+        }
+
+        const int num_events = epoll_wait(worker->epoll, events,
+            CONNECT_MAX_EVENTS, timeout_ms);
+        now_ns = clock_now_ns();
+        for (int i = 0; i < num_events; i++) {
+            handle_event(worker, &events[i], now_ns);
+        }
+
+        if (now_ns - expired_ns >= CONNECT_TICK_MS * NSEC_PER_MSEC) {
+            expire_conns(worker, now_ns, false);
+            expired_ns = now_ns;
+        }
+    }
+
+    expire_conns(worker, clock_now_ns(), true);
+    return thrd_success;
+}
+
+static int worker_init(struct conn_worker *const worker) {
+    const unsigned int concurrency =
+        worker->program_args->conn.concurrency;
+
+    worker->epoll = epoll_create1(EPOLL_CLOEXEC);
+    worker->conns = calloc(concurrency, sizeof (*worker->conns));
+    worker->idle = calloc(concurrency, sizeof (*worker->idle));
+    if (worker->epoll == -1 || worker->conns == NULL
+        || worker->idle == NULL
+    ) {
+        logger(LOG_ERROR,
+            "Thread %u failed to set up its connections.", worker->id);
+        return 1;
+    }
+
+    // (Handed out from the top, so that the first ones go first.)
+    for (unsigned int i = 0; i < concurrency; i++) {
+        worker->conns[i] = (struct conn){.socket = -1};
+        worker->idle[i] = concurrency - 1 - i;
+    }
+    worker->num_idle = concurrency;
+    return 0;
+}
+
+static void worker_free(struct conn_worker *const worker) {
+    if (worker->epoll != -1) {
+        (void)close(worker->epoll);
+    }
+    free(worker->conns);
+    free(worker->idle);
+}
+
+// Reads the "--request" that gets sent on every connection.
+static int load_request(
+    const char *const path, uint8_t *const request, size_t *const length
+) {
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL) {
+        logger(LOG_ERROR,
+            "Failed to open request \"%s\": %s", path, strerror(errno));
+        return 1;
+    }
+
+    *length = fread(request, 1, CONNECT_MAX_REQUEST, file);
+    const bool too_long = fgetc(file) != EOF;
+    const bool failed = ferror(file) != 0;
+    (void)fclose(file);
+
+    if (failed || too_long || *length == 0) {
+        logger(LOG_ERROR,
+            "The request \"%s\" must be of 1 to %d bytes.",
+            path, CONNECT_MAX_REQUEST);
+        return 1;
+    }
+    return 0;
+}
+
+static void fill_target(
+    const struct ProgramArgs *const program_args,
+    struct conn_target *const target
+) {
+    if (program_args->protocols.l3 == PROTO_L3_IPV6) {
+        struct sockaddr_in6 *const destination =
+            (struct sockaddr_in6 *)&target->destination;
+        destination->sin6_family = AF_INET6;
+        destination->sin6_port = htons(program_args->tcp->dport);
+        memcpy(&destination->sin6_addr, program_args->ipv6.daddr.octets,
+            sizeof (destination->sin6_addr));
+        target->destination_length = sizeof (*destination);
+
+        struct sockaddr_in6 *const source =
+            (struct sockaddr_in6 *)&target->source;
+        source->sin6_family = AF_INET6;
+        memcpy(&source->sin6_addr, program_args->ipv6.saddr.octets,
+            sizeof (source->sin6_addr));
+        target->source_length = sizeof (*source);
+        target->bind_source = program_args->ipv6_misc.override_source;
+        return;
+    }
+
+    struct sockaddr_in *const destination =
+        (struct sockaddr_in *)&target->destination;
+    destination->sin_family = AF_INET;
+    destination->sin_port = htons(program_args->tcp->dport);
+    destination->sin_addr.s_addr =
+        htonl(program_args->ipv4->daddr.address);
+    target->destination_length = sizeof (*destination);
+
+    struct sockaddr_in *const source =
+        (struct sockaddr_in *)&target->source;
+    source->sin_family = AF_INET;
+    source->sin_addr.s_addr = htonl(program_args->ipv4->saddr.address);
+    target->source_length = sizeof (*source);
+    target->bind_source = program_args->ipv4_misc.override_source;
+}
+
+// Every connection in flight takes a descriptor; the soft limit (often
+// just 1024) gets raised as far as the hard one allows.
+static void raise_descriptor_limit(const rlim_t needed) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= needed) {
+        return;
+    }
+
+    limit.rlim_cur = (limit.rlim_max < needed) ? limit.rlim_max : needed;
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0
+        || limit.rlim_cur < needed
+    ) {
+        logger(LOG_WARN,
+            "Only %llu file descriptors are allowed, for %llu "
+            "connections in flight.",
+            (unsigned long long)limit.rlim_cur,
+            (unsigned long long)needed);
+    }
+}
+#endif
+
+int run_connect_load(const struct ProgramArgs *const program_args) {
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+    const unsigned int num_threads = program_args->advanced.num_threads;
+    const unsigned int num_workers = (num_threads > 0) ? num_threads : 1;
+    // NOTE: Static, because of the (sizable) histograms in the stats.
+    static struct conn_worker workers[MAX_THREADS];
+    static struct conn_target target;
+    static uint8_t request[CONNECT_MAX_REQUEST];
+    int status = 0;
+
+    if (num_threads > MAX_THREADS) {
+        logger(LOG_ERROR,
+            "At most %d threads are supported.", MAX_THREADS);
+        return 1;
+    }
+
+    target = (struct conn_target){0};
+    fill_target(program_args, &target);
+    if (program_args->conn.request_file != NULL) {
+        if (load_request(program_args->conn.request_file, request,
+                &target.request_length) != 0
+        ) {
+            return 1;
+        }
+        target.request = request;
+    }
+
+    raise_descriptor_limit((rlim_t)num_workers
+        * program_args->conn.concurrency + 64);
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        workers[i] = (struct conn_worker){
+            .program_args = program_args,
+            .target = &target,
+            .id = i,
+            .rate = rate_share(program_args->traffic.rate, i, num_workers),
+            .epoll = -1
+        };
+        if (worker_init(&workers[i]) != 0) {
+            for (unsigned int j = 0; j <= i; j++) {
+                worker_free(&workers[j]);
+            }
+            return 1;
+        }
+    }
+
+    logger(LOG_INFO,
+        "Opening connections (up to %u in flight per thread)%s...",
+        program_args->conn.concurrency,
+        (target.request != NULL) ? ", with requests" : "");
+
+    if (num_threads == 0) { // Run in main thread.
+        worker_loop(&workers[0]);
+    }
+    else {
+        thrd_t handles[MAX_THREADS];
+        unsigned int num_started = 0;
+
+        for (; num_started < num_threads; num_started++) {
+            if (thrd_create(&handles[num_started], worker_loop,
+                    &workers[num_started]) != thrd_success
+            ) {
+                logger(LOG_ERROR,
+                    "Failed to spawn thread %u.", num_started);
+                stop_sending();
+                status = 1;
+                break;
+            }
+        }
+        for (unsigned int i = 0; i < num_started; i++) {
+            thrd_join(handles[i], NULL);
+        }
+    }
+
+    static struct conn_stats totals;
+    totals = (struct conn_stats){0};
+    for (unsigned int i = 0; i < num_workers; i++) {
+        conn_stats_merge(&totals, &workers[i].stats);
+        worker_free(&workers[i]);
+    }
+    conn_stats_report("Connect", &totals);
+
+    return status;
+#else
+    (void)program_args;
+    logger(LOG_ERROR, "\"--connect\" requires Linux (epoll).");
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: connect.c
+// ---------------------------------------------------------------------
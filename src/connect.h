@@ -0,0 +1,65 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// connect.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef CONNECT_RUN_H
+#define CONNECT_RUN_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./utils/clock.h"
+#include "packet.h"
+#include "pacing.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <fcntl.h>
+#   include <netinet/in.h>
+#   include <netinet/tcp.h>
+#   include <sys/resource.h>
+#   include <sys/socket.h>
+#   if defined(__linux__)
+#       include <sys/epoll.h>
+#   endif
+#endif
+
+// Connections in flight per thread, unless "--concurrency" says
+// otherwise; and how long each may take, unless "--conn-timeout" does.
+#define CONNECT_DEFAULT_CONCURRENCY 256
+#define CONNECT_DEFAULT_TIMEOUT_NS NSEC_PER_SEC
+// Largest request ("--request") to send on every connection
+#define CONNECT_MAX_REQUEST (64 * 1024)
+// Events taken per epoll_wait(), and the longest that one may wait
+// (in milliseconds) before the connections get checked for timeouts.
+#define CONNECT_MAX_EVENTS 256
+#define CONNECT_TICK_MS 10
+
+
+// Opens TCP connections to the destination at "--rate" (or as fast as
+// "--concurrency" allows), spread over the threads, until the duration
+// elapses or stop_sending() gets called; on each, sends the request
+// (if any) and waits for the first byte of the response.  Then reports
+// the connections per second, the latencies, and why any failed.
+int run_connect_load(const struct ProgramArgs *const program_args);
+
+
+#endif // CONNECT_RUN_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: connect.h
+// ---------------------------------------------------------------------
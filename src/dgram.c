@@ -0,0 +1,695 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// dgram.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: Like sendmmsg() itself (see packet.c), IP_MTU and recvmmsg()
+// are only declared under _GNU_SOURCE.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "dgram.h"
+
+
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+typedef struct dgram_worker {
+    const struct ProgramArgs *program_args;
+    const struct dgram_target *target;
+    unsigned int id;
+    uint64_t rate;          // This thread's share of the datagrams
+    int socket;
+    unsigned int segments;  // (Unless GSO fails after all; see below.)
+    unsigned int batch_size; // Datagrams per syscall
+    struct iovec *iov;      // One per message
+    struct mmsghdr *msgs;
+    // With "--zerocopy": a buffer (of a message's payloads) for every
+    // send that the kernel may still be reading from.  The free ones
+    // are handed out from (and back to) a ring; those in flight are
+    // found by the IDs of their sends, which count up from zero, and
+    // which the completions come in (inclusive) ranges of.
+    bool zerocopy;
+    uint8_t *buffers;
+    size_t buffer_size;
+    unsigned int free_ring[DGRAM_ZEROCOPY_SLOTS];
+    unsigned int ring_head;
+    unsigned int num_free;
+    unsigned int in_flight[DGRAM_ZEROCOPY_SLOTS]; // By ID, modulo
+    uint32_t next_id;
+    uint64_t completed;     // Sends that the kernel is done with
+    uint64_t copied;        // Of those, that it had to copy after all
+    struct send_stats stats;
+} dgram_worker_t;
+
+static double cpu_seconds(const struct timeval *const time) {
+    return (double)time->tv_sec + (double)time->tv_usec / 1e6;
+}
+
+// Sets the size of the datagrams that the kernel cuts every message
+// into (0: none, i.e., one datagram per message).
+static int set_segment_size(const int socket_descriptor, const int size) {
+    return setsockopt(socket_descriptor, IPPROTO_UDP, UDP_SEGMENT,
+        &size, sizeof (size));
+}
+
+int dgram_open_socket(
+    const struct dgram_target *const target, const unsigned int id
+) {
+    const int socket_descriptor = socket(target->destination.ss_family,
+        SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (socket_descriptor == -1) {
+        logger(LOG_ERROR,
+            "Thread %u failed to create a UDP socket: %s",
+            id, strerror(errno));
+        return -1;
+    }
+
+    // (Every thread sends from the same "--src-port".)
+    if (target->bind_port) {
+        const int enable = 1;
+        (void)setsockopt(socket_descriptor, SOL_SOCKET, SO_REUSEPORT,
+            &enable, sizeof (enable));
+    }
+    if ((target->bind_source
+            && bind(socket_descriptor,
+                (const struct sockaddr *)&target->source,
+                target->source_length) != 0)
+        || connect(socket_descriptor,
+            (const struct sockaddr *)&target->destination,
+            target->destination_length) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Thread %u failed to set up its UDP socket: %s",
+            id, strerror(errno));
+        (void)close(socket_descriptor);
+        return -1;
+    }
+
+    // (As with the raw sockets; see socket.c.)
+    const int buffer_size = 16 * 1024 * 1024;
+    (void)setsockopt(socket_descriptor, SOL_SOCKET, SO_SNDBUF,
+        &buffer_size, sizeof (buffer_size));
+
+    return socket_descriptor;
+}
+
+// How many datagrams the kernel may segment out of one message (UDP
+// GSO, since Linux 4.18) for us: it must know the option, and each of
+// the datagrams must fit the MTU of the path as it is, since it never
+// gets fragmented.  Returns 1 (i.e., no GSO) otherwise.
+static unsigned int detect_segments(
+    const int socket_descriptor,
+    const struct dgram_target *const target,
+    const bool ipv6
+) {
+    if (target->payload_length == 0) {
+        logger(LOG_INFO,
+            "UDP GSO: not for empty datagrams (see \"--len\").");
+        return 1;
+    }
+    if (set_segment_size(
+            socket_descriptor, (int)target->payload_length) != 0
+    ) {
+        logger(LOG_INFO,
+            "UDP GSO: not supported by the kernel (%s).",
+            strerror(errno));
+        return 1;
+    }
+
+    int mtu = 0;
+    socklen_t length = sizeof (mtu);
+    if (getsockopt(socket_descriptor,
+            ipv6 ? IPPROTO_IPV6 : IPPROTO_IP,
+            ipv6 ? IPV6_MTU : IP_MTU, &mtu, &length) == 0
+        && target->packet_length > (size_t)mtu
+    ) {
+        logger(LOG_INFO,
+            "UDP GSO: not for datagrams of %zu bytes (MTU: %d).",
+            target->packet_length, mtu);
+        (void)set_segment_size(socket_descriptor, 0);
+        return 1;
+    }
+
+    const size_t fitting = DGRAM_GSO_MAX_BYTES / target->payload_length;
+    if (fitting < 2) {
+        (void)set_segment_size(socket_descriptor, 0);
+        return 1;
+    }
+    return (fitting < DGRAM_GSO_MAX_SEGMENTS)
+        ? (unsigned int)fitting : DGRAM_GSO_MAX_SEGMENTS;
+}
+
+static unsigned int take_buffer(struct dgram_worker *const worker) {
+    const unsigned int slot = worker->free_ring[worker->ring_head];
+    worker->ring_head = (worker->ring_head + 1) % DGRAM_ZEROCOPY_SLOTS;
+    worker->num_free--;
+    return slot;
+}
+
+static void free_buffer(
+    struct dgram_worker *const worker, const unsigned int slot
+) {
+    worker->free_ring[(worker->ring_head + worker->num_free)
+        % DGRAM_ZEROCOPY_SLOTS] = slot;
+    worker->num_free++;
+}
+
+// Frees the buffers of the sends from `first` to `last` (IDs, which may
+// wrap around in between).
+static void complete_sends(
+    struct dgram_worker *const worker,
+    const uint32_t first,
+    const uint32_t last,
+    const bool copied
+) {
+    for (uint32_t id = first;
+        worker->num_free < DGRAM_ZEROCOPY_SLOTS; id++
+    ) {
+        free_buffer(worker, worker->in_flight[id % DGRAM_ZEROCOPY_SLOTS]);
+        worker->completed++;
+        worker->copied += copied ? 1 : 0;
+        if (id == last) {
+            break;
+        }
+    }
+}
+
+// Takes whatever completions are queued (on the error queue of the
+// socket), a batch per syscall.
+static void drain_completions(struct dgram_worker *const worker) {
+    struct mmsghdr msgs[DGRAM_ZEROCOPY_BATCH];
+    // (Room for the error, and for where it came from; none does.)
+    union {
+        size_t align;
+        uint8_t bytes[CMSG_SPACE(sizeof (struct sock_extended_err) + 64)];
+    } controls[DGRAM_ZEROCOPY_BATCH];
+    int received;
+
+    do {
+        for (unsigned int i = 0; i < DGRAM_ZEROCOPY_BATCH; i++) {
+            msgs[i].msg_hdr = (struct msghdr){
+                .msg_control = controls[i].bytes,
+                .msg_controllen = sizeof (controls[i].bytes)
+            };
+        }
+        received = recvmmsg(worker->socket, msgs, DGRAM_ZEROCOPY_BATCH,
+            MSG_ERRQUEUE | MSG_DONTWAIT, NULL);
+
+        for (int i = 0; i < received; i++) {
+            struct msghdr *const msg = &msgs[i].msg_hdr;
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+                cmsg = CMSG_NXTHDR(msg, cmsg)
+            ) {
+                if (!(cmsg->cmsg_level == IPPROTO_IP
+                        && cmsg->cmsg_type == IP_RECVERR)
+                    && !(cmsg->cmsg_level == IPPROTO_IPV6
+                        && cmsg->cmsg_type == IPV6_RECVERR)
+                ) {
+                    continue;
+                }
+                struct sock_extended_err error;
+                memcpy(&error, CMSG_DATA(cmsg), sizeof (error));
+                if (error.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                    complete_sends(worker, error.ee_info, error.ee_data,
+                        (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+                }
+            }
+        }
+    } while (received == DGRAM_ZEROCOPY_BATCH);
+}
+
+// Waits until the kernel is done with at least one of the buffers
+// (or, with `all`, with every one of them).  Where the socket ignores
+// MSG_ZEROCOPY (e.g., UDP before Linux 5.0), no completions ever come;
+// then, after a while, the payloads get copied after all.
+static bool await_buffers(
+    struct dgram_worker *const worker, const bool all
+) {
+    const uint64_t since_ns = clock_now_ns();
+
+    for (;;) {
+        drain_completions(worker);
+        if (worker->num_free == DGRAM_ZEROCOPY_SLOTS
+            || (!all && worker->num_free > 0)
+        ) {
+            return true;
+        }
+        if (!all && sending_stopped()) {
+            return false;
+        }
+        if (clock_now_ns() - since_ns >= DGRAM_ZEROCOPY_TIMEOUT_NS) {
+            break;
+        }
+
+        // (A socket with a non-empty error queue always polls POLLERR.)
+        struct pollfd poll_info = {.fd = worker->socket, .events = 0};
+        (void)poll(&poll_info, 1, DGRAM_ZEROCOPY_TICK_MS);
+    }
+
+    if (!all) {
+        logger(LOG_WARN,
+            "Thread %u got no zerocopy completions; copying the "
+            "payloads instead.", worker->id);
+        worker->zerocopy = false;
+        for (unsigned int i = 0; i < worker->batch_size; i++) {
+            worker->iov[i].iov_base = (void *)worker->target->payloads;
+        }
+    }
+    return false;
+}
+
+// Thread callback
+static int worker_loop(void *arg) {
+    struct dgram_worker *const worker = (struct dgram_worker *)arg;
+    const struct ProgramArgs *const program_args = worker->program_args;
+    const struct dgram_target *const target = worker->target;
+    bool reported_error = false;
+
+    // With fewer datagrams per interval than threads, some threads are
+    // left without a share; they must not end up unpaced.
+    if (worker->rate == 0 && program_args->traffic.rate != 0) {
+        return thrd_success;
+    }
+
+    struct pacer pacer;
+    pacer_start(&pacer, program_args->traffic.shape, worker->rate,
+        program_args->traffic.interval_ns);
+    const uint64_t start_ns = pacer.start_ns;
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? start_ns + program_args->traffic.duration * NSEC_PER_SEC : 0;
+    uint64_t last_batch_ns = 0;
+
+    while (!sending_stopped()) {
+        const unsigned int count =
+            pacer_acquire(&pacer, worker->batch_size);
+        const uint64_t batch_ns = clock_now_ns();
+
+        if (deadline_ns != 0 && batch_ns >= deadline_ns) {
+            break;
+        }
+        if (last_batch_ns != 0) {
+            histogram_record(
+                &worker->stats.gaps, batch_ns - last_batch_ns);
+        }
+        last_batch_ns = batch_ns;
+
+        // Whole messages of `segments` datagrams each, and whatever is
+        // left in a last, shorter one; with zerocopy, only as many as
+        // there are free buffers for (taken back once half of them are
+        // in flight).
+        const unsigned int segments = worker->segments;
+        unsigned int num_msgs = (count + segments - 1) / segments;
+        unsigned int slots[DGRAM_ZEROCOPY_SLOTS];
+        if (worker->zerocopy
+            && worker->num_free < DGRAM_ZEROCOPY_SLOTS / 2
+            && !await_buffers(worker, false)
+        ) {
+            continue;
+        }
+        if (worker->zerocopy) {
+            if (num_msgs > worker->num_free) {
+                num_msgs = worker->num_free;
+            }
+            for (unsigned int i = 0; i < num_msgs; i++) {
+                slots[i] = take_buffer(worker);
+                worker->iov[i].iov_base =
+                    worker->buffers + slots[i] * worker->buffer_size;
+            }
+        }
+        const unsigned int wanted = (count < num_msgs * segments)
+            ? count : num_msgs * segments;
+        const unsigned int last = wanted - (num_msgs - 1) * segments;
+        for (unsigned int i = 0; i + 1 < num_msgs; i++) {
+            worker->iov[i].iov_len = segments * target->payload_length;
+        }
+        worker->iov[num_msgs - 1].iov_len = last * target->payload_length;
+
+        const int sent = sendmmsg(worker->socket, worker->msgs, num_msgs,
+            worker->zerocopy ? MSG_ZEROCOPY : 0);
+
+        if (worker->zerocopy) {
+            const unsigned int done = (sent > 0) ? (unsigned int)sent : 0;
+            for (unsigned int i = 0; i < done; i++) {
+                worker->in_flight[(worker->next_id + i)
+                    % DGRAM_ZEROCOPY_SLOTS] = slots[i];
+            }
+            worker->next_id += done;
+            for (unsigned int i = done; i < num_msgs; i++) {
+                free_buffer(worker, slots[i]);
+            }
+        }
+
+        if (sent > 0) {
+            const unsigned int datagrams = ((unsigned int)sent == num_msgs)
+                ? wanted : (unsigned int)sent * segments;
+            pacer_consume(&pacer, datagrams);
+            worker->stats.packets += datagrams;
+            worker->stats.bytes +=
+                (uint64_t)datagrams * target->packet_length;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK
+            || errno == ENOBUFS
+        ) {
+            // (Dropped for good; the pacer must not hand them out again.)
+            pacer_consume(&pacer, wanted);
+            worker->stats.dropped += wanted;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (segments > 1 && (errno == EIO || errno == EINVAL)) {
+            // The device (e.g., one without checksum offloading) may
+            // still refuse the segmentation; then, it is one datagram
+            // per message after all.
+            logger(LOG_WARN,
+                "Thread %u failed to send with UDP GSO (%s); "
+                "falling back to one datagram per message.",
+                worker->id, strerror(errno));
+            (void)set_segment_size(worker->socket, 0);
+            worker->segments = 1;
+        }
+        else {
+            // (E.g., ECONNREFUSED, after an ICMP "port unreachable".)
+            worker->stats.errors++;
+            if (!reported_error) {
+                logger(LOG_ERROR,
+                    "Thread %u failed to send datagrams: %s",
+                    worker->id, strerror(errno));
+                reported_error = true;
+            }
+        }
+    }
+
+    worker->stats.elapsed_ns = clock_now_ns() - start_ns;
+    // (Its buffers must outlive whatever the kernel still sends.)
+    if (worker->zerocopy) {
+        (void)await_buffers(worker, true);
+    }
+    return thrd_success;
+}
+
+static int worker_init(struct dgram_worker *const worker) {
+    const struct dgram_target *const target = worker->target;
+
+    if (worker->socket == -1) {
+        worker->socket = dgram_open_socket(target, worker->id);
+        if (worker->socket == -1) {
+            return 1;
+        }
+        if (worker->segments > 1
+            && set_segment_size(
+                worker->socket, (int)target->payload_length) != 0
+        ) {
+            worker->segments = 1;
+        }
+    }
+
+    // The kernel may only read (i.e., send) from the buffers later on;
+    // each is page-aligned, so that fewer pages need pinning.
+    if (worker->zerocopy) {
+        const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+        const size_t length = target->segments * target->payload_length;
+        worker->buffer_size =
+            (length + page_size - 1) & ~(page_size - 1);
+
+        const int enable = 1;
+        if (setsockopt(worker->socket, SOL_SOCKET, SO_ZEROCOPY,
+                &enable, sizeof (enable)) != 0
+        ) {
+            logger(LOG_WARN,
+                "Thread %u cannot use zerocopy (%s); copying the "
+                "payloads instead.", worker->id, strerror(errno));
+            worker->zerocopy = false;
+        }
+        else if (posix_memalign((void **)&worker->buffers, page_size,
+                DGRAM_ZEROCOPY_SLOTS * worker->buffer_size) != 0
+        ) {
+            worker->buffers = NULL;
+            logger(LOG_ERROR,
+                "Thread %u failed to allocate its buffers.", worker->id);
+            return 1;
+        }
+        else {
+            for (unsigned int i = 0; i < DGRAM_ZEROCOPY_SLOTS; i++) {
+                memcpy(worker->buffers + i * worker->buffer_size,
+                    target->payloads, length);
+                free_buffer(worker, i);
+            }
+        }
+    }
+
+    // (At most as many messages as datagrams; without zerocopy, all of
+    // them point to the same payloads, and only the lengths differ.)
+    worker->iov = calloc(worker->batch_size, sizeof (*worker->iov));
+    worker->msgs = calloc(worker->batch_size, sizeof (*worker->msgs));
+    if (worker->iov == NULL || worker->msgs == NULL) {
+        logger(LOG_ERROR,
+            "Thread %u failed to allocate its messages.", worker->id);
+        return 1;
+    }
+    for (unsigned int i = 0; i < worker->batch_size; i++) {
+        worker->iov[i].iov_base = (void *)target->payloads;
+        worker->msgs[i].msg_hdr = (struct msghdr){
+            .msg_iov = &worker->iov[i],
+            .msg_iovlen = 1
+        };
+    }
+    return 0;
+}
+
+static void worker_free(struct dgram_worker *const worker) {
+    if (worker->socket != -1) {
+        (void)close(worker->socket);
+    }
+    free(worker->iov);
+    free(worker->msgs);
+    free(worker->buffers);
+}
+
+void dgram_fill_target(
+    const struct ProgramArgs *const program_args,
+    struct dgram_target *const target
+) {
+    target->bind_port = program_args->udp_misc.override_sport
+        && program_args->udp.sport != 0;
+
+    if (program_args->protocols.l3 == PROTO_L3_IPV6) {
+        struct sockaddr_in6 *const destination =
+            (struct sockaddr_in6 *)&target->destination;
+        destination->sin6_family = AF_INET6;
+        destination->sin6_port = htons(program_args->udp.dport);
+        memcpy(&destination->sin6_addr, program_args->ipv6.daddr.octets,
+            sizeof (destination->sin6_addr));
+        target->destination_length = sizeof (*destination);
+
+        struct sockaddr_in6 *const source =
+            (struct sockaddr_in6 *)&target->source;
+        source->sin6_family = AF_INET6;
+        source->sin6_port = htons(program_args->udp.sport);
+        memcpy(&source->sin6_addr, program_args->ipv6.saddr.octets,
+            sizeof (source->sin6_addr));
+        target->source_length = sizeof (*source);
+        target->bind_source = program_args->ipv6_misc.override_source
+            || target->bind_port;
+        target->packet_length = target->payload_length
+            + sizeof (struct ip6_hdr) + sizeof (struct udp_hdr);
+        return;
+    }
+
+    struct sockaddr_in *const destination =
+        (struct sockaddr_in *)&target->destination;
+    destination->sin_family = AF_INET;
+    destination->sin_port = htons(program_args->udp.dport);
+    destination->sin_addr.s_addr =
+        htonl(program_args->ipv4->daddr.address);
+    target->destination_length = sizeof (*destination);
+
+    struct sockaddr_in *const source =
+        (struct sockaddr_in *)&target->source;
+    source->sin_family = AF_INET;
+    source->sin_port = htons(program_args->udp.sport);
+    source->sin_addr.s_addr = htonl(program_args->ipv4->saddr.address);
+    target->source_length = sizeof (*source);
+    target->bind_source = program_args->ipv4_misc.override_source
+        || target->bind_port;
+    target->packet_length = target->payload_length
+        + sizeof (struct ip_hdr) + sizeof (struct udp_hdr);
+}
+#endif
+
+int run_dgram_flood(const struct ProgramArgs *const program_args) {
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+    const unsigned int num_threads = program_args->advanced.num_threads;
+    const unsigned int num_workers = (num_threads > 0) ? num_threads : 1;
+    const bool ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6;
+    // NOTE: Static, because of the (sizable) histograms in the stats.
+    static struct dgram_worker workers[MAX_THREADS];
+    static struct dgram_target target;
+    static struct packet_template template;
+    static uint8_t payloads[DGRAM_GSO_MAX_BYTES];
+    int status = 0;
+
+    if (num_threads > MAX_THREADS) {
+        logger(LOG_ERROR,
+            "At most %d threads are supported.", MAX_THREADS);
+        return 1;
+    }
+
+    // The crafted packet only lends its payload (and thereby its size);
+    // the kernel writes the headers.
+    if (craft_template(program_args, &template) != 0) {
+        return 1;
+    }
+    target = (struct dgram_target){0};
+    target.payload_length = template.length - template.header_length;
+    target.payloads = payloads;
+    dgram_fill_target(program_args, &target);
+
+    // Whether GSO works gets decided on the first socket.
+    const int first_socket = dgram_open_socket(&target, 0);
+    if (first_socket == -1) {
+        return 1;
+    }
+    target.segments = program_args->dgram.no_gso
+        ? 1 : detect_segments(first_socket, &target, ipv6);
+    for (unsigned int i = 0; i < target.segments; i++) {
+        memcpy(payloads + i * target.payload_length,
+            template.buffer + template.header_length,
+            target.payload_length);
+    }
+
+    // (An empty datagram has nothing to send from.)
+    const bool zerocopy =
+        program_args->dgram.zerocopy && target.payload_length > 0;
+    if (program_args->dgram.zerocopy && !zerocopy) {
+        logger(LOG_INFO, "Zerocopy: not for empty datagrams.");
+    }
+
+    const unsigned int buffer_size = program_args->advanced.buffer_size;
+    for (unsigned int i = 0; i < num_workers; i++) {
+        workers[i] = (struct dgram_worker){
+            .program_args = program_args,
+            .target = &target,
+            .id = i,
+            .rate = rate_share(program_args->traffic.rate, i, num_workers),
+            .socket = (i == 0) ? first_socket : -1,
+            .segments = target.segments,
+            .zerocopy = zerocopy,
+            .batch_size = (buffer_size > 0) ? buffer_size : 1
+        };
+        if (worker_init(&workers[i]) != 0) {
+            for (unsigned int j = 0; j <= i; j++) {
+                worker_free(&workers[j]);
+            }
+            return 1;
+        }
+    }
+
+    if (target.segments > 1) {
+        logger(LOG_INFO,
+            "Sending datagrams of %zu bytes, with UDP GSO (up to %u "
+            "per message)%s...",
+            target.packet_length, target.segments,
+            workers[0].zerocopy ? " and zerocopy" : "");
+    }
+    else {
+        logger(LOG_INFO,
+            "Sending datagrams of %zu bytes, one per message%s...",
+            target.packet_length,
+            workers[0].zerocopy ? " (with zerocopy)" : "");
+    }
+
+    // (Of all threads, including those of the kernel's sending on
+    // their behalf, as far as they get accounted to the process.)
+    struct rusage usage_before, usage_after;
+    (void)getrusage(RUSAGE_SELF, &usage_before);
+
+    if (num_threads == 0) { // Run in main thread.
+        worker_loop(&workers[0]);
+    }
+    else {
+        thrd_t handles[MAX_THREADS];
+        unsigned int num_started = 0;
+
+        for (; num_started < num_threads; num_started++) {
+            if (thrd_create(&handles[num_started], worker_loop,
+                    &workers[num_started]) != thrd_success
+            ) {
+                logger(LOG_ERROR,
+                    "Failed to spawn thread %u.", num_started);
+                stop_sending();
+                status = 1;
+                break;
+            }
+        }
+        for (unsigned int i = 0; i < num_started; i++) {
+            thrd_join(handles[i], NULL);
+        }
+    }
+
+    (void)getrusage(RUSAGE_SELF, &usage_after);
+
+    static struct send_stats totals;
+    unsigned int gso_threads = 0;
+    unsigned int zerocopy_threads = 0;
+    uint64_t completed = 0;
+    uint64_t copied = 0;
+    totals = (struct send_stats){0};
+    for (unsigned int i = 0; i < num_workers; i++) {
+        stats_merge(&totals, &workers[i].stats);
+        gso_threads += (workers[i].segments > 1) ? 1 : 0;
+        zerocopy_threads += workers[i].zerocopy ? 1 : 0;
+        completed += workers[i].completed;
+        copied += workers[i].copied;
+        worker_free(&workers[i]);
+    }
+    stats_report("Total", &totals);
+
+    // The same rates in the units of the faster links, and what of them
+    // is payload (i.e., what the service gets to see).
+    const double pps = stats_pps(&totals);
+    logger(LOG_INFO,
+        "Datagrams: %.0f pkts/s, %.3f Gbit/s (%.3f Gbit/s of payload);\n"
+        "  through sendmmsg(), %s.",
+        pps, stats_mbps(&totals) / 1e3,
+        pps * (double)target.payload_length * 8.0 / 1e9,
+        (gso_threads == num_workers) ? "with UDP GSO"
+            : (gso_threads > 0) ? "partly with UDP GSO" : "without GSO");
+
+    // What the copying (or the lack thereof) costs: compare the CPU
+    // time per Gbit of runs with and without "--zerocopy".
+    const double user_s = cpu_seconds(&usage_after.ru_utime)
+        - cpu_seconds(&usage_before.ru_utime);
+    const double system_s = cpu_seconds(&usage_after.ru_stime)
+        - cpu_seconds(&usage_before.ru_stime);
+    const double gbits = (double)totals.bytes * 8.0 / 1e9;
+    logger(LOG_INFO,
+        "CPU: %.2f s user, %.2f s system; %.3f CPU-s per Gbit sent, "
+        "%s zerocopy.",
+        user_s, system_s, (gbits > 0) ? (user_s + system_s) / gbits : 0.0,
+        (zerocopy_threads == num_workers && zerocopy) ? "with"
+            : (zerocopy_threads > 0) ? "partly with" : "without");
+    if (completed > 0) {
+        // (E.g., for a local destination, whose socket must not be
+        // left with pages that we may still write to.)
+        logger(LOG_INFO,
+            "Zerocopy: %llu sends completed, of which the kernel "
+            "copied %llu after all.",
+            (unsigned long long)completed, (unsigned long long)copied);
+    }
+
+    return status;
+#else
+    (void)program_args;
+    logger(LOG_ERROR, "\"--dgram\" requires Linux (sendmmsg()).");
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: dgram.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,114 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// dgram.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef DGRAM_H
+#define DGRAM_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./utils/clock.h"
+#include "packet.h"
+#include "pacing.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#   include <sys/uio.h>
+#   include <sys/resource.h>
+#   include <poll.h>
+#   if defined(__linux__)
+#       include <linux/errqueue.h>
+#   endif
+#endif
+
+// (Older C libraries lack the option, even where the kernel has it.)
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+#   define UDP_SEGMENT 103
+#endif
+#if defined(__linux__) && !defined(SO_ZEROCOPY)
+#   define SO_ZEROCOPY 60
+#endif
+#if defined(__linux__) && !defined(MSG_ZEROCOPY)
+#   define MSG_ZEROCOPY 0x4000000
+#endif
+
+// Most datagrams the kernel segments out of one message (as of Linux
+// 4.18; later ones allow more), and most bytes of such a message,
+// which must still fit in an IP packet of its own (whatever its
+// headers).
+#define DGRAM_GSO_MAX_SEGMENTS 64
+#define DGRAM_GSO_MAX_BYTES 65000
+// With "--zerocopy": the most messages (i.e., buffers) per thread that
+// the kernel may still be sending from; the completions taken per
+// syscall; and how long to wait for them, a tick (in milliseconds) at
+// a time, before giving up on them.
+#define DGRAM_ZEROCOPY_SLOTS 256
+#define DGRAM_ZEROCOPY_BATCH 32
+#define DGRAM_ZEROCOPY_TICK_MS 10
+#define DGRAM_ZEROCOPY_TIMEOUT_NS NSEC_PER_SEC
+
+
+// Where (and from where) every thread sends, and what
+typedef struct dgram_target {
+    struct sockaddr_storage destination;
+    socklen_t destination_length;
+    bool bind_source;       // To "--src-ip" and/or "--src-port"
+    bool bind_port;
+    struct sockaddr_storage source;
+    socklen_t source_length;
+    // As many payloads as make up a message, back to back; they never
+    // change, so that all threads share them.
+    const uint8_t *payloads;
+    size_t payload_length;
+    size_t packet_length;   // Of each datagram (L3 and up), as sent
+    unsigned int segments;  // Datagrams per message (1: no GSO)
+} dgram_target_t;
+
+// Fills in the addresses of `target` (and the length of its packets,
+// going by its `payload_length`) from those of `program_args`.
+void dgram_fill_target(
+    const struct ProgramArgs *const program_args,
+    struct dgram_target *const target
+);
+
+// A UDP socket (of thread `id`) for `target`, connected to it (so that
+// the messages need no address, and the routing gets looked up only
+// once); returns -1 on failure.
+int dgram_open_socket(
+    const struct dgram_target *const target, const unsigned int id
+);
+
+// Sends the UDP payload of the crafted packets (i.e., as sized by
+// "--len") to the destination address and port, through an ordinary
+// (unprivileged) UDP socket per thread, at "--rate" (or as fast as the
+// kernel takes them), until the duration elapses or stop_sending()
+// gets called.  Where the kernel supports it (and unless "--no-gso"),
+// every message of a sendmmsg() gets segmented into many datagrams
+// (UDP GSO).  With "--zerocopy", the kernel sends straight from our
+// buffers (MSG_ZEROCOPY), which then only get reused once it says it
+// is done with them.  Then reports the totals, like those of
+// send_packets(), and the CPU time that they took.
+int run_dgram_flood(const struct ProgramArgs *const program_args);
+
+
+#endif // DGRAM_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: dgram.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,633 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// dns.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: Like sendmmsg() (see packet.c), recvmmsg() is only declared
+// under _GNU_SOURCE.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "dns.h"
+
+
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+#define DNS_FLAG_QR 0x80 // (Of the third byte of the header)
+#define DNS_FLAG_TC 0x02
+#define DNS_FLAG_RD 0x01
+#define DNS_RCODE_MASK 0x0F // (Of the fourth byte)
+#define DNS_CLASS_IN 1
+
+typedef struct dns_type {
+    const char *name;
+    uint16_t type;
+} dns_type_t;
+
+static const struct dns_type DNS_TYPES[] = {
+    {"A", 1},
+    {"NS", 2},
+    {"CNAME", 5},
+    {"SOA", 6},
+    {"PTR", 12},
+    {"MX", 15},
+    {"TXT", 16},
+    {"AAAA", 28},
+    {"SRV", 33},
+    {"NAPTR", 35},
+    {"DS", 43},
+    {"DNSKEY", 48},
+    {"SVCB", 64},
+    {"HTTPS", 65},
+    {"ANY", 255},
+    {"CAA", 257}
+};
+#define DNS_NUM_TYPES (sizeof (DNS_TYPES) / sizeof (DNS_TYPES[0]))
+
+typedef struct dns_query {
+    uint32_t offset;         // In the arena
+    uint16_t length;
+} dns_query_t;
+
+// What all threads share: the queries, encoded back to back in an
+// arena (with IDs of zero, which the senders never write to), and the
+// table of those that await their responses.
+typedef struct dns_load {
+    uint8_t *arena;
+    size_t arena_length;
+    size_t arena_size;
+    struct dns_query *queries;
+    unsigned int num_queries;
+    unsigned int max_queries;
+    struct probe_table table; // Keyed by dns_key()
+    // The sockets of the senders, and their (local) ports
+    struct pollfd polls[MAX_THREADS];
+    uint16_t ports[MAX_THREADS];
+    unsigned int num_sockets;
+    int done;
+    struct dns_stats stats;  // Of the receiving thread
+} dns_load_t;
+
+typedef struct dns_worker {
+    const struct ProgramArgs *program_args;
+    struct dns_load *load;
+    unsigned int id;
+    uint64_t rate;           // This thread's share of the queries
+    int socket;
+    uint16_t port;           // Local (host byte order)
+    unsigned int batch_size; // Queries per syscall
+    unsigned int next_query;
+    uint16_t next_id;
+    // Every message gathers its ID (in network byte order) and the
+    // rest of its query (from the arena).
+    uint16_t *ids;
+    struct iovec *iov;       // Two per message
+    struct mmsghdr *msgs;
+    struct dns_stats stats;
+} dns_worker_t;
+
+// Identifies a query by the port it was sent from and its ID (both in
+// host byte order); never PROBE_EMPTY.
+static uint64_t dns_key(const uint16_t port, const uint16_t id) {
+    return (((uint64_t)port << 16) | id) + 1;
+}
+
+// Encodes a domain name (dotted, as in "example.com" or "example.com.";
+// "." is the root) into its labels; returns their length, or 0 if the
+// name is not a valid one.
+static size_t encode_name(
+    const char *const name, uint8_t encoded[DNS_MAX_NAME_LENGTH]
+) {
+    size_t length = 0;
+
+    if (strcmp(name, ".") != 0) {
+        for (const char *label = name; *label != '\0';) {
+            const char *const dot = strchr(label, '.');
+            const size_t label_length = (dot != NULL)
+                ? (size_t)(dot - label) : strlen(label);
+            if (label_length == 0 || label_length > 63
+                || length + 1 + label_length + 1 > DNS_MAX_NAME_LENGTH
+            ) {
+                return 0;
+            }
+            encoded[length++] = (uint8_t)label_length;
+            memcpy(encoded + length, label, label_length);
+            length += label_length;
+            if (dot == NULL) {
+                break;
+            }
+            label = dot + 1;
+        }
+    }
+
+    encoded[length++] = 0;
+    return length;
+}
+
+// Returns the type of a query by its name (or "TYPE<number>"), or -1.
+static long parse_type(const char *const text) {
+    for (size_t i = 0; i < DNS_NUM_TYPES; i++) {
+        if (strcasecmp(text, DNS_TYPES[i].name) == 0) {
+            return DNS_TYPES[i].type;
+        }
+    }
+
+    if (strncasecmp(text, "TYPE", 4) == 0 && text[4] != '\0') {
+        char *end;
+        errno = 0;
+        const unsigned long type = strtoul(text + 4, &end, 10);
+        if (errno == 0 && *end == '\0' && type <= UINT16_MAX) {
+            return (long)type;
+        }
+    }
+    return -1;
+}
+
+// Appends a query to the arena (growing it as needed).
+static int add_query(
+    struct dns_load *const load,
+    const uint8_t *const query,
+    const size_t length
+) {
+    if (load->num_queries == load->max_queries) {
+        const unsigned int max_queries =
+            (load->max_queries > 0) ? 2 * load->max_queries : 1024;
+        struct dns_query *const queries = realloc(load->queries,
+            max_queries * sizeof (*queries));
+        if (queries == NULL) {
+            return 1;
+        }
+        load->queries = queries;
+        load->max_queries = max_queries;
+    }
+    if (load->arena_length + length > load->arena_size) {
+        const size_t arena_size = (load->arena_size > 0)
+            ? 2 * load->arena_size : 64 * 1024;
+        uint8_t *const arena = realloc(load->arena, arena_size);
+        if (arena == NULL) {
+            return 1;
+        }
+        load->arena = arena;
+        load->arena_size = arena_size;
+    }
+
+    memcpy(load->arena + load->arena_length, query, length);
+    load->queries[load->num_queries++] = (struct dns_query){
+        .offset = (uint32_t)load->arena_length,
+        .length = (uint16_t)length
+    };
+    load->arena_length += length;
+    return 0;
+}
+
+// Encodes the query of a line (if it has one; comments start with
+// '#'); returns 0 on success, -1 for a line without a query, and 1
+// on errors.
+static int load_line(
+    struct dns_load *const load,
+    char *const line,
+    const unsigned int line_number
+) {
+    const char *const name = strtok(line, " \t\r\n");
+    if (name == NULL || name[0] == '#') {
+        return -1;
+    }
+    const char *const type_text = strtok(NULL, " \t\r\n");
+    const long type = (type_text != NULL) ? parse_type(type_text) : 1;
+    if (type < 0) {
+        logger(LOG_ERROR,
+            "Line %u: unknown query type \"%s\".", line_number, type_text);
+        return 1;
+    }
+
+    // A standard query of one question, with recursion desired
+    uint8_t query[DNS_MAX_QUERY_LENGTH] = {
+        0, 0,           // ID (patched in by the senders)
+        DNS_FLAG_RD, 0,
+        0, 1,           // QDCOUNT
+        0, 0, 0, 0, 0, 0
+    };
+    const size_t name_length =
+        encode_name(name, query + DNS_HEADER_LENGTH);
+    if (name_length == 0) {
+        logger(LOG_ERROR,
+            "Line %u: invalid domain name \"%s\".", line_number, name);
+        return 1;
+    }
+    size_t length = DNS_HEADER_LENGTH + name_length;
+    query[length++] = (uint8_t)(type >> 8);
+    query[length++] = (uint8_t)type;
+    query[length++] = 0;
+    query[length++] = DNS_CLASS_IN;
+
+    if (add_query(load, query, length) != 0) {
+        logger(LOG_ERROR, "Failed to allocate the queries.");
+        return 1;
+    }
+    return 0;
+}
+
+static int load_queries(
+    const char *const path, struct dns_load *const load
+) {
+    FILE *const file = fopen(path, "r");
+    if (file == NULL) {
+        logger(LOG_ERROR,
+            "Failed to open queries \"%s\": %s", path, strerror(errno));
+        return 1;
+    }
+
+    int status = 0;
+    unsigned int line_number = 0;
+    char line[DNS_MAX_LINE];
+
+    while (status == 0 && fgets(line, sizeof (line), file) != NULL) {
+        line_number++;
+        if (strchr(line, '\n') == NULL && !feof(file)) {
+            logger(LOG_ERROR,
+                "Line %u: longer than %d characters.",
+                line_number, DNS_MAX_LINE - 1);
+            status = 1;
+            break;
+        }
+        if (load_line(load, line, line_number) > 0) {
+            status = 1;
+        }
+    }
+
+    if (ferror(file)) {
+        logger(LOG_ERROR,
+            "Failed to read queries \"%s\": %s", path, strerror(errno));
+        status = 1;
+    }
+    fclose(file);
+
+    if (status == 0 && load->num_queries == 0) {
+        logger(LOG_ERROR, "\"%s\" has no queries.", path);
+        status = 1;
+    }
+    return status;
+}
+
+// Matches a response (of which only the header was read) to its query.
+static void match_response(
+    struct dns_load *const load,
+    const uint16_t port,
+    const uint8_t *const response,
+    const size_t length,
+    const uint64_t now_ns
+) {
+    struct dns_stats *const stats = &load->stats;
+    if (length < DNS_HEADER_LENGTH || !(response[2] & DNS_FLAG_QR)) {
+        return;
+    }
+
+    uint16_t id;
+    memcpy(&id, response, sizeof (id));
+    uint64_t sent_ns;
+    if (!probe_match(&load->table, dns_key(port, ntohs(id)), &sent_ns)) {
+        stats->unmatched++;
+        return;
+    }
+    stats->responses++;
+    stats->rcodes[response[3] & DNS_RCODE_MASK]++;
+    if (response[2] & DNS_FLAG_TC) {
+        stats->truncated++;
+    }
+    histogram_record(&stats->latencies, now_ns - sent_ns);
+}
+
+// Thread callback
+static int receive_loop(void *arg) {
+    struct dns_load *const load = (struct dns_load *)arg;
+    uint8_t buffers[DNS_BATCH_SIZE][DNS_SNAP_LENGTH];
+    struct iovec iov[DNS_BATCH_SIZE];
+    struct mmsghdr msgs[DNS_BATCH_SIZE];
+
+    while (!LOAD_ACQUIRE(&load->done)) {
+        if (poll(load->polls, load->num_sockets, DNS_POLL_TIMEOUT) <= 0) {
+            continue;
+        }
+
+        for (unsigned int s = 0; s < load->num_sockets; s++) {
+            if (load->polls[s].revents == 0) {
+                continue;
+            }
+
+            // (Longer responses get truncated to their headers.)
+            for (unsigned int i = 0; i < DNS_BATCH_SIZE; i++) {
+                iov[i] = (struct iovec){
+                    .iov_base = buffers[i],
+                    .iov_len = sizeof (buffers[i])
+                };
+                msgs[i].msg_hdr = (struct msghdr){
+                    .msg_iov = &iov[i],
+                    .msg_iovlen = 1
+                };
+            }
+            const int received = recvmmsg(load->polls[s].fd, msgs,
+                DNS_BATCH_SIZE, MSG_DONTWAIT, NULL);
+            const uint64_t now_ns = clock_now_ns();
+            for (int i = 0; i < received; i++) {
+                match_response(load, load->ports[s], buffers[i],
+                    msgs[i].msg_len, now_ns);
+            }
+        }
+    }
+
+    return thrd_success;
+}
+
+// Thread callback
+static int send_loop(void *arg) {
+    struct dns_worker *const worker = (struct dns_worker *)arg;
+    const struct ProgramArgs *const program_args = worker->program_args;
+    struct dns_load *const load = worker->load;
+    struct dns_stats *const stats = &worker->stats;
+    bool reported_error = false;
+
+    // With fewer queries per interval than threads, some threads are
+    // left without a share; they must not end up unpaced.
+    if (worker->rate == 0 && program_args->traffic.rate != 0) {
+        return thrd_success;
+    }
+
+    struct pacer pacer;
+    pacer_start(&pacer, program_args->traffic.shape, worker->rate,
+        program_args->traffic.interval_ns);
+    const uint64_t start_ns = pacer.start_ns;
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? start_ns + program_args->traffic.duration * NSEC_PER_SEC : 0;
+
+    while (!sending_stopped()) {
+        const unsigned int count =
+            pacer_acquire(&pacer, worker->batch_size);
+        const uint64_t now_ns = clock_now_ns();
+        if (deadline_ns != 0 && now_ns >= deadline_ns) {
+            break;
+        }
+        pacer_consume(&pacer, count);
+
+        // Every query gets tracked before it is sent (as its response
+        // may well come back before the syscall returns); those that
+        // find no slot are left out.
+        unsigned int num_msgs = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            const uint16_t id = worker->next_id++;
+            const probe_result_t tracked = probe_track(
+                &load->table, dns_key(worker->port, id), now_ns);
+            if (tracked == PROBE_FULL) {
+                stats->untracked++;
+                continue;
+            }
+            if (tracked == PROBE_REPLACED) {
+                stats->lost++;
+            }
+
+            const struct dns_query *const query =
+                &load->queries[worker->next_query];
+            if (++worker->next_query == load->num_queries) {
+                worker->next_query = 0;
+            }
+            worker->ids[num_msgs] = htons(id);
+            worker->iov[2 * num_msgs + 1] = (struct iovec){
+                .iov_base = load->arena + query->offset + sizeof (id),
+                .iov_len = query->length - sizeof (id)
+            };
+            num_msgs++;
+        }
+        if (num_msgs == 0) {
+            continue;
+        }
+
+        const int sent =
+            sendmmsg(worker->socket, worker->msgs, num_msgs, 0);
+        const unsigned int done = (sent > 0) ? (unsigned int)sent : 0;
+        stats->sent += done;
+        if (done == num_msgs) {
+            continue;
+        }
+
+        // The rest is dropped, and counted as such.  (Only a failed
+        // syscall tells why, e.g., ECONNREFUSED, after an ICMP "port
+        // unreachable"; after a partial send, errno is stale.)
+        for (unsigned int i = done; i < num_msgs; i++) {
+            (void)probe_untrack(&load->table,
+                dns_key(worker->port, ntohs(worker->ids[i])));
+        }
+        stats->errors += num_msgs - done;
+        if (sent < 0 && !reported_error) {
+            logger(LOG_ERROR,
+                "Thread %u failed to send queries: %s",
+                worker->id, strerror(errno));
+            reported_error = true;
+        }
+    }
+
+    stats->elapsed_ns = clock_now_ns() - start_ns;
+    return thrd_success;
+}
+
+static int worker_init(
+    struct dns_worker *const worker, const struct dgram_target *target
+) {
+    worker->socket = dgram_open_socket(target, worker->id);
+    if (worker->socket == -1) {
+        return 1;
+    }
+
+    // (The responses come back to the port that connect() picked.)
+    struct sockaddr_storage local;
+    socklen_t local_length = sizeof (local);
+    if (getsockname(worker->socket, (struct sockaddr *)&local,
+            &local_length) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Thread %u failed to get its port: %s",
+            worker->id, strerror(errno));
+        return 1;
+    }
+    worker->port = ntohs((local.ss_family == AF_INET6)
+        ? ((const struct sockaddr_in6 *)&local)->sin6_port
+        : ((const struct sockaddr_in *)&local)->sin_port);
+
+    // (As many responses come back as queries went out.)
+    const int buffer_size = 16 * 1024 * 1024;
+    (void)setsockopt(worker->socket, SOL_SOCKET, SO_RCVBUF,
+        &buffer_size, sizeof (buffer_size));
+
+    worker->ids = calloc(worker->batch_size, sizeof (*worker->ids));
+    worker->iov = calloc(2 * (size_t)worker->batch_size,
+        sizeof (*worker->iov));
+    worker->msgs = calloc(worker->batch_size, sizeof (*worker->msgs));
+    if (worker->ids == NULL || worker->iov == NULL
+        || worker->msgs == NULL
+    ) {
+        logger(LOG_ERROR,
+            "Thread %u failed to allocate its messages.", worker->id);
+        return 1;
+    }
+    for (unsigned int i = 0; i < worker->batch_size; i++) {
+        worker->iov[2 * i] = (struct iovec){
+            .iov_base = &worker->ids[i],
+            .iov_len = sizeof (worker->ids[i])
+        };
+        worker->msgs[i].msg_hdr = (struct msghdr){
+            .msg_iov = &worker->iov[2 * i],
+            .msg_iovlen = 2
+        };
+    }
+    return 0;
+}
+
+static void worker_free(struct dns_worker *const worker) {
+    if (worker->socket != -1) {
+        (void)close(worker->socket);
+    }
+    free(worker->ids);
+    free(worker->iov);
+    free(worker->msgs);
+}
+
+static void load_free(struct dns_load *const load) {
+    free(load->arena);
+    free(load->queries);
+    probe_table_free(&load->table);
+}
+#endif
+
+int run_dns_load(const struct ProgramArgs *const program_args) {
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+    const unsigned int num_threads = program_args->advanced.num_threads;
+    const unsigned int num_workers = (num_threads > 0) ? num_threads : 1;
+    const unsigned int buffer_size = program_args->advanced.buffer_size;
+    // NOTE: Static, because of the (sizable) histograms in the stats.
+    static struct dns_worker workers[MAX_THREADS];
+    static struct dns_load load;
+    static struct dgram_target target;
+    int status = 0;
+
+    if (num_threads > MAX_THREADS) {
+        logger(LOG_ERROR,
+            "At most %d threads are supported.", MAX_THREADS);
+        return 1;
+    }
+
+    target = (struct dgram_target){0};
+    dgram_fill_target(program_args, &target);
+    // (The responses would go to any one of the threads.)
+    if (target.bind_port && num_workers > 1) {
+        logger(LOG_ERROR,
+            "\"--dns\" can only send from a \"--src-port\" of one "
+            "thread.");
+        return 1;
+    }
+
+    load = (struct dns_load){0};
+    if (load_queries(program_args->dns.query_file, &load) != 0
+        || probe_table_init(&load.table, DNS_TABLE_BITS,
+            DNS_MAX_PROBES, program_args->dns.timeout_ns) != 0
+    ) {
+        if (load.table.slots == NULL && load.num_queries > 0) {
+            logger(LOG_ERROR, "Failed to allocate the table of queries.");
+        }
+        load_free(&load);
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        workers[i] = (struct dns_worker){
+            .program_args = program_args,
+            .load = &load,
+            .id = i,
+            .rate = rate_share(program_args->traffic.rate, i, num_workers),
+            .socket = -1,
+            .batch_size = (buffer_size > 0) ? buffer_size : 1,
+            // (Each thread starts elsewhere in the list.)
+            .next_query = (unsigned int)((uint64_t)load.num_queries
+                * i / num_workers)
+        };
+        if (worker_init(&workers[i], &target) != 0) {
+            for (unsigned int j = 0; j <= i; j++) {
+                worker_free(&workers[j]);
+            }
+            load_free(&load);
+            return 1;
+        }
+        load.polls[i] = (struct pollfd){
+            .fd = workers[i].socket,
+            .events = POLLIN
+        };
+        load.ports[i] = workers[i].port;
+    }
+    load.num_sockets = num_workers;
+
+    thrd_t receiver;
+    if (thrd_create(&receiver, receive_loop, &load) != thrd_success) {
+        logger(LOG_ERROR, "Failed to spawn the receiving thread.");
+        for (unsigned int i = 0; i < num_workers; i++) {
+            worker_free(&workers[i]);
+        }
+        load_free(&load);
+        return 1;
+    }
+
+    logger(LOG_INFO,
+        "Sending %u queries (%zu bytes, encoded) round-robin...",
+        load.num_queries, load.arena_length);
+
+    if (num_threads == 0) { // Run in main thread.
+        send_loop(&workers[0]);
+    }
+    else {
+        thrd_t handles[MAX_THREADS];
+        unsigned int num_started = 0;
+
+        for (; num_started < num_threads; num_started++) {
+            if (thrd_create(&handles[num_started], send_loop,
+                    &workers[num_started]) != thrd_success
+            ) {
+                logger(LOG_ERROR,
+                    "Failed to spawn thread %u.", num_started);
+                stop_sending();
+                status = 1;
+                break;
+            }
+        }
+        for (unsigned int i = 0; i < num_started; i++) {
+            thrd_join(handles[i], NULL);
+        }
+    }
+
+    // Give the last queries their chance to be answered.
+    sleep_until_ns(clock_now_ns() + program_args->dns.timeout_ns);
+    STORE_RELEASE(&load.done, 1);
+    thrd_join(receiver, NULL);
+
+    // Whatever is left in the table has been waiting for too long.
+    static struct dns_stats totals;
+    totals = (struct dns_stats){0};
+    for (unsigned int i = 0; i < num_workers; i++) {
+        dns_stats_merge(&totals, &workers[i].stats);
+        worker_free(&workers[i]);
+    }
+    dns_stats_merge(&totals, &load.stats);
+    totals.lost += probe_table_pending(&load.table);
+    dns_stats_report("DNS", &totals);
+
+    load_free(&load);
+    return status;
+#else
+    (void)program_args;
+    logger(LOG_ERROR, "\"--dns\" requires Linux (sendmmsg()).");
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: dns.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,78 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// dns.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef DNS_H
+#define DNS_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./utils/clock.h"
+#include "./utils/intrins.h"
+#include "./utils/probes.h"
+#include "dgram.h"
+#include "pacing.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <poll.h>
+#   include <strings.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#   include <sys/uio.h>
+#endif
+
+// The queries ("--dns") are lines of "<name> [<type>]" (as for
+// dnsperf), each of at most DNS_MAX_LINE characters; the type is A,
+// unless given by its name or as "TYPE<number>".
+#define DNS_MAX_LINE 512
+#define DNS_HEADER_LENGTH 12
+#define DNS_MAX_NAME_LENGTH 255 // Encoded (i.e., as labels)
+#define DNS_MAX_QUERY_LENGTH \
+    (DNS_HEADER_LENGTH + DNS_MAX_NAME_LENGTH + 4)
+#define DNS_DEFAULT_TIMEOUT_NS NSEC_PER_SEC
+// Queries awaiting their responses are kept in a table of 2^20 slots,
+// each within DNS_MAX_PROBES slots of where its socket's port and its
+// ID hash to.  (Every thread has a socket, i.e., port, and 65536 IDs of
+// its own; beyond as many outstanding queries, the oldest counts as
+// lost.)
+#define DNS_TABLE_BITS 20
+#define DNS_MAX_PROBES 16
+// Bytes of each response that get read: just its header.
+#define DNS_SNAP_LENGTH DNS_HEADER_LENGTH
+// Responses received per syscall
+#define DNS_BATCH_SIZE 64
+// Milliseconds to wait for responses before checking for the end.
+#define DNS_POLL_TIMEOUT 100
+
+
+// Sends the queries of the "--dns" file (round-robin, all of them
+// encoded once up front, so that only their IDs change) to the
+// destination address and port, through the UDP sockets of "--dgram",
+// at "--rate" until the duration elapses or stop_sending() gets called,
+// while another thread matches the responses to them by their ID.  Then
+// reports the queries and responses per second, the RCODEs, and the
+// distribution of the response times.
+int run_dns_load(const struct ProgramArgs *const program_args);
+
+
+#endif // DNS_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: dns.h
+// ---------------------------------------------------------------------
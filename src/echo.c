@@ -0,0 +1,302 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// echo.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "echo.h"
+
+
+typedef struct echo_probe {
+    const struct ProgramArgs *program_args;
+    int socket;
+    bool ipv6;
+    uint16_t id;            // Network byte order
+    struct probe_table requests; // Keyed by sequence number (plus one)
+    int done;               // Set once no more replies are awaited
+    // (Apart, so that neither thread writes to the other's counters.)
+    struct echo_stats sender_stats;
+    struct echo_stats receiver_stats;
+} echo_probe_t;
+
+// Finds an echo reply to us in what a raw socket received (with the IP
+// header in front for IPv4, but not for IPv6) and returns its sequence
+// number; our own requests show up, too, when probing the loopback.
+static bool parse_reply(
+    const struct echo_probe *const probe,
+    const uint8_t *const packet,
+    const size_t length,
+    uint16_t *const seq
+) {
+    size_t offset = 0;
+    if (!probe->ipv6) {
+        if (length < sizeof (struct ip_hdr)) {
+            return false;
+        }
+        offset = (size_t)(packet[0] & 0x0F) * 4;
+    }
+
+    struct icmp_hdr header;
+    if (offset + sizeof (header) > length) {
+        return false;
+    }
+    memcpy(&header, packet + offset, sizeof (header));
+    if (header.type != (probe->ipv6 ? ICMP6_ECHO_REPLY : ICMP_ECHO_REPLY)
+        || header.code != 0 || header.id != probe->id
+    ) {
+        return false;
+    }
+
+    *seq = ntohs(header.seq);
+    return true;
+}
+
+// Thread callback
+static int receive_loop(void *arg) {
+    struct echo_probe *const probe = (struct echo_probe *)arg;
+    struct echo_stats *const stats = &probe->receiver_stats;
+    struct pollfd poll_info = {.fd = probe->socket, .events = POLLIN};
+    uint8_t buffer[IP_PKT_MTU];
+
+    while (!LOAD_ACQUIRE(&probe->done)) {
+        if (poll(&poll_info, 1, ECHO_POLL_TIMEOUT) <= 0) {
+            continue;
+        }
+
+        for (;;) {
+            const ssize_t length = recv(probe->socket, buffer,
+                sizeof (buffer), MSG_DONTWAIT);
+            if (length < 0) {
+                break;
+            }
+            const uint64_t now_ns = clock_now_ns();
+
+            uint16_t seq;
+            uint64_t sent_ns;
+            if (!parse_reply(probe, buffer, (size_t)length, &seq)) {
+                continue;
+            }
+            if (probe_match(&probe->requests, (uint64_t)seq + 1,
+                    &sent_ns)
+            ) {
+                stats->received++;
+                histogram_record(&stats->rtts, now_ns - sent_ns);
+            }
+            else {
+                stats->unmatched++;
+            }
+        }
+    }
+
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    return thrd_success;
+#else
+    return 0;
+#endif
+}
+
+// Sends the requests, paced, until the duration elapses (or until
+// interrupted); the checksum only changes along with the sequence
+// number, so it gets updated incrementally (RFC 1624).
+static void send_loop(
+    struct echo_probe *const probe,
+    uint8_t *const request,
+    const size_t length,
+    const struct sockaddr *const destination,
+    const socklen_t destination_length
+) {
+    const struct ProgramArgs *const program_args = probe->program_args;
+    struct echo_stats *const stats = &probe->sender_stats;
+    const bool paced = program_args->traffic.rate > 0;
+    struct icmp_hdr header;
+    memcpy(&header, request, sizeof (header));
+    const uint16_t base_chksum = header.chksum;
+
+    struct pacer pacer;
+    pacer_start(&pacer,
+        paced ? program_args->traffic.shape : SHAPE_CONSTANT,
+        paced ? program_args->traffic.rate : ECHO_DEFAULT_RATE,
+        paced ? program_args->traffic.interval_ns : NSEC_PER_SEC);
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? pacer.start_ns + program_args->traffic.duration * NSEC_PER_SEC
+        : 0;
+
+    for (uint16_t seq = 0; !sending_stopped(); seq++) {
+        (void)pacer_acquire(&pacer, 1);
+        const uint64_t now_ns = clock_now_ns();
+        if (sending_stopped()
+            || (deadline_ns != 0 && now_ns >= deadline_ns)
+        ) {
+            break;
+        }
+        pacer_consume(&pacer, 1);
+
+        const probe_result_t tracked =
+            probe_track(&probe->requests, (uint64_t)seq + 1, now_ns);
+        if (tracked == PROBE_FULL) {
+            stats->untracked++;
+            continue;
+        }
+        if (tracked == PROBE_REPLACED) {
+            stats->lost++;
+        }
+
+        header.seq = htons(seq);
+        // (The kernel checksums ICMPv6, along with its pseudo-header.)
+        if (!probe->ipv6) {
+            header.chksum = chksum_update16(base_chksum, 0, header.seq);
+        }
+        memcpy(request, &header, sizeof (header));
+
+        if (sendto(probe->socket, request, length, 0,
+                destination, destination_length) < 0
+        ) {
+            (void)probe_untrack(&probe->requests, (uint64_t)seq + 1);
+            stats->errors++;
+            continue;
+        }
+        stats->sent++;
+    }
+}
+
+// A raw ICMP(v6) socket, bound to the source address (if any was given)
+// so that the replies come back to it.
+static int open_socket(const struct ProgramArgs *const program_args) {
+    const bool ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6;
+    const int socket_descriptor = socket(ipv6 ? AF_INET6 : AF_INET,
+        SOCK_RAW, ipv6 ? IP_PROTO_ICMPV6 : IP_PROTO_ICMP);
+    if (socket_descriptor == -1) {
+        logger(LOG_ERROR,
+            "Failed to create an ICMP socket: %s", strerror(errno));
+        return -1;
+    }
+
+    int status = 0;
+    if (ipv6 && program_args->ipv6_misc.override_source) {
+        struct sockaddr_in6 source = {.sin6_family = AF_INET6};
+        memcpy(&source.sin6_addr, program_args->ipv6.saddr.octets,
+            sizeof (source.sin6_addr));
+        status = bind(socket_descriptor,
+            (const struct sockaddr *)&source, sizeof (source));
+    }
+    else if (!ipv6 && program_args->ipv4_misc.override_source) {
+        struct sockaddr_in source = {.sin_family = AF_INET};
+        source.sin_addr.s_addr =
+            htonl(program_args->ipv4->saddr.address);
+        status = bind(socket_descriptor,
+            (const struct sockaddr *)&source, sizeof (source));
+    }
+    if (status != 0) {
+        logger(LOG_ERROR,
+            "Failed to bind to the source address: %s", strerror(errno));
+        close(socket_descriptor);
+        return -1;
+    }
+
+    return socket_descriptor;
+}
+
+int run_echo_probe(const struct ProgramArgs *const program_args) {
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    const bool ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6;
+    const size_t length =
+        sizeof (struct icmp_hdr) + program_args->icmp.size;
+    struct echo_probe probe = {
+        .program_args = program_args,
+        .ipv6 = ipv6,
+        .id = htons(program_args->icmp.override_id
+            ? program_args->icmp.id : (uint16_t)getpid())
+    };
+    uint8_t request[IP_PKT_MTU] = {0};
+    int status = 0;
+
+    if (probe_table_init(&probe.requests, ECHO_TABLE_BITS,
+            ECHO_MAX_PROBES, program_args->icmp.timeout_ns) != 0
+    ) {
+        logger(LOG_ERROR, "Failed to allocate the table of requests.");
+        return 1;
+    }
+    probe.socket = open_socket(program_args);
+    if (probe.socket == -1) {
+        probe_table_free(&probe.requests);
+        return 1;
+    }
+
+    // The data is a counting pattern, as ping's is.
+    const struct icmp_hdr header = {
+        .type = ipv6 ? ICMP6_ECHO_REQUEST : ICMP_ECHO_REQUEST,
+        .code = 0,
+        .chksum = 0,
+        .id = probe.id,
+        .seq = 0
+    };
+    memcpy(request, &header, sizeof (header));
+    for (size_t i = sizeof (header); i < length; i++) {
+        request[i] = (uint8_t)i;
+    }
+    if (!ipv6) {
+        const uint16_t chksum = inet_chksum(request, length);
+        memcpy(request + offsetof(struct icmp_hdr, chksum),
+            &chksum, sizeof (chksum));
+    }
+
+    struct sockaddr_storage destination = {0};
+    socklen_t destination_length;
+    if (ipv6) {
+        struct sockaddr_in6 *const address =
+            (struct sockaddr_in6 *)&destination;
+        address->sin6_family = AF_INET6;
+        memcpy(&address->sin6_addr, program_args->ipv6.daddr.octets,
+            sizeof (address->sin6_addr));
+        destination_length = sizeof (*address);
+    }
+    else {
+        struct sockaddr_in *const address =
+            (struct sockaddr_in *)&destination;
+        address->sin_family = AF_INET;
+        address->sin_addr.s_addr =
+            htonl(program_args->ipv4->daddr.address);
+        destination_length = sizeof (*address);
+    }
+
+    thrd_t receiver;
+    if (thrd_create(&receiver, receive_loop, &probe) != thrd_success) {
+        logger(LOG_ERROR, "Failed to spawn the receiving thread.");
+        close(probe.socket);
+        probe_table_free(&probe.requests);
+        return 1;
+    }
+
+    logger(LOG_INFO,
+        "Sending echo requests (with %u bytes of data), ID %u...",
+        program_args->icmp.size, (unsigned int)ntohs(probe.id));
+    send_loop(&probe, request, length,
+        (const struct sockaddr *)&destination, destination_length);
+
+    // Give the last requests their chance to be answered.
+    sleep_until_ns(clock_now_ns() + program_args->icmp.timeout_ns);
+    STORE_RELEASE(&probe.done, 1);
+    thrd_join(receiver, NULL);
+
+    // Whatever is left in the table has been waiting for too long.
+    struct echo_stats totals = {0};
+    echo_stats_merge(&totals, &probe.sender_stats);
+    echo_stats_merge(&totals, &probe.receiver_stats);
+    totals.lost += probe_table_pending(&probe.requests);
+    echo_stats_report("Echo", &totals);
+
+    close(probe.socket);
+    probe_table_free(&probe.requests);
+    return status;
+#else
+    (void)program_args;
+    logger(LOG_ERROR,
+        "\"--icmp\" needs a thread of its own for the replies.");
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: echo.c
+// ---------------------------------------------------------------------
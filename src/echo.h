@@ -0,0 +1,65 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// echo.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef ECHO_H
+#define ECHO_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./netlib/chksum.h"
+#include "./utils/clock.h"
+#include "./utils/intrins.h"
+#include "./utils/probes.h"
+#include "packet.h"
+#include "pacing.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <poll.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#endif
+
+// Bytes of data in each echo request: 56 by default (as with ping),
+// and at most what still fits an IPv6 packet of IP_PKT_MTU bytes.
+#define ECHO_DEFAULT_SIZE 56
+#define ECHO_MAX_SIZE \
+    (IP_PKT_MTU - sizeof (struct ip6_hdr) - sizeof (struct icmp_hdr))
+// Requests per second, unless "--rate" says otherwise.
+#define ECHO_DEFAULT_RATE 100
+#define ECHO_DEFAULT_TIMEOUT_NS NSEC_PER_SEC
+// Outstanding requests are kept in a table of 2^14 slots, each within
+// ECHO_MAX_PROBES slots of where its sequence number hashes to.
+#define ECHO_TABLE_BITS 14
+#define ECHO_MAX_PROBES 16
+// Milliseconds to wait for replies before checking for the end.
+#define ECHO_POLL_TIMEOUT 100
+
+
+// Sends ICMP(v6) echo requests to the destination at "--rate" (paced
+// like any other traffic) until the duration elapses or stop_sending()
+// gets called, while another thread matches the replies to them; then
+// reports the distribution of the round-trip times and the losses.
+int run_echo_probe(const struct ProgramArgs *const program_args);
+
+
+#endif // ECHO_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: echo.h
+// ---------------------------------------------------------------------
@@ -24,6 +24,16 @@
 #include "./cmdline/parser.h"
 #include "packet.h"
 #include "socket.h"
+#include "stats.h"
+#include "echo.h"
+#include "twamp.h"
+#include "connect.h"
+#include "dgram.h"
+#include "dns.h"
+#include "rfc2544.h"
+#include "scenario.h"
+#include "profile.h"
+#include "sink.h"
 #include "./netlib/netinet.h"
 
 #include <stdbool.h>
@@ -127,39 +137,92 @@ void fill_defaults(struct ProgramArgs *const program_args) {
     // Advanced
     program_args->advanced.num_threads =
         program_args->diagnostics.runtime.num_cores;
+    program_args->advanced.buffer_size = UIO_MAXIOV;
+
+    // Traffic
+    program_args->traffic.interval_ns = NSEC_PER_SEC;
+    program_args->traffic.txtime_lead_ns =
+        TXTIME_DEFAULT_LEAD_US * NSEC_PER_USEC;
+
+    // RFC 2544 (section 24 requires trials of at least 60 seconds.)
+    program_args->rfc2544.trial_time = 60;
+
+    program_args->icmp.size = ECHO_DEFAULT_SIZE;
+    program_args->icmp.timeout_ns = ECHO_DEFAULT_TIMEOUT_NS;
+
+    program_args->twamp.port = TWAMP_PORT;
+    program_args->twamp.padding = TWAMP_DEFAULT_PADDING;
+
+    program_args->conn.concurrency = CONNECT_DEFAULT_CONCURRENCY;
+    program_args->conn.timeout_ns = CONNECT_DEFAULT_TIMEOUT_NS;
+
+    program_args->dns.timeout_ns = DNS_DEFAULT_TIMEOUT_NS;
+
+    program_args->protocols.l3 = PROTO_L3_IPV4;
+    program_args->protocols.l4 = PROTO_L4_TCP;
 
     // IPv4
     //
     // NOTE: Unfortunately, there is no POSIX-compliant way to
     // get the current interface's ip address; getifaddrs() is
-    // not standardized.
-    // TODO: Use unprivilaged sendto() as an alternative.
+    // not standardized.  (Without privileges, "--connect" opens
+    // real connections instead, and "--dgram" sends plain datagrams.)
     *(program_args->ipv4) = (struct ip_hdr){
         .ver = 4,
         .ihl = 5,
         .ttl = 128,
         .proto = IP_PROTO_TCP,
-        .len = htons(sizeof(struct ip_hdr) + sizeof(struct tcp_hdr)),
+        .len = sizeof(struct ip_hdr) + sizeof(struct tcp_hdr),
         .saddr.address = 0,
         .daddr.address = 0
     };
+
+    // TCP
+    *(program_args->tcp) = (struct tcp_hdr){
+        .dport = 80,
+        .dataofs = 5,
+        .flags.syn = true
+    };
+
+    // IPv6 (the addresses are handled like those of IPv4.)
+    program_args->ipv6 = (struct ip6_hdr){
+        .ver_tc_flow = (uint32_t)6 << IP6_VERSION_SHIFT,
+        .hop_limit = 128
+    };
+
+    // Tunnel (a locally administered source, and a broadcast
+    // destination, which any VXLAN endpoint takes in.)
+    program_args->tunnel.inner_saddr =
+        (eth_addr_t){{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}};
+    program_args->tunnel.inner_daddr =
+        (eth_addr_t){{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}};
+
+    // UDP (the discard port; length and checksum get computed.)
+    program_args->udp = (struct udp_hdr){
+        .dport = 9
+    };
 }
 
 int main(int argc, char *argv[]) {
-     struct ProgramArgs program_args = {0};
+    struct ProgramArgs program_args = {0};
     struct ip_hdr *ipv4_header_args = 
         (struct ip_hdr *)calloc(1, sizeof(struct ip_hdr));
+    struct tcp_hdr *tcp_header_args =
+        (struct tcp_hdr *)calloc(1, sizeof(struct tcp_hdr));
 
-    if (ipv4_header_args == NULL) {
+    if (ipv4_header_args == NULL || tcp_header_args == NULL) {
         program_args.diagnostics.unrecoverable_error = true;
         logger(LOG_ERROR,
             "Failed to allocate memory for program arguments.");
         goto CLEANUP;
     }
     program_args.ipv4 = ipv4_header_args;
+    program_args.tcp = tcp_header_args;
 
 
     diagnose_system(&program_args);
+    // Before anything gets timed (and before any threads exist).
+    clock_init();
 
     fill_defaults(&program_args);
 
@@ -190,8 +253,190 @@ int main(int argc, char *argv[]) {
     logger_set_level(program_args.general.logger_level);
     logger_set_timestamps(!program_args.advanced.no_log_timestamp);
 
-    int socket_descriptor = create_raw_async_socket();
-    if (socket_descriptor == EXIT_FAILURE) {
+    // A sink only receives, so none of what follows applies to it.
+    if (program_args.run.sink) {
+        (void)install_stop_handler();
+        if (run_sink(&program_args) != 0) {
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+        goto CLEANUP;
+    }
+    // Nor to a reflector (of whatever comes in).
+    if (program_args.twamp.reflector) {
+        (void)install_stop_handler();
+        if (run_twamp_reflector(&program_args) != 0) {
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+        goto CLEANUP;
+    }
+
+    const bool ipv6 = program_args.protocols.l3 == PROTO_L3_IPV6;
+    static const ip6_addr_t IP6_ANY = {{0}};
+    if ((ipv6 && memcmp(&program_args.ipv6.daddr, &IP6_ANY,
+            sizeof (IP6_ANY)) == 0)
+        || (!ipv6 && program_args.ipv4->daddr.address == 0)
+    ) {
+        program_args.diagnostics.unrecoverable_error = true;
+        logger(LOG_ERROR, ipv6
+            ? "An IPv6 destination address (--dest-ip) is required."
+            : "A destination address (--dest-ip) is required.");
+        goto CLEANUP;
+    }
+
+    // The probes have sockets of their own (and craft no IP headers).
+    if (program_args.protocols.l4 == PROTO_L4_ICMP
+        || program_args.twamp.sender
+    ) {
+        if (program_args.tunnel.kind != TUNNEL_NONE
+            || program_args.protocols.l2 == PROTO_L2_ETH
+            || program_args.rfc2544.enabled
+            || program_args.traffic.scenario_file != NULL
+            || program_args.traffic.profile_file != NULL
+            || program_args.traffic.payload_file != NULL
+            || program_args.run.tagged
+        ) {
+            logger(LOG_ERROR,
+                "\"--icmp\" and \"--twamp\" cannot be combined with "
+                "\"--encap\", \"--eth\",\n  \"--rfc2544\", "
+                "\"--scenario\", \"--profile\", \"--payload-file\" "
+                "or \"--run-id\".");
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+        else {
+            (void)install_stop_handler();
+            if ((program_args.twamp.sender
+                    ? run_twamp_sender(&program_args)
+                    : run_echo_probe(&program_args)) != 0
+            ) {
+                program_args.diagnostics.unrecoverable_error = true;
+            }
+        }
+        goto CLEANUP;
+    }
+
+    // Nor does a run of real connections (which needs no privileges).
+    if (program_args.conn.enabled) {
+        if (program_args.protocols.l4 != PROTO_L4_TCP
+            || program_args.tunnel.kind != TUNNEL_NONE
+            || program_args.protocols.l2 == PROTO_L2_ETH
+            || program_args.rfc2544.enabled
+            || program_args.traffic.scenario_file != NULL
+            || program_args.traffic.profile_file != NULL
+            || program_args.traffic.payload_file != NULL
+            || program_args.run.tagged
+            || program_args.traffic.responses
+        ) {
+            logger(LOG_ERROR,
+                "\"--connect\" needs TCP, and cannot be combined with "
+                "\"--encap\", \"--eth\",\n  \"--rfc2544\", "
+                "\"--scenario\", \"--profile\", \"--payload-file\", "
+                "\"--run-id\"\n  or \"--responses\".");
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+        else {
+            (void)install_stop_handler();
+            if (run_connect_load(&program_args) != 0) {
+                program_args.diagnostics.unrecoverable_error = true;
+            }
+        }
+        goto CLEANUP;
+    }
+    // Nor do plain datagrams (whose headers the kernel writes), such as
+    // DNS queries.
+    const bool dns = program_args.dns.query_file != NULL;
+    if (program_args.dgram.enabled || dns) {
+        if (program_args.protocols.l4 != PROTO_L4_UDP
+            || program_args.tunnel.kind != TUNNEL_NONE
+            || program_args.protocols.l2 == PROTO_L2_ETH
+            || program_args.rfc2544.enabled
+            || program_args.traffic.scenario_file != NULL
+            || program_args.traffic.profile_file != NULL
+            || program_args.traffic.payload_file != NULL
+            || program_args.run.tagged
+            || program_args.traffic.txtime
+            || program_args.traffic.tx_stamp_every > 0
+            || program_args.vary.num_specs > 0
+        ) {
+            logger(LOG_ERROR,
+                "\"--%s\" needs UDP, and cannot be combined with "
+                "\"--encap\", \"--eth\",\n  \"--rfc2544\", "
+                "\"--scenario\", \"--profile\", \"--payload-file\", "
+                "\"--run-id\",\n  \"--txtime\", \"--tx-timestamps\" "
+                "or \"--vary\".", dns ? "dns" : "dgram");
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+        else {
+            (void)install_stop_handler();
+            if ((dns ? run_dns_load(&program_args)
+                    : run_dgram_flood(&program_args)) != 0
+            ) {
+                program_args.diagnostics.unrecoverable_error = true;
+            }
+        }
+        goto CLEANUP;
+    }
+
+    const bool tunnel = program_args.tunnel.kind != TUNNEL_NONE;
+    if (tunnel && program_args.tunnel.daddr.address == 0) {
+        program_args.diagnostics.unrecoverable_error = true;
+        logger(LOG_ERROR,
+            "A tunnel endpoint (--tunnel-dest) is required with "
+            "\"--encap\".");
+        goto CLEANUP;
+    }
+    if (tunnel && !program_args.tunnel.override_source
+        && resolve_source_address(program_args.tunnel.daddr.address,
+            &program_args.tunnel.saddr.address) != 0
+    ) {
+        program_args.diagnostics.unrecoverable_error = true;
+        goto CLEANUP;
+    }
+    // The inner addresses need not be routable from here, so those of
+    // IPv4 default to that of the tunnel instead.
+    if (tunnel && !ipv6 && !program_args.ipv4_misc.override_source) {
+        program_args.ipv4->saddr = program_args.tunnel.saddr;
+    }
+
+    // The kernel would fill in a zero source address by itself, but
+    // only after we have already checksummed the TCP pseudo-header.
+    if (ipv6 && !program_args.ipv6_misc.override_source
+        && resolve_source_address6(program_args.ipv6.daddr.octets,
+            program_args.ipv6.saddr.octets) != 0
+    ) {
+        program_args.diagnostics.unrecoverable_error = true;
+        goto CLEANUP;
+    }
+    if (!ipv6 && !tunnel && !program_args.ipv4_misc.override_source
+        && resolve_source_address(program_args.ipv4->daddr.address,
+            &program_args.ipv4->saddr.address) != 0
+    ) {
+        program_args.diagnostics.unrecoverable_error = true;
+        goto CLEANUP;
+    }
+
+    const bool ethernet = program_args.protocols.l2 == PROTO_L2_ETH;
+    if (ethernet && !program_args.eth_misc.override_dest) {
+        // NOTE: Nothing resolves the next hop (i.e., ARP/NDP) for us
+        // at layer 2; "ip neigh" shows what the kernel already knows.
+        program_args.diagnostics.unrecoverable_error = true;
+        logger(LOG_ERROR,
+            "A destination MAC address (--dest-mac) is required "
+            "with \"--eth\".");
+        goto CLEANUP;
+    }
+
+    eth_addr_t hwaddr;
+    int socket_descriptor = ethernet
+        ? create_packet_tx_socket(
+            program_args.eth_misc.interface, hwaddr.octets)
+        : create_raw_async_socket(
+            (ipv6 && !tunnel) ? AF_INET6 : AF_INET);
+    if (ethernet && socket_descriptor != -1
+        && !program_args.eth_misc.override_source
+    ) {
+        program_args.eth.saddr = hwaddr;
+    }
+    if (socket_descriptor == -1) {
         program_args.diagnostics.unrecoverable_error = true;
         logger(LOG_INFO, "Quitting after failing to create a socket.");
         goto CLEANUP;
@@ -199,14 +444,102 @@ int main(int argc, char *argv[]) {
 
     program_args.socket = socket_descriptor;
 
-    send_packets(&program_args);
+    (void)install_stop_handler();
 
-
-    if (shutdown(socket_descriptor, SHUT_RDWR) == -1) {
-        logger(LOG_WARN, "Socket shutdown failed: %s", strerror(errno));
+    if (program_args.rfc2544.enabled
+        && program_args.traffic.scenario_file != NULL
+    ) {
+        logger(LOG_ERROR,
+            "\"--rfc2544\" and \"--scenario\" are mutually exclusive.");
+        program_args.diagnostics.unrecoverable_error = true;
+    }
+    else if (program_args.rfc2544.enabled && tunnel) {
+        // (Its frame sizes, and what it counts as received, are those
+        // of plain IP packets.)
+        logger(LOG_ERROR,
+            "\"--rfc2544\" cannot be combined with \"--encap\".");
+        program_args.diagnostics.unrecoverable_error = true;
+    }
+    else if (program_args.run.tagged
+        && (program_args.rfc2544.enabled
+            || program_args.traffic.scenario_file != NULL
+            || program_args.traffic.profile_file != NULL)
+    ) {
+        // (Each of their templates would count from zero again.)
+        logger(LOG_ERROR,
+            "\"--run-id\" cannot be combined with \"--rfc2544\", "
+            "\"--scenario\"\n  or \"--profile\".");
+        program_args.diagnostics.unrecoverable_error = true;
+    }
+    else if (program_args.traffic.responses
+        && (program_args.protocols.l4 != PROTO_L4_TCP || tunnel
+            || program_args.rfc2544.enabled
+            || program_args.traffic.scenario_file != NULL)
+    ) {
+        // (The answers to encapsulated SYNs would come back through
+        // the tunnel, if at all.)
+        logger(LOG_ERROR,
+            "\"--responses\" needs TCP, and cannot be combined with "
+            "\"--encap\",\n  \"--rfc2544\" or \"--scenario\".");
+        program_args.diagnostics.unrecoverable_error = true;
+    }
+    else if ((program_args.traffic.profile_file != NULL
+            || program_args.traffic.payload_file != NULL)
+        && (program_args.rfc2544.enabled
+            || program_args.traffic.scenario_file != NULL)
+    ) {
+        logger(LOG_ERROR,
+            "\"--profile\" and \"--payload-file\" cannot be combined "
+            "with \"--rfc2544\"\n  or \"--scenario\".");
+        program_args.diagnostics.unrecoverable_error = true;
+    }
+    else if (program_args.traffic.scenario_file != NULL) {
+        if (run_scenario(&program_args) != 0) {
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+    }
+    else if (program_args.rfc2544.enabled) {
+        if (run_rfc2544(&program_args) != 0) {
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+    }
+    else if (program_args.traffic.profile_file != NULL) {
+        // NOTE: Sizable (i.e., a template per entry); hence the heap.
+        struct traffic_profile *const profile =
+            calloc(1, sizeof (*profile));
+        struct send_stats totals = {0};
+        if (profile == NULL
+            || load_profile(&program_args, profile) != 0
+            || send_packets(&program_args, &profile->mix, &totals) != 0
+        ) {
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+        else {
+            stats_report("Total", &totals);
+        }
+        if (profile != NULL) {
+            free_profile(profile);
+            free(profile);
+        }
     }
     else {
-        logger(LOG_INFO, "Socket shutdown successfully.");
+        struct send_stats totals = {0};
+        if (send_packets(&program_args, NULL, &totals) != 0) {
+            program_args.diagnostics.unrecoverable_error = true;
+        }
+        stats_report("Total", &totals);
+    }
+
+
+    // (Packet sockets have no connection to shut down.)
+    if (!ethernet) {
+        if (shutdown(socket_descriptor, SHUT_RDWR) == -1) {
+            logger(LOG_WARN,
+                "Socket shutdown failed: %s", strerror(errno));
+        }
+        else {
+            logger(LOG_INFO, "Socket shutdown successfully.");
+        }
     }
 
     if (close(socket_descriptor) == -1) {
@@ -218,6 +551,7 @@ int main(int argc, char *argv[]) {
 
 CLEANUP:
 
+    free(tcp_header_args);
     free(ipv4_header_args);
 
     logger(LOG_INFO, "Done; exiting program...");
@@ -0,0 +1,605 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// mutate.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "mutate.h"
+#include "./cmdline/logger.h"
+#include "./netlib/netinet.h"
+#include "./utils/clock.h"
+#include "payload.h"
+
+
+static vary_patch_loop_t select_patch_loop(
+    const vary_generator_t generator,
+    const unsigned int width,
+    const bool chksum
+);
+static vary_stamp_loop_t select_stamp_loop(const bool chksum);
+static vary_finish_loop_t select_finish_loop(
+    const bool l3, const bool l4, const bool udp
+);
+
+typedef enum field_home {
+    FIELD_IN_IPV4 = 0,
+    FIELD_IN_IPV6,
+    FIELD_IN_L4,  // Either TCP or UDP (i.e., the ports)
+    FIELD_IN_TCP,
+    FIELD_IN_TAG  // The test tag behind the transport header
+} field_home_t;
+
+static const struct field_layout {
+    const char *name;
+    field_home_t home;
+    uint8_t offset; // Within its header
+    uint8_t width;
+    uint8_t shift;
+    uint32_t mask;
+    uint8_t covers;
+} FIELD_LAYOUTS[NUM_VARY_FIELDS] = {
+    [VARY_FIELD_TOS] =
+        {"tos", FIELD_IN_IPV4, 1, 1, 0, 0xFF, VARY_COVERS_L3},
+    [VARY_FIELD_IDENT] =
+        {"ident", FIELD_IN_IPV4, 4, 2, 0, 0xFFFF, VARY_COVERS_L3},
+    [VARY_FIELD_TTL] =
+        {"ttl", FIELD_IN_IPV4, 8, 1, 0, 0xFF, VARY_COVERS_L3},
+    // The addresses are part of the TCP/UDP pseudo-header, too.
+    [VARY_FIELD_SADDR] = {"saddr", FIELD_IN_IPV4, 12, 4, 0,
+        0xFFFFFFFF, VARY_COVERS_L3 | VARY_COVERS_L4},
+    [VARY_FIELD_DADDR] = {"daddr", FIELD_IN_IPV4, 16, 4, 0,
+        0xFFFFFFFF, VARY_COVERS_L3 | VARY_COVERS_L4},
+    [VARY_FIELD_TRAFFIC_CLASS] = {"traffic-class", FIELD_IN_IPV6, 0, 4,
+        IP6_TCLASS_SHIFT, IP6_TCLASS_MASK, 0},
+    [VARY_FIELD_FLOW_LABEL] = {"flow-label", FIELD_IN_IPV6, 0, 4,
+        0, IP6_FLOW_LABEL_MASK, 0},
+    [VARY_FIELD_HOP_LIMIT] =
+        {"hop-limit", FIELD_IN_IPV6, 7, 1, 0, 0xFF, 0},
+    [VARY_FIELD_SPORT] =
+        {"sport", FIELD_IN_L4, 0, 2, 0, 0xFFFF, VARY_COVERS_L4},
+    [VARY_FIELD_DPORT] =
+        {"dport", FIELD_IN_L4, 2, 2, 0, 0xFFFF, VARY_COVERS_L4},
+    [VARY_FIELD_SEQ] =
+        {"seq", FIELD_IN_TCP, 4, 4, 0, 0xFFFFFFFF, VARY_COVERS_L4},
+    [VARY_FIELD_ACK] =
+        {"ack", FIELD_IN_TCP, 8, 4, 0, 0xFFFFFFFF, VARY_COVERS_L4},
+    [VARY_FIELD_WINDOW] =
+        {"window", FIELD_IN_TCP, 14, 2, 0, 0xFFFF, VARY_COVERS_L4},
+    [VARY_FIELD_URG_PTR] =
+        {"urg-ptr", FIELD_IN_TCP, 18, 2, 0, 0xFFFF, VARY_COVERS_L4},
+    // Its offset depends on the other TCP options.
+    [VARY_FIELD_TSVAL] =
+        {"tsval", FIELD_IN_TCP, 0, 4, 0, 0xFFFFFFFF, VARY_COVERS_L4},
+    // (Part of the transport payload, as far as checksums go.)
+    [VARY_FIELD_TAG_THREAD] = {"tag-thread", FIELD_IN_TAG,
+        offsetof(struct test_tag, thread), 4, 0, 0xFFFFFFFF,
+        VARY_COVERS_L4}
+};
+
+uint32_t vary_field_max(const vary_field_t field) {
+    return FIELD_LAYOUTS[field].mask >> FIELD_LAYOUTS[field].shift;
+}
+
+void vary_program_init(
+    struct vary_program *const program,
+    const struct vary_layout *const layout
+) {
+    memset(program, 0, sizeof (*program));
+    program->udp = layout->udp;
+    program->l3_chksum_offset = layout->l3_chksum_offset;
+    program->l4_chksum_offset = layout->l4_chksum_offset;
+    program->finish = select_finish_loop(false, false, false);
+}
+
+int vary_compile(
+    struct vary_program *const program,
+    const struct vary_spec *const spec,
+    const struct vary_layout *const layout
+) {
+    const struct field_layout *const field = &FIELD_LAYOUTS[spec->field];
+
+    bool applies = false;
+    size_t offset = field->offset;
+    switch (field->home) {
+        case FIELD_IN_IPV4: {
+            applies = !layout->ipv6;
+            offset += layout->l3_offset;
+            break;
+        }
+        case FIELD_IN_IPV6: {
+            applies = layout->ipv6;
+            offset += layout->l3_offset;
+            break;
+        }
+        case FIELD_IN_L4: {
+            applies = true;
+            offset += layout->l4_offset;
+            break;
+        }
+        case FIELD_IN_TAG: {
+            applies = layout->tag_offset != 0;
+            offset += layout->tag_offset;
+            break;
+        }
+        case FIELD_IN_TCP:
+        default: {
+            applies = !layout->udp;
+            offset += (spec->field == VARY_FIELD_TSVAL)
+                ? layout->tsval_offset : layout->l4_offset;
+            break;
+        }
+    }
+    if (!applies) {
+        logger(LOG_ERROR,
+            "Cannot vary \"%s\"; the packets have no such field.",
+            field->name
+        );
+        return 1;
+    }
+    if (program->num_patches == VARY_MAX_PATCHES) {
+        logger(LOG_ERROR,
+            "At most %d fields may be varied.", VARY_MAX_PATCHES);
+        return 1;
+    }
+
+    uint8_t covers = field->covers;
+    if (layout->l3_chksum_offset == 0) {
+        covers &= (uint8_t)~VARY_COVERS_L3;
+    }
+    if (layout->l4_chksum_offset == 0) {
+        covers &= (uint8_t)~VARY_COVERS_L4;
+    }
+
+    struct vary_patch *const patch =
+        &program->patches[program->num_patches++];
+    *patch = (struct vary_patch){
+        .offset = (uint16_t)offset,
+        .word_offset = (uint16_t)(offset & ~(size_t)1),
+        .width = field->width,
+        .shift = field->shift,
+        .covers = covers,
+        .mask = field->mask,
+        .max = field->mask >> field->shift,
+        .l3_mask = (covers & VARY_COVERS_L3) ? UINT32_MAX : 0,
+        .l4_mask = (covers & VARY_COVERS_L4) ? UINT32_MAX : 0,
+        .spec = *spec
+    };
+    // A range that spans all 32 bits would not fit its own span.
+    if (spec->generator == VARY_RANGE && spec->hi - spec->lo + 1 == 0) {
+        patch->spec.generator = VARY_RANDOM;
+    }
+    patch->loop = select_patch_loop(
+        patch->spec.generator, patch->width, covers != 0);
+
+    program->covers |= covers;
+    program->finish = select_finish_loop(
+        (program->covers & VARY_COVERS_L3) != 0,
+        (program->covers & VARY_COVERS_L4) != 0,
+        program->udp
+    );
+
+    return 0;
+}
+
+void vary_compile_stamp(
+    struct vary_program *const program,
+    const struct vary_layout *const layout
+) {
+    const bool chksum = layout->l4_chksum_offset != 0;
+
+    program->stamp_offset =
+        layout->tag_offset + offsetof(struct test_tag, seq);
+    program->stamp = select_stamp_loop(chksum);
+    if (chksum) {
+        program->covers |= VARY_COVERS_L4;
+        program->finish = select_finish_loop(
+            (program->covers & VARY_COVERS_L3) != 0, true, program->udp);
+    }
+}
+
+bool vary_has_field(
+    const struct vary_program *const program, const vary_field_t field
+) {
+    for (unsigned int i = 0; i < program->num_patches; i++) {
+        if (program->patches[i].spec.field == field) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int vary_state_init(
+    struct vary_state *const state, const unsigned int batch_size
+) {
+    memset(state, 0, sizeof (*state));
+    state->batch_size = batch_size;
+    state->sums = calloc(2 * (size_t)batch_size, sizeof (*state->sums));
+    return (state->sums == NULL) ? 1 : 0;
+}
+
+// Value of the field (in host byte order, shifted into place).
+static uint32_t read_field(
+    const uint8_t *const field, const struct vary_patch *const patch
+) {
+    uint32_t raw;
+    if (patch->width == 1) {
+        raw = field[0];
+    }
+    else if (patch->width == 2) {
+        uint16_t word;
+        memcpy(&word, field, sizeof (word));
+        raw = ntohs(word);
+    }
+    else {
+        uint32_t dword;
+        memcpy(&dword, field, sizeof (dword));
+        raw = ntohl(dword);
+    }
+    return (raw & patch->mask) >> patch->shift;
+}
+
+// NOTE: `width` is always a constant (see PATCH_LOOPS below), so only
+// one of these branches survives in each specialized loop.
+static ALWAYS_INLINE void write_field(
+    uint8_t *const field, const struct vary_patch *const patch,
+    const unsigned int width, const uint32_t value
+) {
+    const uint32_t bits = (value << patch->shift) & patch->mask;
+
+    if (width == 1) {
+        field[0] = (uint8_t)((field[0] & ~patch->mask) | bits);
+    }
+    else if (width == 2) {
+        uint16_t word;
+        memcpy(&word, field, sizeof (word));
+        word = htons((uint16_t)((ntohs(word) & ~patch->mask) | bits));
+        memcpy(field, &word, sizeof (word));
+    }
+    else {
+        uint32_t dword;
+        memcpy(&dword, field, sizeof (dword));
+        dword = htonl((ntohl(dword) & ~patch->mask) | bits);
+        memcpy(field, &dword, sizeof (dword));
+    }
+}
+
+void vary_state_load(
+    struct vary_state *const state,
+    const struct vary_program *const program,
+    const uint8_t *const headers,
+    const unsigned int thread,
+    const unsigned int num_threads
+) {
+    for (unsigned int i = 0; i < program->num_patches; i++) {
+        const struct vary_patch *const patch = &program->patches[i];
+        const struct vary_spec *const spec = &patch->spec;
+
+        if (spec->generator == VARY_INC) {
+            // Thread n sends the n-th, (n + threads)-th, ... values.
+            state->values[i] = read_field(headers + patch->offset, patch)
+                + thread * spec->step;
+            state->steps[i] = num_threads * spec->step;
+        }
+        else if (spec->generator == VARY_LIST) {
+            state->values[i] = thread % spec->list_length;
+            state->steps[i] = num_threads % spec->list_length;
+        }
+        else if (spec->generator == VARY_THREAD) {
+            state->values[i] = thread;
+            state->steps[i] = 0;
+        }
+    }
+    state->seq = 0;
+}
+
+void vary_state_free(struct vary_state *const state) {
+    free(state->sums);
+    state->sums = NULL;
+}
+
+
+// Writes `value` into the field of the packet at `slot`; if `chksum`,
+// the difference that it made also gets added to the sums of those
+// checksums that the masks of the patch let through.
+static ALWAYS_INLINE void patch_packet(
+    uint8_t *const slot, const struct vary_patch *const patch,
+    const unsigned int width, const bool chksum,
+    const uint32_t value, uint32_t *const sums
+) {
+    if (!chksum) {
+        write_field(slot + patch->offset, patch, width, value);
+        return;
+    }
+
+    const size_t num_words = (width == 4) ? 2 : 1;
+    uint16_t old_words[2], new_words[2];
+    memcpy(old_words, slot + patch->word_offset, 2 * num_words);
+    write_field(slot + patch->offset, patch, width, value);
+    memcpy(new_words, slot + patch->word_offset, 2 * num_words);
+
+    // Eqn. 3 of RFC 1624, spread over every field before folding.
+    uint32_t delta = 0;
+    for (size_t w = 0; w < num_words; w++) {
+        delta += (uint16_t)~old_words[w];
+        delta += new_words[w];
+    }
+    sums[0] += delta & patch->l3_mask;
+    sums[1] += delta & patch->l4_mask;
+}
+
+// Runs one patch over a whole batch; `generator`, `width` and `chksum`
+// are constants in each instance (see PATCH_LOOPS), which leaves the
+// loop itself without any branches to take.
+static ALWAYS_INLINE void patch_loop(
+    const struct vary_patch *const patch,
+    uint32_t *const state_value,
+    const uint32_t step,
+    const struct vary_batch *const batch,
+    const vary_generator_t generator,
+    const unsigned int width,
+    const bool chksum
+) {
+    const struct vary_spec *const spec = &patch->spec;
+    // NOTE: Kept in locals, since the stores to the (byte-addressed)
+    // slots could otherwise alias them and force a reload every time.
+    struct xorshift32 rng = *batch->rng;
+    uint32_t value = *state_value; // Next value (inc) or index (list)
+    const uint32_t span = spec->hi - spec->lo + 1;
+
+    for (unsigned int i = 0; i < batch->count; i++) {
+        uint32_t next;
+        switch (generator) {
+            case VARY_RANDOM: {
+                next = xorshift32_next(&rng);
+                break;
+            }
+            case VARY_INC:
+            case VARY_THREAD: {
+                next = value;
+                value += step;
+                break;
+            }
+            case VARY_LIST: {
+                next = spec->list[value];
+                value += step;
+                value -= (value >= spec->list_length)
+                    ? spec->list_length : 0;
+                break;
+            }
+            case VARY_RANGE: {
+                next = spec->lo + xorshift32_bounded(&rng, span);
+                break;
+            }
+            case VARY_CLOCK_MS:
+            default: {
+                next = batch->now_ms;
+                break;
+            }
+        }
+        patch_packet(batch->slots + i * batch->slot_size, patch,
+            width, chksum, next, &batch->sums[2 * i]);
+    }
+
+    *state_value = value;
+    *batch->rng = rng;
+}
+
+// Every generator, for every field width, with and without checksums.
+#define PATCH_LOOPS_OF(X, width, chksum) \
+    X(random, VARY_RANDOM, width, chksum) \
+    X(inc, VARY_INC, width, chksum) \
+    X(list, VARY_LIST, width, chksum) \
+    X(range, VARY_RANGE, width, chksum) \
+    X(clock, VARY_CLOCK_MS, width, chksum) \
+    X(thread, VARY_THREAD, width, chksum)
+#define PATCH_LOOPS(X) \
+    PATCH_LOOPS_OF(X, 1, false) PATCH_LOOPS_OF(X, 1, true) \
+    PATCH_LOOPS_OF(X, 2, false) PATCH_LOOPS_OF(X, 2, true) \
+    PATCH_LOOPS_OF(X, 4, false) PATCH_LOOPS_OF(X, 4, true)
+
+#define DEFINE_PATCH_LOOP(name, generator, width, chksum) \
+    static void patch_##name##_##width##_##chksum( \
+        const struct vary_patch *const patch, \
+        uint32_t *const state_value, \
+        const uint32_t step, \
+        const struct vary_batch *const batch \
+    ) { \
+        patch_loop(patch, state_value, step, batch, \
+            generator, width, chksum); \
+    }
+PATCH_LOOPS(DEFINE_PATCH_LOOP)
+#undef DEFINE_PATCH_LOOP
+
+static vary_patch_loop_t select_patch_loop(
+    const vary_generator_t generator,
+    const unsigned int width,
+    const bool chksum
+) {
+#define SELECT_PATCH_LOOP(name, gen, w, c) \
+    if (generator == (gen) && width == (w) && chksum == (c)) { \
+        return patch_##name##_##w##_##c; \
+    }
+    PATCH_LOOPS(SELECT_PATCH_LOOP)
+#undef SELECT_PATCH_LOOP
+    return NULL;
+}
+
+
+// Stamps the sequence number and send time (4 words of 32 bits, which
+// are 16-bit aligned like any field) into the test tag of every packet
+// of a batch; the checksum delta spans all of their 16-bit words.
+static ALWAYS_INLINE void stamp_loop(
+    const struct vary_program *const program,
+    uint64_t *const seq,
+    const struct vary_batch *const batch,
+    const bool chksum
+) {
+    uint64_t next = *seq;
+    const uint32_t tx_ns[2] = {
+        htonl((uint32_t)(batch->now_ns >> 32)),
+        htonl((uint32_t)batch->now_ns)
+    };
+
+    for (unsigned int i = 0; i < batch->count; i++) {
+        uint8_t *const stamp = batch->slots + i * batch->slot_size
+            + program->stamp_offset;
+        const uint32_t words[4] = {
+            htonl((uint32_t)(next >> 32)), htonl((uint32_t)next),
+            tx_ns[0], tx_ns[1]
+        };
+        next++;
+
+        if (!chksum) {
+            memcpy(stamp, words, sizeof (words));
+            continue;
+        }
+
+        uint16_t old_words[8], new_words[8];
+        memcpy(old_words, stamp, sizeof (old_words));
+        memcpy(new_words, words, sizeof (new_words));
+        memcpy(stamp, words, sizeof (words));
+
+        // (Eqn. 3 of RFC 1624, as in patch_packet().)
+        uint32_t delta = 0;
+        for (size_t w = 0; w < 8; w++) {
+            delta += (uint16_t)~old_words[w];
+            delta += new_words[w];
+        }
+        batch->sums[2 * i + 1] += delta;
+    }
+
+    *seq = next;
+}
+
+static void stamp_plain(
+    const struct vary_program *const program,
+    uint64_t *const seq,
+    const struct vary_batch *const batch
+) {
+    stamp_loop(program, seq, batch, false);
+}
+
+static void stamp_chksum(
+    const struct vary_program *const program,
+    uint64_t *const seq,
+    const struct vary_batch *const batch
+) {
+    stamp_loop(program, seq, batch, true);
+}
+
+static vary_stamp_loop_t select_stamp_loop(const bool chksum) {
+    return chksum ? stamp_chksum : stamp_plain;
+}
+
+
+static ALWAYS_INLINE void update_chksum(
+    uint8_t *const slot, const size_t offset, const uint32_t sum,
+    const bool udp
+) {
+    uint16_t chksum;
+    memcpy(&chksum, slot + offset, sizeof (chksum));
+    chksum = chksum_fold((uint16_t)~chksum + sum);
+    // Zero would mean "no checksum" to UDP (RFC 768).
+    if (udp && chksum == 0) {
+        chksum = 0xFFFF;
+    }
+    memcpy(slot + offset, &chksum, sizeof (chksum));
+}
+
+// Folds the sums of a batch into its checksums; again, the arguments
+// after `batch` are constants in each instance (see FINISH_LOOPS).
+static ALWAYS_INLINE void finish_loop(
+    const struct vary_program *const program,
+    const struct vary_batch *const batch,
+    const bool l3, const bool l4, const bool udp
+) {
+    for (unsigned int i = 0; i < batch->count && (l3 || l4); i++) {
+        uint8_t *const slot = batch->slots + i * batch->slot_size;
+        if (l3) {
+            update_chksum(slot, program->l3_chksum_offset,
+                batch->sums[2 * i], false);
+        }
+        if (l4) {
+            update_chksum(slot, program->l4_chksum_offset,
+                batch->sums[2 * i + 1], udp);
+        }
+    }
+}
+
+#define FINISH_LOOPS(X) \
+    X(none, false, false, false) \
+    X(l3, true, false, false) \
+    X(l4, false, true, false) \
+    X(l4_udp, false, true, true) \
+    X(both, true, true, false) \
+    X(both_udp, true, true, true)
+
+#define DEFINE_FINISH_LOOP(name, l3, l4, udp) \
+    static void finish_##name( \
+        const struct vary_program *const program, \
+        const struct vary_batch *const batch \
+    ) { \
+        finish_loop(program, batch, l3, l4, udp); \
+    }
+FINISH_LOOPS(DEFINE_FINISH_LOOP)
+#undef DEFINE_FINISH_LOOP
+
+static vary_finish_loop_t select_finish_loop(
+    const bool l3, const bool l4, const bool udp
+) {
+#define SELECT_FINISH_LOOP(name, c3, c4, u) \
+    if (l3 == (c3) && l4 == (c4) && (udp && l4) == (u)) { \
+        return finish_##name; \
+    }
+    FINISH_LOOPS(SELECT_FINISH_LOOP)
+#undef SELECT_FINISH_LOOP
+    return finish_none;
+}
+
+void vary_apply(
+    const struct vary_program *const program,
+    struct vary_state *const state,
+    uint8_t *const slots,
+    const size_t slot_size,
+    const unsigned int count,
+    const uint64_t now_ns,
+    struct xorshift32 *const rng
+) {
+    const struct vary_batch batch = {
+        .slots = slots,
+        .slot_size = slot_size,
+        .count = count,
+        .now_ns = now_ns,
+        .now_ms = (uint32_t)(now_ns / NSEC_PER_MSEC),
+        .rng = rng,
+        .sums = state->sums
+    };
+
+    if (program->covers != 0) {
+        memset(state->sums, 0, 2 * count * sizeof (*state->sums));
+    }
+    for (unsigned int p = 0; p < program->num_patches; p++) {
+        const struct vary_patch *const patch = &program->patches[p];
+        patch->loop(patch, &state->values[p], state->steps[p], &batch);
+    }
+    if (program->stamp != NULL) {
+        program->stamp(program, &state->seq, &batch);
+    }
+    program->finish(program, &batch);
+}
+
+void vary_unstamp(
+    const struct vary_program *const program,
+    struct vary_state *const state,
+    const unsigned int count
+) {
+    if (program->stamp != NULL) {
+        state->seq -= count;
+    }
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: mutate.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,246 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// mutate.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef MUTATE_H
+#define MUTATE_H
+
+
+#include "./utils/intrins.h"
+#include "./utils/random.h"
+#include "./netlib/chksum.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_POSIX_C_SOURCE)
+#   include <arpa/inet.h>
+#endif
+
+#define VARY_MAX_SPECS 16    // Of "--vary" options
+#define VARY_MAX_LIST 16     // Values of a "list:" generator
+// The user's specs plus the implicit ones (see vary_compile()).
+#define VARY_MAX_PATCHES (VARY_MAX_SPECS + 6)
+
+
+// Header fields that "--vary" knows (see FIELD_LAYOUTS in mutate.c).
+typedef enum vary_field {
+    // IPv4
+    VARY_FIELD_TOS = 0,
+    VARY_FIELD_IDENT,
+    VARY_FIELD_TTL,
+    VARY_FIELD_SADDR,
+    VARY_FIELD_DADDR,
+    // IPv6
+    VARY_FIELD_TRAFFIC_CLASS,
+    VARY_FIELD_FLOW_LABEL,
+    VARY_FIELD_HOP_LIMIT,
+    // TCP and UDP
+    VARY_FIELD_SPORT,
+    VARY_FIELD_DPORT,
+    // TCP
+    VARY_FIELD_SEQ,
+    VARY_FIELD_ACK,
+    VARY_FIELD_WINDOW,
+    VARY_FIELD_URG_PTR,
+    VARY_FIELD_TSVAL,  // Internal; for the TCP timestamp option
+    // Test tag
+    VARY_FIELD_TAG_THREAD, // Internal; for "--run-id"
+    NUM_VARY_FIELDS
+} vary_field_t;
+
+// How each packet's value of a field gets generated:
+//  - random: uniformly over the whole field;
+//  - inc: counting up (by "step") from the value in the template;
+//  - list: cycling through a list of values, in order;
+//  - range: uniformly within [lo, hi];
+//  - clock: the time in milliseconds (internal; for TSval); and
+//  - thread: the index of the sending thread (internal; for the test
+//    tag, whose sequence number and send time are too wide for a patch
+//    and get stamped separately; see vary_compile_stamp()).
+typedef enum vary_generator {
+    VARY_RANDOM = 0,
+    VARY_INC,
+    VARY_LIST,
+    VARY_RANGE,
+    VARY_CLOCK_MS,
+    VARY_THREAD
+} vary_generator_t;
+
+// A "--vary" option as parsed; it only becomes a patch (with actual
+// offsets) once the layout of the template is known.
+typedef struct vary_spec {
+    vary_field_t field;
+    vary_generator_t generator;
+    uint32_t step;        // inc
+    uint32_t lo, hi;      // range
+    unsigned int list_length;
+    uint32_t list[VARY_MAX_LIST];
+} vary_spec_t;
+
+// Where the fields (and the checksums covering them) are in a template.
+typedef struct vary_layout {
+    bool ipv6;
+    bool udp;
+    size_t l3_offset;        // Behind the outer headers of a tunnel
+    size_t l4_offset;
+    size_t l3_chksum_offset; // 0: none (IPv6) or overridden
+    size_t l4_chksum_offset; // 0: overridden
+    size_t tsval_offset;     // 0: no TCP timestamp option
+    size_t tag_offset;       // 0: no test tag
+} vary_layout_t;
+
+#define VARY_COVERS_L3 (1U << 0) // Covered by the IPv4 header checksum
+#define VARY_COVERS_L4 (1U << 1) // Covered by the TCP/UDP checksum
+
+// The packets (i.e., their header slots) of one batch being patched.
+typedef struct vary_batch {
+    uint8_t *slots;
+    size_t slot_size;
+    unsigned int count;
+    uint64_t now_ns;
+    uint32_t now_ms;
+    struct xorshift32 *rng;
+    uint32_t *sums;         // L3 and L4 checksum deltas of each packet
+} vary_batch_t;
+
+struct vary_patch;
+struct vary_program;
+typedef void (*vary_patch_loop_t)(
+    const struct vary_patch *const patch,
+    uint32_t *const state_value,
+    const uint32_t step,
+    const struct vary_batch *const batch
+);
+typedef void (*vary_stamp_loop_t)(
+    const struct vary_program *const program,
+    uint64_t *const seq,
+    const struct vary_batch *const batch
+);
+typedef void (*vary_finish_loop_t)(
+    const struct vary_program *const program,
+    const struct vary_batch *const batch
+);
+
+// NOTE: Deciding, per packet, which fields to vary (and how) would put
+// a branch for every field into the sending loop; instead, the specs
+// get compiled into this table once, and the sender just runs through
+// it for a whole batch at a time.  Every patch also points to a loop
+// that is specialized for its generator, field width, and checksums
+// (see PATCH_LOOPS in mutate.c), so that the loop has no branches.
+//
+// All fields are in network byte order and at most 32 bits wide, but
+// not all of them are 16-bit aligned (e.g., the TOS at offset 1, or the
+// hop limit at 7); whatever its offset, each patch reads the aligned
+// 16-bit word(s) that its field lies within (from `word_offset` on)
+// before and after writing it, which is all that an incremental
+// checksum update needs.
+typedef struct vary_patch {
+    vary_patch_loop_t loop;
+    uint16_t offset;       // Of the field, within the headers
+    uint16_t word_offset;  // Of the 16-bit word(s) that it lies within
+    uint8_t width;         // In bytes (1, 2, or 4)
+    uint8_t shift;         // Of the value, within the field
+    uint8_t covers;        // VARY_COVERS_* flags (of live checksums)
+    uint32_t mask;         // Of the value, within the field
+    uint32_t max;          // Of the value itself (i.e., mask >> shift)
+    uint32_t l3_mask;      // All ones if it covers L3; zero otherwise
+    uint32_t l4_mask;      // Likewise for L4
+    struct vary_spec spec;
+} vary_patch_t;
+
+typedef struct vary_program {
+    unsigned int num_patches;
+    struct vary_patch patches[VARY_MAX_PATCHES];
+    vary_stamp_loop_t stamp;   // NULL: no test tag to stamp
+    size_t stamp_offset;       // Of the sequence number in the test tag
+    vary_finish_loop_t finish; // Folds the deltas into the checksums
+    uint8_t covers;          // Union of those of all patches
+    bool udp;                // A zero UDP checksum must be sent as ~0
+    size_t l3_chksum_offset;
+    size_t l4_chksum_offset;
+} vary_program_t;
+
+// Per-thread progress through a program (inc and list), which threads
+// interleave so that they do not all send the same sequence (whereas
+// the test tag tells the threads apart by itself).
+typedef struct vary_state {
+    uint32_t values[VARY_MAX_PATCHES]; // Next value (inc) or index (list)
+    uint32_t steps[VARY_MAX_PATCHES];
+    uint64_t seq;                      // Next one of the test tag
+    uint32_t *sums;                    // 2 per packet of a batch
+    unsigned int batch_size;
+} vary_state_t;
+
+// Largest value of the field (e.g., for validating the parsed specs).
+uint32_t vary_field_max(const vary_field_t field);
+
+void vary_program_init(
+    struct vary_program *const program,
+    const struct vary_layout *const layout
+);
+// Appends a patch for `spec`; fails if the field is not part of the
+// template (e.g., a TCP field on UDP packets).
+int vary_compile(
+    struct vary_program *const program,
+    const struct vary_spec *const spec,
+    const struct vary_layout *const layout
+);
+// Makes the program stamp every packet's test tag (see payload.h) with
+// the packet's sequence number (counting per thread) and send time.
+void vary_compile_stamp(
+    struct vary_program *const program,
+    const struct vary_layout *const layout
+);
+// Whether a patch already varies `field` (i.e., the user asked for it).
+bool vary_has_field(
+    const struct vary_program *const program, const vary_field_t field
+);
+
+int vary_state_init(
+    struct vary_state *const state, const unsigned int batch_size
+);
+// Starts a program over; `headers` are those of the template, and
+// `thread` is one of `num_threads` (at least one, even for the main
+// thread) that interleave their values.
+void vary_state_load(
+    struct vary_state *const state,
+    const struct vary_program *const program,
+    const uint8_t *const headers,
+    const unsigned int thread,
+    const unsigned int num_threads
+);
+void vary_state_free(struct vary_state *const state);
+
+// Patches the headers (and checksums) of `count` packets, `slot_size`
+// bytes apart, at `slots`, which get sent at (around) `now_ns`.
+void vary_apply(
+    const struct vary_program *const program,
+    struct vary_state *const state,
+    uint8_t *const slots,
+    const size_t slot_size,
+    const unsigned int count,
+    const uint64_t now_ns,
+    struct xorshift32 *const rng
+);
+// Takes back the sequence numbers that vary_apply() stamped into the
+// last `count` packets of its batch, which did not get sent after all
+// (so that the receiver sees no gap for them).
+void vary_unstamp(
+    const struct vary_program *const program,
+    struct vary_state *const state,
+    const unsigned int count
+);
+
+
+#endif // MUTATE_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: mutate.h
+// ---------------------------------------------------------------------
@@ -8,7 +8,69 @@ _Pragma ("once")
 #define ARPA_H
 
 
+// NOTE: Like <arpa/inet.h>, but for the link-layer addresses that
+// POSIX has no notion of (ether_aton() is a BSD/glibc extension.)
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
+#include "./protos/eth.h"
+
+
+#define ETH_ADDR_STRLEN 18 // "xx:xx:xx:xx:xx:xx" plus a null
+
+
+static inline int eth_hex_digit(const char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Parses six colon- (or hyphen-) separated hexadecimal octets (e.g.,
+// "02:00:5e:10:00:01"), each one or two digits long; returns false if
+// `str` is anything else.
+static inline bool eth_pton(const char *str, eth_addr_t *const addr) {
+    for (size_t i = 0; i < ETH_ADDR_LENGTH; i++) {
+        const int high = eth_hex_digit(*str++);
+        if (high < 0) {
+            return false;
+        }
+        const int low = eth_hex_digit(*str);
+        if (low >= 0) {
+            str++;
+        }
+        addr->octets[i] =
+            (uint8_t)((low >= 0) ? (high << 4 | low) : high);
+
+        const char separator = *str++;
+        if (i + 1 < ETH_ADDR_LENGTH
+            ? (separator != ':' && separator != '-')
+            : separator != '\0'
+        ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Formats `addr` as "xx:xx:xx:xx:xx:xx" into `str`.
+static inline void eth_ntop(
+    const eth_addr_t *const addr, char str[ETH_ADDR_STRLEN]
+) {
+    static const char DIGITS[] = "0123456789abcdef";
+    for (size_t i = 0; i < ETH_ADDR_LENGTH; i++) {
+        str[3 * i] = DIGITS[addr->octets[i] >> 4];
+        str[3 * i + 1] = DIGITS[addr->octets[i] & 0x0F];
+        str[3 * i + 2] = (i + 1 < ETH_ADDR_LENGTH) ? ':' : '\0';
+    }
+}
 
 
 #endif // ARPA_H
@@ -0,0 +1,87 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// chksum.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef CHKSUM_H
+#define CHKSUM_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// NOTE: The Internet checksum (RFC 1071) is a ones' complement sum of
+// 16-bit words, which makes it "byte-order independent:" summing the
+// network-order words as if they were native integers (and storing
+// the result without swapping) yields the correct on-wire checksum
+// on both little- and big-endian machines.  For that reason, none of
+// the functions herein call htons() or ntohs().
+
+
+// Add `len` bytes at `data` to a running 32-bit (unfolded) sum.
+static inline uint32_t chksum_add(
+    uint32_t sum, const void *const data, size_t len
+) {
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    while (len > 1) {
+        uint16_t word;
+        memcpy(&word, bytes, sizeof (word)); // Alignment-safe load
+        sum += word;
+        bytes += 2;
+        len -= 2;
+    }
+    // An odd trailing byte is padded with a zero byte (RFC 1071).
+    if (len == 1) {
+        uint16_t word = 0;
+        memcpy(&word, bytes, 1);
+        sum += word;
+    }
+
+    return sum;
+}
+
+// Fold the carries of a 32-bit sum back into 16 bits and complement.
+static inline uint16_t chksum_fold(uint32_t sum) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+static inline uint16_t inet_chksum(const void *const data, size_t len) {
+    return chksum_fold(chksum_add(0, data, len));
+}
+
+// Incremental update of a checksum after a 16-bit field changed from
+// `old_word` to `new_word`; this is eqn. 3 of RFC 1624, which (unlike
+// RFC 1141) never produces a spurious 0xFFFF (-0) result.
+static inline uint16_t chksum_update16(
+    const uint16_t chksum, const uint16_t old_word, const uint16_t new_word
+) {
+    uint32_t sum = (uint16_t)~chksum;
+    sum += (uint16_t)~old_word;
+    sum += new_word;
+    return chksum_fold(sum);
+}
+
+// Same as above, but for a (32-bit) field such as an IPv4 address.
+static inline uint16_t chksum_update32(
+    const uint16_t chksum, const uint32_t old_dword, const uint32_t new_dword
+) {
+    uint32_t sum = (uint16_t)~chksum;
+    sum += (uint16_t)~(old_dword & 0xFFFF);
+    sum += (uint16_t)~(old_dword >> 16);
+    sum += new_dword & 0xFFFF;
+    sum += new_dword >> 16;
+    return chksum_fold(sum);
+}
+
+
+#endif // CHKSUM_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: chksum.h
+// ---------------------------------------------------------------------
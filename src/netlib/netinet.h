@@ -78,8 +78,14 @@ _Pragma ("once")
 
 
 /* Protocol Definitions */
+#include "./protos/eth.h"
 #include "./protos/ip.h"
+#include "./protos/ip6.h"
 #include "./protos/tcp.h"
+#include "./protos/udp.h"
+#include "./protos/icmp.h"
+#include "./protos/twamp.h"
+#include "./protos/tunnel.h"
 
 typedef enum osi_layer {
     LAYER_2,
@@ -88,6 +94,9 @@ typedef enum osi_layer {
 } osi_layer_t;
 
 typedef enum osi_protocol {
+    // Layer 2 (Data Link)
+    PROTO_L2_NONE, // Sent through an IP (layer 3) socket
+    PROTO_L2_ETH,
     // Layer 3 (Network)
     PROTO_L3_RAW,
     PROTO_L3_IPV4,
@@ -0,0 +1,78 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// eth.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef ETH_H
+#define ETH_H
+
+
+#define ETH_ADDR_LENGTH 6
+#define ETH_MAX_VLANS 2 // An 802.1ad (QinQ) S-tag and an 802.1Q C-tag
+#define ETH_VLAN_ID_MAX 4095
+#define ETH_VLAN_PCP_MAX 7
+#define ETH_VLAN_PCP_SHIFT 13
+
+// EtherTypes (IEEE 802 Numbers); only those that we craft.
+_Pragma ("pack(push)")
+typedef enum __attribute__((packed)) eth_type {
+    ETH_TYPE_IPV4 = 0x0800, // Internet Protocol version 4
+    ETH_TYPE_VLAN = 0x8100, // 802.1Q customer VLAN tag (C-tag)
+    ETH_TYPE_IPV6 = 0x86DD, // Internet Protocol version 6
+    ETH_TYPE_QINQ = 0x88A8  // 802.1ad service VLAN tag (S-tag)
+} eth_type_t;
+_Pragma ("pack(pop)")
+
+typedef struct eth_addr {
+    uint8_t octets[ETH_ADDR_LENGTH];
+} eth_addr_t;
+
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                      Destination Address                      |
+//   +                               +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                               |                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+                               +
+//   |                         Source Address                        |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |           EtherType           |                               :
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+                               :
+//   :                     Payload (46-1500 bytes)                   :
+//   :                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//
+// NOTE: The frame check sequence (FCS) is appended by the NIC.
+typedef struct eth_hdr {
+    eth_addr_t           daddr;        // Destination MAC address
+    eth_addr_t           saddr;        // Source MAC address
+    uint16_t             type;         // EtherType (or that of a tag)
+} eth_hdr_t;
+_Static_assert(sizeof (eth_hdr_t) == 14,
+            "An eth_hdr struct should only be 14 bytes!");
+
+// A VLAN tag sits between the source address and the EtherType; its
+// TPID takes the place of the latter (and thus "announces" the tag.)
+//
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |  Tag Protocol ID (EtherType)  | PCP |D|         VLAN ID       |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+typedef struct eth_vlan_tag {
+    uint16_t             tpid;         // 0x8100 (C-tag) or 0x88A8
+    uint16_t             tci;          // Priority, drop-eligible, ID
+} eth_vlan_tag_t;
+_Static_assert(sizeof (eth_vlan_tag_t) == 4,
+            "An eth_vlan_tag struct should only be 4 bytes!");
+
+#define ETH_MAX_HEADER_LENGTH \
+    (sizeof (eth_hdr_t) + ETH_MAX_VLANS * sizeof (eth_vlan_tag_t))
+
+
+#endif // ETH_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: eth.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,49 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// icmp.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef ICMP_H
+#define ICMP_H
+
+
+// ICMP (RFC 792) and ICMPv6 (RFC 4443) message types; only the echo
+// messages are of any use here.
+_Pragma ("pack(push)")
+typedef enum __attribute__((packed)) icmp_type {
+    ICMP_ECHO_REPLY    = 0,
+    ICMP_ECHO_REQUEST  = 8,
+    ICMP6_ECHO_REQUEST = 128,
+    ICMP6_ECHO_REPLY   = 129
+} icmp_type_t;
+_Pragma ("pack(pop)")
+
+// Echo (reply) message; the rest of the ICMP types have other fields
+// in place of the identifier and sequence number.
+//
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |     Type      |     Code      |          Checksum             |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |           Identifier          |        Sequence Number        |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |     Data ...
+//   +-+-+-+-+-
+typedef struct icmp_hdr {
+    uint8_t              type;         // Message type (icmp_type_t)
+    uint8_t              code;         // Subtype (0 for echo)
+    uint16_t             chksum;       // Over the whole ICMP message
+    uint16_t             id;           // Identifier (of the pinger)
+    uint16_t             seq;          // Sequence number
+} icmp_hdr_t;
+_Static_assert(sizeof (icmp_hdr_t) == 8,
+            "An icmp_hdr struct should only be 8 bytes!");
+
+
+#endif // ICMP_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: icmp.h
+// ---------------------------------------------------------------------
@@ -20,8 +20,12 @@ _Pragma ("pack(push)")
 typedef enum __attribute__((packed)) ip_proto {
     IP_PROTO_IP   = 0,
     IP_PROTO_ICMP = 1,
+    IP_PROTO_IPIP = 4,  // IPv4 in IP (RFC 2003)
     IP_PROTO_TCP  = 6,
     IP_PROTO_UDP  = 17,
+    IP_PROTO_IPV6 = 41, // IPv6 in IP (RFC 4213)
+    IP_PROTO_GRE  = 47,
+    IP_PROTO_ICMPV6 = 58, // ICMP for IPv6 (RFC 4443)
 } ip_proto_t;
 _Pragma ("pack(pop)")
 
@@ -232,10 +236,37 @@ struct {
     ip_addr_t               daddr;          // Destination Address
     uint32_t                options[];      // IP Options (0-320 bits)
 } ip_hdr_t;
-// TODO: Make a struct for IP options
 _Static_assert(sizeof (ip_hdr_t) == 20,
             "An empty ip_hdr struct should only be 20 bytes!");
 
+// IP options definitions (the "copied" flag, class, and number bits of
+// the type octet all together)
+// iana.org/assignments/ip-parameters/ip-parameters.xhtml
+_Pragma ("pack(push)")
+typedef enum __attribute__((packed)) ip_option_kind {
+    // RFC 791
+    IP_OPT_KIND_EOL             = 0,   // End of Options List
+    IP_OPT_KIND_NOP             = 1,   // No Operation
+    IP_OPT_KIND_RR              = 7,   // Record Route
+    IP_OPT_KIND_TS              = 68,  // Internet Timestamp
+    // RFC 2113
+    IP_OPT_KIND_RA              = 148, // Router Alert
+} ip_option_kind_t;
+_Pragma ("pack(pop)")
+
+// Route records and timestamps are followed by room for as many 32-bit
+// slots as the sender reserves (for routers to fill in); the pointer
+// (1-based, like the option itself) leads to the first free slot.
+#define IP_OPT_LEN_RR_BASE      3
+#define IP_OPT_LEN_TS_BASE      4
+#define IP_OPT_LEN_RA           4
+#define IP_OPT_RR_POINTER       4
+#define IP_OPT_TS_POINTER       5
+#define IP_OPT_TS_FLAG_TSONLY   0 // Timestamps only (without addresses)
+// The 4-bit IHL allows for at most 60 - 20 bytes of options.
+#define IP_MAX_OPTIONS_LENGTH   40
+#define IP_OPT_MAX_SLOTS        9 // That fit into the above
+
 
 
 #endif // IP_H
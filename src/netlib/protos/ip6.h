@@ -8,7 +8,87 @@ _Pragma ("once")
 #define IP6_H
 
 
+typedef union ip6_addr_view {
+    uint8_t octets[16]; // Sixteen octets (bytes), in network order
+    uint16_t words[8];  // Eight 16-bit groups (e.g., for checksums)
+    uint32_t dwords[4];
+} ip6_addr_t;
 
+// Next-header values of the extension headers (RFC 8200)
+_Pragma ("pack(push)")
+typedef enum __attribute__((packed)) ip6_ext_kind {
+    IP6_EXT_HOP_BY_HOP = 0,  // Hop-by-Hop Options
+    IP6_EXT_ROUTING    = 43, // Routing
+    IP6_EXT_FRAGMENT   = 44, // Fragment
+    IP6_EXT_NO_NEXT    = 59, // No Next Header
+    IP6_EXT_DEST_OPTS  = 60, // Destination Options
+} ip6_ext_kind_t;
+_Pragma ("pack(pop)")
+
+// NOTE: The 4-bit version, 8-bit traffic class, and 20-bit flow label
+// straddle byte boundaries, which bitfields cannot portably express;
+// they are kept as a single (host-order, until crafted) word instead.
+#define IP6_VERSION_SHIFT 28
+#define IP6_TCLASS_SHIFT 20
+#define IP6_TCLASS_MASK (0xFFu << IP6_TCLASS_SHIFT)
+#define IP6_FLOW_LABEL_MAX 0xFFFFFu
+#define IP6_FLOW_LABEL_MASK IP6_FLOW_LABEL_MAX
+
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |Version| Traffic Class |              Flow Label               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |         Payload Length        |  Next Header  |   Hop Limit   |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                                                               |
+//   +                                                               +
+//   |                                                               |
+//   +                         Source Address                        +
+//   |                                                               |
+//   +                                                               +
+//   |                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                                                               |
+//   +                                                               +
+//   |                                                               |
+//   +                      Destination Address                      +
+//   |                                                               |
+//   +                                                               +
+//   |                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+typedef struct ip6_hdr {
+    uint32_t             ver_tc_flow;  // Version, class, and flow label
+    uint16_t             len;          // Payload (and ext. hdr.) length
+    uint8_t              next_hdr;     // Akin to IPv4's protocol
+    uint8_t              hop_limit;    // Akin to IPv4's time-to-live
+    ip6_addr_t           saddr;        // Source address
+    ip6_addr_t           daddr;        // Destination address
+} ip6_hdr_t;
+_Static_assert(sizeof (ip6_hdr_t) == 40,
+            "An ip6_hdr struct should only be 40 bytes!");
+
+// Hop-by-Hop and Destination Options share this format; with a single
+// PadN option filling it up, it is the smallest (8-byte) such header.
+typedef struct ip6_opts_hdr {
+    uint8_t              next_hdr;     // Type of the following header
+    uint8_t              len;          // In 8-byte units, minus the 1st
+    uint8_t              options[6];   // (Padding) options
+} ip6_opts_hdr_t;
+_Static_assert(sizeof (ip6_opts_hdr_t) == 8,
+            "A minimal ip6_opts_hdr struct should be 8 bytes!");
+
+typedef struct ip6_frag_hdr {
+    uint8_t              next_hdr;     // Type of the following header
+    uint8_t              reserved;     // Zero
+    uint16_t             fragofs_m;    // Offset (13 bits), 00, M flag
+    uint32_t             id;           // Identification
+} ip6_frag_hdr_t;
+_Static_assert(sizeof (ip6_frag_hdr_t) == 8,
+            "An ip6_frag_hdr struct should be 8 bytes!");
+
+#define IP6_OPT_PAD1 0 // A single byte of padding
+#define IP6_OPT_PADN 1 // N (i.e., 2 + its data length) bytes of padding
 
 
 #endif // IP6_H
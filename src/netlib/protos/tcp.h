@@ -117,6 +117,15 @@ typedef enum __attribute__((packed)) tcp_option_kind {
 } tcp_option_kind_t;
 _Pragma ("pack(pop)")
 
+// Total lengths (kind and length bytes included) of the options that
+// the "--options" compiler knows; EOL and NOP are a single byte.
+#define TCP_OPT_LEN_MSS         4
+#define TCP_OPT_LEN_WS          3
+#define TCP_OPT_LEN_SACK_PERM   2
+#define TCP_OPT_LEN_TIMESTAMP   10
+// The 4-bit data offset allows for at most 60 - 20 bytes of options.
+#define TCP_MAX_OPTIONS_LENGTH  40
+
 //    0                   1                   2                   3
 //    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
 //   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
@@ -156,7 +165,6 @@ typedef struct tcp_hdr {
     uint16_t             urgptr;       // Pointer to urgent data
     uint32_t             options[];    // TCP Options (0-320 bits)
 } tcp_hdr_t;
-// TODO: Make options a struct
 _Static_assert(sizeof (tcp_hdr_t) == 20,
             "An empty tcp_hdr struct should only be 20 bytes!");
 
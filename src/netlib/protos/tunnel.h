@@ -0,0 +1,62 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// tunnel.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef TUNNEL_H
+#define TUNNEL_H
+
+
+// Encapsulations that an (outer) IPv4 header can carry packets in.
+typedef enum tunnel_kind {
+    TUNNEL_NONE = 0,
+    TUNNEL_IPIP,  // IP-in-IP (RFC 2003) or 6in4 (RFC 4213)
+    TUNNEL_GRE,   // Generic Routing Encapsulation (RFC 2784)
+    TUNNEL_VXLAN  // Virtual eXtensible LAN, over UDP (RFC 7348)
+} tunnel_kind_t;
+
+#define GRE_FLAG_KEY 0x2000 // Key present (RFC 2890)
+#define GRE_KEY_LENGTH 4
+
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |C| |K|S| Reserved0       | Ver |         Protocol Type         |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   :                         [Key (RFC 2890)]                      :
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+typedef struct gre_hdr {
+    uint16_t             flags_ver;    // Flags and version (0)
+    uint16_t             proto;        // EtherType of the payload
+} gre_hdr_t;
+_Static_assert(sizeof (gre_hdr_t) == 4,
+            "A gre_hdr struct should only be 4 bytes!");
+
+#define VXLAN_PORT 4789 // IANA-assigned UDP destination port
+#define VXLAN_FLAG_VNI 0x08000000 // The "I" flag (a valid VNI)
+#define VXLAN_VNI_MAX 0xFFFFFFu
+#define VXLAN_VNI_SHIFT 8
+
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |R|R|R|R|I|R|R|R|                   Reserved                    |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |         VXLAN Network Identifier (VNI)        |   Reserved    |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//
+// NOTE: What follows is a whole (inner) Ethernet frame, sans FCS.
+typedef struct vxlan_hdr {
+    uint32_t             flags;        // Flags and reserved bits
+    uint32_t             vni;          // VNI and reserved bits
+} vxlan_hdr_t;
+_Static_assert(sizeof (vxlan_hdr_t) == 8,
+            "A vxlan_hdr struct should only be 8 bytes!");
+
+
+#endif // TUNNEL_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: tunnel.h
+// ---------------------------------------------------------------------
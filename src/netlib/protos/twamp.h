@@ -0,0 +1,85 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// twamp.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef TWAMP_H
+#define TWAMP_H
+
+
+// TWAMP-light (RFC 5357, Appendix I) test packets, in unauthenticated
+// mode; they go over UDP, to port 862 unless agreed otherwise.
+#define TWAMP_PORT 862
+
+// NOTE: The timestamps are only 4-byte aligned and the packets end at
+// odd offsets, so they are laid out as byte offsets rather than as
+// (packed) structs.  Timestamps are NTP's: seconds since 1900 and
+// a 32-bit binary fraction thereof, in network byte order.
+//
+// Session-Sender test packet:
+//
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                        Sequence Number                        |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                          Timestamp                            |
+//   |                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |        Error Estimate         |                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+                               |
+//   :                         Packet Padding                        :
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+#define TWAMP_SEQ              0
+#define TWAMP_TIMESTAMP        4
+#define TWAMP_ERROR_ESTIMATE   12
+#define TWAMP_TEST_SIZE        14 // Without the padding
+
+// Session-Reflector test packet:
+//
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                        Sequence Number                        |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                          Timestamp                            |
+//   |                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |        Error Estimate         |              MBZ              |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                       Receive Timestamp                       |
+//   |                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                    Sender Sequence Number                     |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                       Sender Timestamp                        |
+//   |                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |     Sender Error Estimate     |              MBZ              |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |  Sender TTL   |                                               |
+//   +-+-+-+-+-+-+-+-+                                               |
+//   :                         Packet Padding                        :
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+#define TWAMP_RECEIVE_TIMESTAMP       16
+#define TWAMP_SENDER_SEQ              24
+#define TWAMP_SENDER_TIMESTAMP        28
+#define TWAMP_SENDER_ERROR_ESTIMATE   36
+#define TWAMP_SENDER_TTL              40
+#define TWAMP_REFLECTED_SIZE          41 // Without the padding
+
+// Error Estimate: S(ynchronized), Z(ero), Scale (6 bits) and Multiplier
+// (8 bits); the error is Multiplier * 2^(Scale - 32) seconds.
+#define TWAMP_ERROR_SYNC        0x8000
+#define TWAMP_ERROR_SCALE_SHIFT 8
+
+// Seconds from the NTP epoch (1900) to the Unix one (1970)
+#define TWAMP_NTP_OFFSET 2208988800ULL
+
+
+#endif // TWAMP_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: twamp.h
+// ---------------------------------------------------------------------
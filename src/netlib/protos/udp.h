@@ -8,7 +8,25 @@ _Pragma ("once")
 #define UDP_H
 
 
-
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |          Source Port          |       Destination Port        |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |            Length             |           Checksum            |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                                                               :
+//   :                             Data                              :
+//   :                                                               |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+typedef struct udp_hdr {
+    uint16_t             sport;        // Source port number
+    uint16_t             dport;        // Destination port number
+    uint16_t             len;          // Length of header plus data
+    uint16_t             chksum;       // Checksum (0: none, over IPv4)
+} udp_hdr_t;
+_Static_assert(sizeof (udp_hdr_t) == 8,
+            "A udp_hdr struct should only be 8 bytes!");
 
 
 #endif // UDP_H
@@ -0,0 +1,275 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// pacing.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "pacing.h"
+
+
+void sleep_until_ns(const uint64_t deadline_ns) {
+    const uint64_t now_ns = clock_now_ns();
+    if (now_ns >= deadline_ns) {
+        return;
+    }
+
+    // The deadline is on our (calibrated) clock, which may have drifted
+    // from the kernel's by now; the remaining time is what counts.
+    struct timespec kernel_now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &kernel_now);
+    const uint64_t target_ns = (uint64_t)kernel_now.tv_sec * NSEC_PER_SEC
+        + (uint64_t)kernel_now.tv_nsec + (deadline_ns - now_ns);
+    const struct timespec deadline = {
+        .tv_sec = (time_t)(target_ns / NSEC_PER_SEC),
+        .tv_nsec = (long)(target_ns % NSEC_PER_SEC)
+    };
+
+    // An absolute deadline (unlike a relative nanosleep()) does not
+    // drift if we get interrupted by a signal and have to retry.
+    while (clock_nanosleep(
+        CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR
+    ) {
+        continue;
+    }
+}
+
+void wait_until_ns(const uint64_t deadline_ns, const uint64_t spin_ns) {
+    const uint64_t now_ns = clock_now_ns();
+    if (now_ns >= deadline_ns) {
+        return;
+    }
+
+    if (deadline_ns - now_ns > spin_ns) {
+        sleep_until_ns(deadline_ns - spin_ns);
+    }
+    while (clock_now_ns() < deadline_ns) {
+        CPU_RELAX();
+    }
+}
+
+// NOTE: How late clock_nanosleep() wakes us up depends on the kernel
+// (timer slack, HZ, PREEMPT_RT), the virtualization layer, and the
+// load of the machine, so it is measured rather than assumed; the
+// spinning window then gets some headroom above the worst wake-up.
+static uint64_t calibrate_spin_ns(void) {
+    uint64_t worst_ns = 0;
+
+    for (int i = 0; i < PACER_CALIBRATION_ROUNDS; i++) {
+        const uint64_t target_ns = clock_now_ns() + 20 * NSEC_PER_USEC;
+        sleep_until_ns(target_ns);
+
+        const uint64_t late_ns = clock_now_ns() - target_ns;
+        if (late_ns > worst_ns) {
+            worst_ns = late_ns;
+        }
+    }
+
+    const uint64_t spin_ns = 2 * worst_ns;
+    if (spin_ns < PACER_MIN_SPIN_NS) {
+        return PACER_MIN_SPIN_NS;
+    }
+    return (spin_ns > PACER_MAX_SPIN_NS) ? PACER_MAX_SPIN_NS : spin_ns;
+}
+
+// Number of packets whose deadline lies at or before `elapsed_ns`.
+//
+// NOTE: The whole intervals and the remainder are multiplied
+// separately, so that "elapsed * amount" cannot overflow 64 bits on
+// long runs.
+static uint64_t packets_due(
+    const struct pacer *const pacer, const uint64_t elapsed_ns
+) {
+    const uint64_t intervals = elapsed_ns / pacer->interval_ns;
+    const uint64_t rem = elapsed_ns % pacer->interval_ns;
+
+    if (pacer->shape == SHAPE_BURST) {
+        return (intervals + 1) * pacer->amount;
+    }
+    return intervals * pacer->amount
+        + (rem * pacer->amount) / pacer->interval_ns + 1;
+}
+
+// Deadline (relative to the start) of the packet at `index`.
+static uint64_t packet_deadline(
+    const struct pacer *const pacer, const uint64_t index
+) {
+    const uint64_t intervals = index / pacer->amount;
+    const uint64_t rem = index % pacer->amount;
+
+    if (pacer->shape == SHAPE_BURST) {
+        return intervals * pacer->interval_ns;
+    }
+    return intervals * pacer->interval_ns
+        + (rem * pacer->interval_ns + pacer->amount - 1) / pacer->amount;
+}
+
+// Inverse transform sampling of the exponential distribution.
+static double exponential_gap(struct pacer *const pacer) {
+    // In (0, 1]; zero would make the logarithm blow up.
+    const double uniform =
+        ((double)xorshift32_next(&pacer->rng) + 1.0) / 4294967296.0;
+    return -log(uniform) * pacer->mean_gap;
+}
+
+static unsigned int poisson_acquire(
+    struct pacer *const pacer, const unsigned int max
+) {
+    const double elapsed_ns = (double)(clock_now_ns() - pacer->start_ns);
+
+    while (pacer->arrived - pacer->sent < max
+        && pacer->next_arrival <= elapsed_ns
+    ) {
+        pacer->arrived++;
+        pacer->next_arrival += exponential_gap(pacer);
+    }
+
+    if (pacer->arrived == pacer->sent) {
+        wait_until_ns(pacer->start_ns + (uint64_t)pacer->next_arrival,
+            pacer->spin_ns);
+        pacer->arrived++;
+        pacer->next_arrival += exponential_gap(pacer);
+    }
+
+    return (unsigned int)(pacer->arrived - pacer->sent);
+}
+
+void pacer_start(
+    struct pacer *const pacer,
+    const traffic_shape_t shape,
+    const uint64_t amount,
+    const uint64_t interval_ns
+) {
+    *pacer = (struct pacer){
+        .shape = shape,
+        .amount = amount,
+        .interval_ns = (interval_ns > 0) ? interval_ns : NSEC_PER_SEC
+    };
+
+    if (amount > 0) {
+        pacer->spin_ns = calibrate_spin_ns();
+        pacer->mean_gap = (double)pacer->interval_ns / (double)amount;
+    }
+
+    pacer->start_ns = clock_now_ns();
+    xorshift32_seed(&pacer->rng,
+        (uint32_t)pacer->start_ns ^ (uint32_t)(uintptr_t)pacer);
+}
+
+unsigned int pacer_acquire(
+    struct pacer *const pacer, const unsigned int max
+) {
+    if (pacer->amount == 0) {
+        return max;
+    }
+    if (pacer->shape == SHAPE_POISSON) {
+        return poisson_acquire(pacer, max);
+    }
+
+    uint64_t due = packets_due(pacer, clock_now_ns() - pacer->start_ns);
+
+    if (due <= pacer->sent) {
+        const uint64_t deadline_ns = packet_deadline(pacer, pacer->sent);
+        wait_until_ns(pacer->start_ns + deadline_ns, pacer->spin_ns);
+        due = packets_due(pacer, deadline_ns);
+    }
+
+    const uint64_t count = due - pacer->sent;
+    return (count < max) ? (unsigned int)count : max;
+}
+
+unsigned int pacer_schedule(
+    struct pacer *const pacer, const unsigned int max,
+    const uint64_t lead_ns, uint64_t *const launch_ns
+) {
+    for (;;) {
+        const uint64_t now_ns = clock_now_ns();
+        const uint64_t horizon_ns = now_ns - pacer->start_ns + lead_ns;
+        // Packets that are already late still get some slack, or else
+        // the qdisc would drop them for having missed their time.
+        const uint64_t earliest_ns = now_ns + lead_ns / 2;
+        unsigned int count = 0;
+        uint64_t next_ns;
+
+        if (pacer->amount == 0) {
+            for (; count < max; count++) {
+                launch_ns[count] = earliest_ns;
+            }
+            return count;
+        }
+        else if (pacer->shape == SHAPE_POISSON) {
+            // Arrivals that were drawn for packets that did not get
+            // sent (e.g., with a full socket buffer) are skipped.
+            pacer->arrived = pacer->sent;
+            while (count < max && pacer->next_arrival <= horizon_ns) {
+                launch_ns[count++] =
+                    pacer->start_ns + (uint64_t)pacer->next_arrival;
+                pacer->arrived++;
+                pacer->next_arrival += exponential_gap(pacer);
+            }
+            next_ns = (uint64_t)pacer->next_arrival;
+        }
+        else {
+            for (; count < max; count++) {
+                const uint64_t deadline_ns =
+                    packet_deadline(pacer, pacer->sent + count);
+                if (deadline_ns > horizon_ns) {
+                    break;
+                }
+                launch_ns[count] = pacer->start_ns + deadline_ns;
+            }
+            next_ns = packet_deadline(pacer, pacer->sent);
+        }
+
+        if (count > 0) {
+            for (unsigned int i = 0; i < count; i++) {
+                if (launch_ns[i] < earliest_ns) {
+                    launch_ns[i] = earliest_ns;
+                }
+            }
+            return count;
+        }
+
+        wait_until_ns(pacer->start_ns + next_ns - lead_ns,
+            pacer->spin_ns);
+    }
+}
+
+unsigned int pacer_poll(
+    struct pacer *const pacer, const unsigned int max,
+    uint64_t *const next_ns
+) {
+    const uint64_t elapsed_ns = clock_now_ns() - pacer->start_ns;
+
+    if (pacer->amount == 0) {
+        *next_ns = pacer->start_ns + elapsed_ns;
+        return max;
+    }
+    if (pacer->shape == SHAPE_POISSON) {
+        while (pacer->arrived - pacer->sent < max
+            && pacer->next_arrival <= (double)elapsed_ns
+        ) {
+            pacer->arrived++;
+            pacer->next_arrival += exponential_gap(pacer);
+        }
+        *next_ns = pacer->start_ns + (uint64_t)pacer->next_arrival;
+        return (unsigned int)(pacer->arrived - pacer->sent);
+    }
+
+    const uint64_t due = packets_due(pacer, elapsed_ns);
+    if (due <= pacer->sent) {
+        *next_ns = pacer->start_ns + packet_deadline(pacer, pacer->sent);
+        return 0;
+    }
+    *next_ns = pacer->start_ns + elapsed_ns;
+    const uint64_t count = due - pacer->sent;
+    return (count < max) ? (unsigned int)count : max;
+}
+
+void pacer_consume(struct pacer *const pacer, const unsigned int count) {
+    pacer->sent += count;
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: pacing.c
+// ---------------------------------------------------------------------
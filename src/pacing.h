@@ -0,0 +1,99 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// pacing.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef PACING_H
+#define PACING_H
+
+
+#include "./utils/clock.h"
+#include "./utils/intrins.h"
+#include "./utils/random.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+// Bounds of the calibrated spinning window (see wait_until_ns()).
+#define PACER_MIN_SPIN_NS (10 * NSEC_PER_USEC)
+#define PACER_MAX_SPIN_NS (2 * NSEC_PER_MSEC)
+#define PACER_CALIBRATION_ROUNDS 16
+
+
+// How packets are spread over each interval:
+//  - constant: evenly spaced (the default "--rate" behavior);
+//  - burst: all of them back-to-back, at the start of the interval;
+//  - poisson: exponentially distributed gaps (i.e., random arrivals).
+typedef enum traffic_shape {
+    SHAPE_CONSTANT = 0,
+    SHAPE_BURST,
+    SHAPE_POISSON
+} traffic_shape_t;
+
+// NOTE: The pacer does not space individual packets apart; it only
+// decides how many packets of a batch are "due" by now, so that the
+// sender can still hand them to the kernel in a single syscall.  At
+// low rates that degenerates into one packet per wake-up, and at high
+// rates into full batches with the (coarse) sleeps in between.
+//
+// Deadlines are kept relative to the start of the pacer and derived
+// from the packet count (rather than accumulated per batch), so that
+// rounding errors never add up over a long run.
+typedef struct pacer {
+    traffic_shape_t shape;
+    uint64_t amount;      // Packets per interval (0: unpaced)
+    uint64_t interval_ns;
+    uint64_t start_ns;    // Monotonic time at pacer_start()
+    uint64_t sent;        // Packets consumed so far
+    uint64_t spin_ns;     // Spin (rather than sleep) for shorter waits
+    // Poisson arrivals are random, so they cannot be derived from the
+    // packet count; they get drawn one at a time instead.
+    uint64_t arrived;     // Arrivals up to now (>= sent)
+    double next_arrival;  // Of the next packet, relative to start_ns
+    double mean_gap;      // Nanoseconds
+    struct xorshift32 rng;
+} pacer_t;
+
+void pacer_start(
+    struct pacer *const pacer,
+    const traffic_shape_t shape,
+    const uint64_t amount,
+    const uint64_t interval_ns
+);
+unsigned int pacer_acquire(
+    struct pacer *const pacer, const unsigned int max
+);
+// For launch-time (SO_TXTIME) sending: rather than waiting for each
+// packet to be due, hands out the (absolute, clock_now_ns()) launch
+// times of up to `max` packets that are due within `lead_ns` from now,
+// only waiting if there are none yet.
+unsigned int pacer_schedule(
+    struct pacer *const pacer, const unsigned int max,
+    const uint64_t lead_ns, uint64_t *const launch_ns
+);
+// For event loops, which must not block on the pacer: hands out up to
+// `max` packets (or connections, etc.) that are due by now, without
+// waiting; if there are none, `next_ns` tells when the next one is.
+unsigned int pacer_poll(
+    struct pacer *const pacer, const unsigned int max,
+    uint64_t *const next_ns
+);
+void pacer_consume(struct pacer *const pacer, const unsigned int count);
+
+// Sleeps until `deadline_ns` (as read by clock_now_ns()).
+void sleep_until_ns(const uint64_t deadline_ns);
+// Sleeps through most of the wait, and then busy-polls the clock for
+// the last `spin_ns`, which the kernel's timers cannot hit reliably.
+void wait_until_ns(const uint64_t deadline_ns, const uint64_t spin_ns);
+
+
+#endif // PACING_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: pacing.h
+// ---------------------------------------------------------------------
@@ -4,152 +4,1461 @@
 // ---------------------------------------------------------------------
 
 
+// NOTE: sendmmsg() is a Linux extension that both glibc and musl only
+// declare under _GNU_SOURCE; everything else herein remains POSIX.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
 #include "packet.h"
 
-/* WORK IN-PROGRESS */
 
+static volatile sig_atomic_t STOP_REQUESTED = 0;
 
+void stop_sending(void) {
+    STOP_REQUESTED = 1;
+}
 
-// TODO: Split the packet crafting logic to another function.
-// Thread callback
-static int send_loop(void *arg) {
-    const struct ProgramArgs *const program_args =
-        (const struct ProgramArgs *const)arg;
+bool sending_stopped(void) {
+    return STOP_REQUESTED != 0;
+}
 
-    // Initialize the seed for random number generation.
-    // TODO: make this a program parameter
-    srand(time(0));
+static void handle_stop_signal(int signal_number) {
+    (void)signal_number;
+    stop_sending();
+}
 
-    // Initialize an empty packet buffer on the stack and align it
-    // for potentially faster access from memory.
-    // TODO: malloc() this buffer instead?
-    _Alignas (_Alignof (max_align_t)) uint8_t
-        packet_buffer[IP_PKT_MTU] = {0};
+int install_stop_handler(void) {
+    struct sigaction action = {0};
+    action.sa_handler = handle_stop_signal;
+    // A second Ctrl+C falls back to the default (i.e., terminating)
+    // action, in case the sending threads are stuck in a syscall.
+    action.sa_flags = SA_RESETHAND;
+    (void)sigemptyset(&action.sa_mask);
 
+    if (sigaction(SIGINT, &action, NULL) == -1
+        || sigaction(SIGTERM, &action, NULL) == -1
+    ) {
+        logger(LOG_WARN,
+            "Failed to install the signal handler: %s", strerror(errno)
+        );
+        return 1;
+    }
 
-    // Make the IP and TCP header structures "point" to their
-    // respective locations in the aforementioned buffer
-    struct ip_hdr  *ip_header  =
-        (struct ip_hdr *)packet_buffer;
-    struct tcp_hdr *tcp_header =
-        (struct tcp_hdr *)(packet_buffer + sizeof (struct ip_hdr));
+    return 0;
+}
 
 
-    *ip_header = *(program_args->ipv4);
+// Sum of the pseudo-header (RFC 9293 and RFC 768 share that of IPv4,
+// and RFC 8200 defines that of IPv6) plus the whole transport segment;
+// the template is already in network byte order by then.
+static uint16_t l4_chksum(
+    const struct packet_template *const template
+) {
+    const uint16_t l4_length =
+        (uint16_t)(template->length - template->l4_offset);
+    uint32_t sum;
 
-    // TODO: parametrize
-    *tcp_header = (struct tcp_hdr){
-        .sport = htons(rand() % 65536),
-        .dport = htons(80),
-        .seqnum = rand(),
-        .flags.syn = true
+    if (template->ipv6) {
+        const struct ip6_hdr *const ip6_header =
+            (const struct ip6_hdr *)template->buffer;
+        const uint16_t pseudo_header[4] = {
+            0, htons(l4_length), 0, htons(template->l4_proto)
+        };
+        // NOTE: The source and destination addresses are adjacent.
+        sum = chksum_add(0, &ip6_header->saddr, 2 * sizeof (ip6_addr_t));
+        sum = chksum_add(sum, pseudo_header, sizeof (pseudo_header));
+    }
+    else {
+        const struct ip_hdr *const ip_header =
+            (const struct ip_hdr *)template->buffer;
+        const uint16_t pseudo_header[6] = {
+            (uint16_t)(ip_header->saddr.address & 0xFFFF),
+            (uint16_t)(ip_header->saddr.address >> 16),
+            (uint16_t)(ip_header->daddr.address & 0xFFFF),
+            (uint16_t)(ip_header->daddr.address >> 16),
+            htons(template->l4_proto),
+            htons(l4_length)
+        };
+        sum = chksum_add(0, pseudo_header, sizeof (pseudo_header));
+    }
+
+    return chksum_fold(chksum_add(
+        sum, template->buffer + template->l4_offset, l4_length));
+}
+
+static void craft_tcp(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    struct tcp_hdr *const tcp_header =
+        (struct tcp_hdr *)(template->buffer + template->l4_offset);
+
+    *tcp_header = *(program_args->tcp);
+    tcp_header->sport = htons(program_args->tcp->sport);
+    tcp_header->dport = htons(program_args->tcp->dport);
+    tcp_header->seqnum = htonl(program_args->tcp->seqnum);
+    tcp_header->acknum = htonl(program_args->tcp->acknum);
+    tcp_header->window = htons(program_args->tcp->window);
+    tcp_header->urgptr = htons(program_args->tcp->urgptr);
+
+    const unsigned int options_length =
+        program_args->tcp_misc.options_length;
+    memcpy(tcp_header->options, program_args->tcp_misc.options,
+        options_length);
+    if (!program_args->tcp_misc.override_data_ofs) {
+        tcp_header->dataofs = (uint8_t)
+            ((sizeof (struct tcp_hdr) + options_length) / 4);
+    }
+    if (program_args->tcp_misc.tsval_offset != 0) {
+        // The sender keeps it ticking (in milliseconds) from here on.
+        const uint32_t tsval =
+            htonl((uint32_t)(clock_now_ns() / NSEC_PER_MSEC));
+        template->tsval_offset = template->l4_offset
+            + sizeof (struct tcp_hdr) + program_args->tcp_misc.tsval_offset;
+        memcpy(template->buffer + template->tsval_offset,
+            &tsval, sizeof (tsval));
+    }
+
+    template->l4_chksum_offset = offsetof(struct tcp_hdr, chksum);
+    if (program_args->tcp_misc.override_checksum) {
+        tcp_header->chksum = htons(program_args->tcp->chksum);
+        template->fixed_l4_chksum = true;
+        return;
+    }
+    tcp_header->chksum = 0;
+    tcp_header->chksum = l4_chksum(template);
+}
+
+static void craft_udp(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    struct udp_hdr *const udp_header =
+        (struct udp_hdr *)(template->buffer + template->l4_offset);
+    const uint16_t udp_length =
+        (uint16_t)(template->length - template->l4_offset);
+
+    udp_header->sport = htons(program_args->udp.sport);
+    udp_header->dport = htons(program_args->udp.dport);
+    udp_header->len = htons(program_args->udp_misc.override_length
+        ? program_args->udp.len : udp_length);
+
+    template->l4_chksum_offset = offsetof(struct udp_hdr, chksum);
+    if (program_args->udp_misc.override_checksum) {
+        udp_header->chksum = htons(program_args->udp.chksum);
+        template->fixed_l4_chksum = true;
+        return;
+    }
+    udp_header->chksum = 0;
+    // A computed zero is sent as all ones, since a zero checksum means
+    // that there is none (RFC 768).
+    const uint16_t chksum = l4_chksum(template);
+    udp_header->chksum = (chksum != 0) ? chksum : 0xFFFF;
+}
+
+// Of the outer IPv4 header and everything up to the inner IP header.
+static size_t tunnel_header_length(
+    const struct ProgramArgs *const program_args
+) {
+    switch (program_args->tunnel.kind) {
+        case TUNNEL_IPIP: {
+            return sizeof (struct ip_hdr);
+        }
+        case TUNNEL_GRE: {
+            return sizeof (struct ip_hdr) + sizeof (struct gre_hdr)
+                + (program_args->tunnel.has_gre_key ? GRE_KEY_LENGTH : 0);
+        }
+        case TUNNEL_VXLAN: {
+            return sizeof (struct ip_hdr) + sizeof (struct udp_hdr)
+                + sizeof (struct vxlan_hdr) + sizeof (struct eth_hdr);
+        }
+        case TUNNEL_NONE:
+        default: {
+            return 0;
+        }
+    }
+}
+
+// Moves the crafted (inner) packet back to make room for the headers
+// of the tunnel, which are then written in front of it; being fixed,
+// they cost nothing per packet, except for where a payload corpus
+// changes the lengths (see load_payloads()).
+//
+// NOTE: The inner packet gets crafted at the (aligned) start of the
+// buffer first, since its headers are accessed through their structs;
+// after the move, it may well be misaligned (e.g., behind VXLAN).
+static void encapsulate(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    const size_t offset = tunnel_header_length(program_args);
+    const uint16_t inner_type = template->ipv6
+        ? ETH_TYPE_IPV6 : ETH_TYPE_IPV4;
+    uint8_t *const buffer = template->buffer;
+
+    // The inner addresses and ports make up its flow (for VXLAN.)
+    uint32_t flow = template->ipv6
+        ? chksum_add(0, buffer + offsetof(struct ip6_hdr, saddr),
+            2 * sizeof (ip6_addr_t))
+        : chksum_add(0, buffer + offsetof(struct ip_hdr, saddr),
+            2 * sizeof (ip_addr_t));
+    flow = chksum_add(flow, buffer + template->l4_offset,
+        2 * sizeof (uint16_t));
+
+    memmove(buffer + offset, buffer, template->length);
+    template->tunnel = program_args->tunnel.kind;
+    template->l3_offset = offset;
+    template->l4_offset += offset;
+    template->header_length += offset;
+    template->length += offset;
+    if (template->tsval_offset != 0) {
+        template->tsval_offset += offset;
+    }
+    if (template->tag_offset != 0) {
+        template->tag_offset += offset;
+    }
+
+    struct ip_hdr outer = {
+        .ver = 4,
+        .ihl = sizeof (struct ip_hdr) / 4,
+        .len = htons((uint16_t)template->length),
+        .ttl = 64,
+        .saddr.address = htonl(program_args->tunnel.saddr.address),
+        .daddr.address = htonl(program_args->tunnel.daddr.address)
     };
+    size_t position = sizeof (outer);
+
+    switch (template->tunnel) {
+        case TUNNEL_IPIP: {
+            outer.proto = template->ipv6 ? IP_PROTO_IPV6 : IP_PROTO_IPIP;
+            break;
+        }
+        case TUNNEL_GRE: {
+            outer.proto = IP_PROTO_GRE;
+            const struct gre_hdr gre = {
+                .flags_ver = htons(program_args->tunnel.has_gre_key
+                    ? GRE_FLAG_KEY : 0),
+                .proto = htons(inner_type)
+            };
+            memcpy(buffer + position, &gre, sizeof (gre));
+            position += sizeof (gre);
+            if (program_args->tunnel.has_gre_key) {
+                const uint32_t key = htonl(program_args->tunnel.gre_key);
+                memcpy(buffer + position, &key, sizeof (key));
+                position += sizeof (key);
+            }
+            break;
+        }
+        case TUNNEL_VXLAN: {
+            outer.proto = IP_PROTO_UDP;
+            // The source port gives ECMP some entropy to hash on; it
+            // is derived from the inner flow (RFC 7348, section 5), and
+            // the checksum is zero, as it should be over IPv4.
+            const struct udp_hdr udp = {
+                .sport = htons((uint16_t)
+                    (0xC000 | (chksum_fold(flow) & 0x3FFF))),
+                .dport = htons(VXLAN_PORT),
+                .len = htons((uint16_t)
+                    (template->length - sizeof (struct ip_hdr))),
+                .chksum = 0
+            };
+            const struct vxlan_hdr vxlan = {
+                .flags = htonl(VXLAN_FLAG_VNI),
+                .vni = htonl(program_args->tunnel.vni << VXLAN_VNI_SHIFT)
+            };
+            const struct eth_hdr inner_eth = {
+                .daddr = program_args->tunnel.inner_daddr,
+                .saddr = program_args->tunnel.inner_saddr,
+                .type = htons(inner_type)
+            };
+            memcpy(buffer + position, &udp, sizeof (udp));
+            position += sizeof (udp);
+            memcpy(buffer + position, &vxlan, sizeof (vxlan));
+            position += sizeof (vxlan);
+            memcpy(buffer + position, &inner_eth, sizeof (inner_eth));
+            break;
+        }
+        case TUNNEL_NONE:
+        default: {
+            break;
+        }
+    }
 
+    outer.chksum = inet_chksum(&outer, sizeof (outer));
+    memcpy(buffer, &outer, sizeof (outer));
+}
 
-    // if override_source
-    uint32_t ip_diff = 0;
-    // If CIDR
-    //uint32_t ip_diff = program_args->src_ip_end.address
-    //    - program_args->src_ip_start.address + 1;
+static void craft_eth(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    uint8_t *const header = template->l2_header;
+    const unsigned int num_vlans = program_args->eth_misc.num_vlans;
+    // (Tunnels are always carried over IPv4.)
+    const bool ipv6 = template->ipv6 && template->tunnel == TUNNEL_NONE;
+    const uint16_t type = htons(program_args->eth_misc.override_type
+        ? program_args->eth.type
+        : (ipv6 ? ETH_TYPE_IPV6 : ETH_TYPE_IPV4));
 
-    // Set the default destination address
-    struct sockaddr_in dest_info = {
-        .sin_family = AF_INET,
-        .sin_port = ntohs(tcp_header->dport),
-        .sin_addr.s_addr = ntohl(ip_header->daddr.address)
+    memcpy(header + offsetof(struct eth_hdr, daddr),
+        &program_args->eth.daddr, sizeof (eth_addr_t));
+    memcpy(header + offsetof(struct eth_hdr, saddr),
+        &program_args->eth.saddr, sizeof (eth_addr_t));
+
+    // Every tag goes in front of the EtherType (which it pushes back);
+    // the outer of two is an 802.1ad (QinQ) tag, any other an 802.1Q.
+    size_t offset = offsetof(struct eth_hdr, type);
+    for (unsigned int i = 0; i < num_vlans; i++) {
+        const struct eth_vlan_tag tag = {
+            .tpid = htons((num_vlans > 1 && i == 0)
+                ? ETH_TYPE_QINQ : ETH_TYPE_VLAN),
+            .tci = htons(program_args->eth_misc.vlan_tci[i])
+        };
+        memcpy(header + offset, &tag, sizeof (tag));
+        offset += sizeof (tag);
+    }
+    memcpy(header + offset, &type, sizeof (type));
+
+    template->l2_length = offset + sizeof (type);
+}
+
+static void craft_ipv4(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    struct ip_hdr *const ip_header =
+        (struct ip_hdr *)template->buffer;
+
+    // The header arguments are kept in host byte order; only the
+    // template itself gets converted to network byte order.
+    *ip_header = *(program_args->ipv4);
+    ip_header->len = htons((uint16_t)template->length);
+    ip_header->id = htons(program_args->ipv4->id);
+    ip_header->saddr.address = htonl(program_args->ipv4->saddr.address);
+    ip_header->daddr.address = htonl(program_args->ipv4->daddr.address);
+    // NOTE: The 3 flag bits and the 13-bit fragment offset share a
+    // single 16-bit word, which has to be swapped as a whole.
+    uint16_t flags_fragofs;
+    memcpy(&flags_fragofs, template->buffer + 6, sizeof (uint16_t));
+    flags_fragofs = htons(flags_fragofs);
+    memcpy(template->buffer + 6, &flags_fragofs, sizeof (uint16_t));
+
+    // The options are encoded once, here, so they cost nothing per
+    // packet (only the saddr ever gets patched, at a fixed offset).
+    const unsigned int options_length =
+        program_args->ipv4_misc.options_length;
+    memcpy(ip_header->options, program_args->ipv4_misc.options,
+        options_length);
+    if (!program_args->ipv4_misc.override_ihl) {
+        ip_header->ihl = (uint8_t)
+            ((sizeof (struct ip_hdr) + options_length) / 4);
+    }
+
+    // Checksums go last, since they cover everything above.
+    if (program_args->ipv4_misc.override_checksum) {
+        ip_header->chksum = htons(program_args->ipv4->chksum);
+    }
+    else {
+        ip_header->chksum = 0;
+        ip_header->chksum = inet_chksum(ip_header,
+            sizeof (*ip_header) + options_length);
+    }
+
+    template->l4_proto = (uint8_t)ip_header->proto;
+}
+
+static void craft_ipv6(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    struct ip6_hdr *const ip6_header =
+        (struct ip6_hdr *)template->buffer;
+
+    *ip6_header = program_args->ipv6;
+    ip6_header->ver_tc_flow = htonl(program_args->ipv6.ver_tc_flow);
+    ip6_header->len = htons(program_args->ipv6_misc.override_length
+        ? program_args->ipv6.len
+        : (uint16_t)(template->length - sizeof (struct ip6_hdr)));
+
+    // Chain the extension headers (if any) in between; every one of
+    // them names the type of the next in its first byte.
+    uint8_t *next_hdr = &ip6_header->next_hdr;
+    uint8_t *ext_header = template->buffer + sizeof (struct ip6_hdr);
+    for (unsigned int i = 0; i < program_args->ipv6_misc.num_ext_headers;
+        i++
+    ) {
+        const ip6_ext_kind_t kind = program_args->ipv6_misc.ext_headers[i];
+        *next_hdr = (uint8_t)kind;
+
+        if (kind == IP6_EXT_FRAGMENT) {
+            // An "atomic" fragment (RFC 6946): offset 0, no M flag.
+            const struct ip6_frag_hdr fragment = {0};
+            memcpy(ext_header, &fragment, sizeof (fragment));
+        }
+        else {
+            // Hop-by-Hop or Destination Options, padded with PadN.
+            const struct ip6_opts_hdr options = {
+                .len = 0,
+                .options = {IP6_OPT_PADN, 4, 0, 0, 0, 0}
+            };
+            memcpy(ext_header, &options, sizeof (options));
+        }
+
+        next_hdr = ext_header;
+        ext_header += IP6_EXT_HEADER_LENGTH;
+    }
+
+    template->l4_proto = program_args->ipv6_misc.override_next_header
+        ? program_args->ipv6.next_hdr
+        : (program_args->protocols.l4 == PROTO_L4_UDP)
+            ? IP_PROTO_UDP : IP_PROTO_TCP;
+    *next_hdr = template->l4_proto;
+}
+
+// Compiles the "--vary" specs, followed by the variations that are
+// implied by the other options (unless "--vary" already covers their
+// fields), into the patch program of a crafted template.
+static int compile_variations(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    struct vary_program *const program = &template->vary;
+    const bool udp = program_args->protocols.l4 == PROTO_L4_UDP;
+    const struct vary_layout layout = {
+        .ipv6 = template->ipv6,
+        .udp = udp,
+        .l3_offset = template->l3_offset,
+        .l4_offset = template->l4_offset,
+        .l3_chksum_offset = (template->ipv6
+            || program_args->ipv4_misc.override_checksum)
+            ? 0 : template->l3_offset + offsetof(struct ip_hdr, chksum),
+        .l4_chksum_offset = template->fixed_l4_chksum
+            ? 0 : template->l4_offset + template->l4_chksum_offset,
+        .tsval_offset = template->tsval_offset,
+        .tag_offset = template->tag_offset
     };
 
-    // NOTE: Instead of using sento() or sendmmsg(), both of which
-    // require a "destination info" struct, you can pre-bind your
-    // socket to a fixed destination by using connect() accompanied
-    // by write() or writev().  However, if you do want to change
-    // your destination with every call, then it might be better
-    // to use the former functions, because they'd be handling
-    // this binding inside kernelspace, bypassing what would
-    // otherwise be an extraneous overhead to a separate connect().
-    int connection_status = connect(
-        program_args->socket,
-        (struct sockaddr *)&dest_info,
-        sizeof(dest_info)
-    );
+    vary_program_init(program, &layout);
+    for (unsigned int i = 0; i < program_args->vary.num_specs; i++) {
+        if (vary_compile(program, &program_args->vary.specs[i],
+            &layout) != 0
+        ) {
+            return 1;
+        }
+    }
+
+    // (At most six of these can apply to any one template.)
+    struct vary_spec implied[VARY_MAX_PATCHES - VARY_MAX_SPECS];
+    unsigned int num_implied = 0;
+    if (!template->ipv6 && program_args->ipv4_misc.is_cidr) {
+        implied[num_implied++] = (struct vary_spec){
+            .field = VARY_FIELD_SADDR,
+            .generator = VARY_RANGE,
+            .lo = program_args->ipv4_misc.source_cidr.start.address,
+            .hi = program_args->ipv4_misc.source_cidr.end.address
+        };
+    }
+    if (udp ? !program_args->udp_misc.override_sport
+        : !program_args->tcp_misc.override_sport
+    ) {
+        implied[num_implied++] = (struct vary_spec){
+            .field = VARY_FIELD_SPORT, .generator = VARY_RANDOM
+        };
+    }
+    // The answers get matched by source port and sequence number; with
+    // the latter counting up (and interleaved across the threads), no
+    // two SYNs share both, even from a fixed port.
+    if (!udp && program_args->traffic.responses) {
+        implied[num_implied++] = (struct vary_spec){
+            .field = VARY_FIELD_SEQ, .generator = VARY_INC, .step = 1
+        };
+    }
+    if (template->ipv6 && program_args->ipv6_misc.random_traffic_class) {
+        implied[num_implied++] = (struct vary_spec){
+            .field = VARY_FIELD_TRAFFIC_CLASS, .generator = VARY_RANDOM
+        };
+    }
+    if (template->ipv6 && program_args->ipv6_misc.random_flow_label) {
+        implied[num_implied++] = (struct vary_spec){
+            .field = VARY_FIELD_FLOW_LABEL, .generator = VARY_RANDOM
+        };
+    }
+    // NOTE: TSval is only there (let alone varied) with "--options=ts".
+    if (template->tsval_offset != 0) {
+        implied[num_implied++] = (struct vary_spec){
+            .field = VARY_FIELD_TSVAL, .generator = VARY_CLOCK_MS
+        };
+    }
 
-    if (connection_status != 0) {
+    if (template->tag_offset != 0) {
+        implied[num_implied++] = (struct vary_spec){
+            .field = VARY_FIELD_TAG_THREAD, .generator = VARY_THREAD
+        };
+        // (Its sequence number and send time are wider than a field.)
+        vary_compile_stamp(program, &layout);
+    }
+
+    for (unsigned int i = 0; i < num_implied; i++) {
+        if (!vary_has_field(program, implied[i].field)
+            && vary_compile(program, &implied[i], &layout) != 0
+        ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int craft_template(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+) {
+    const bool ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6;
+    const bool udp = program_args->protocols.l4 == PROTO_L4_UDP;
+    const size_t l3_length = ipv6
+        ? sizeof (struct ip6_hdr) + IP6_EXT_HEADER_LENGTH
+            * program_args->ipv6_misc.num_ext_headers
+        : sizeof (struct ip_hdr) + program_args->ipv4_misc.options_length;
+    const size_t l4_length = udp
+        ? sizeof (struct udp_hdr)
+        : sizeof (struct tcp_hdr) + program_args->tcp_misc.options_length;
+    // The test tag (with "--run-id") counts as one of the headers, since
+    // every packet gets its own sequence number.
+    const size_t tag_length =
+        program_args->run.tagged ? sizeof (struct test_tag) : 0;
+    const size_t headers_length = l3_length + l4_length + tag_length;
+    const bool override_length = ipv6
+        ? program_args->ipv6_misc.override_length
+        : program_args->ipv4_misc.override_length;
+
+    memset(template, 0, sizeof (*template));
+    template->ipv6 = ipv6;
+    template->l4_offset = l3_length;
+    template->header_length = headers_length;
+    if (!override_length) {
+        template->length = headers_length;
+    }
+    else if (ipv6) {
+        // IPv6 only knows the length of what follows its header.
+        template->length =
+            sizeof (struct ip6_hdr) + program_args->ipv6.len;
+    }
+    else {
+        template->length = program_args->ipv4->len;
+    }
+    // Unless the IP length says otherwise, a UDP length also sizes
+    // the packet (i.e., its payload).
+    if (udp && program_args->udp_misc.override_length
+        && !override_length
+    ) {
+        template->length =
+            template->l4_offset + program_args->udp.len;
+    }
+
+    // (A tunnel's headers eat into the MTU of the outer packet.)
+    const size_t max_length =
+        IP_PKT_MTU - tunnel_header_length(program_args);
+    if (template->length < headers_length
+        || template->length > max_length
+    ) {
         logger(LOG_ERROR,
-            "Failed to bind socket to the destination address: %s",
-            strerror(errno)
+            "Packet length must be [%zu, %zu] bytes (got %zu).",
+            headers_length, max_length, template->length
         );
         return 1;
     }
 
-    size_t packet_length = ntohs(ip_header->len);
+    if (ipv6) {
+        craft_ipv6(program_args, template);
+    }
+    else {
+        craft_ipv4(program_args, template);
+    }
+
+    // (Before the transport header, so that its checksum covers it.)
+    if (program_args->run.tagged) {
+        const struct test_tag tag = {
+            .magic = htonl(TEST_TAG_MAGIC),
+            .run_id = htonl(program_args->run.run_id),
+            .thread = 0,
+            .seq = {0, 0},
+            .tx_ns = {0, 0}
+        };
+        template->tag_offset = l3_length + l4_length;
+        memcpy(template->buffer + template->tag_offset,
+            &tag, sizeof (tag));
+    }
 
+    if (udp) {
+        craft_udp(program_args, template);
+    }
+    else {
+        craft_tcp(program_args, template);
+    }
 
-    //int num_threads = 4; // number of threads
+    if (program_args->tunnel.kind != TUNNEL_NONE) {
+        encapsulate(program_args, template);
+    }
+    if (program_args->protocols.l2 == PROTO_L2_ETH) {
+        craft_eth(program_args, template);
+    }
 
-    //int X = UIO_MAXIOV / (packet_length * num_threads);
+    return compile_variations(program_args, template);
+}
 
-    // NOTE: The addresses in this array of buffers all point
-    // to the same packet buffer.  This might seem wasteful at
-    // first, but a benefit is that the "for-loop" part of this
-    // iteration will now be able to exist in kernelspace,
-    // bypassing expensive syscalls.
-    // TODO: Maybe pre-craft the changing parts of multiple packeets,
-    // as to "queue" them for sending?
-    _Alignas (_Alignof (max_align_t)) struct iovec iov[UIO_MAXIOV];
-    for (int i = 0; i < 37; i++) {
-        iov[i].iov_base = packet_buffer;
-        iov[i].iov_len = packet_length;
+
+// Hands `count` pre-crafted packets, starting at `first` (in the
+// arena), to the kernel in as few syscalls as possible; returns the
+// number sent, or -1 (with errno) if none.
+static int send_batch(
+    const int socket_descriptor,
+    struct sender *const sender,
+    const unsigned int first,
+    const unsigned int count
+) {
+#if defined(__linux__)
+    return sendmmsg(socket_descriptor, sender->msgs + first, count, 0);
+#else
+    // Without sendmmsg(), every packet needs its own syscall; note
+    // that a single writev() with many iovecs would NOT work here,
+    // because it would gather all of them into one large datagram.
+    const unsigned int iovlen = sender->iov_per_packet;
+    unsigned int sent = 0;
+    for (; sent < count; sent++) {
+        if (writev(socket_descriptor,
+            &sender->iov[(first + sent) * iovlen], (int)iovlen) == -1
+        ) {
+            return (sent > 0) ? (int)sent : -1;
+        }
+    }
+    return (int)sent;
+#endif
+}
+
+int sender_init(
+    struct sender *const sender,
+    const unsigned int batch_size,
+    const size_t max_header_length,
+    const struct packet_mix *const mix
+) {
+    sender->batch_size = (batch_size > 0) ? batch_size : 1;
+    sender->arena_size =
+        (mix != NULL) ? mix->arena_size : sender->batch_size;
+    sender->num_vary = (mix != NULL) ? mix->num_templates : 1;
+    sender->slot_size =
+        (max_header_length + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+
+    // Every packet in the arena needs its own copy of the headers,
+    // because they get mutated (e.g., source port) independently;
+    // the payload is never mutated, so all of them share that.
+    // The slots are aligned and padded to whole cache lines, so that
+    // neighbouring packets never share one.
+    bool failed =
+        posix_memalign((void **)&sender->slots, CACHE_LINE,
+            sender->slot_size * sender->arena_size) != 0
+        || (sender->iov = calloc(
+            3 * sender->arena_size, sizeof (*sender->iov))) == NULL
+        || (sender->schedule = calloc(
+            sender->arena_size, sizeof (*sender->schedule))) == NULL
+        || (sender->slot_of = calloc(
+            sender->arena_size, sizeof (*sender->slot_of))) == NULL
+        || (sender->bytes_before = calloc(
+            sender->arena_size + 1, sizeof (*sender->bytes_before)))
+            == NULL
+        || (sender->record_of = calloc(
+            sender->arena_size, sizeof (*sender->record_of))) == NULL
+#if defined(__linux__)
+        || (sender->msgs = calloc(
+            sender->arena_size, sizeof (*sender->msgs))) == NULL
+        || (sender->controls = calloc(
+            sender->arena_size, TXTIME_CONTROL_SIZE)) == NULL
+        || (sender->launch_ns = calloc(
+            sender->batch_size, sizeof (*sender->launch_ns))) == NULL
+#endif
+        ;
+    for (unsigned int i = 0; i < sender->num_vary && !failed; i++) {
+        failed = vary_state_init(&sender->vary[i], sender->batch_size) != 0;
+    }
+    if (failed) {
+        logger(LOG_ERROR,
+            "Thread %u failed to allocate its packet buffers.",
+            sender->id
+        );
+        sender_free(sender);
+        return 1;
+    }
+
+    xorshift32_seed(&sender->rng,
+        (uint32_t)time(NULL) ^ ((sender->id + 1) * 0x9E3779B9u));
+
+    return 0;
+}
+
+// Varies the fields of the packets in a window of the arena; those of
+// each template lie in consecutive slots (in sending order), so every
+// template's patch program still runs over a single stretch of them.
+static void vary_window(
+    struct sender *const sender,
+    const unsigned int first,
+    const unsigned int count,
+    const uint64_t now_ns,
+    struct xorshift32 *const rng
+) {
+    const struct packet_mix *const mix = &sender->mix;
+    unsigned int num_packets[MIX_MAX_TEMPLATES] = {0};
+    unsigned int first_slot[MIX_MAX_TEMPLATES] = {0};
+
+    for (unsigned int i = first; i < first + count; i++) {
+        const unsigned int t = sender->schedule[i];
+        if (num_packets[t]++ == 0) {
+            first_slot[t] = sender->slot_of[i];
+        }
+    }
+
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        if (num_packets[t] > 0
+            && mix->templates[t]->vary.num_patches > 0
+        ) {
+            vary_apply(&mix->templates[t]->vary, &sender->vary[t],
+                sender->slots + first_slot[t] * sender->slot_size,
+                sender->slot_size, num_packets[t], now_ns, rng);
+        }
     }
+}
+
+// Takes back the sequence numbers of the packets in a window of the
+// arena that did not get sent (the last ones of each template's
+// stretch, stamped with its highest numbers).
+static void unstamp_window(
+    struct sender *const sender,
+    const unsigned int first,
+    const unsigned int count
+) {
+    const struct packet_mix *const mix = &sender->mix;
+    unsigned int num_packets[MIX_MAX_TEMPLATES] = {0};
+
+    for (unsigned int i = first; i < first + count; i++) {
+        num_packets[sender->schedule[i]]++;
+    }
+
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        if (num_packets[t] > 0
+            && mix->templates[t]->vary.num_patches > 0
+        ) {
+            vary_unstamp(&mix->templates[t]->vary, &sender->vary[t],
+                num_packets[t]);
+        }
+    }
+}
+
+// The (outer) lengths of a tunnel, and the checksum of its IPv4 header,
+// for a payload of `new` instead of `old` (see load_payloads()).
+static ALWAYS_INLINE void patch_tunnel_lengths(
+    const struct packet_template *const template,
+    uint8_t *const slot,
+    const struct payload_record *const old,
+    const struct payload_record *const new
+) {
+    const uint16_t old_length =
+        htons((uint16_t)(template->header_length + old->length));
+    const uint16_t new_length =
+        htons((uint16_t)(template->header_length + new->length));
+    uint16_t chksum;
+
+    memcpy(slot + offsetof(struct ip_hdr, len),
+        &new_length, sizeof (new_length));
+    memcpy(&chksum, slot + offsetof(struct ip_hdr, chksum),
+        sizeof (chksum));
+    chksum = chksum_update16(chksum, old_length, new_length);
+    memcpy(slot + offsetof(struct ip_hdr, chksum),
+        &chksum, sizeof (chksum));
+
+    // (Its UDP checksum is zero, and stays that way.)
+    if (template->tunnel == TUNNEL_VXLAN) {
+        const uint16_t udp_length = htons((uint16_t)(
+            template->header_length - sizeof (struct ip_hdr)
+            + new->length));
+        memcpy(slot + sizeof (struct ip_hdr)
+            + offsetof(struct udp_hdr, len),
+            &udp_length, sizeof (udp_length));
+    }
+}
+
+// Points the payloads of a window of the arena at the next records of
+// the corpus, and patches the lengths (and checksums) in the headers to
+// match; only the differences to the prior records of the same packets
+// get summed into the checksums (RFC 1624).
+static ALWAYS_INLINE void load_payloads(
+    struct sender *const sender,
+    const unsigned int first,
+    const unsigned int count,
+    const bool mix
+) {
+    const struct payload_corpus *const corpus = sender->corpus;
+    unsigned int next = sender->next_record;
+
+    for (unsigned int i = first; i < first + count; i++) {
+        const struct packet_template *const template = mix
+            ? sender->mix.templates[sender->schedule[i]]
+            : sender->template;
+        // (The patch program knows where the live checksums are.)
+        const struct vary_program *const layout = &template->vary;
+        uint8_t *const slot =
+            sender->slots + sender->slot_of[i] * sender->slot_size;
+        const struct payload_record *const old =
+            &corpus->records[sender->record_of[i]];
+        const struct payload_record *const new = &corpus->records[next];
+
+        // IPv6 only counts what follows its (fixed) header.
+        const size_t l3_base = template->header_length
+            - template->l3_offset
+            - (template->ipv6 ? sizeof (struct ip6_hdr) : 0);
+        const size_t l4_base =
+            template->header_length - template->l4_offset;
+        const uint16_t old_l3 = htons((uint16_t)(l3_base + old->length));
+        const uint16_t new_l3 = htons((uint16_t)(l3_base + new->length));
+        const uint16_t old_l4 = htons((uint16_t)(l4_base + old->length));
+        const uint16_t new_l4 = htons((uint16_t)(l4_base + new->length));
+        uint16_t chksum;
+
+        memcpy(slot + template->l3_offset + (template->ipv6
+            ? offsetof(struct ip6_hdr, len) : offsetof(struct ip_hdr, len)),
+            &new_l3, sizeof (new_l3));
+        if (layout->l3_chksum_offset != 0) {
+            memcpy(&chksum, slot + layout->l3_chksum_offset,
+                sizeof (chksum));
+            chksum = chksum_update16(chksum, old_l3, new_l3);
+            memcpy(slot + layout->l3_chksum_offset, &chksum,
+                sizeof (chksum));
+        }
+        if (layout->udp) {
+            memcpy(slot + template->l4_offset
+                + offsetof(struct udp_hdr, len), &new_l4, sizeof (new_l4));
+        }
+        if (layout->l4_chksum_offset != 0) {
+            // The length is in the pseudo-header (and, for UDP, in the
+            // header as well), and the payload is summed as a whole.
+            memcpy(&chksum, slot + layout->l4_chksum_offset,
+                sizeof (chksum));
+            uint32_t sum = (uint16_t)~chksum;
+            sum += ((uint32_t)(uint16_t)~old_l4 + new_l4)
+                * (layout->udp ? 2 : 1);
+            sum += (uint32_t)(uint16_t)~old->sum + new->sum;
+            chksum = chksum_fold(sum);
+            if (layout->udp && chksum == 0) {
+                chksum = 0xFFFF;
+            }
+            memcpy(slot + layout->l4_chksum_offset, &chksum,
+                sizeof (chksum));
+        }
+
+        if (template->tunnel != TUNNEL_NONE) {
+            patch_tunnel_lengths(template, slot, old, new);
+        }
+
+        struct iovec *const iov =
+            &sender->iov[i * sender->iov_per_packet + sender->header_iov];
+        iov[1].iov_base = (void *)new->data;
+        iov[1].iov_len = new->length;
+        sender->record_of[i] = next;
+        if (++next == corpus->num_records) {
+            next = 0;
+        }
+    }
+
+    sender->next_record = next;
+}
+
+#if defined(__linux__)
+// Picks the packet of a batch whose kernel TX timestamps get sampled
+// (if it is time, and no other thread's sample is in flight), and
+// attaches the request for them to its own control message(s); returns
+// its index within the batch, or UINT_MAX.
+static unsigned int sample_packet(
+    struct sender *const sender,
+    const unsigned int first,
+    const unsigned int count
+) {
+    if (sender->stamp_countdown > count) {
+        sender->stamp_countdown -= count;
+        return UINT_MAX;
+    }
+    if (!tstamp_claim(sender->sampler)) {
+        sender->stamp_countdown = 1;
+        return UINT_MAX;
+    }
+
+    const unsigned int index = (sender->stamp_countdown > 0)
+        ? sender->stamp_countdown - 1 : 0;
+    const unsigned int every =
+        sender->program_args->traffic.tx_stamp_every;
+    const unsigned int after = count - index - 1;
+    sender->stamp_countdown = (every > after) ? every - after : 1;
+
+    // (Behind its launch time, if it has one.)
+    struct msghdr *const msg = &sender->msgs[first + index].msg_hdr;
+    uint8_t *const control = sender->stamp_control.data;
+    const size_t length = msg->msg_controllen;
+    sender->stamp_own_length = length;
+    if (length > 0) {
+        memcpy(control, msg->msg_control, length);
+    }
+    msg->msg_control = control;
+    msg->msg_controllen =
+        length + tstamp_prepare(sender->sampler, control + length);
+
+    return index;
+}
+
+// Puts the sampled packet's own control message (if any) back.
+static void unsample_packet(
+    struct sender *const sender,
+    const unsigned int packet,
+    const bool txtime
+) {
+    struct msghdr *const msg = &sender->msgs[packet].msg_hdr;
+    msg->msg_control = txtime
+        ? sender->controls + packet * TXTIME_CONTROL_SIZE : NULL;
+    msg->msg_controllen = sender->stamp_own_length;
+}
+#endif
+
+// Tracks the SYNs among the packets of a batch that is about to be
+// sent (at `now_ns`) for their answers to be matched to, or (unless
+// `track`) takes them back after they failed to be sent.
+static void track_syns(
+    struct sender *const sender,
+    const unsigned int first,
+    const unsigned int count,
+    const uint64_t now_ns,
+    const bool track
+) {
+    for (unsigned int i = first; i < first + count; i++) {
+        const struct packet_template *const template =
+            sender->mix.templates[sender->schedule[i]];
+        if (template->l4_proto != IP_PROTO_TCP) {
+            continue;
+        }
+        const uint8_t *const tcp_header = sender->slots
+            + sender->slot_of[i] * sender->slot_size + template->l4_offset;
+        if (track) {
+            responses_track(sender->tracker, tcp_header, now_ns,
+                &sender->syn_stats);
+        }
+        else {
+            responses_untrack(sender->tracker, tcp_header,
+                &sender->syn_stats);
+        }
+    }
+}
+
+// NOTE: Whether launch times get attached, whether any fields get
+// varied, whether a mix of templates gets sent, and whether payloads
+// come from a corpus is fixed for a whole phase; rather than testing
+// these for every batch, the loop below gets stamped out once per
+// combination (see SEND_LOOPS), and sender_load_mix() picks the one to
+// run.
+static ALWAYS_INLINE void run_loop(
+    struct sender *const sender,
+    const bool txtime, const bool vary, const bool mix, const bool corpus
+) {
+    const struct ProgramArgs *const program_args = sender->program_args;
+    const struct packet_template *const template = sender->template;
+    uint8_t *const slots = sender->slots;
+    const size_t slot_size = sender->slot_size;
+    struct xorshift32 rng = sender->rng;
+
     // Compiler optimizations likely override this anyhow
     if (!program_args->advanced.no_cpu_prefetch) {
-        PREFETCH(packet_buffer, 1, 3);
-        PREFETCH(iov, 0, 3);
+        PREFETCH(slots, 1, 3);
+        PREFETCH(sender->iov, 0, 3);
     }
 
-    for (;;) {
-        // Randomize source IP and port
-        ip_header->saddr.address = htonl(
-            program_args->ipv4->saddr.address
-            + (rand() % ip_diff)
-        );
-        tcp_header->sport = htons(rand() % 65536);
+    // A scenario phase may ask for smaller batches than were allocated.
+    const unsigned int requested_batch =
+        (program_args->advanced.buffer_size > 0)
+        ? program_args->advanced.buffer_size : 1;
+    const unsigned int batch_size = (requested_batch < sender->batch_size)
+        ? requested_batch : sender->batch_size;
+
+    sender->stats = (struct send_stats){0};
+    sender->syn_stats = (struct syn_stats){0};
 
-        writev(program_args->socket, iov, 37);
+    // With fewer packets per interval than threads, some threads are
+    // left without a share; they must not end up unpaced.
+    if (sender->rate == 0 && program_args->traffic.rate != 0) {
+        return;
     }
 
+    struct pacer pacer;
+    pacer_start(&pacer, program_args->traffic.shape, sender->rate,
+        program_args->traffic.interval_ns);
+    const uint64_t start_ns = pacer.start_ns;
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? start_ns + program_args->traffic.duration * NSEC_PER_SEC : 0;
+    uint64_t last_batch_ns = 0;
+    bool reported_error = false;
+
+    // With launch times, the packets are handed to the kernel ahead of
+    // time (by up to "lead"), and the qdisc takes care of the gaps.
+    const uint64_t lead_ns = program_args->traffic.txtime_lead_ns;
+    int64_t tai_offset_ns = txtime ? txtime_clock_offset() : 0;
+    uint64_t tai_offset_at_ns = start_ns;
+
+    // Where in the schedule of a mix the next batch starts; a single
+    // template's batches always start at its first slot.
+    unsigned int position = 0;
+
+    sender->stamp_countdown = program_args->traffic.tx_stamp_every;
 
     // For maximal performance, do the bare-minimum processing in this
     // loop.  As of now, the Kernel syscall is the bottleneck.
-    /*for (;;) {
-        // Randomize source IP and port
-        ip_header->saddr.address = htonl(
-            program_args->src_ip_start.address
-            + (rand() % ip_diff)
-        );
-        tcp_header->sport = htons(rand() % 65536);
+    while (!STOP_REQUESTED) {
+        // Batches never wrap around the end of the schedule.
+        const unsigned int room = sender->arena_size - position;
+        const unsigned int wanted =
+            (mix && room < batch_size) ? room : batch_size;
+        const unsigned int count = txtime
+            ? pacer_schedule(
+                &pacer, wanted, lead_ns, sender->launch_ns)
+            : pacer_acquire(&pacer, wanted);
+        const uint64_t batch_ns = clock_now_ns();
+
+        if (deadline_ns != 0 && batch_ns >= deadline_ns) {
+            break;
+        }
+        if (last_batch_ns != 0) {
+            histogram_record(
+                &sender->stats.gaps, batch_ns - last_batch_ns);
+        }
+        last_batch_ns = batch_ns;
+
+        // Our clock and CLOCK_TAI are only tied together by the offset
+        // (which slewing or a drifting counter would slowly skew).
+        if (txtime && batch_ns - tai_offset_at_ns >= NSEC_PER_SEC) {
+            tai_offset_ns = txtime_clock_offset();
+            tai_offset_at_ns = batch_ns;
+        }
+
+        // Vary the fields of the whole batch (e.g., source address and
+        // port), patching the checksums incrementally (RFC 1624); TSval
+        // ticks in milliseconds, as RFC 7323 suggests, and the test tag
+        // gets stamped with the time of the batch.
+        if (corpus) {
+            load_payloads(sender, position, count, mix);
+        }
+        if (vary && mix) {
+            vary_window(sender, position, count, batch_ns, &rng);
+        }
+        else if (vary) {
+            vary_apply(&template->vary, &sender->vary[0], slots,
+                slot_size, count, batch_ns, &rng);
+        }
+
+        if (txtime) {
+            for (unsigned int i = 0; i < count; i++) {
+                txtime_set(sender->controls
+                    + (position + i) * TXTIME_CONTROL_SIZE,
+                    sender->launch_ns[i] + (uint64_t)tai_offset_ns);
+            }
+        }
+
+        if (sender->tracker != NULL) {
+            track_syns(sender, position, count, batch_ns, true);
+        }
+
+#if defined(__linux__)
+        const unsigned int sampled = (sender->sampler != NULL)
+            ? sample_packet(sender, position, count) : UINT_MAX;
+#endif
+
+        const int sent =
+            send_batch(program_args->socket, sender, position, count);
+
+#if defined(__linux__)
+        if (sampled != UINT_MAX) {
+            unsample_packet(sender, position + sampled, txtime);
+            tstamp_sent(sender->sampler,
+                sent > 0 && (unsigned int)sent > sampled);
+        }
+#endif
+
+        const unsigned int done = (sent > 0) ? (unsigned int)sent : 0;
+        if (sender->tracker != NULL) {
+            track_syns(sender, position + done, count - done, 0, false);
+        }
+
+        // The packets that did not get sent (be it for a partial send
+        // or a drop) hand their sequence numbers on to the next batch,
+        // so that the receiver only counts those lost after sending.
+        if (vary && mix && done < count) {
+            unstamp_window(sender, position + done, count - done);
+        }
+        else if (vary && done < count) {
+            vary_unstamp(&template->vary, &sender->vary[0],
+                count - done);
+        }
+
+        // (Of the batch, what the next one starts behind, in a mix.)
+        unsigned int passed = done;
+        if (sent > 0) {
+            pacer_consume(&pacer, (unsigned int)sent);
+            sender->stats.packets += (uint64_t)sent;
+            if (corpus) {
+                const unsigned int stride = sender->iov_per_packet;
+                const struct iovec *const iov = &sender->iov[
+                    position * stride + sender->header_iov];
+                for (int i = 0; i < sent; i++) {
+                    sender->stats.bytes += iov[i * stride].iov_len
+                        + iov[i * stride + 1].iov_len;
+                }
+            }
+            else {
+                sender->stats.bytes += mix
+                    ? sender->bytes_before[position + (unsigned int)sent]
+                        - sender->bytes_before[position]
+                    : (uint64_t)sent * template->length;
+            }
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK
+            || errno == ENOBUFS
+        ) {
+            // Dropped for good (the socket buffer is full); they were
+            // still offered, so the pacer moves on to the next ones,
+            // rather than hand the same ones out again at once.
+            pacer_consume(&pacer, count);
+            sender->stats.dropped += count;
+            passed = count;
+        }
+        else {
+            sender->stats.errors++;
+            if (!reported_error) {
+                logger(LOG_ERROR,
+                    "Thread %u failed to send packets: %s",
+                    sender->id, strerror(errno)
+                );
+                reported_error = true;
+            }
+        }
+
+        // (Unless the thread of the TX timestamps drains them.)
+        if (txtime && sender->sampler == NULL) {
+            sender->stats.missed +=
+                txtime_drain_errors(program_args->socket);
+        }
+
+        // Whatever did not get sent is retried, except for drops.
+        if (mix) {
+            position += passed;
+            if (position == sender->arena_size) {
+                position = 0;
+            }
+        }
+    }
+
+    sender->stats.elapsed_ns = clock_now_ns() - start_ns;
+    sender->rng = rng;
+}
+
+// X(name, txtime, vary, mix, corpus)
+#define SEND_LOOPS \
+    X(plain, false, false, false, false) \
+    X(varied, false, true, false, false) \
+    X(txtime, true, false, false, false) \
+    X(txtime_varied, true, true, false, false) \
+    X(mixed, false, false, true, false) \
+    X(mixed_varied, false, true, true, false) \
+    X(mixed_txtime, true, false, true, false) \
+    X(mixed_txtime_varied, true, true, true, false) \
+    X(corpus, false, false, false, true) \
+    X(corpus_varied, false, true, false, true) \
+    X(corpus_txtime, true, false, false, true) \
+    X(corpus_txtime_varied, true, true, false, true) \
+    X(corpus_mixed, false, false, true, true) \
+    X(corpus_mixed_varied, false, true, true, true) \
+    X(corpus_mixed_txtime, true, false, true, true) \
+    X(corpus_mixed_txtime_varied, true, true, true, true)
 
-        //sendmsg(program_args->socket, &msg, 0);
-        //write(program_args->socket, packet_buffer, packet_length);
-        writev(program_args->socket, iov, 37);
-        //ssize_t bytes_written = writev(program_args->socket, iov, 37);
-        //if (bytes_written == -1) {
-        //    perror("writev failed");
-        //}
-    }*/
+#define X(name, txtime, vary, mix, corpus) \
+    static void run_##name(struct sender *const sender) { \
+        run_loop(sender, txtime, vary, mix, corpus); \
+    }
+SEND_LOOPS
+#undef X
+
+static sender_loop_t select_loop(
+    const bool txtime, const bool vary, const bool mix,
+    const bool corpus, const char **const name
+) {
+#define X(loop_name, loop_txtime, loop_vary, loop_mix, loop_corpus) \
+    if (txtime == (loop_txtime) && vary == (loop_vary) \
+        && mix == (loop_mix) && corpus == (loop_corpus) \
+    ) { \
+        *name = #loop_name; \
+        return run_##loop_name; \
+    }
+    SEND_LOOPS
+#undef X
+    *name = "plain";
+    return run_plain;
+}
+
+// Deals out the arena to the templates (in proportion to their
+// weights) and shuffles it; the slots of each template are then laid
+// out in the order that they get sent in.
+static void shuffle_schedule(struct sender *const sender) {
+    const struct packet_mix *const mix = &sender->mix;
+    const unsigned int arena_size = sender->arena_size;
+
+    unsigned int total_weight = 0;
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        total_weight += mix->weights[t];
+    }
+    const unsigned int repeats = arena_size / total_weight;
+
+    unsigned int i = 0;
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        for (unsigned int n = 0; n < mix->weights[t] * repeats; n++) {
+            sender->schedule[i++] = (uint8_t)t;
+        }
+    }
+    // Fisher-Yates
+    for (i = arena_size - 1; i > 0; i--) {
+        const unsigned int j =
+            xorshift32_bounded(&sender->rng, i + 1);
+        const uint8_t swapped = sender->schedule[i];
+        sender->schedule[i] = sender->schedule[j];
+        sender->schedule[j] = swapped;
+    }
+
+    unsigned int next_slot[MIX_MAX_TEMPLATES];
+    unsigned int first_slot = 0;
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        next_slot[t] = first_slot;
+        first_slot += mix->weights[t] * repeats;
+    }
+    sender->bytes_before[0] = 0;
+    for (i = 0; i < arena_size; i++) {
+        const unsigned int t = sender->schedule[i];
+        sender->slot_of[i] = (uint16_t)next_slot[t]++;
+        sender->bytes_before[i + 1] =
+            sender->bytes_before[i] + mix->templates[t]->length;
+    }
+}
+
+void sender_load(
+    struct sender *const sender,
+    const struct packet_template *const template
+) {
+    const struct packet_mix mix = {
+        .num_templates = 1,
+        .templates = {template},
+        .weights = {1},
+        .arena_size = sender->arena_size
+    };
+    sender_load_mix(sender, &mix);
+}
+
+void sender_load_mix(
+    struct sender *const sender,
+    const struct packet_mix *const mix
+) {
+    const struct ProgramArgs *const program_args = sender->program_args;
+    // (Running in the main thread is still one thread's worth.)
+    const unsigned int num_threads =
+        (program_args->advanced.num_threads > 0)
+        ? program_args->advanced.num_threads : 1;
+    bool vary = false;
+    bool payload = false;
+
+    sender->mix = *mix;
+    sender->template = mix->templates[0];
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        const struct packet_template *const template = mix->templates[t];
+        vary_state_load(&sender->vary[t], &template->vary,
+            template->buffer, sender->id, num_threads);
+        vary = vary || template->vary.num_patches > 0;
+        payload = payload || template->length > template->header_length;
+    }
+    shuffle_schedule(sender);
+
+    const bool corpus = sender->corpus != NULL;
+    const char *loop_name;
+    sender->run = select_loop(program_args->traffic.txtime, vary,
+        mix->num_templates > 1, corpus, &loop_name);
+    if (sender->id == 0) {
+        logger(LOG_DEBUG, "Sending with the \"%s\" loop.", loop_name);
+    }
+    // The (read-only) payload right behind the headers of a template
+    // doubles as the shared payload of all of its packets; likewise,
+    // its link-layer header (if any) goes in front of all of them.
+    // (All templates of a mix share the layer 2 of the command line.)
+    sender->header_iov = (mix->templates[0]->l2_length > 0) ? 1 : 0;
+    sender->iov_per_packet =
+        sender->header_iov + ((payload || corpus) ? 2 : 1);
+    if (corpus) {
+        // Threads start at different records, spread over the corpus.
+        sender->next_record = (unsigned int)(
+            (uint64_t)sender->id * sender->corpus->num_records
+            / num_threads);
+    }
+
+    for (unsigned int i = 0; i < sender->arena_size; i++) {
+        const struct packet_template *const template =
+            mix->templates[sender->schedule[i]];
+        uint8_t *const slot =
+            sender->slots + sender->slot_of[i] * sender->slot_size;
+        struct iovec *const frame =
+            &sender->iov[i * sender->iov_per_packet];
+        struct iovec *const iov = frame + sender->header_iov;
+        memcpy(slot, template->buffer, template->header_length);
+
+        if (sender->header_iov > 0) {
+            frame[0].iov_base = (void *)template->l2_header;
+            frame[0].iov_len = template->l2_length;
+        }
+        iov[0].iov_base = slot;
+        iov[0].iov_len = template->header_length;
+        if (corpus) {
+            // Nothing, until load_payloads() picks the first record.
+            sender->record_of[i] = sender->corpus->num_records;
+            iov[1].iov_base = (void *)template->buffer;
+            iov[1].iov_len = 0;
+        }
+        else if (payload) {
+            // (Possibly empty, for the templates without a payload.)
+            iov[1].iov_base =
+                (void *)(template->buffer + template->header_length);
+            iov[1].iov_len = template->length - template->header_length;
+        }
+#if defined(__linux__)
+        sender->msgs[i].msg_hdr = (struct msghdr){
+            .msg_iov = frame,
+            .msg_iovlen = sender->iov_per_packet
+        };
+        if (program_args->traffic.txtime) {
+            uint8_t *const control =
+                sender->controls + i * TXTIME_CONTROL_SIZE;
+            sender->msgs[i].msg_hdr.msg_control = control;
+            sender->msgs[i].msg_hdr.msg_controllen =
+                txtime_prepare(control);
+        }
+#endif
+    }
+}
+
+void sender_run(struct sender *const sender) {
+    sender->run(sender);
+}
+
+void sender_free(struct sender *const sender) {
+#if defined(__linux__)
+    free(sender->msgs);
+    sender->msgs = NULL;
+    free(sender->controls);
+    sender->controls = NULL;
+    free(sender->launch_ns);
+    sender->launch_ns = NULL;
+#endif
+    for (unsigned int i = 0; i < MIX_MAX_TEMPLATES; i++) {
+        vary_state_free(&sender->vary[i]);
+    }
+    free(sender->record_of);
+    sender->record_of = NULL;
+    free(sender->bytes_before);
+    sender->bytes_before = NULL;
+    free(sender->slot_of);
+    sender->slot_of = NULL;
+    free(sender->schedule);
+    sender->schedule = NULL;
+    free(sender->iov);
+    sender->iov = NULL;
+    free(sender->slots);
+    sender->slots = NULL;
+}
+
+// Thread callback
+static int send_loop(void *arg) {
+    struct sender *const sender = (struct sender *)arg;
+    const struct packet_mix *const mix = &sender->mix;
+
+    size_t max_header_length = 0;
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        if (mix->templates[t]->header_length > max_header_length) {
+            max_header_length = mix->templates[t]->header_length;
+        }
+    }
+
+    if (sender_init(sender, sender->program_args->advanced.buffer_size,
+        max_header_length, (mix->num_templates > 1) ? mix : NULL) != 0
+    ) {
+        sender->status = 1;
+    }
+    else {
+        sender_load_mix(sender, mix);
+        sender_run(sender);
+        sender_free(sender);
+    }
 
 #if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
-    return thrd_success;
+    return (sender->status == 0) ? thrd_success : thrd_error;
 #else
-    return 0;
+    return sender->status;
 #endif
 }
 
+int connect_destination(const struct ProgramArgs *const program_args) {
+    // Packet sockets are bound to their interface instead, and what
+    // the frames are addressed to is already in their headers.
+    if (program_args->protocols.l2 == PROTO_L2_ETH) {
+        return 0;
+    }
 
+    // NOTE: Instead of using sento() or sendmmsg(), both of which
+    // require a "destination info" struct, you can pre-bind your
+    // socket to a fixed destination by using connect() accompanied
+    // by write() or writev().  However, if you do want to change
+    // your destination with every call, then it might be better
+    // to use the former functions, because they'd be handling
+    // this binding inside kernelspace, bypassing what would
+    // otherwise be an extraneous overhead to a separate connect().
+    struct sockaddr_in dest_info = {
+        .sin_family = AF_INET,
+        .sin_port = 0, // Raw sockets have no notion of ports
+        .sin_addr.s_addr = htonl(program_args->ipv4->daddr.address)
+    };
+    struct sockaddr_in6 dest6_info = {
+        .sin6_family = AF_INET6,
+        .sin6_port = 0
+    };
+    memcpy(&dest6_info.sin6_addr, program_args->ipv6.daddr.octets,
+        sizeof (dest6_info.sin6_addr));
 
-// TODO: Use xorshift
-// TODO: check for POSIX_MEMLOCK
-int send_packets(struct ProgramArgs *const program_args) {
+    // A tunnel's packets are addressed to its (IPv4) endpoint instead.
+    if (program_args->tunnel.kind != TUNNEL_NONE) {
+        dest_info.sin_addr.s_addr =
+            htonl(program_args->tunnel.daddr.address);
+    }
+
+    const bool ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6
+        && program_args->tunnel.kind == TUNNEL_NONE;
+    if (connect(program_args->socket, ipv6
+            ? (const struct sockaddr *)&dest6_info
+            : (const struct sockaddr *)&dest_info,
+            ipv6 ? sizeof (dest6_info) : sizeof (dest_info)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to bind socket to the destination address: %s",
+            strerror(errno)
+        );
+        return 1;
+    }
+
+    return 0;
+}
 
+int lock_memory(const struct ProgramArgs *const program_args) {
     if (!program_args->advanced.no_mem_lock) {
         if (mlockall(MCL_FUTURE) == -1) {
             logger(LOG_ERROR,
@@ -158,105 +1467,218 @@ int send_packets(struct ProgramArgs *const program_args) {
             return 1;
         }
         else {
-            logger(LOG_INFO, "Locked memory.");
-        }
-    }
-
-    // TODO: See if this is required for a raw sendto()?
-    /*
-    struct sockaddr_in dest_info;
-    dest_info.sin_family = AF_INET;
-    dest_info.sin_port = tcp_header->dport;
-    dest_info.sin_addr.s_addr = ip_header->daddr.address;
-    size_t packet_length = ntohs(ip_header->len);
-    struct sockaddr *dest_addr = (struct sockaddr *)&dest_info;
-    size_t addr_len = sizeof (dest_info);
-    */
-
-    /*struct msghdr msg = {
-        .msg_name = &(struct sockaddr_in){
-            .sin_family = AF_INET,
-            .sin_port = tcp_header->dport,
-            .sin_addr.s_addr = ip_header->daddr.address
-        },
-        .msg_namelen = sizeof (struct sockaddr_in),
-        .msg_iov = (struct iovec[1]){
-            {
-                .iov_base = packet_buffer,
-                .iov_len = ntohs(ip_header->len)
-            }
-        },
-        .msg_iovlen = 1
-    };*/
+            logger(LOG_DEBUG, "Locked memory.");
+        }
+    }
+
+    return 0;
+}
 
-    /*
-    printf("Packet:\n");
-    printf("Source IP: %s\n", inet_ntoa(*(struct in_addr*)&ip_header->saddr.address));
-    printf("Destination IP: %s\n", inet_ntoa(*(struct in_addr*)&ip_header->daddr.address));
-    printf("Source Port: %d\n", ntohs(tcp_header->sport));
-    printf("Destination Port: %d\n", ntohs(tcp_header->dport));
-    printf("TTL: %d\n", ip_header->ttl);
-    printf("Header Length: %d\n", ip_header->ihl * 4); // ihl is in 32-bit words
-    printf("Total Length: %d\n", ntohs(ip_header->len));
-    printf("SYN Flag: %s\n", tcp_header->flags.syn ? "Set" : "Not set");
-    printf("\n");
-    */
+int unlock_memory(const struct ProgramArgs *const program_args) {
+    if (!program_args->advanced.no_mem_lock) {
+        if (munlockall() == -1) {
+            logger(LOG_ERROR,
+                "Failed to unlock used memory: %s", strerror(errno)
+            );
+            return 1;
+        }
+        else {
+            logger(LOG_DEBUG, "Unlocked used memory.");
+        }
+    }
 
+    return 0;
+}
 
+uint64_t rate_share(
+    const uint64_t rate,
+    const unsigned int index,
+    const unsigned int num_threads
+) {
+    // Split the total rate evenly; the first few threads also take
+    // the remainder, so that the shares add up to the exact rate.
+    return rate / num_threads + (index < rate % num_threads);
+}
 
-   unsigned int num_threads = program_args->advanced.num_threads;
+
+// Maps the "--payload-file;" its records replace the payloads of the
+// templates, which must therefore not have any of their own.
+static int load_corpus(
+    const struct ProgramArgs *const program_args,
+    const struct packet_mix *const mix,
+    struct payload_corpus *const corpus
+) {
+    size_t max_header_length = 0;
+    for (unsigned int t = 0; t < mix->num_templates; t++) {
+        const struct packet_template *const template = mix->templates[t];
+        if (template->length != template->header_length) {
+            logger(LOG_ERROR,
+                "The records of \"--payload-file\" set the lengths of "
+                "the packets;\n  they cannot be combined with \"--len\".");
+            return 1;
+        }
+        if (template->header_length > max_header_length) {
+            max_header_length = template->header_length;
+        }
+    }
+
+    return payload_load(corpus, program_args->traffic.payload_file,
+        program_args->traffic.payload_format,
+        program_args->traffic.payload_separator,
+        IP_PKT_MTU - max_header_length);
+}
+
+// TODO: check for POSIX_MEMLOCK
+int send_packets(
+    const struct ProgramArgs *const program_args,
+    const struct packet_mix *const mix,
+    struct send_stats *const totals
+) {
+    static struct packet_template template;
+    static struct payload_corpus corpus;
+    const struct packet_mix single = {
+        .num_templates = 1,
+        .templates = {&template},
+        .weights = {1}
+    };
+    const struct packet_mix *const packets = (mix != NULL) ? mix : &single;
+    const bool payloads = program_args->traffic.payload_file != NULL;
+
+    if ((mix == NULL && craft_template(program_args, &template) != 0)
+        || connect_destination(program_args) != 0
+        || (program_args->traffic.txtime
+            && txtime_setup(program_args) != 0)
+    ) {
+        return 1;
+    }
+
+    const unsigned int num_threads = program_args->advanced.num_threads;
+    const unsigned int num_loops = (num_threads > 0) ? num_threads : 1;
+    // NOTE: Static, because of the (sizable) histograms in the stats.
+    static struct sender senders[MAX_THREADS];
+    static struct tstamp_sampler sampler;
+    static struct response_tracker tracker;
+    bool stamping = false;
+    bool tracking = false;
+
+    if (num_threads > MAX_THREADS) {
+        logger(LOG_ERROR,
+            "At most %d threads are supported.", MAX_THREADS);
+        return 1;
+    }
+
+    if (lock_memory(program_args) != 0) {
+        return 1;
+    }
+
+    int status = 0;
+
+    // (Mapped after locking the memory, so that it gets paged in.)
+    if (payloads && load_corpus(program_args, packets, &corpus) != 0) {
+        status = 1;
+        goto UNLOCK;
+    }
+
+    if (program_args->traffic.tx_stamp_every > 0) {
+        if (tstamp_start(&sampler, program_args) != 0) {
+            status = 1;
+            goto UNLOCK;
+        }
+        stamping = true;
+    }
+    if (program_args->traffic.responses) {
+        if (responses_start(&tracker, program_args) != 0) {
+            status = 1;
+            goto UNLOCK;
+        }
+        tracking = true;
+    }
+
+    for (unsigned int i = 0; i < num_loops; i++) {
+        senders[i] = (struct sender){
+            .program_args = program_args,
+            .template = packets->templates[0],
+            .mix = *packets,
+            .corpus = payloads ? &corpus : NULL,
+            .sampler = stamping ? &sampler : NULL,
+            .tracker = tracking ? &tracker : NULL,
+            .id = i,
+            .rate = rate_share(program_args->traffic.rate, i, num_loops)
+        };
+    }
 
 // TODO: Use dlsym to check for thrds at RUNTIME.
     if (num_threads == 0) { // Run in main thread.
-        send_loop(program_args);
+        send_loop(&senders[0]);
     }
     else { // Multi-threaded
 #if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
-        //thrd_t *threads =
-        //    malloc(args.num_threads * sizeof (thrd_t));
-        thrd_t threads[MAX_THREADS];
+        thrd_t handles[MAX_THREADS];
 
         for (unsigned int i = 0; i < num_threads; i++) {
             int thread_status = thrd_create(
-                &threads[i], send_loop, program_args
+                &handles[i], send_loop, &senders[i]
             );
 
             if (thread_status != thrd_success) {
-                logger(LOG_ERROR, "Failed to spawn thread %d.", i);
+                logger(LOG_ERROR, "Failed to spawn thread %u.", i);
                 // Cleanup already-created threads
+                stop_sending();
                 for (unsigned int j = 0; j < i; j++) {
-                    thrd_join(threads[j], NULL);
+                    thrd_join(handles[j], NULL);
                 }
-                //free(threads);
-                return 1;
+                status = 1;
+                goto UNLOCK;
             }
         }
 
-        // TODO: This is never reached; add a signal handler?
         for (unsigned int i = 0; i < num_threads; i++) {
-            thrd_join(threads[i], NULL);
+            thrd_join(handles[i], NULL);
         }
 #else
-        return 1;
+        status = 1;
+        goto UNLOCK;
 #endif
     }
 
-
-
-
-    if (!program_args->advanced.no_mem_lock) {
-        if (munlockall() == -1) {
-            logger(LOG_ERROR,
-                "Failed to unlock used memory: %s", strerror(errno)
-            );
-            return 1;
-        }
-        else {
-            logger(LOG_INFO, "Unlocked used memory.");
+    *totals = (struct send_stats){0};
+    for (unsigned int i = 0; i < num_loops; i++) {
+        stats_merge(totals, &senders[i].stats);
+        status |= senders[i].status;
+    }
+    if (stamping) {
+        tstamp_stop(&sampler);
+        stamping = false;
+        totals->missed += sampler.stats.missed;
+        tstamp_stats_report("TX timestamps", &sampler.stats);
+    }
+    if (tracking) {
+        static struct syn_stats syn_totals;
+        syn_totals = (struct syn_stats){0};
+        for (unsigned int i = 0; i < num_loops; i++) {
+            syn_stats_merge(&syn_totals, &senders[i].syn_stats);
         }
+        responses_stop(&tracker, &syn_totals);
+        tracking = false;
+        syn_stats_report("Responses", &syn_totals);
     }
 
-    return 0;
+UNLOCK:
+    if (stamping) {
+        tstamp_stop(&sampler);
+    }
+    if (tracking) {
+        static struct syn_stats discarded;
+        responses_stop(&tracker, &discarded);
+    }
+    if (payloads) {
+        payload_free(&corpus);
+    }
+    if (unlock_memory(program_args) != 0) {
+        return 1;
+    }
+
+    return status;
 }
 
 
@@ -9,8 +9,17 @@
 
 
 #include "./utils/intrins.h"
+#include "./utils/random.h"
 #include "./netlib/netinet.h"
+#include "./netlib/chksum.h"
 #include "./cmdline/parser.h"
+#include "pacing.h"
+#include "stats.h"
+#include "txtime.h"
+#include "tstamp.h"
+#include "responses.h"
+#include "mutate.h"
+#include "payload.h"
 
 #include <stddef.h>
 #if __STDC_VERSION__ >= 201112L
@@ -26,6 +35,7 @@ typedef union {
 
 #include <stdlib.h>
 #include <errno.h>
+#include <signal.h>
 
 #include <stdio.h>
 #include <time.h>
@@ -42,6 +52,7 @@ typedef union {
 #   endif
 #   include <arpa/inet.h>
 #   include <sys/mman.h>
+#   include <sys/socket.h>
 #   include <sys/uio.h>
 #elif defined(_WIN32)
 //#include <winsock2.h>
@@ -51,10 +62,153 @@ extern int errno; // Declared in <errno.h>
 
 #define IP_PKT_MTU 1500 // Same as Ethernet II MTU (bytes)
 #define MAX_THREADS 100 // Arbitrary limit (TODO: Remove?)
+#define CACHE_LINE 64   // Packet slots are padded to this many bytes
+#define IP6_EXT_HEADER_LENGTH 8 // Of each (minimal) extension header
+#define MIX_MAX_TEMPLATES 16   // Of a traffic profile ("--profile")
+#define MIX_MAX_ARENA 4096     // Packets in a sender's arena (a mix)
 
 
-// Thread callback
-int send_packets(struct ProgramArgs *const program_args);
+// The static parts of a packet, crafted once (outside of the sending
+// loop); the headers then get copied into every slot of each thread's
+// batch, whereas the payload behind them is shared by all packets
+// (through a second iovec), so it never gets copied at all.  The same
+// goes for the link-layer header in front of them (with "--eth").
+typedef struct packet_template {
+    _Alignas (_Alignof (max_align_t)) uint8_t buffer[IP_PKT_MTU];
+    uint8_t l2_header[ETH_MAX_HEADER_LENGTH];
+    size_t l2_length;     // 0: sent through an IP (layer 3) socket
+    size_t length;        // Total length on the wire (L3 and up)
+    size_t header_length; // Of all the headers; the payload follows
+    tunnel_kind_t tunnel; // Encapsulation (in front of the IP header)
+    size_t l3_offset;     // Offset of the (inner) IP header in buffer
+    size_t l4_offset;     // Offset of the transport header in buffer
+    size_t l4_chksum_offset; // Within the transport header
+    bool fixed_l4_chksum; // Overridden; must not be patched per packet
+    size_t tsval_offset;  // Of the TCP timestamp value (0: none)
+    size_t tag_offset;    // Of the test tag ("--run-id"; 0: none)
+    bool ipv6;            // IPv6 (rather than IPv4) header
+    uint8_t l4_proto;     // Transport protocol, for the pseudo-header
+    struct vary_program vary; // Fields that change with every packet
+} packet_template_t;
+
+int craft_template(
+    const struct ProgramArgs *const program_args,
+    struct packet_template *const template
+);
+
+// Templates that get sent in proportion to their weights (e.g., the
+// IMIX of a "--profile"); every sender expands them into its own
+// shuffled schedule of `arena_size` packets, which it then cycles
+// through, so that the mix costs no more than a single template.
+typedef struct packet_mix {
+    unsigned int num_templates;
+    const struct packet_template *templates[MIX_MAX_TEMPLATES];
+    unsigned int weights[MIX_MAX_TEMPLATES];
+    unsigned int arena_size; // A multiple of the sum of the weights
+} packet_mix_t;
+
+struct mmsghdr; // Only defined by Linux (under _GNU_SOURCE)
+
+struct sender;
+typedef void (*sender_loop_t)(struct sender *const sender);
+
+// Per-thread state of a sending loop; the batch buffers are allocated
+// once, and may be re-loaded with different templates (with headers of
+// up to the initially given length) without being torn down.
+typedef struct sender {
+    const struct ProgramArgs *program_args;
+    const struct packet_template *template;
+    unsigned int id;
+    uint64_t rate; // This thread's share of the packets per interval
+    struct send_stats stats;
+    int status;
+    // Batch buffers; the arena holds every packet of the schedule,
+    // and each batch is a window onto it (just the first packets of
+    // it, unless a mix got loaded).
+    unsigned int batch_size;
+    unsigned int arena_size;
+    size_t slot_size;
+    uint8_t *slots;      // Grouped by template; see sender_load_mix()
+    struct iovec *iov;   // (L2 header,) headers (and payload) of each
+    unsigned int iov_per_packet;
+    unsigned int header_iov; // Index of the headers among those
+    struct mmsghdr *msgs;
+    uint8_t *controls;   // TXTIME_CONTROL_SIZE bytes per packet
+    uint64_t *launch_ns; // Of the packets in the current batch
+    // Kernel TX timestamps ("--tx-timestamps"); the sampled packet's
+    // control message(s) get composed in here, just for its syscall.
+    struct tstamp_sampler *sampler; // NULL: none
+    unsigned int stamp_countdown;   // Packets until the next sample
+    size_t stamp_own_length;        // Of the sampled one's own
+    union {
+        size_t align;
+        uint8_t data[TXTIME_CONTROL_SIZE + TSTAMP_CONTROL_SIZE];
+    } stamp_control;
+    // The answers to the SYNs ("--responses"); this thread's own
+    // counters of the SYNs it tracked.
+    struct response_tracker *tracker; // NULL: none
+    struct syn_stats syn_stats;
+    // The (shuffled) schedule of a mix, in sending order.
+    uint8_t *schedule;      // Template of each packet
+    uint16_t *slot_of;      // Slot (in the arena) of each packet
+    uint64_t *bytes_before; // Sum of the lengths of earlier packets
+    // Payloads from a "--payload-file" (NULL: those of the templates).
+    const struct payload_corpus *corpus;
+    uint32_t *record_of;    // Current record of each packet
+    unsigned int next_record;
+    struct packet_mix mix;
+    unsigned int num_vary;  // Initialized states (one per template)
+    struct vary_state vary[MIX_MAX_TEMPLATES];
+    struct xorshift32 rng;
+    sender_loop_t run; // Specialized for the template (see sender_load())
+} sender_t;
+
+// `mix` is NULL for senders of single templates (see sender_load()).
+int sender_init(
+    struct sender *const sender,
+    const unsigned int batch_size,
+    const size_t max_header_length,
+    const struct packet_mix *const mix
+);
+void sender_load(
+    struct sender *const sender,
+    const struct packet_template *const template
+);
+// Needs a sender that was initialized for (at least) this large a mix.
+void sender_load_mix(
+    struct sender *const sender,
+    const struct packet_mix *const mix
+);
+// Sends until the duration of `sender->program_args` elapses (or
+// forever, if it is zero) or until stop_sending() gets called.
+void sender_run(struct sender *const sender);
+void sender_free(struct sender *const sender);
+
+int connect_destination(const struct ProgramArgs *const program_args);
+int lock_memory(const struct ProgramArgs *const program_args);
+int unlock_memory(const struct ProgramArgs *const program_args);
+uint64_t rate_share(
+    const uint64_t rate,
+    const unsigned int index,
+    const unsigned int num_threads
+);
+
+// Sends until the configured duration elapses (or forever, if it is
+// zero) or until stop_sending() gets called; the combined counters of
+// all threads are returned in `totals`.  Unless a `mix` of templates
+// is given, the packet gets crafted from `program_args`.
+int send_packets(
+    const struct ProgramArgs *const program_args,
+    const struct packet_mix *const mix,
+    struct send_stats *const totals
+);
+
+// Async-signal-safe; makes every sending loop return after its
+// current batch.
+void stop_sending(void);
+bool sending_stopped(void);
+// Have SIGINT/SIGTERM call stop_sending() (once).
+int install_stop_handler(void);
 
 
 #endif // PACKET_H
@@ -0,0 +1,171 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// payload.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "payload.h"
+
+
+static uint16_t record_sum(const uint8_t *const data, const size_t length) {
+    uint32_t sum = chksum_add(0, data, length);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+// Finds the end of the record at `start` and where the next one begins;
+// returns false once there are no more records.
+static bool next_record(
+    const uint8_t *const bytes, const size_t size, size_t *const start,
+    size_t *const length, const payload_format_t format,
+    const uint8_t separator
+) {
+    if (*start >= size) {
+        return false;
+    }
+
+    if (format == PAYLOAD_FORMAT_LEN16) {
+        if (size - *start < 2) {
+            *length = SIZE_MAX; // Truncated length prefix
+            return true;
+        }
+        *length = (size_t)bytes[*start] << 8 | bytes[*start + 1];
+        *start += 2;
+        if (*length > size - *start) {
+            *length = SIZE_MAX; // Truncated record
+        }
+        return true;
+    }
+
+    const uint8_t delimiter =
+        (format == PAYLOAD_FORMAT_LINES) ? '\n' : separator;
+    const uint8_t *const end =
+        memchr(bytes + *start, delimiter, size - *start);
+    *length = (end != NULL)
+        ? (size_t)(end - (bytes + *start)) : size - *start;
+    return true;
+}
+
+int payload_load(
+    struct payload_corpus *const corpus,
+    const char *const path,
+    const payload_format_t format,
+    const uint8_t separator,
+    const size_t max_length
+) {
+    *corpus = (struct payload_corpus){0};
+
+    const int descriptor = open(path, O_RDONLY);
+    struct stat status;
+    if (descriptor == -1 || fstat(descriptor, &status) != 0) {
+        logger(LOG_ERROR,
+            "Failed to open payload file \"%s\": %s",
+            path, strerror(errno));
+        if (descriptor != -1) {
+            close(descriptor);
+        }
+        return 1;
+    }
+    if (status.st_size == 0) {
+        logger(LOG_ERROR, "Payload file \"%s\" is empty.", path);
+        close(descriptor);
+        return 1;
+    }
+
+    corpus->map_size = (size_t)status.st_size;
+    corpus->map = mmap(NULL, corpus->map_size, PROT_READ, MAP_PRIVATE,
+        descriptor, 0);
+    close(descriptor); // The mapping holds on to the file.
+    if (corpus->map == MAP_FAILED) {
+        logger(LOG_ERROR,
+            "Failed to map payload file \"%s\": %s",
+            path, strerror(errno));
+        corpus->map = NULL;
+        return 1;
+    }
+    const uint8_t *const bytes = (const uint8_t *)corpus->map;
+
+    // Count first, so that the index is allocated only once.
+    unsigned int num_records = 0;
+    size_t length;
+    for (size_t start = 0;
+        next_record(bytes, corpus->map_size, &start, &length,
+            format, separator);
+        start += length + (format != PAYLOAD_FORMAT_LEN16)
+    ) {
+        if (length == SIZE_MAX) {
+            logger(LOG_ERROR,
+                "Payload file \"%s\" ends in a truncated record.", path);
+            payload_free(corpus);
+            return 1;
+        }
+        if (length > max_length) {
+            logger(LOG_ERROR,
+                "Record %u of \"%s\" has %zu bytes; at most %zu fit "
+                "behind the headers.",
+                num_records + 1, path, length, max_length
+            );
+            payload_free(corpus);
+            return 1;
+        }
+        if (length > 0 && ++num_records > PAYLOAD_MAX_RECORDS) {
+            logger(LOG_ERROR,
+                "Payload file \"%s\" has more than %u records.",
+                path, PAYLOAD_MAX_RECORDS);
+            payload_free(corpus);
+            return 1;
+        }
+    }
+    if (num_records == 0) {
+        logger(LOG_ERROR, "Payload file \"%s\" has no records.", path);
+        payload_free(corpus);
+        return 1;
+    }
+
+    corpus->records = calloc(num_records + 1, sizeof (*corpus->records));
+    if (corpus->records == NULL) {
+        logger(LOG_ERROR, "Failed to allocate the payload index.");
+        payload_free(corpus);
+        return 1;
+    }
+
+    // Empty records (e.g., blank lines) are skipped.
+    for (size_t start = 0;
+        next_record(bytes, corpus->map_size, &start, &length,
+            format, separator);
+        start += length + (format != PAYLOAD_FORMAT_LEN16)
+    ) {
+        if (length > 0) {
+            corpus->records[corpus->num_records++] =
+                (struct payload_record){
+                    .data = bytes + start,
+                    .length = (uint16_t)length,
+                    .sum = record_sum(bytes + start, length)
+                };
+        }
+    }
+    corpus->records[num_records] = (struct payload_record){
+        .data = bytes, .length = 0, .sum = 0
+    };
+
+    logger(LOG_INFO, "Loaded %u payload record(s) from \"%s\".",
+        corpus->num_records, path);
+
+    return 0;
+}
+
+void payload_free(struct payload_corpus *const corpus) {
+    if (corpus->map != NULL) {
+        (void)munmap(corpus->map, corpus->map_size);
+        corpus->map = NULL;
+    }
+    free(corpus->records);
+    corpus->records = NULL;
+    corpus->num_records = 0;
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: payload.c
+// ---------------------------------------------------------------------
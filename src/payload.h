@@ -0,0 +1,93 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// payload.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+
+#include "./cmdline/logger.h"
+#include "./netlib/chksum.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_POSIX_C_SOURCE)
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+#define PAYLOAD_MAX_RECORDS (1U << 20)
+
+
+// How the records of a "--payload-file" are delimited:
+//  - lines: by newlines (which are not part of the records);
+//  - separator: by any other byte (e.g., NUL); or
+//  - len16: each one follows its length (16 bits, big-endian).
+typedef enum payload_format {
+    PAYLOAD_FORMAT_LINES = 0,
+    PAYLOAD_FORMAT_SEPARATOR,
+    PAYLOAD_FORMAT_LEN16
+} payload_format_t;
+
+// Leads the payload of every packet of a test run ("--run-id"), as part
+// of the headers, so that a "--sink" can pick the packets of that run
+// out of any other traffic, count them, and tell which went missing or
+// arrived out of order (and how late).  Network byte order; the 64-bit
+// fields are split into 32-bit halves (high one first), which keeps
+// the tag free of padding and 32-bit aligned.
+#define TEST_TAG_MAGIC 0x425A5254 // "BZRT"
+typedef struct test_tag {
+    uint32_t magic;
+    uint32_t run_id;
+    uint32_t thread;    // Index of the sending thread
+    uint32_t seq[2];    // Counts up (from 0) with every packet of that
+                        // thread
+    uint32_t tx_ns[2];  // When it was sent, on the sender's clock
+} test_tag_t;
+
+typedef struct payload_record {
+    const uint8_t *data; // Within the mapped file
+    uint16_t length;
+    uint16_t sum;        // Ones' complement sum (folded, not inverted)
+} payload_record_t;
+
+// The records of a payload file, which stays mapped (read-only) for as
+// long as the packets refer to it; none of them ever gets copied.
+//
+// Since the sum of every record is known up front, a packet's checksum
+// only needs an incremental update (RFC 1624) when its payload changes.
+typedef struct payload_corpus {
+    void *map;
+    size_t map_size;
+    unsigned int num_records;
+    // Followed by an empty record (at index num_records), which stands
+    // for the (lack of a) payload of the templates themselves.
+    struct payload_record *records;
+} payload_corpus_t;
+
+// Maps and indexes `path`; fails if a record exceeds `max_length`.
+int payload_load(
+    struct payload_corpus *const corpus,
+    const char *const path,
+    const payload_format_t format,
+    const uint8_t separator,
+    const size_t max_length
+);
+void payload_free(struct payload_corpus *const corpus);
+
+
+#endif // PAYLOAD_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: payload.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,310 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// profile.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "profile.h"
+
+
+// The (simple) IMIX: IP lengths and their weights.
+static const unsigned int IMIX_LENGTHS[] = {40, 576, 1500};
+static const unsigned int IMIX_WEIGHTS[] = {7, 4, 1};
+#define IMIX_NUM_ENTRIES (sizeof (IMIX_LENGTHS) / sizeof (IMIX_LENGTHS[0]))
+
+// Every entry starts from the command line, not the prior entry.
+static int copy_args(
+    const struct ProgramArgs *const program_args,
+    struct profile_entry *const entry
+) {
+    entry->args = *program_args;
+    entry->args.ipv4 = malloc(sizeof (*(program_args->ipv4)));
+    entry->args.tcp = malloc(sizeof (*(program_args->tcp)));
+    if (entry->args.ipv4 == NULL || entry->args.tcp == NULL) {
+        logger(LOG_ERROR, "Failed to allocate the profile.");
+        return 1;
+    }
+    *(entry->args.ipv4) = *(program_args->ipv4);
+    *(entry->args.tcp) = *(program_args->tcp);
+    entry->args.traffic.profile_file = NULL;
+
+    return 0;
+}
+
+// Parses (and crafts) an entry; returns -1 for a blank line.
+static int load_entry(
+    const struct ProgramArgs *const program_args,
+    struct profile_entry *const entry,
+    unsigned int *const weight,
+    const unsigned int line_number
+) {
+    char *argv[PROFILE_MAX_ARGS];
+    int argc = 0;
+
+    // Everything after a '#' is a comment.
+    char *const comment = strchr(entry->line, '#');
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+
+    const char *const weight_text = strtok(entry->line, " \t\r\n");
+    if (weight_text == NULL) {
+        return -1; // Blank line; not an entry.
+    }
+    char *end;
+    const unsigned long parsed = strtoul(weight_text, &end, 10);
+    if (*end != '\0' || weight_text[0] == '-'
+        || parsed == 0 || parsed > PROFILE_MAX_WEIGHT
+    ) {
+        logger(LOG_ERROR,
+            "Line %u: an entry must start with its weight (1-%d), not "
+            "\"%s\".", line_number, PROFILE_MAX_WEIGHT, weight_text
+        );
+        return 1;
+    }
+    *weight = (unsigned int)parsed;
+
+    for (char *token = strtok(NULL, " \t\r\n"); token != NULL;
+        token = strtok(NULL, " \t\r\n")
+    ) {
+        if (argc == PROFILE_MAX_ARGS) {
+            logger(LOG_ERROR,
+                "Line %u: an entry may have at most %d options.",
+                line_number, PROFILE_MAX_ARGS
+            );
+            return 1;
+        }
+        argv[argc++] = token;
+    }
+
+    if (copy_args(program_args, entry) != 0) {
+        return 1;
+    }
+    if (parse_phase_args(argc, argv, &entry->args) != 0) {
+        logger(LOG_ERROR, "Line %u: invalid options.", line_number);
+        return 1;
+    }
+
+    if (entry->args.traffic.profile_file != NULL
+        || entry->args.traffic.scenario_file != NULL
+        || entry->args.rfc2544.enabled
+        || entry->args.general.opt_info
+    ) {
+        logger(LOG_ERROR,
+            "Line %u: entries cannot nest profiles, run scenarios or "
+            "benchmarks, or print information.", line_number
+        );
+        return 1;
+    }
+
+    // All entries share the one (raw) socket of the command line,
+    // which is connected to its destination.
+    if (entry->args.protocols.l3 != program_args->protocols.l3
+        || entry->args.tunnel.kind != program_args->tunnel.kind
+        || entry->args.tunnel.daddr.address
+            != program_args->tunnel.daddr.address
+        || entry->args.ipv4->daddr.address
+            != program_args->ipv4->daddr.address
+        || memcmp(entry->args.ipv6.daddr.octets,
+            program_args->ipv6.daddr.octets, sizeof (ip6_addr_t)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Line %u: entries cannot switch between IPv4 and IPv6, nor "
+            "change the destination\n  address or tunnel.", line_number
+        );
+        return 1;
+    }
+    if (entry->args.eth_misc.interface
+        != program_args->eth_misc.interface
+    ) {
+        logger(LOG_ERROR,
+            "Line %u: entries cannot give \"--eth\"; it belongs on the "
+            "command line.", line_number
+        );
+        return 1;
+    }
+
+    if (craft_template(&entry->args, &entry->template) != 0) {
+        logger(LOG_ERROR,
+            "Line %u: cannot craft the packet.", line_number);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int load_file(
+    const struct ProgramArgs *const program_args,
+    struct traffic_profile *const profile
+) {
+    const char *const path = program_args->traffic.profile_file;
+    FILE *const file = fopen(path, "r");
+    if (file == NULL) {
+        logger(LOG_ERROR,
+            "Failed to open profile \"%s\": %s", path, strerror(errno));
+        return 1;
+    }
+
+    int status = 0;
+    unsigned int line_number = 0;
+
+    while (status == 0) {
+        if (profile->num_entries == MIX_MAX_TEMPLATES) {
+            logger(LOG_ERROR,
+                "A profile may have at most %d entries.",
+                MIX_MAX_TEMPLATES
+            );
+            status = 1;
+            break;
+        }
+
+        struct profile_entry *const entry =
+            &profile->entries[profile->num_entries];
+        if (fgets(entry->line, sizeof (entry->line), file) == NULL) {
+            break;
+        }
+        line_number++;
+
+        if (strchr(entry->line, '\n') == NULL && !feof(file)) {
+            logger(LOG_ERROR,
+                "Line %u: longer than %d characters.",
+                line_number, PROFILE_MAX_LINE - 1
+            );
+            status = 1;
+            break;
+        }
+
+        const int entry_status = load_entry(program_args, entry,
+            &profile->mix.weights[profile->num_entries], line_number);
+        if (entry_status == 0) {
+            profile->num_entries++;
+        }
+        else if (entry_status > 0) {
+            status = 1;
+        }
+    }
+
+    if (ferror(file)) {
+        logger(LOG_ERROR,
+            "Failed to read profile \"%s\": %s", path, strerror(errno));
+        status = 1;
+    }
+    fclose(file);
+
+    if (status == 0 && profile->num_entries == 0) {
+        logger(LOG_ERROR, "Profile \"%s\" has no entries.", path);
+        status = 1;
+    }
+
+    return status;
+}
+
+// Crafts the IMIX out of the command line's packet; the small packets
+// are only as small as its headers allow (e.g., 48 bytes for IPv6).
+static int load_imix(
+    const struct ProgramArgs *const program_args,
+    struct traffic_profile *const profile
+) {
+    struct profile_entry *const first = &profile->entries[0];
+    if (copy_args(program_args, first) != 0
+        || craft_template(&first->args, &first->template) != 0
+    ) {
+        return 1;
+    }
+    const size_t header_length = first->template.header_length;
+
+    for (unsigned int i = 0; i < IMIX_NUM_ENTRIES; i++) {
+        struct profile_entry *const entry = &profile->entries[i];
+        const size_t length = (IMIX_LENGTHS[i] > header_length)
+            ? IMIX_LENGTHS[i] : header_length;
+
+        if (i > 0 && copy_args(program_args, entry) != 0) {
+            return 1;
+        }
+        // (With a tunnel, these are the lengths of the outer packets.)
+        const size_t inner_length = length - first->template.l3_offset;
+        if (entry->args.protocols.l3 == PROTO_L3_IPV6) {
+            entry->args.ipv6_misc.override_length = true;
+            entry->args.ipv6.len =
+                (uint16_t)(inner_length - sizeof (struct ip6_hdr));
+        }
+        else {
+            entry->args.ipv4_misc.override_length = true;
+            entry->args.ipv4->len = (uint16_t)inner_length;
+        }
+        if (craft_template(&entry->args, &entry->template) != 0) {
+            return 1;
+        }
+
+        profile->mix.weights[i] = IMIX_WEIGHTS[i];
+        profile->num_entries++;
+    }
+
+    return 0;
+}
+
+int load_profile(
+    const struct ProgramArgs *const program_args,
+    struct traffic_profile *const profile
+) {
+    const int status =
+        (strcmp(program_args->traffic.profile_file, "imix") == 0)
+        ? load_imix(program_args, profile)
+        : load_file(program_args, profile);
+    if (status != 0) {
+        return 1;
+    }
+
+    struct packet_mix *const mix = &profile->mix;
+    unsigned int total_weight = 0;
+    for (unsigned int i = 0; i < profile->num_entries; i++) {
+        mix->templates[i] = &profile->entries[i].template;
+        total_weight += mix->weights[i];
+    }
+    mix->num_templates = profile->num_entries;
+
+    if (total_weight > PROFILE_MAX_WEIGHT) {
+        logger(LOG_ERROR,
+            "The weights of a profile may add up to at most %d.",
+            PROFILE_MAX_WEIGHT
+        );
+        return 1;
+    }
+
+    // Every sender cycles through (a shuffle of) whole multiples of
+    // the weights, which must hold at least a batch.
+    const unsigned int batch_size = program_args->advanced.buffer_size;
+    const unsigned int min_arena = (batch_size > PROFILE_MIN_ARENA)
+        ? batch_size : PROFILE_MIN_ARENA;
+    mix->arena_size = total_weight
+        * ((min_arena + total_weight - 1) / total_weight);
+    if (mix->arena_size > MIX_MAX_ARENA) {
+        logger(LOG_ERROR,
+            "The profile would need arenas of %u packets (at most %d).",
+            mix->arena_size, MIX_MAX_ARENA
+        );
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < profile->num_entries; i++) {
+        logger(LOG_DEBUG, "Profile entry %u: %zu bytes, weight %u.",
+            i + 1, profile->entries[i].template.length, mix->weights[i]);
+    }
+
+    return 0;
+}
+
+// Also frees the headers of an entry that failed to load.
+void free_profile(struct traffic_profile *const profile) {
+    for (unsigned int i = 0; i < MIX_MAX_TEMPLATES; i++) {
+        free(profile->entries[i].args.ipv4);
+        profile->entries[i].args.ipv4 = NULL;
+        free(profile->entries[i].args.tcp);
+        profile->entries[i].args.tcp = NULL;
+    }
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: profile.c
+// ---------------------------------------------------------------------
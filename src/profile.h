@@ -0,0 +1,70 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// profile.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef PROFILE_H
+#define PROFILE_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./cmdline/parser.h"
+#include "packet.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_MAX_LINE 1024  // Characters per entry (line)
+#define PROFILE_MAX_ARGS 64    // Options per entry
+#define PROFILE_MAX_WEIGHT 1024 // Of all entries together
+// Arenas are at least this large (or a batch, if larger), so that the
+// shuffled schedule does not repeat too soon.
+#define PROFILE_MIN_ARENA 1024
+
+
+typedef struct profile_entry {
+    // The parser may keep pointers into its (tokenized) arguments, so
+    // the line has to outlive the entry's arguments.
+    char line[PROFILE_MAX_LINE];
+    struct ProgramArgs args; // Owns its (own copies of the) headers
+    struct packet_template template;
+} profile_entry_t;
+
+// A weighted mix of packets ("--profile"), crafted into templates.
+//
+// Every line of the file is an entry: a weight followed by the packet
+// options (as accepted on the command line) that set it apart from the
+// others.  Entries do not inherit from each other; each one starts
+// from the command line.
+//
+//     # weight  options
+//     7         --len=40
+//     4         --len=576  --dscp=af11
+//     1         --len=1500 --dest-port=443
+//
+// Instead of a file, "imix" stands for the above (simple) IMIX of
+// 40-, 576-, and 1500-byte packets (in terms of their IP length).
+typedef struct traffic_profile {
+    unsigned int num_entries;
+    struct profile_entry entries[MIX_MAX_TEMPLATES];
+    struct packet_mix mix;
+} traffic_profile_t;
+
+int load_profile(
+    const struct ProgramArgs *const program_args,
+    struct traffic_profile *const profile
+);
+void free_profile(struct traffic_profile *const profile);
+
+
+#endif // PROFILE_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: profile.h
+// ---------------------------------------------------------------------
@@ -9,12 +9,19 @@
 
 
 #include "./netlib/netinet.h"
+#include "./netlib/arpa.h"
 #include "./cmdline/logger.h"
 #include "./utils/endian.h"
+#include "pacing.h"
+#include "mutate.h"
+#include "payload.h"
 
 #include <stdbool.h>
 #include <stdint.h>
 
+#define RFC2544_MAX_FRAME_SIZES 16
+#define IP6_MAX_EXT_HEADERS 8
+
 
 // It is better to contain everything within a single struct, as
 // opposed to having a bunch of global variables all over the place.
@@ -59,6 +66,69 @@ typedef struct ProgramArgs {
         bool no_mem_lock;
         bool no_cpu_prefetch;
     } advanced;
+    // Traffic
+    struct {
+        uint64_t rate;         // Packets per interval (0: unlimited)
+        uint64_t interval_ns;  // One second, except for bursts
+        traffic_shape_t shape;
+        bool txtime;           // Stamp launch times (SO_TXTIME)
+        uint64_t txtime_lead_ns;
+        // Packets (per thread) between those sampled for kernel TX
+        // timestamps ("--tx-timestamps"; 0: none)
+        unsigned int tx_stamp_every;
+        // Match the SYN-ACKs and RSTs to the SYNs ("--responses")
+        bool responses;
+        unsigned int duration; // Seconds (0: until interrupted)
+        const char *scenario_file;
+        const char *profile_file; // Or "imix"
+        const char *payload_file;
+        payload_format_t payload_format;
+        uint8_t payload_separator;
+    } traffic;
+    // RFC 2544 Benchmark
+    struct {
+        bool enabled;
+        unsigned int num_sizes;
+        unsigned int frame_sizes[RFC2544_MAX_FRAME_SIZES];
+        unsigned int trial_time;  // Seconds per trial
+        const char *rx_interface; // NULL: listen on all interfaces
+    } rfc2544;
+    // Test runs: the tag that marks the packets of one ("--run-id"),
+    // and the receiver that counts them ("--sink", on "--rx-if")
+    struct {
+        bool tagged;
+        uint32_t run_id;
+        bool sink;
+    } run;
+    // Protocols of the crafted packets
+    struct {
+        osi_proto_t l2; // "--eth" (on an AF_PACKET socket) or none
+        osi_proto_t l3; // "--ipv6" (or an IPv6 destination) or IPv4
+        osi_proto_t l4; // The last of "--tcp"/"--udp" (default: TCP)
+    } protocols;
+    // Ethernet II (the EtherType is in host byte order)
+    struct eth_hdr eth;
+    struct {
+        const char *interface; // To send the frames through
+        bool override_source;
+        bool override_dest;
+        bool override_type;
+        unsigned int num_vlans;
+        uint16_t vlan_tci[ETH_MAX_VLANS]; // Outermost first (host order)
+    } eth_misc;
+    // Tunnel ("--encap"), of which the outer header is always IPv4
+    // (host byte order)
+    struct {
+        tunnel_kind_t kind;
+        ip_addr_t saddr;
+        ip_addr_t daddr;
+        bool override_source;
+        bool has_gre_key;
+        uint32_t gre_key;
+        uint32_t vni;
+        eth_addr_t inner_saddr; // Of the inner Ethernet header (VXLAN)
+        eth_addr_t inner_daddr;
+    } tunnel;
     // IPv4
     struct ip_hdr *ipv4;
     struct {
@@ -70,12 +140,87 @@ typedef struct ProgramArgs {
         bool override_checksum;
         bool override_source;
         bool override_length;
+        bool override_proto;
+        bool override_ihl;
+        // Compiled from "--options" (in network byte order), padded to
+        // a multiple of 4 bytes.
+        uint8_t options[IP_MAX_OPTIONS_LENGTH];
+        unsigned int options_length;
     } ipv4_misc;
-    // TODO: IPv6
+    // IPv6 (host byte order, except for the addresses)
+    struct ip6_hdr ipv6;
+    struct {
+        bool override_source;
+        bool override_length;
+        bool override_next_header;
+        bool random_traffic_class; // Per packet
+        bool random_flow_label;    // Per packet
+        unsigned int num_ext_headers;
+        ip6_ext_kind_t ext_headers[IP6_MAX_EXT_HEADERS];
+    } ipv6_misc;
     // TCP
     struct tcp_hdr *tcp;
-    // TODO: UDP
-    // TODO: ICMP
+    struct {
+        bool override_sport;
+        bool override_flags; // The first flag replaces the default SYN
+        bool override_data_ofs;
+        bool override_checksum;
+        // Compiled from "--options" (in network byte order), padded to
+        // a multiple of 4 bytes.
+        uint8_t options[TCP_MAX_OPTIONS_LENGTH];
+        unsigned int options_length;
+        unsigned int tsval_offset; // Within options (0: no timestamp)
+    } tcp_misc;
+    // UDP
+    struct udp_hdr udp;
+    struct {
+        bool override_sport;
+        bool override_length;
+        bool override_checksum;
+    } udp_misc;
+    // ICMP echo ("--icmp"), which probes the round-trip latency to the
+    // destination instead of sending crafted packets (host byte order)
+    struct {
+        uint16_t id;           // Identifier of the echo requests
+        bool override_id;      // (Otherwise, that of the process)
+        unsigned int size;     // Bytes of data in each request
+        uint64_t timeout_ns;   // Until a request counts as lost
+    } icmp;
+    // TWAMP-light (RFC 5357, Appendix I): the Session-Sender ("--twamp")
+    // of UDP test packets, or the Session-Reflector ("--reflect") that
+    // sends them back, timestamped (host byte order)
+    struct {
+        bool sender;
+        bool reflector;
+        uint16_t port;         // Of the reflector
+        unsigned int padding;  // Bytes after each test packet
+    } twamp;
+    // Real TCP connections ("--connect") to the destination address and
+    // port, through ordinary (unprivileged) sockets, at "--rate"
+    struct {
+        bool enabled;
+        unsigned int concurrency; // Connections in flight, per thread
+        uint64_t timeout_ns;      // Of the handshake (and the response)
+        const char *request_file; // Sent once connected (NULL: none)
+    } conn;
+    // Plain UDP datagrams ("--dgram") of the crafted packets' payload,
+    // through ordinary (unprivileged) sockets, at "--rate"
+    struct {
+        bool enabled;
+        bool no_gso;              // "--no-gso": one datagram per message
+        bool zerocopy;            // "--zerocopy" (MSG_ZEROCOPY)
+    } dgram;
+    // DNS queries ("--dns") over the sockets of "--dgram", matched to
+    // their responses
+    struct {
+        const char *query_file;   // One "<name> [<type>]" per line
+        uint64_t timeout_ns;      // "--dns-timeout": until one is lost
+    } dns;
+    // Per-packet field generators ("--vary")
+    struct {
+        unsigned int num_specs;
+        struct vary_spec specs[VARY_MAX_SPECS];
+    } vary;
 } program_args_t;
 
 
@@ -0,0 +1,279 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// responses.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: Like sendmmsg() (see packet.c), recvmmsg() is only declared
+// under _GNU_SOURCE.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "responses.h"
+
+
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+#define ANSWER_FLAGS (TCP_FLAG_SYN | TCP_FLAG_ACK)
+
+// Lets through the SYN-ACKs and RSTs from the destination address and
+// port (patched into the jumps marked below), truncated to the headers.
+// An IPv4 raw socket gets to see the IP header, with the TCP header
+// right behind its options.
+static const struct sock_filter IPV4_FILTER[] = {
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0 /* address */, 0, 8),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 0),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0 /* port */, 0, 5),
+    BPF_STMT(BPF_LD | BPF_B | BPF_IND, 13),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, TCP_FLAG_RST, 2, 0),
+    BPF_STMT(BPF_ALU | BPF_AND | BPF_K, ANSWER_FLAGS),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ANSWER_FLAGS, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, RESPONSES_SNAP_LENGTH),
+    BPF_STMT(BPF_RET | BPF_K, 0)
+};
+#define IPV4_FILTER_ADDRESS 1
+#define IPV4_FILTER_PORT 4
+
+// An IPv6 one only gets to see the TCP header (behind any extension
+// headers); the source address is still there, relative to the start
+// of the network header.
+#define IPV6_SADDR_OFFSET ((uint32_t)(SKF_NET_OFF + 8))
+static const struct sock_filter IPV6_FILTER[] = {
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, IPV6_SADDR_OFFSET),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0 /* address */, 0, 13),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, IPV6_SADDR_OFFSET + 4),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0 /* address */, 0, 11),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, IPV6_SADDR_OFFSET + 8),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0 /* address */, 0, 9),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, IPV6_SADDR_OFFSET + 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0 /* address */, 0, 7),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 0),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0 /* port */, 0, 5),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 13),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, TCP_FLAG_RST, 2, 0),
+    BPF_STMT(BPF_ALU | BPF_AND | BPF_K, ANSWER_FLAGS),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ANSWER_FLAGS, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, RESPONSES_SNAP_LENGTH),
+    BPF_STMT(BPF_RET | BPF_K, 0)
+};
+#define IPV6_FILTER_ADDRESS 1 // And every other instruction up to 7
+#define IPV6_FILTER_PORT 9
+
+#define MAX_FILTER_LENGTH \
+    (sizeof (IPV6_FILTER) / sizeof (IPV6_FILTER[0]))
+
+// Compiles the filter for the destination of `program_args` into
+// `program`; returns its number of instructions.
+static unsigned short compile_filter(
+    const struct ProgramArgs *const program_args,
+    const bool ipv6,
+    struct sock_filter program[MAX_FILTER_LENGTH]
+) {
+    if (ipv6) {
+        memcpy(program, IPV6_FILTER, sizeof (IPV6_FILTER));
+        for (unsigned int i = 0; i < 4; i++) {
+            uint32_t word;
+            memcpy(&word, program_args->ipv6.daddr.octets + 4 * i,
+                sizeof (word));
+            program[IPV6_FILTER_ADDRESS + 2 * i].k = ntohl(word);
+        }
+        program[IPV6_FILTER_PORT].k = program_args->tcp->dport;
+        return MAX_FILTER_LENGTH;
+    }
+
+    memcpy(program, IPV4_FILTER, sizeof (IPV4_FILTER));
+    program[IPV4_FILTER_ADDRESS].k = program_args->ipv4->daddr.address;
+    program[IPV4_FILTER_PORT].k = program_args->tcp->dport;
+    return sizeof (IPV4_FILTER) / sizeof (IPV4_FILTER[0]);
+}
+
+// Matches an answer (that got past the filter) to its SYN.
+static void match_answer(
+    struct response_tracker *const tracker,
+    const uint8_t *const packet,
+    const size_t length,
+    const uint64_t now_ns
+) {
+    struct syn_stats *const stats = &tracker->stats;
+    const size_t offset = tracker->ipv6
+        ? 0 : (size_t)(packet[0] & 0x0F) * 4;
+    if (offset + sizeof (struct tcp_hdr) > length) {
+        return;
+    }
+
+    const uint8_t *const tcp_header = packet + offset;
+    uint16_t dport;
+    uint32_t acknum;
+    memcpy(&dport, tcp_header + offsetof(struct tcp_hdr, dport),
+        sizeof (dport));
+    memcpy(&acknum, tcp_header + offsetof(struct tcp_hdr, acknum),
+        sizeof (acknum));
+    const bool syn_ack = (tcp_header[13] & TCP_FLAG_SYN) != 0;
+
+    // Either kind of answer acknowledges the SYN's sequence number.
+    uint64_t sent_ns;
+    if (!probe_match(&tracker->probes,
+            response_key(dport, htonl(ntohl(acknum) - 1)), &sent_ns)
+    ) {
+        stats->unmatched++;
+        return;
+    }
+    if (syn_ack) {
+        stats->syn_acks++;
+        histogram_record(&stats->syn_ack_rtts, now_ns - sent_ns);
+    }
+    else {
+        stats->rsts++;
+        histogram_record(&stats->rst_rtts, now_ns - sent_ns);
+    }
+}
+
+// Thread callback
+static int receive_loop(void *arg) {
+    struct response_tracker *const tracker =
+        (struct response_tracker *)arg;
+    struct pollfd poll_info = {.fd = tracker->socket, .events = POLLIN};
+    uint8_t buffers[RESPONSES_BATCH_SIZE][RESPONSES_SNAP_LENGTH];
+    struct iovec iov[RESPONSES_BATCH_SIZE];
+    struct mmsghdr msgs[RESPONSES_BATCH_SIZE];
+
+    while (!LOAD_ACQUIRE(&tracker->done)) {
+        if (poll(&poll_info, 1, RESPONSES_POLL_TIMEOUT) <= 0) {
+            continue;
+        }
+
+        for (unsigned int i = 0; i < RESPONSES_BATCH_SIZE; i++) {
+            iov[i] = (struct iovec){
+                .iov_base = buffers[i],
+                .iov_len = sizeof (buffers[i])
+            };
+            msgs[i].msg_hdr = (struct msghdr){
+                .msg_iov = &iov[i],
+                .msg_iovlen = 1
+            };
+        }
+        const int received = recvmmsg(tracker->socket, msgs,
+            RESPONSES_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        const uint64_t now_ns = clock_now_ns();
+        for (int i = 0; i < received; i++) {
+            match_answer(tracker, buffers[i], msgs[i].msg_len, now_ns);
+        }
+    }
+
+    return thrd_success;
+}
+
+// A raw TCP socket, filtered down to the answers; anything that got
+// queued before the filter was attached gets thrown away.
+static int open_socket(
+    const struct ProgramArgs *const program_args, const bool ipv6
+) {
+    const int socket_descriptor =
+        socket(ipv6 ? AF_INET6 : AF_INET, SOCK_RAW, IP_PROTO_TCP);
+    if (socket_descriptor == -1) {
+        logger(LOG_ERROR,
+            "Failed to create a socket for the answers: %s",
+            strerror(errno));
+        return -1;
+    }
+
+    struct sock_filter filter[MAX_FILTER_LENGTH];
+    const struct sock_fprog program = {
+        .len = compile_filter(program_args, ipv6, filter),
+        .filter = filter
+    };
+    if (setsockopt(socket_descriptor, SOL_SOCKET, SO_ATTACH_FILTER,
+            &program, sizeof (program)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to attach the filter for the answers: %s",
+            strerror(errno));
+        close(socket_descriptor);
+        return -1;
+    }
+
+    uint8_t discard[RESPONSES_SNAP_LENGTH];
+    while (recv(socket_descriptor, discard, sizeof (discard),
+            MSG_DONTWAIT) >= 0
+    ) {
+        continue;
+    }
+
+    // (A SYN flood gets as many answers; see socket.c.)
+    const int buffer_size = 16 * 1024 * 1024;
+    (void)setsockopt(socket_descriptor, SOL_SOCKET, SO_RCVBUF,
+        &buffer_size, sizeof (buffer_size));
+
+    return socket_descriptor;
+}
+#endif
+
+int responses_start(
+    struct response_tracker *const tracker,
+    const struct ProgramArgs *const program_args
+) {
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+    memset(tracker, 0, sizeof (*tracker));
+    tracker->ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6;
+
+    if (probe_table_init(&tracker->probes, RESPONSES_TABLE_BITS,
+            RESPONSES_MAX_PROBES, RESPONSES_TIMEOUT_NS) != 0
+    ) {
+        logger(LOG_ERROR, "Failed to allocate the table of SYNs.");
+        return 1;
+    }
+    tracker->socket = open_socket(program_args, tracker->ipv6);
+    if (tracker->socket == -1) {
+        probe_table_free(&tracker->probes);
+        return 1;
+    }
+
+    if (thrd_create(&tracker->thread, receive_loop, tracker)
+        != thrd_success
+    ) {
+        logger(LOG_ERROR, "Failed to spawn the thread for the answers.");
+        close(tracker->socket);
+        probe_table_free(&tracker->probes);
+        return 1;
+    }
+
+    return 0;
+#else
+    (void)tracker;
+    (void)program_args;
+    logger(LOG_ERROR,
+        "\"--responses\" requires Linux and C11 threads.");
+    return 1;
+#endif
+}
+
+void responses_stop(
+    struct response_tracker *const tracker,
+    struct syn_stats *const totals
+) {
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+    sleep_until_ns(clock_now_ns() + RESPONSES_TIMEOUT_NS);
+    STORE_RELEASE(&tracker->done, 1);
+    thrd_join(tracker->thread, NULL);
+
+    // Whatever is left in the table has been waiting for too long.
+    syn_stats_merge(totals, &tracker->stats);
+    totals->unanswered += probe_table_pending(&tracker->probes);
+
+    close(tracker->socket);
+    probe_table_free(&tracker->probes);
+#else
+    (void)tracker;
+    (void)totals;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: responses.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,140 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// responses.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef RESPONSES_H
+#define RESPONSES_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./netlib/netinet.h"
+#include "./utils/clock.h"
+#include "./utils/intrins.h"
+#include "./utils/probes.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <poll.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#   if defined(__linux__)
+#       include <linux/filter.h>
+#   endif
+#endif
+
+// SYNs awaiting their answers are kept in a table of 2^20 slots (as
+// many as a second's worth at a million SYNs per second), each within
+// RESPONSES_MAX_PROBES slots of where its port and sequence number
+// hash to; a SYN counts as unanswered after RESPONSES_TIMEOUT_NS.
+#define RESPONSES_TABLE_BITS 20
+#define RESPONSES_MAX_PROBES 16
+#define RESPONSES_TIMEOUT_NS NSEC_PER_SEC
+// Bytes of each answer that get past the filter: enough for the IP
+// header (with any options) and the start of the TCP header.
+#define RESPONSES_SNAP_LENGTH 128
+// Answers received per syscall
+#define RESPONSES_BATCH_SIZE 64
+// Milliseconds to wait for answers before checking for the end.
+#define RESPONSES_POLL_TIMEOUT 100
+
+
+// NOTE: The answers come in on a raw TCP socket, which would otherwise
+// get a copy of every TCP segment the host receives; a classic BPF
+// program lets only the SYN-ACKs and RSTs from the destination address
+// and port through, so the kernel drops everything else before it
+// ever gets queued.  The answers then get matched to their SYNs by the
+// port they were sent from and the sequence number they acknowledge.
+typedef struct response_tracker {
+    int socket;
+    bool ipv6;
+    struct probe_table probes; // Keyed by response_key()
+    int done;
+    struct syn_stats stats;    // Of the receiving thread
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    thrd_t thread;
+#endif
+} response_tracker_t;
+
+// Opens the (filtered) raw socket for the answers from the destination
+// of `program_args`, and spawns the thread that matches them.
+int responses_start(
+    struct response_tracker *const tracker,
+    const struct ProgramArgs *const program_args
+);
+
+// Gives the last SYNs their chance to be answered, stops the thread,
+// and adds its counters (and the SYNs still unanswered) to `totals`.
+void responses_stop(
+    struct response_tracker *const tracker,
+    struct syn_stats *const totals
+);
+
+// Identifies a SYN by its source port and sequence number (both in
+// network byte order, as they are in the packet); never PROBE_EMPTY.
+static inline uint64_t response_key(
+    const uint16_t sport, const uint32_t seqnum
+) {
+    return (((uint64_t)ntohs(sport) << 32) | ntohl(seqnum)) + 1;
+}
+
+static inline uint64_t response_key_of(const uint8_t *const tcp_header) {
+    uint16_t sport;
+    uint32_t seqnum;
+    memcpy(&sport, tcp_header + offsetof(struct tcp_hdr, sport),
+        sizeof (sport));
+    memcpy(&seqnum, tcp_header + offsetof(struct tcp_hdr, seqnum),
+        sizeof (seqnum));
+    return response_key(sport, seqnum);
+}
+
+// Tracks the SYN of a TCP header that is about to be sent (at `now_ns`;
+// its answer may well come back before the syscall returns), and counts
+// it in the sending thread's own `stats`.
+static inline void responses_track(
+    struct response_tracker *const tracker,
+    const uint8_t *const tcp_header,
+    const uint64_t now_ns,
+    struct syn_stats *const stats
+) {
+    const probe_result_t tracked = probe_track(&tracker->probes,
+        response_key_of(tcp_header), now_ns);
+    if (tracked == PROBE_FULL) {
+        stats->untracked++;
+        return;
+    }
+    if (tracked == PROBE_REPLACED) {
+        stats->unanswered++;
+    }
+    stats->probes++;
+}
+
+// Takes a SYN back if it did not get sent after all.
+static inline void responses_untrack(
+    struct response_tracker *const tracker,
+    const uint8_t *const tcp_header,
+    struct syn_stats *const stats
+) {
+    if (probe_untrack(&tracker->probes, response_key_of(tcp_header))) {
+        stats->probes--;
+    }
+}
+
+#endif // RESPONSES_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: responses.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,313 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// rfc2544.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "rfc2544.h"
+
+
+// RFC 2544 section 9.1 (Ethernet frame sizes).
+static const unsigned int DEFAULT_FRAME_SIZES[] = {
+    64, 128, 256, 512, 1024, 1280, 1518
+};
+
+// Counts the test frames that come back, either on a second interface
+// (after having passed through the DUT) or from a reflector, which
+// swaps the addresses and ports around.
+struct rx_counter {
+    int socket;
+    uint32_t daddr; // Network byte order
+    uint16_t dport; // Network byte order
+    uint16_t length; // Network byte order; length of this trial's frames
+    uint8_t proto;
+    volatile sig_atomic_t stop;
+    uint64_t matched;
+};
+
+static bool is_test_frame(
+    const struct rx_counter *const counter,
+    const uint8_t *const frame, const size_t length
+) {
+    if (length < sizeof (struct ip_hdr)) {
+        return false;
+    }
+
+    const struct ip_hdr *const ip_header =
+        (const struct ip_hdr *)frame;
+    const size_t ip_length = (size_t)ip_header->ihl * 4;
+
+    // Matching the length, too, keeps out unrelated replies (e.g., the
+    // RSTs of a host that got our SYNs) on the reflected path.
+    if (ip_header->ver != 4 || ip_header->proto != counter->proto
+        || ip_header->len != counter->length
+        || length < ip_length + 4
+    ) {
+        return false;
+    }
+
+    // Source and destination ports lead both TCP and UDP headers.
+    uint16_t ports[2];
+    memcpy(ports, frame + ip_length, sizeof (ports));
+
+    return (ip_header->daddr.address == counter->daddr
+            && ports[1] == counter->dport)
+        || (ip_header->saddr.address == counter->daddr
+            && ports[0] == counter->dport);
+}
+
+// Thread callback
+static int count_loop(void *arg) {
+    struct rx_counter *const counter = (struct rx_counter *)arg;
+    _Alignas (_Alignof (max_align_t)) uint8_t frame[IP_PKT_MTU];
+
+    while (!counter->stop) {
+#if defined(__linux__)
+        struct sockaddr_ll link_info;
+        socklen_t link_length = sizeof (link_info);
+        const ssize_t length = recvfrom(
+            counter->socket, frame, sizeof (frame), 0,
+            (struct sockaddr *)&link_info, &link_length
+        );
+
+        // Our own frames, on their way out, are not "received."
+        if (length <= 0 || link_info.sll_pkttype == PACKET_OUTGOING) {
+            continue;
+        }
+#else
+        const ssize_t length =
+            recv(counter->socket, frame, sizeof (frame), 0);
+        if (length <= 0) {
+            continue;
+        }
+#endif
+        if (is_test_frame(counter, frame, (size_t)length)) {
+            counter->matched++;
+        }
+    }
+
+    return 0;
+}
+
+// Discard whatever a previous trial left behind in the socket buffer.
+static void drain_socket(const int socket_descriptor) {
+    uint8_t frame[IP_PKT_MTU];
+
+    while (recv(socket_descriptor, frame, sizeof (frame),
+        MSG_DONTWAIT) > 0
+    ) {
+        continue;
+    }
+}
+
+struct trial_result {
+    uint64_t sent;
+    uint64_t received;
+    double sent_pps;
+};
+
+static int run_trial(
+    const struct ProgramArgs *const program_args,
+    struct rx_counter *const counter,
+    const unsigned int frame_size,
+    const uint64_t rate,
+    struct trial_result *const result
+) {
+    // Each trial is an ordinary (time-limited) run of the sending
+    // loops, only with a different packet length and rate.
+    struct ProgramArgs trial_args = *program_args;
+    struct ip_hdr trial_ipv4 = *(program_args->ipv4);
+    trial_ipv4.len = (uint16_t)(frame_size - RFC2544_FRAME_OVERHEAD);
+    trial_args.ipv4 = &trial_ipv4;
+    trial_args.ipv4_misc.override_length = true;
+    trial_args.traffic.rate = rate;
+    trial_args.traffic.interval_ns = NSEC_PER_SEC;
+    trial_args.traffic.shape = SHAPE_CONSTANT;
+    trial_args.traffic.duration = program_args->rfc2544.trial_time;
+
+    drain_socket(counter->socket);
+    counter->length = htons(trial_ipv4.len);
+    counter->stop = 0;
+    counter->matched = 0;
+
+    struct send_stats stats = {0};
+    int status = 0;
+
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    thrd_t receiver;
+    if (thrd_create(&receiver, count_loop, counter) != thrd_success) {
+        logger(LOG_ERROR, "Failed to spawn the receiving thread.");
+        return 1;
+    }
+
+    status = send_packets(&trial_args, NULL, &stats);
+
+    // Frames may still be queued inside the DUT.
+    if (!sending_stopped()) {
+        sleep(RFC2544_SETTLE_TIME);
+    }
+    counter->stop = 1;
+    thrd_join(receiver, NULL);
+#else
+    logger(LOG_ERROR, "RFC 2544 mode requires C11 threads.");
+    return 1;
+#endif
+
+    result->sent = stats.packets;
+    result->received = counter->matched;
+    result->sent_pps = stats_pps(&stats);
+
+    logger(LOG_INFO,
+        "Trial (%u-byte frames) at %llu pkts/s: sent %llu at %.0f "
+        "pkts/s,\n  received %llu.",
+        frame_size, (unsigned long long)rate,
+        (unsigned long long)result->sent, result->sent_pps,
+        (unsigned long long)result->received
+    );
+
+    return status;
+}
+
+static bool is_lossless(const struct trial_result *const result) {
+    return result->sent > 0 && result->received >= result->sent;
+}
+
+struct search_result {
+    unsigned int frame_size;
+    double lossless_pps; // 0 if every trial lost frames
+    unsigned int trials;
+};
+
+static int search_frame_size(
+    const struct ProgramArgs *const program_args,
+    struct rx_counter *const counter,
+    struct search_result *const search
+) {
+    struct trial_result result;
+
+    // Without a user-given ceiling, the first (unpaced) trial finds
+    // out how fast we can possibly send; there is no point in
+    // searching above that.
+    uint64_t high = program_args->traffic.rate;
+    if (run_trial(program_args, counter, search->frame_size,
+        high, &result) != 0
+    ) {
+        return 1;
+    }
+    search->trials++;
+    if (high == 0) {
+        high = (uint64_t)result.sent_pps;
+    }
+    if (is_lossless(&result)) {
+        search->lossless_pps = result.sent_pps;
+        return 0;
+    }
+
+    uint64_t low = 0;
+    const uint64_t resolution = (high / RFC2544_RESOLUTION > 0)
+        ? high / RFC2544_RESOLUTION : 1;
+
+    while (high - low > resolution && !sending_stopped()) {
+        const uint64_t rate = low + (high - low) / 2;
+
+        if (run_trial(program_args, counter, search->frame_size,
+            rate, &result) != 0
+        ) {
+            return 1;
+        }
+        search->trials++;
+
+        if (is_lossless(&result)) {
+            low = rate;
+            if (result.sent_pps > search->lossless_pps) {
+                search->lossless_pps = result.sent_pps;
+            }
+        }
+        else {
+            high = rate;
+        }
+    }
+
+    return 0;
+}
+
+static void print_report(
+    const struct ProgramArgs *const program_args,
+    const struct search_result *const searches,
+    const unsigned int num_searches
+) {
+    printf(
+        "\nRFC 2544 Throughput (%u s trials, %.1f%% resolution)\n"
+        "+------------+------------------+------------------+--------+\n"
+        "| Frame (B)  | Lossless (pps)   | Lossless (Mbps)  | Trials |\n"
+        "+------------+------------------+------------------+--------+\n",
+        program_args->rfc2544.trial_time, 100.0 / RFC2544_RESOLUTION
+    );
+    for (unsigned int i = 0; i < num_searches; i++) {
+        printf("| %10u | %16.0f | %16.2f | %6u |\n",
+            searches[i].frame_size,
+            searches[i].lossless_pps,
+            searches[i].lossless_pps * searches[i].frame_size * 8 / 1e6,
+            searches[i].trials
+        );
+    }
+    printf(
+        "+------------+------------------+------------------+--------+\n"
+    );
+}
+
+int run_rfc2544(const struct ProgramArgs *const program_args) {
+    const unsigned int num_sizes = (program_args->rfc2544.num_sizes > 0)
+        ? program_args->rfc2544.num_sizes
+        : (unsigned int)ARRAY_SIZE(DEFAULT_FRAME_SIZES);
+    const unsigned int *const frame_sizes =
+        (program_args->rfc2544.num_sizes > 0)
+        ? program_args->rfc2544.frame_sizes : DEFAULT_FRAME_SIZES;
+
+    if (program_args->protocols.l3 == PROTO_L3_IPV6) {
+        logger(LOG_ERROR, "RFC 2544 mode only supports IPv4 (for now).");
+        return 1;
+    }
+
+    struct rx_counter counter = {
+        .socket = create_packet_rx_socket(
+            program_args->rfc2544.rx_interface),
+        .daddr = htonl(program_args->ipv4->daddr.address),
+        .dport = htons((program_args->protocols.l4 == PROTO_L4_UDP)
+            ? program_args->udp.dport : program_args->tcp->dport),
+        .proto = (uint8_t)program_args->ipv4->proto
+    };
+    if (counter.socket == -1) {
+        logger(LOG_ERROR,
+            "RFC 2544 mode needs a packet socket to count frames.");
+        return 1;
+    }
+
+    struct search_result searches[RFC2544_MAX_FRAME_SIZES] = {{0}};
+    unsigned int num_searches = 0;
+    int status = 0;
+
+    for (unsigned int i = 0; i < num_sizes && !sending_stopped(); i++) {
+        searches[i].frame_size = frame_sizes[i];
+        logger(LOG_INFO,
+            "Searching the throughput of %u-byte frames...",
+            frame_sizes[i]
+        );
+
+        status = search_frame_size(program_args, &counter, &searches[i]);
+        num_searches++;
+        if (status != 0) {
+            break;
+        }
+    }
+
+    close(counter.socket);
+    print_report(program_args, searches, num_searches);
+
+    return status;
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: rfc2544.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,57 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// rfc2544.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef RFC2544_H
+#define RFC2544_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "packet.h"
+#include "socket.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <sys/socket.h>
+#   if defined(__linux__)
+#       include <linux/if_packet.h>
+#   endif
+#endif
+
+// RFC 2544 frame sizes include the Ethernet II header (14 bytes) and
+// its trailing FCS (4 bytes), neither of which is ours to send.
+#define RFC2544_FRAME_OVERHEAD 18
+#define RFC2544_MIN_FRAME 64
+#define RFC2544_MAX_FRAME (IP_PKT_MTU + RFC2544_FRAME_OVERHEAD)
+// Time to wait for frames still in flight after a trial (RFC 2544
+// section 23 suggests two seconds).
+#define RFC2544_SETTLE_TIME 2
+// The search stops once the interval between the highest lossless
+// and the lowest lossy rate shrinks below 1/RESOLUTION of the start.
+#define RFC2544_RESOLUTION 200
+
+
+// Binary-searches the highest rate without frame loss (RFC 2544,
+// section 26.1) for each of the configured frame sizes.
+int run_rfc2544(const struct ProgramArgs *const program_args);
+
+
+#endif // RFC2544_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: rfc2544.h
+// ---------------------------------------------------------------------
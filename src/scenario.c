@@ -0,0 +1,458 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// scenario.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "scenario.h"
+
+
+struct scenario_phase {
+    char name[SCENARIO_MAX_NAME + 1];
+    // The parser may keep pointers into its (tokenized) arguments, so
+    // the line has to outlive the phase's arguments.
+    char line[SCENARIO_MAX_LINE];
+    struct ProgramArgs args; // Owns its (own copies of the) headers
+    struct packet_template template;
+    unsigned int num_threads; // Never zero (unlike args.advanced)
+    struct send_stats stats;
+};
+
+// Parses (and validates) every phase up front, so that a typo in the
+// last phase does not get noticed only after the first ones ran.
+static int load_phase(
+    const struct ProgramArgs *const program_args,
+    struct scenario_phase *const phase,
+    const unsigned int line_number
+) {
+    char *argv[SCENARIO_MAX_ARGS];
+    int argc = 0;
+
+    // Everything after a '#' is a comment.
+    char *const comment = strchr(phase->line, '#');
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+
+    char *const name = strtok(phase->line, " \t\r\n");
+    if (name == NULL) {
+        return -1; // Blank line; not a phase.
+    }
+    if (strlen(name) > SCENARIO_MAX_NAME || name[0] == '-') {
+        logger(LOG_ERROR,
+            "Line %u: a phase must start with a name (of at most %d "
+            "characters), not \"%s\".",
+            line_number, SCENARIO_MAX_NAME, name
+        );
+        return 1;
+    }
+    strcpy(phase->name, name);
+
+    for (char *token = strtok(NULL, " \t\r\n"); token != NULL;
+        token = strtok(NULL, " \t\r\n")
+    ) {
+        if (argc == SCENARIO_MAX_ARGS) {
+            logger(LOG_ERROR,
+                "Line %u: a phase may have at most %d options.",
+                line_number, SCENARIO_MAX_ARGS
+            );
+            return 1;
+        }
+        argv[argc++] = token;
+    }
+
+    // Every phase starts from the command line, not the prior phase.
+    phase->args = *program_args;
+    phase->args.ipv4 = malloc(sizeof (*(program_args->ipv4)));
+    phase->args.tcp = malloc(sizeof (*(program_args->tcp)));
+    if (phase->args.ipv4 == NULL || phase->args.tcp == NULL) {
+        logger(LOG_ERROR, "Line %u: failed to allocate.", line_number);
+        return 1;
+    }
+    *(phase->args.ipv4) = *(program_args->ipv4);
+    *(phase->args.tcp) = *(program_args->tcp);
+    phase->args.traffic.scenario_file = NULL;
+
+    if (parse_phase_args(argc, argv, &phase->args) != 0) {
+        logger(LOG_ERROR, "Line %u: invalid options.", line_number);
+        return 1;
+    }
+
+    if (phase->args.traffic.scenario_file != NULL
+        || phase->args.rfc2544.enabled
+        || phase->args.general.opt_info
+    ) {
+        logger(LOG_ERROR,
+            "Line %u: phases cannot nest scenarios, run benchmarks, or "
+            "print information.", line_number
+        );
+        return 1;
+    }
+
+    // All phases share the one (raw) socket of the command line, of
+    // which a tunnel decides the family.
+    if (phase->args.protocols.l3 != program_args->protocols.l3
+        || (phase->args.tunnel.kind == TUNNEL_NONE)
+            != (program_args->tunnel.kind == TUNNEL_NONE)
+    ) {
+        logger(LOG_ERROR,
+            "Line %u: phases cannot switch between IPv4 and IPv6, nor "
+            "in or out of a tunnel.", line_number
+        );
+        return 1;
+    }
+    if (phase->args.eth_misc.interface
+        != program_args->eth_misc.interface
+    ) {
+        logger(LOG_ERROR,
+            "Line %u: phases cannot give \"--eth\"; it belongs on the "
+            "command line.", line_number
+        );
+        return 1;
+    }
+
+    phase->num_threads = (phase->args.advanced.num_threads > 0)
+        ? phase->args.advanced.num_threads : 1;
+    if (phase->num_threads > MAX_THREADS) {
+        logger(LOG_ERROR,
+            "Line %u: at most %d threads are supported.",
+            line_number, MAX_THREADS
+        );
+        return 1;
+    }
+
+    if (craft_template(&phase->args, &phase->template) != 0) {
+        logger(LOG_ERROR,
+            "Line %u: cannot craft the packet.", line_number);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Also frees the headers of a phase that failed to load.
+static void free_phases(struct scenario_phase *const phases) {
+    for (unsigned int i = 0; i < SCENARIO_MAX_PHASES; i++) {
+        free(phases[i].args.ipv4);
+        free(phases[i].args.tcp);
+    }
+    free(phases);
+}
+
+static int load_scenario(
+    const struct ProgramArgs *const program_args,
+    struct scenario_phase *const phases,
+    unsigned int *const num_phases
+) {
+    const char *const path = program_args->traffic.scenario_file;
+    FILE *const file = fopen(path, "r");
+    if (file == NULL) {
+        logger(LOG_ERROR,
+            "Failed to open scenario \"%s\": %s", path, strerror(errno));
+        return 1;
+    }
+
+    int status = 0;
+    unsigned int line_number = 0;
+    *num_phases = 0;
+
+    while (status == 0) {
+        if (*num_phases == SCENARIO_MAX_PHASES) {
+            logger(LOG_ERROR,
+                "A scenario may have at most %d phases.",
+                SCENARIO_MAX_PHASES
+            );
+            status = 1;
+            break;
+        }
+
+        struct scenario_phase *const phase = &phases[*num_phases];
+        if (fgets(phase->line, sizeof (phase->line), file) == NULL) {
+            break;
+        }
+        line_number++;
+
+        if (strchr(phase->line, '\n') == NULL && !feof(file)) {
+            logger(LOG_ERROR,
+                "Line %u: longer than %d characters.",
+                line_number, SCENARIO_MAX_LINE - 1
+            );
+            status = 1;
+            break;
+        }
+
+        const int phase_status =
+            load_phase(program_args, phase, line_number);
+        if (phase_status == 0) {
+            (*num_phases)++;
+        }
+        else if (phase_status > 0) {
+            status = 1;
+        }
+    }
+
+    if (ferror(file)) {
+        logger(LOG_ERROR,
+            "Failed to read scenario \"%s\": %s", path, strerror(errno));
+        status = 1;
+    }
+    fclose(file);
+
+    if (status == 0 && *num_phases == 0) {
+        logger(LOG_ERROR, "Scenario \"%s\" has no phases.", path);
+        status = 1;
+    }
+
+    return status;
+}
+
+
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+// NOTE: The threads are spawned once, for the largest phase, and then
+// parked on a condition variable between phases; a phase that needs
+// fewer threads simply leaves the rest of them parked.
+struct worker_pool {
+    mtx_t lock;
+    cnd_t phase_ready;
+    cnd_t phase_done;
+    unsigned long generation; // Incremented for every new phase
+    unsigned int num_workers;
+    unsigned int num_finished;
+    bool quit;
+    const struct scenario_phase *phase;
+    struct sender senders[MAX_THREADS];
+    struct tstamp_sampler sampler; // Of the phase, if it samples any
+};
+
+struct worker_arg {
+    struct worker_pool *pool;
+    unsigned int id;
+};
+
+// Thread callback
+static int worker_loop(void *arg) {
+    const struct worker_arg *const worker =
+        (const struct worker_arg *)arg;
+    struct worker_pool *const pool = worker->pool;
+    struct sender *const sender = &pool->senders[worker->id];
+    unsigned long seen_generation = 0;
+
+    for (;;) {
+        mtx_lock(&pool->lock);
+        while (pool->generation == seen_generation && !pool->quit) {
+            cnd_wait(&pool->phase_ready, &pool->lock);
+        }
+        if (pool->quit) {
+            mtx_unlock(&pool->lock);
+            break;
+        }
+        seen_generation = pool->generation;
+        const struct scenario_phase *const phase = pool->phase;
+        mtx_unlock(&pool->lock);
+
+        if (worker->id < phase->num_threads) {
+            sender->program_args = &phase->args;
+            sender->rate = rate_share(
+                phase->args.traffic.rate, worker->id, phase->num_threads);
+            sender->sampler = (phase->args.traffic.tx_stamp_every > 0)
+                ? &pool->sampler : NULL;
+            sender_load(sender, &phase->template);
+            sender_run(sender);
+        }
+
+        mtx_lock(&pool->lock);
+        if (++pool->num_finished == pool->num_workers) {
+            cnd_signal(&pool->phase_done);
+        }
+        mtx_unlock(&pool->lock);
+    }
+
+    return thrd_success;
+}
+
+static void run_phase(
+    struct worker_pool *const pool,
+    struct scenario_phase *const phase
+) {
+    mtx_lock(&pool->lock);
+    pool->phase = phase;
+    pool->num_finished = 0;
+    pool->generation++;
+    cnd_broadcast(&pool->phase_ready);
+    while (pool->num_finished < pool->num_workers) {
+        cnd_wait(&pool->phase_done, &pool->lock);
+    }
+    mtx_unlock(&pool->lock);
+
+    phase->stats = (struct send_stats){0};
+    for (unsigned int i = 0; i < phase->num_threads; i++) {
+        stats_merge(&phase->stats, &pool->senders[i].stats);
+    }
+}
+#endif
+
+static void print_report(
+    const struct scenario_phase *const phases,
+    const unsigned int num_phases
+) {
+    printf(
+        "\nScenario Summary\n"
+        "+--------------------------+----------+------------+----------+\n"
+        "| Phase                    | Time (s) | Pkts/s     | Mbit/s   |\n"
+        "+--------------------------+----------+------------+----------+\n"
+    );
+    for (unsigned int i = 0; i < num_phases; i++) {
+        printf("| %-24s | %8.2f | %10.0f | %8.2f |\n",
+            phases[i].name,
+            (double)phases[i].stats.elapsed_ns / 1e9,
+            stats_pps(&phases[i].stats),
+            stats_mbps(&phases[i].stats)
+        );
+    }
+    printf(
+        "+--------------------------+----------+------------+----------+\n"
+    );
+}
+
+int run_scenario(const struct ProgramArgs *const program_args) {
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    struct scenario_phase *const phases =
+        calloc(SCENARIO_MAX_PHASES, sizeof (*phases));
+    struct worker_pool *const pool = calloc(1, sizeof (*pool));
+    struct worker_arg workers[MAX_THREADS];
+    thrd_t handles[MAX_THREADS];
+    unsigned int num_phases = 0;
+    unsigned int num_spawned = 0;
+    int status = 0;
+
+    if (phases == NULL || pool == NULL) {
+        logger(LOG_ERROR, "Failed to allocate the scenario.");
+        free(phases);
+        free(pool);
+        return 1;
+    }
+
+    if (load_scenario(program_args, phases, &num_phases) != 0) {
+        free_phases(phases);
+        free(pool);
+        return 1;
+    }
+
+    // Size the pool (and every thread's batch buffers) for the most
+    // demanding phase, so that nothing gets reallocated in between.
+    unsigned int max_batch = 1;
+    size_t max_header_length = 0;
+    for (unsigned int i = 0; i < num_phases; i++) {
+        if (phases[i].num_threads > pool->num_workers) {
+            pool->num_workers = phases[i].num_threads;
+        }
+        if (phases[i].args.advanced.buffer_size > max_batch) {
+            max_batch = phases[i].args.advanced.buffer_size;
+        }
+        if (phases[i].template.header_length > max_header_length) {
+            max_header_length = phases[i].template.header_length;
+        }
+    }
+
+    if (mtx_init(&pool->lock, mtx_plain) != thrd_success
+        || cnd_init(&pool->phase_ready) != thrd_success
+        || cnd_init(&pool->phase_done) != thrd_success
+    ) {
+        logger(LOG_ERROR, "Failed to initialize the thread pool.");
+        free_phases(phases);
+        free(pool);
+        return 1;
+    }
+
+    if (lock_memory(program_args) != 0) {
+        status = 1;
+        goto CLEANUP;
+    }
+
+    for (; num_spawned < pool->num_workers; num_spawned++) {
+        struct sender *const sender = &pool->senders[num_spawned];
+        sender->id = num_spawned;
+        workers[num_spawned] = (struct worker_arg){
+            .pool = pool, .id = num_spawned
+        };
+
+        if (sender_init(sender, max_batch, max_header_length, NULL) != 0
+            || thrd_create(&handles[num_spawned], worker_loop,
+                &workers[num_spawned]) != thrd_success
+        ) {
+            logger(LOG_ERROR, "Failed to spawn thread %u.", num_spawned);
+            sender_free(sender);
+            status = 1;
+            goto CLEANUP;
+        }
+    }
+
+    for (unsigned int i = 0; i < num_phases && !sending_stopped(); i++) {
+        struct scenario_phase *const phase = &phases[i];
+
+        logger(LOG_INFO,
+            "Phase %u/%u \"%s\": %.0f pkts/s, %u s, %u thread(s).",
+            i + 1, num_phases, phase->name,
+            (double)phase->args.traffic.rate * 1e9
+                / (double)phase->args.traffic.interval_ns,
+            phase->args.traffic.duration, phase->num_threads
+        );
+
+        // The (raw) socket stays open; it only gets re-pointed in case
+        // the phase changed the destination address.
+        const bool stamping = phase->args.traffic.tx_stamp_every > 0;
+        if (connect_destination(&phase->args) != 0
+            || (phase->args.traffic.txtime
+                && txtime_setup(&phase->args) != 0)
+            || (stamping && tstamp_start(&pool->sampler, &phase->args) != 0)
+        ) {
+            status = 1;
+            break;
+        }
+
+        run_phase(pool, phase);
+        if (stamping) {
+            tstamp_stop(&pool->sampler);
+            phase->stats.missed += pool->sampler.stats.missed;
+        }
+        stats_report(phase->name, &phase->stats);
+        if (stamping) {
+            tstamp_stats_report(phase->name, &pool->sampler.stats);
+        }
+    }
+
+    print_report(phases, num_phases);
+
+CLEANUP:
+    mtx_lock(&pool->lock);
+    pool->quit = true;
+    cnd_broadcast(&pool->phase_ready);
+    mtx_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < num_spawned; i++) {
+        thrd_join(handles[i], NULL);
+        sender_free(&pool->senders[i]);
+    }
+
+    if (unlock_memory(program_args) != 0) {
+        status = 1;
+    }
+
+    cnd_destroy(&pool->phase_done);
+    cnd_destroy(&pool->phase_ready);
+    mtx_destroy(&pool->lock);
+    free(pool);
+    free_phases(phases);
+
+    return status;
+#else
+    (void)program_args;
+    logger(LOG_ERROR, "Scenarios require C11 threads.");
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: scenario.c
+// ---------------------------------------------------------------------
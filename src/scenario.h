@@ -0,0 +1,53 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// scenario.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./cmdline/parser.h"
+#include "packet.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#define SCENARIO_MAX_PHASES 64
+#define SCENARIO_MAX_LINE 1024 // Characters per phase (line)
+#define SCENARIO_MAX_ARGS 64   // Options per phase
+#define SCENARIO_MAX_NAME 24   // Characters per phase name
+
+
+// Runs the phases of a scenario file back-to-back, on the same socket
+// and the same (persistent) sending threads, and reports each phase
+// separately.
+//
+// Every line of the file is a phase: a name followed by the options
+// (as accepted on the command line) that it changes.  Phases do not
+// inherit from each other; each one starts from the command line.
+//
+//     # name   options
+//     warmup   --duration=5  --rate=1000
+//     ramp     --duration=10 --rate=10000 --num-threads=2 --ttl=64
+//     steady   --duration=60 --rate=100000
+int run_scenario(const struct ProgramArgs *const program_args);
+
+
+#endif // SCENARIO_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: scenario.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,790 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// sink.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: Like sendmmsg() (see packet.c), recvmmsg() is only declared
+// under _GNU_SOURCE.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "sink.h"
+
+
+// The packets of one sending thread, as far as one receiving thread
+// has seen them (which, given the fanout program, is all of them).
+typedef struct stream {
+    uint64_t packets;
+    uint64_t first_seq; // Lowest sequence number received
+    uint64_t last_seq;  // Highest sequence number received
+    uint64_t reordered;
+    uint64_t reorder_depth;
+    // A missing sequence number is only taken to be lost once it slides
+    // out of the window (until then, it may still show up late); runs
+    // of consecutive lost ones make up the bursts.
+    uint64_t loss_bursts;
+    uint64_t longest_burst;
+    uint64_t burst_length; // Of the latest burst
+    uint64_t burst_end;    // Sequence number right after it
+    // Interarrival jitter, as in A.8 of RFC 3550 (but in nanoseconds);
+    // the transit times include the offset between the two clocks,
+    // which cancels out.
+    int64_t last_transit_ns;
+    double jitter_ns;
+    // A bit for each of the SINK_WINDOW sequence numbers up to (and
+    // including) the highest one; set for those received.
+    uint64_t window[SINK_WINDOW / 64];
+} stream_t;
+
+// Per-thread state of a receiving loop.
+typedef struct receiver {
+    const struct ProgramArgs *program_args;
+    unsigned int id;
+    int socket;
+    uint8_t *ring;        // NULL: receives through recvmmsg() instead
+    uint32_t run_id;      // Network byte order
+    uint64_t deadline_ns; // 0: none
+    struct recv_stats stats;
+    // Of every sending thread (allocated once its first packet shows up)
+    struct stream *streams[MAX_THREADS];
+    int status;
+} receiver_t;
+
+// Finds the test tag of the run in a packet (starting at its IP header)
+// and returns its sending thread, sequence number, and send time.
+//
+// NOTE: Nothing aligns the packets in a ring (let alone behind a
+// tunnel), so their headers get copied out before being looked at.
+static bool find_tag(
+    const uint32_t run_id,
+    const uint8_t *const packet,
+    const size_t length,
+    uint32_t *const thread,
+    uint64_t *const seq,
+    uint64_t *const tx_ns
+) {
+    size_t offset;
+    uint8_t proto;
+
+    if (length >= sizeof (struct ip_hdr) && packet[0] >> 4 == 4) {
+        struct ip_hdr ip_header;
+        memcpy(&ip_header, packet, sizeof (ip_header));
+        offset = (size_t)ip_header.ihl * 4;
+        proto = ip_header.proto;
+    }
+    else if (length >= sizeof (struct ip6_hdr) && packet[0] >> 4 == 6) {
+        struct ip6_hdr ip6_header;
+        memcpy(&ip6_header, packet, sizeof (ip6_header));
+        offset = sizeof (ip6_header);
+        proto = ip6_header.next_hdr;
+
+        // (As many extension headers as the sender could have added.)
+        for (unsigned int i = 0; i < IP6_MAX_EXT_HEADERS; i++) {
+            if (offset + 2 > length) {
+                return false;
+            }
+            if (proto == IP6_EXT_FRAGMENT) {
+                proto = packet[offset];
+                offset += sizeof (struct ip6_frag_hdr);
+            }
+            else if (proto == IP6_EXT_HOP_BY_HOP
+                || proto == IP6_EXT_ROUTING
+                || proto == IP6_EXT_DEST_OPTS
+            ) {
+                proto = packet[offset];
+                offset += ((size_t)packet[offset + 1] + 1) * 8;
+            }
+            else {
+                break;
+            }
+        }
+    }
+    else {
+        return false;
+    }
+
+    if (proto == IP_PROTO_UDP) {
+        offset += sizeof (struct udp_hdr);
+    }
+    else if (proto == IP_PROTO_TCP
+        && offset + sizeof (struct tcp_hdr) <= length
+    ) {
+        struct tcp_hdr tcp_header;
+        memcpy(&tcp_header, packet + offset, sizeof (tcp_header));
+        offset += (size_t)tcp_header.dataofs * 4;
+    }
+    else {
+        return false;
+    }
+
+    struct test_tag tag;
+    if (offset + sizeof (tag) > length) {
+        return false;
+    }
+    memcpy(&tag, packet + offset, sizeof (tag));
+    if (tag.magic != htonl(TEST_TAG_MAGIC) || tag.run_id != run_id
+        || ntohl(tag.thread) >= MAX_THREADS
+    ) {
+        return false;
+    }
+
+    *thread = ntohl(tag.thread);
+    *seq = (uint64_t)ntohl(tag.seq[0]) << 32 | ntohl(tag.seq[1]);
+    *tx_ns = (uint64_t)ntohl(tag.tx_ns[0]) << 32 | ntohl(tag.tx_ns[1]);
+    return true;
+}
+
+static ALWAYS_INLINE uint64_t *window_word(
+    struct stream *const stream, const uint64_t seq
+) {
+    return &stream->window[(seq / 64) % (SINK_WINDOW / 64)];
+}
+
+// Takes `count` consecutive sequence numbers, from `seq` on, as lost.
+static void note_lost(
+    struct stream *const stream, const uint64_t seq, const uint64_t count
+) {
+    if (stream->loss_bursts == 0 || seq != stream->burst_end) {
+        stream->loss_bursts++;
+        stream->burst_length = 0;
+    }
+    stream->burst_length += count;
+    stream->burst_end = seq + count;
+    if (stream->burst_length > stream->longest_burst) {
+        stream->longest_burst = stream->burst_length;
+    }
+}
+
+// Moves the window up to `seq` (the new highest sequence number); the
+// numbers that slide out of it are lost, unless they were received.
+static void slide_window(struct stream *const stream, const uint64_t seq) {
+    const uint64_t distance = seq - stream->last_seq;
+    const uint64_t slid = (distance < SINK_WINDOW) ? distance : SINK_WINDOW;
+
+    for (uint64_t s = stream->last_seq + 1;
+        s <= stream->last_seq + slid; s++
+    ) {
+        // (The bit of `s` is still that of `s - SINK_WINDOW`.)
+        uint64_t *const word = window_word(stream, s);
+        if (s >= SINK_WINDOW && s - SINK_WINDOW >= stream->first_seq
+            && (*word >> (s % 64) & 1) == 0
+        ) {
+            note_lost(stream, s - SINK_WINDOW, 1);
+        }
+        *word &= ~(1ULL << (s % 64));
+    }
+    // Those skipped over entirely never made it into the window.
+    if (distance > SINK_WINDOW) {
+        note_lost(stream, stream->last_seq + 1, distance - SINK_WINDOW);
+    }
+    stream->last_seq = seq;
+}
+
+// Counts a test packet, unless it is a duplicate (within the window).
+static void count_packet(
+    struct receiver *const receiver,
+    const uint32_t thread,
+    const uint64_t seq,
+    const uint64_t tx_ns,
+    const size_t length,
+    const uint64_t rx_ns
+) {
+    struct stream *stream = receiver->streams[thread];
+
+    if (stream == NULL) {
+        stream = calloc(1, sizeof (*stream));
+        if (stream == NULL) {
+            logger(LOG_ERROR, "Failed to allocate a sequence window.");
+            receiver->status = 1;
+            stop_sending();
+            return;
+        }
+        receiver->streams[thread] = stream;
+        stream->first_seq = seq;
+        stream->last_seq = seq;
+    }
+
+    if (seq > stream->last_seq) {
+        slide_window(stream, seq);
+    }
+    else if (stream->last_seq - seq >= SINK_WINDOW) {
+        // Its bit now stands for a later number, so there is no telling
+        // a duplicate from a straggler (already counted lost, when it
+        // slid out); leave the window, and the ordering, alone.
+        receiver->stats.late++;
+        return;
+    }
+    else if (stream->packets > 0) {
+        if ((*window_word(stream, seq) >> (seq % 64) & 1) != 0) {
+            receiver->stats.duplicates++;
+            return;
+        }
+        // (How far behind the highest one it is; cf. RFC 4737.)
+        stream->reordered++;
+        if (stream->last_seq - seq > stream->reorder_depth) {
+            stream->reorder_depth = stream->last_seq - seq;
+        }
+    }
+    if (seq < stream->first_seq) {
+        stream->first_seq = seq;
+    }
+    *window_word(stream, seq) |= 1ULL << (seq % 64);
+
+    // J += (|D(i-1, i)| - J) / 16, in the order of arrival.
+    const int64_t transit_ns = (int64_t)(rx_ns - tx_ns);
+    if (stream->packets > 0) {
+        const int64_t delta_ns = transit_ns - stream->last_transit_ns;
+        const double magnitude =
+            (double)((delta_ns < 0) ? -delta_ns : delta_ns);
+        stream->jitter_ns += (magnitude - stream->jitter_ns) / 16.0;
+    }
+    stream->last_transit_ns = transit_ns;
+    stream->packets++;
+
+    struct recv_stats *const stats = &receiver->stats;
+    if (stats->packets == 0) {
+        stats->first_ns = rx_ns;
+    }
+    stats->packets++;
+    stats->bytes += length;
+    stats->last_ns = rx_ns;
+}
+
+static bool receiver_done(const struct receiver *const receiver) {
+    return sending_stopped() || (receiver->deadline_ns != 0
+        && clock_now_ns() >= receiver->deadline_ns);
+}
+
+#if defined(__linux__)
+// Walks the blocks of the ring (in order) as the kernel hands them
+// over; no syscall is needed for as long as there are packets.
+static void ring_loop(struct receiver *const receiver) {
+    struct pollfd poll_info = {
+        .fd = receiver->socket, .events = POLLIN | POLLERR
+    };
+    unsigned int block = 0;
+
+    while (!receiver_done(receiver)) {
+        struct tpacket_block_desc *const descriptor =
+            (struct tpacket_block_desc *)
+                (receiver->ring + (size_t)block * SINK_BLOCK_SIZE);
+        if ((LOAD_ACQUIRE(&descriptor->hdr.bh1.block_status)
+            & TP_STATUS_USER) == 0
+        ) {
+            (void)poll(&poll_info, 1, SINK_POLL_TIMEOUT);
+            continue;
+        }
+
+        const uint8_t *header = (const uint8_t *)descriptor
+            + descriptor->hdr.bh1.offset_to_first_pkt;
+        for (uint32_t i = 0; i < descriptor->hdr.bh1.num_pkts; i++) {
+            const struct tpacket3_hdr *const packet =
+                (const struct tpacket3_hdr *)header;
+            const struct sockaddr_ll *const link_info =
+                (const struct sockaddr_ll *)(header
+                    + TPACKET_ALIGN(sizeof (struct tpacket3_hdr)));
+            uint32_t thread;
+            uint64_t seq, tx_ns;
+
+            // Our own packets, on their way out, are not "received."
+            // (The kernel timestamps the others as they come in.)
+            if (link_info->sll_pkttype != PACKET_OUTGOING
+                && find_tag(receiver->run_id, header + packet->tp_net,
+                    packet->tp_snaplen, &thread, &seq, &tx_ns)
+            ) {
+                count_packet(receiver, thread, seq, tx_ns,
+                    packet->tp_len, (uint64_t)packet->tp_sec
+                        * NSEC_PER_SEC + packet->tp_nsec);
+            }
+            header += packet->tp_next_offset;
+        }
+
+        STORE_RELEASE(&descriptor->hdr.bh1.block_status,
+            TP_STATUS_KERNEL);
+        block = (block + 1) % SINK_NUM_BLOCKS;
+    }
+}
+
+// When the kernel received a packet (CLOCK_REALTIME, like the ring's
+// timestamps), or else `fallback`.
+static uint64_t receive_time(
+    struct msghdr *const msg, const struct timespec *const fallback
+) {
+    struct timespec time = *fallback;
+
+    for (struct cmsghdr *control = CMSG_FIRSTHDR(msg); control != NULL;
+        control = CMSG_NXTHDR(msg, control)
+    ) {
+        if (control->cmsg_level == SOL_SOCKET
+            && control->cmsg_type == SCM_TIMESTAMPNS
+        ) {
+            memcpy(&time, CMSG_DATA(control), sizeof (time));
+        }
+    }
+    return (uint64_t)time.tv_sec * NSEC_PER_SEC + (uint64_t)time.tv_nsec;
+}
+
+static void recvmmsg_loop(struct receiver *const receiver) {
+    uint8_t (*const buffers)[IP_PKT_MTU] =
+        malloc(SINK_BATCH_SIZE * sizeof (*buffers));
+    struct mmsghdr msgs[SINK_BATCH_SIZE];
+    struct iovec iov[SINK_BATCH_SIZE];
+    struct sockaddr_ll link_info[SINK_BATCH_SIZE];
+    // (For the SO_TIMESTAMPNS of each packet; aligned like a cmsghdr.)
+    union {
+        size_t align;
+        uint8_t data[CMSG_SPACE(sizeof (struct timespec))];
+    } controls[SINK_BATCH_SIZE];
+
+    if (buffers == NULL) {
+        logger(LOG_ERROR, "Failed to allocate the receive buffers.");
+        receiver->status = 1;
+        return;
+    }
+
+    for (unsigned int i = 0; i < SINK_BATCH_SIZE; i++) {
+        iov[i] = (struct iovec){
+            .iov_base = buffers[i], .iov_len = sizeof (buffers[i])
+        };
+        msgs[i] = (struct mmsghdr){
+            .msg_hdr = {
+                .msg_name = &link_info[i],
+                .msg_namelen = sizeof (link_info[i]),
+                .msg_iov = &iov[i],
+                .msg_iovlen = 1,
+                .msg_control = &controls[i],
+                .msg_controllen = sizeof (controls[i])
+            }
+        };
+    }
+
+    while (!receiver_done(receiver)) {
+        // (The socket times out every SINK_POLL_TIMEOUT milliseconds.)
+        const int count = recvmmsg(receiver->socket, msgs,
+            SINK_BATCH_SIZE, MSG_WAITFORONE, NULL);
+        if (count <= 0) {
+            continue;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        for (int i = 0; i < count; i++) {
+            struct msghdr *const msg = &msgs[i].msg_hdr;
+            uint32_t thread;
+            uint64_t seq, tx_ns;
+            if (link_info[i].sll_pkttype != PACKET_OUTGOING
+                && find_tag(receiver->run_id, buffers[i],
+                    msgs[i].msg_len, &thread, &seq, &tx_ns)
+            ) {
+                count_packet(receiver, thread, seq, tx_ns,
+                    msgs[i].msg_len, receive_time(msg, &now));
+            }
+            msg->msg_namelen = sizeof (link_info[i]);
+            msg->msg_controllen = sizeof (controls[i]);
+        }
+    }
+
+    free(buffers);
+}
+
+// Maps a TPACKET_V3 ring onto the (not yet bound) socket; on failure,
+// the socket is still good for recvmmsg().
+static uint8_t *map_ring(const int socket_descriptor) {
+    const int version = TPACKET_V3;
+    const struct tpacket_req3 request = {
+        .tp_block_size = SINK_BLOCK_SIZE,
+        .tp_block_nr = SINK_NUM_BLOCKS,
+        .tp_frame_size = SINK_FRAME_SIZE,
+        .tp_frame_nr = SINK_BLOCK_SIZE / SINK_FRAME_SIZE * SINK_NUM_BLOCKS,
+        .tp_retire_blk_tov = SINK_BLOCK_TIMEOUT
+    };
+
+    if (setsockopt(socket_descriptor, SOL_PACKET, PACKET_VERSION,
+            &version, sizeof (version)) != 0
+        || setsockopt(socket_descriptor, SOL_PACKET, PACKET_RX_RING,
+            &request, sizeof (request)) != 0
+    ) {
+        logger(LOG_WARN,
+            "Failed to set up a packet ring (%s); falling back to "
+            "recvmmsg().", strerror(errno));
+        return NULL;
+    }
+
+    void *const ring = mmap(NULL,
+        (size_t)SINK_BLOCK_SIZE * SINK_NUM_BLOCKS,
+        PROT_READ | PROT_WRITE, MAP_SHARED, socket_descriptor, 0);
+    if (ring == MAP_FAILED) {
+        logger(LOG_WARN,
+            "Failed to map the packet ring (%s); falling back to "
+            "recvmmsg().", strerror(errno));
+        return NULL;
+    }
+
+    return (uint8_t *)ring;
+}
+
+// Picks the socket of the fanout group (i.e., the receiving thread)
+// for a packet: the sending thread in its test tag, modulo the number
+// of sockets, so that every stream is seen whole by one thread (rather
+// than spread out over them by the hash of each flow, which the random
+// source ports would do).  Only IPv4 and IPv6 (without extension
+// headers) get looked into; anything else goes to the first socket.
+#define TAG_THREAD_OFFSET offsetof(struct test_tag, thread)
+static const struct sock_filter FANOUT_PROGRAM[] = {
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 4, 0, 3),
+    // IPv4: X = IHL * 4; A = protocol
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+    BPF_JUMP(BPF_JMP | BPF_JA, 3, 0, 0),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 13),
+    // IPv6: X = 40; A = next header
+    BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, sizeof (struct ip6_hdr)),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 6),
+    // UDP: the tag is right behind the 8 bytes of its header.
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IP_PROTO_UDP, 0, 2),
+    BPF_STMT(BPF_LD | BPF_W | BPF_IND,
+        sizeof (struct udp_hdr) + TAG_THREAD_OFFSET),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+    // TCP: X += data offset * 4
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IP_PROTO_TCP, 0, 7),
+    BPF_STMT(BPF_LD | BPF_B | BPF_IND, 12),
+    BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xF0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 2),
+    BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_IND, TAG_THREAD_OFFSET),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+    BPF_STMT(BPF_RET | BPF_K, 0)
+};
+#undef TAG_THREAD_OFFSET
+
+// Joins the `fanout` group, steered by FANOUT_PROGRAM; without it (on
+// kernels before 4.3), the kernel hashes each flow to a socket instead.
+static int join_fanout(const int socket_descriptor, const uint16_t fanout) {
+    int fanout_arg = fanout | (PACKET_FANOUT_CBPF << 16);
+    if (setsockopt(socket_descriptor, SOL_PACKET, PACKET_FANOUT,
+            &fanout_arg, sizeof (fanout_arg)) == 0
+    ) {
+        const struct sock_fprog program = {
+            .len = sizeof (FANOUT_PROGRAM) / sizeof (FANOUT_PROGRAM[0]),
+            .filter = (struct sock_filter *)FANOUT_PROGRAM
+        };
+        if (setsockopt(socket_descriptor, SOL_PACKET, PACKET_FANOUT_DATA,
+                &program, sizeof (program)) != 0
+        ) {
+            logger(LOG_WARN,
+                "Failed to attach the fanout program (%s); the first "
+                "thread gets all of the packets.", strerror(errno));
+        }
+        return 0;
+    }
+
+    fanout_arg = fanout | (PACKET_FANOUT_HASH << 16);
+    if (setsockopt(socket_descriptor, SOL_PACKET, PACKET_FANOUT,
+            &fanout_arg, sizeof (fanout_arg)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to join the fanout group: %s", strerror(errno));
+        return 1;
+    }
+    logger(LOG_WARN,
+        "Fanout by test tag is not supported; loss bursts, reordering, "
+        "and jitter are only per flow.");
+    return 0;
+}
+
+// A receive-only AF_PACKET socket (with a ring, if possible) for all
+// IP packets on `interface` (or on all interfaces, if it is NULL),
+// which joins the `fanout` group (see join_fanout()).
+static int open_receiver(
+    struct receiver *const receiver,
+    const char *const interface,
+    const uint16_t fanout
+) {
+    unsigned int interface_index = 0;
+    if (interface != NULL) {
+        interface_index = if_nametoindex(interface);
+        if (interface_index == 0) {
+            logger(LOG_ERROR,
+                "Unknown network interface \"%s\".", interface);
+            return 1;
+        }
+    }
+
+    // (Protocol 0 receives nothing until bound, with the ring in place.)
+    receiver->socket = socket(AF_PACKET, SOCK_DGRAM, 0);
+    if (receiver->socket == -1) {
+        logger(LOG_ERROR,
+            "Failed to create a packet socket: %s", strerror(errno));
+        return 1;
+    }
+
+    receiver->ring = map_ring(receiver->socket);
+    if (receiver->ring == NULL) {
+        const struct timeval timeout = {
+            .tv_sec = 0, .tv_usec = SINK_POLL_TIMEOUT * 1000
+        };
+        (void)setsockopt(receiver->socket, SOL_SOCKET, SO_RCVTIMEO,
+            &timeout, sizeof (timeout));
+        const int buffer_size = 16 * 1024 * 1024;
+        (void)setsockopt(receiver->socket, SOL_SOCKET, SO_RCVBUF,
+            &buffer_size, sizeof (buffer_size));
+        const int enable = 1;
+        (void)setsockopt(receiver->socket, SOL_SOCKET, SO_TIMESTAMPNS,
+            &enable, sizeof (enable));
+    }
+
+    const struct sockaddr_ll link_info = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ALL),
+        .sll_ifindex = (int)interface_index
+    };
+    if (bind(receiver->socket, (const struct sockaddr *)&link_info,
+            sizeof (link_info)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to bind the packet socket: %s", strerror(errno));
+        return 1;
+    }
+
+    return join_fanout(receiver->socket, fanout);
+}
+
+static void close_receiver(struct receiver *const receiver) {
+    if (receiver->socket == -1) {
+        return;
+    }
+
+    // What the kernel had to drop (for lack of room in the ring or the
+    // socket buffer) is not the fault of the DUT.
+    struct tpacket_stats_v3 kernel_stats = {0};
+    socklen_t length = sizeof (kernel_stats);
+    if (getsockopt(receiver->socket, SOL_PACKET, PACKET_STATISTICS,
+            &kernel_stats, &length) == 0
+    ) {
+        receiver->stats.dropped += kernel_stats.tp_drops;
+    }
+
+    if (receiver->ring != NULL) {
+        munmap(receiver->ring, (size_t)SINK_BLOCK_SIZE * SINK_NUM_BLOCKS);
+        receiver->ring = NULL;
+    }
+    close(receiver->socket);
+    receiver->socket = -1;
+}
+#endif
+
+// Thread callback
+static int receive_loop(void *arg) {
+    struct receiver *const receiver = (struct receiver *)arg;
+
+#if defined(__linux__)
+    if (receiver->ring != NULL) {
+        ring_loop(receiver);
+    }
+    else {
+        recvmmsg_loop(receiver);
+    }
+#endif
+
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    return (receiver->status == 0) ? thrd_success : thrd_error;
+#else
+    return receiver->status;
+#endif
+}
+
+// The flows of a sending thread get spread over all of the receiving
+// threads, so only all of their streams together tell what went missing
+// from the sequence of that thread.
+static uint64_t count_lost(
+    const struct receiver *const receivers,
+    const unsigned int num_receivers
+) {
+    uint64_t lost = 0;
+
+    for (unsigned int t = 0; t < MAX_THREADS; t++) {
+        uint64_t packets = 0, first_seq = 0, last_seq = 0;
+        for (unsigned int i = 0; i < num_receivers; i++) {
+            const struct stream *const stream = receivers[i].streams[t];
+            if (stream == NULL) {
+                continue;
+            }
+            if (packets == 0 || stream->first_seq < first_seq) {
+                first_seq = stream->first_seq;
+            }
+            if (stream->last_seq > last_seq) {
+                last_seq = stream->last_seq;
+            }
+            packets += stream->packets;
+        }
+
+        if (packets > 0 && last_seq - first_seq + 1 > packets) {
+            lost += last_seq - first_seq + 1 - packets;
+        }
+    }
+
+    return lost;
+}
+
+// Once the run is over, whatever is still missing from the windows is
+// lost, too; then adds up the streams of the receiving thread.
+static void close_streams(struct receiver *const receiver) {
+    struct recv_stats *const stats = &receiver->stats;
+
+    for (unsigned int t = 0; t < MAX_THREADS; t++) {
+        struct stream *const stream = receiver->streams[t];
+        if (stream == NULL) {
+            continue;
+        }
+
+        const uint64_t start =
+            (stream->last_seq - stream->first_seq >= SINK_WINDOW)
+                ? stream->last_seq - SINK_WINDOW + 1 : stream->first_seq;
+        for (uint64_t s = start; s < stream->last_seq; s++) {
+            if ((*window_word(stream, s) >> (s % 64) & 1) == 0) {
+                note_lost(stream, s, 1);
+            }
+        }
+
+        stats->reordered += stream->reordered;
+        stats->loss_bursts += stream->loss_bursts;
+        if (stream->reorder_depth > stats->reorder_depth) {
+            stats->reorder_depth = stream->reorder_depth;
+        }
+        if (stream->longest_burst > stats->longest_burst) {
+            stats->longest_burst = stream->longest_burst;
+        }
+        if (stream->jitter_ns > stats->jitter_ns) {
+            stats->jitter_ns = stream->jitter_ns;
+        }
+    }
+}
+
+static void free_streams(
+    struct receiver *const receivers, const unsigned int num_receivers
+) {
+    for (unsigned int i = 0; i < num_receivers; i++) {
+        for (unsigned int t = 0; t < MAX_THREADS; t++) {
+            free(receivers[i].streams[t]);
+            receivers[i].streams[t] = NULL;
+        }
+    }
+}
+
+int run_sink(const struct ProgramArgs *const program_args) {
+#if defined(__linux__)
+    const unsigned int num_threads = program_args->advanced.num_threads;
+    const unsigned int num_loops = (num_threads > 0) ? num_threads : 1;
+    // NOTE: Static, because of the (sizable) windows.
+    static struct receiver receivers[MAX_THREADS];
+
+    if (!program_args->run.tagged) {
+        logger(LOG_ERROR,
+            "\"--sink\" needs the \"--run-id\" of the traffic to count.");
+        return 1;
+    }
+    if (num_threads > MAX_THREADS) {
+        logger(LOG_ERROR,
+            "At most %d threads are supported.", MAX_THREADS);
+        return 1;
+    }
+
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? clock_now_ns()
+            + program_args->traffic.duration * NSEC_PER_SEC
+        : 0;
+    // (Any group ID will do, as long as no other process uses it.)
+    const uint16_t fanout = (uint16_t)getpid();
+    int status = 0;
+
+    for (unsigned int i = 0; i < num_loops; i++) {
+        receivers[i] = (struct receiver){
+            .program_args = program_args,
+            .id = i,
+            .socket = -1,
+            .run_id = htonl(program_args->run.run_id),
+            .deadline_ns = deadline_ns
+        };
+    }
+    for (unsigned int i = 0; i < num_loops && status == 0; i++) {
+        status = open_receiver(&receivers[i],
+            program_args->rfc2544.rx_interface, fanout);
+    }
+    if (status != 0) {
+        goto CLOSE;
+    }
+
+    logger(LOG_INFO,
+        "Counting the packets of run %u on %s (%u %s)...",
+        program_args->run.run_id,
+        (program_args->rfc2544.rx_interface != NULL)
+            ? program_args->rfc2544.rx_interface : "all interfaces",
+        num_loops, (receivers[0].ring != NULL)
+            ? "packet rings" : "sockets");
+
+    if (num_threads == 0) { // Run in main thread.
+        receive_loop(&receivers[0]);
+    }
+    else { // Multi-threaded
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+        thrd_t handles[MAX_THREADS];
+
+        for (unsigned int i = 0; i < num_threads; i++) {
+            if (thrd_create(&handles[i], receive_loop, &receivers[i])
+                != thrd_success
+            ) {
+                logger(LOG_ERROR, "Failed to spawn thread %u.", i);
+                stop_sending();
+                for (unsigned int j = 0; j < i; j++) {
+                    thrd_join(handles[j], NULL);
+                }
+                status = 1;
+                goto CLOSE;
+            }
+        }
+
+        for (unsigned int i = 0; i < num_threads; i++) {
+            thrd_join(handles[i], NULL);
+        }
+#else
+        status = 1;
+        goto CLOSE;
+#endif
+    }
+
+CLOSE:
+    for (unsigned int i = 0; i < num_loops; i++) {
+        close_receiver(&receivers[i]);
+    }
+    if (status != 0) {
+        free_streams(receivers, num_loops);
+        return status;
+    }
+
+    struct recv_stats totals = {0};
+    for (unsigned int i = 0; i < num_loops; i++) {
+        close_streams(&receivers[i]);
+        recv_stats_merge(&totals, &receivers[i].stats);
+        status |= receivers[i].status;
+    }
+    totals.lost = count_lost(receivers, num_loops);
+    free_streams(receivers, num_loops);
+    recv_stats_report("Total", &totals);
+
+    return status;
+#else
+    (void)program_args;
+    logger(LOG_ERROR, "\"--sink\" needs AF_PACKET sockets (Linux).");
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: sink.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,71 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// sink.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef SINK_H
+#define SINK_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./utils/clock.h"
+#include "./utils/intrins.h"
+#include "packet.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <poll.h>
+#   include <net/if.h>
+#   include <sys/mman.h>
+#   include <sys/socket.h>
+#   if defined(__linux__)
+#       include <linux/filter.h>
+#       include <linux/if_ether.h>
+#       include <linux/if_packet.h>
+#   endif
+#endif
+
+// Every receiving thread maps a ring of this many blocks (TPACKET_V3),
+// which the kernel fills with whole batches of packets; a block gets
+// handed over once it is full, or after SINK_BLOCK_TIMEOUT (ms).
+#define SINK_BLOCK_SIZE (1U << 18)
+#define SINK_NUM_BLOCKS 32
+#define SINK_FRAME_SIZE 2048
+#define SINK_BLOCK_TIMEOUT 10
+// Without a ring, packets get received this many per recvmmsg().
+#define SINK_BATCH_SIZE 64
+// Test packets that are at most this many sequence numbers behind the
+// latest one are checked for being duplicates; any older ones are not.
+// Missing ones are taken to be lost once they are that far behind.
+#define SINK_WINDOW (1U << 16)
+// Milliseconds to wait for packets before checking for a stop request.
+#define SINK_POLL_TIMEOUT 100
+
+
+// Counts the test packets of a run ("--run-id") that arrive on
+// "--rx-if" (or on any interface), spread over the threads through a
+// fanout group, until the duration elapses or stop_sending() gets
+// called; then reports the rate, loss (and its bursts), duplicates,
+// reordering, and jitter of the run.
+int run_sink(const struct ProgramArgs *const program_args);
+
+
+#endif // SINK_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: sink.h
+// ---------------------------------------------------------------------
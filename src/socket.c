@@ -7,14 +7,16 @@
 #include "socket.h"
 
 
-int create_raw_async_socket() {
+int create_raw_async_socket(const int family) {
     // Setting the 'errno' flag to 0 indicates "no errors" so
     // that a previously set value does not affect us.
     errno = 0;
 
     // Attempt to create a raw socket.
+    // NOTE: Linux implies IPV6_HDRINCL for IPPROTO_RAW as well (though
+    // POSIX leaves raw IPv6 sockets without one, in general).
     int socket_descriptor = socket(
-        AF_INET,                  // Domain
+        family,                   // Domain (AF_INET or AF_INET6)
         SOCK_RAW | SOCK_NONBLOCK, // Type (+ options)
         IPPROTO_RAW               // Protocol (implies IP_HDRINCL)
     );
@@ -23,13 +25,208 @@ int create_raw_async_socket() {
 	if (socket_descriptor == -1) {
 		// Socket creation failed (maybe non-root privileges?)
 		perror("Failed to create an asynchronous raw socket");
-        return EXIT_FAILURE;
+        return -1;
 	}
 
     // On success, return the socket descriptor.
     return socket_descriptor;
 }
 
+int resolve_source_address(const uint32_t daddr, uint32_t *const saddr) {
+    // NOTE: connect() on a datagram socket sends nothing; it merely
+    // makes the kernel pick a route (and thus a source address),
+    // which is the closest that POSIX gets to getifaddrs().
+    const int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe == -1) {
+        logger(LOG_ERROR,
+            "Failed to create a routing probe socket: %s",
+            strerror(errno)
+        );
+        return 1;
+    }
+
+    const struct sockaddr_in dest_info = {
+        .sin_family = AF_INET,
+        .sin_port = htons(9), // Any non-zero port (discard)
+        .sin_addr.s_addr = htonl(daddr)
+    };
+    struct sockaddr_in local_info = {0};
+    socklen_t local_length = sizeof (local_info);
+
+    int status = 0;
+    if (connect(probe, (const struct sockaddr *)&dest_info,
+            sizeof (dest_info)) != 0
+        || getsockname(probe, (struct sockaddr *)&local_info,
+            &local_length) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to find a route to the destination: %s",
+            strerror(errno)
+        );
+        status = 1;
+    }
+    else {
+        *saddr = ntohl(local_info.sin_addr.s_addr);
+    }
+
+    close(probe);
+    return status;
+}
+
+int resolve_source_address6(
+    const uint8_t daddr[16], uint8_t saddr[16]
+) {
+    const int probe = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (probe == -1) {
+        logger(LOG_ERROR,
+            "Failed to create a routing probe socket: %s",
+            strerror(errno)
+        );
+        return 1;
+    }
+
+    struct sockaddr_in6 dest_info = {
+        .sin6_family = AF_INET6,
+        .sin6_port = htons(9) // Any non-zero port (discard)
+    };
+    memcpy(&dest_info.sin6_addr, daddr, 16);
+    struct sockaddr_in6 local_info = {0};
+    socklen_t local_length = sizeof (local_info);
+
+    int status = 0;
+    if (connect(probe, (const struct sockaddr *)&dest_info,
+            sizeof (dest_info)) != 0
+        || getsockname(probe, (struct sockaddr *)&local_info,
+            &local_length) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to find a route to the destination: %s",
+            strerror(errno)
+        );
+        status = 1;
+    }
+    else {
+        memcpy(saddr, &local_info.sin6_addr, 16);
+    }
+
+    close(probe);
+    return status;
+}
+
+int create_packet_tx_socket(
+    const char *const interface, uint8_t hwaddr[6]
+) {
+#if defined(__linux__)
+    const unsigned int interface_index = if_nametoindex(interface);
+    if (interface_index == 0) {
+        logger(LOG_ERROR, "Unknown network interface \"%s\".", interface);
+        return -1;
+    }
+
+    // NOTE: Unlike a raw IP socket, this one skips the routing table
+    // and the neighbour (ARP/NDP) lookup for every packet; the frames
+    // go straight to the queueing discipline of the interface.
+    // (A protocol of zero keeps the kernel from delivering any
+    // incoming frames to us, which we would never read.)
+    const int socket_descriptor =
+        socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, 0);
+    if (socket_descriptor == -1) {
+        logger(LOG_ERROR,
+            "Failed to create a packet socket: %s", strerror(errno));
+        return -1;
+    }
+
+    const struct sockaddr_ll link_info = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = 0,
+        .sll_ifindex = (int)interface_index
+    };
+    struct sockaddr_ll local_info = {0};
+    socklen_t local_length = sizeof (local_info);
+    if (bind(socket_descriptor, (const struct sockaddr *)&link_info,
+            sizeof (link_info)) != 0
+        || getsockname(socket_descriptor,
+            (struct sockaddr *)&local_info, &local_length) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to bind the packet socket to \"%s\": %s",
+            interface, strerror(errno)
+        );
+        close(socket_descriptor);
+        return -1;
+    }
+
+    if (local_info.sll_halen != 6) {
+        logger(LOG_ERROR,
+            "Interface \"%s\" has no Ethernet (MAC) address.",
+            interface);
+        close(socket_descriptor);
+        return -1;
+    }
+    memcpy(hwaddr, local_info.sll_addr, 6);
+
+    return socket_descriptor;
+#else
+    (void)interface;
+    (void)hwaddr;
+    logger(LOG_ERROR, "Packet sockets are only available on Linux.");
+    return -1;
+#endif
+}
+
+int create_packet_rx_socket(const char *const interface) {
+#if defined(__linux__)
+    unsigned int interface_index = 0;
+    if (interface != NULL) {
+        interface_index = if_nametoindex(interface);
+        if (interface_index == 0) {
+            logger(LOG_ERROR,
+                "Unknown network interface \"%s\".", interface);
+            return -1;
+        }
+    }
+
+    const int socket_descriptor =
+        socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (socket_descriptor == -1) {
+        logger(LOG_ERROR,
+            "Failed to create a packet socket: %s", strerror(errno));
+        return -1;
+    }
+
+    const struct sockaddr_ll link_info = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_IP),
+        .sll_ifindex = (int)interface_index
+    };
+    if (bind(socket_descriptor, (const struct sockaddr *)&link_info,
+            sizeof (link_info)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to bind the packet socket: %s", strerror(errno));
+        close(socket_descriptor);
+        return -1;
+    }
+
+    // Wake up periodically, so that the receiver can notice when it
+    // is told to stop even if no traffic arrives.
+    const struct timeval timeout = {.tv_sec = 0, .tv_usec = 100000};
+    (void)setsockopt(socket_descriptor, SOL_SOCKET, SO_RCVTIMEO,
+        &timeout, sizeof (timeout));
+    // A larger buffer absorbs bursts that would otherwise be miscounted
+    // as loss (the kernel silently caps it to net.core.rmem_max).
+    const int buffer_size = 16 * 1024 * 1024;
+    (void)setsockopt(socket_descriptor, SOL_SOCKET, SO_RCVBUF,
+        &buffer_size, sizeof (buffer_size));
+
+    return socket_descriptor;
+#else
+    (void)interface;
+    logger(LOG_ERROR, "Packet sockets are only available on Linux.");
+    return -1;
+#endif
+}
+
 
 // ---------------------------------------------------------------------
 // END OF FILE: socket.c
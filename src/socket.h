@@ -8,13 +8,26 @@
 #define SOCKET_H
 
 
+#include "./cmdline/logger.h"
+
+#include <stdint.h>
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
 #   include <sys/socket.h>
+#   include <sys/time.h>
 #   include <arpa/inet.h>
+#   include <net/if.h>
+#   include <netinet/in.h>
+#   if defined(__linux__)
+#       include <linux/if_ether.h>
+#       include <linux/if_packet.h>
+#   endif
 #elif defined(_WIN32)
 //#include <winsock2.h>
 #endif
@@ -22,7 +35,30 @@
 extern int errno; // Declared in <errno.h>
 
 
-int create_raw_async_socket();
+// A non-blocking raw socket (of AF_INET or AF_INET6) that sends our
+// own, pre-crafted IP headers.
+int create_raw_async_socket(const int family);
+
+// Ask the routing table which local (host-order) address would be
+// used to reach `daddr`, without sending anything.
+int resolve_source_address(const uint32_t daddr, uint32_t *const saddr);
+// Same as above, but for (network-order) IPv6 addresses.
+int resolve_source_address6(
+    const uint8_t daddr[16], uint8_t saddr[16]
+);
+
+// A non-blocking AF_PACKET socket that sends our own, pre-crafted
+// link-layer frames out of `interface` (and never receives any); its
+// (6-byte) hardware address is returned in `hwaddr`.  Returns -1 on
+// failure, on non-Ethernet interfaces, or on non-Linux systems.
+int create_packet_tx_socket(
+    const char *const interface, uint8_t hwaddr[6]
+);
+
+// A receive-only AF_PACKET socket that yields IP datagrams (without
+// their link-layer header) from `interface`, or from all interfaces
+// if it is NULL; returns -1 on failure or on non-Linux systems.
+int create_packet_rx_socket(const char *const interface);
 
 
 #endif // SOCKET_H
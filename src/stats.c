@@ -0,0 +1,508 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// stats.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+#include "stats.h"
+
+
+void stats_merge(
+    struct send_stats *const into, const struct send_stats *const from
+) {
+    into->packets += from->packets;
+    into->bytes += from->bytes;
+    into->dropped += from->dropped;
+    into->errors += from->errors;
+    into->missed += from->missed;
+    // Threads run concurrently; the slowest one sets the duration.
+    if (from->elapsed_ns > into->elapsed_ns) {
+        into->elapsed_ns = from->elapsed_ns;
+    }
+    histogram_merge(&into->gaps, &from->gaps);
+}
+
+double stats_pps(const struct send_stats *const stats) {
+    if (stats->elapsed_ns == 0) {
+        return 0.0;
+    }
+    return (double)stats->packets * 1e9 / (double)stats->elapsed_ns;
+}
+
+double stats_mbps(const struct send_stats *const stats) {
+    if (stats->elapsed_ns == 0) {
+        return 0.0;
+    }
+    return (double)stats->bytes * 8e3 / (double)stats->elapsed_ns;
+}
+
+void stats_report(
+    const char *const label, const struct send_stats *const stats
+) {
+    logger(LOG_INFO,
+        "%s: sent %llu packets (%llu bytes) in %.3f s;\n"
+        "  %.0f pkts/s, %.2f Mbit/s, %llu dropped, %llu errors.",
+        label,
+        (unsigned long long)stats->packets,
+        (unsigned long long)stats->bytes,
+        (double)stats->elapsed_ns / 1e9,
+        stats_pps(stats), stats_mbps(stats),
+        (unsigned long long)stats->dropped,
+        (unsigned long long)stats->errors
+    );
+
+    if (stats->missed > 0) {
+        logger(LOG_WARN,
+            "%s: %llu packets missed (or had invalid) launch times.",
+            label, (unsigned long long)stats->missed
+        );
+    }
+
+    if (stats->gaps.count > 0) {
+        const struct histogram *const gaps = &stats->gaps;
+        logger(LOG_INFO,
+            "%s: inter-batch gaps (us) of %llu batches:\n"
+            "  min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f,"
+            " max %.1f, mean %.1f.",
+            label, (unsigned long long)gaps->count,
+            (double)gaps->min / 1e3,
+            (double)histogram_percentile(gaps, 50.0) / 1e3,
+            (double)histogram_percentile(gaps, 90.0) / 1e3,
+            (double)histogram_percentile(gaps, 99.0) / 1e3,
+            (double)histogram_percentile(gaps, 99.9) / 1e3,
+            (double)gaps->max / 1e3,
+            histogram_mean(gaps) / 1e3
+        );
+    }
+}
+
+
+void recv_stats_merge(
+    struct recv_stats *const into, const struct recv_stats *const from
+) {
+    // (Only threads that received anything know when they did.)
+    if (from->packets > 0 && (into->packets == 0
+        || from->first_ns < into->first_ns)
+    ) {
+        into->first_ns = from->first_ns;
+    }
+    if (from->last_ns > into->last_ns) {
+        into->last_ns = from->last_ns;
+    }
+    into->packets += from->packets;
+    into->bytes += from->bytes;
+    into->duplicates += from->duplicates;
+    into->late += from->late;
+    into->lost += from->lost;
+    into->dropped += from->dropped;
+    into->reordered += from->reordered;
+    into->loss_bursts += from->loss_bursts;
+    if (from->reorder_depth > into->reorder_depth) {
+        into->reorder_depth = from->reorder_depth;
+    }
+    if (from->longest_burst > into->longest_burst) {
+        into->longest_burst = from->longest_burst;
+    }
+    if (from->jitter_ns > into->jitter_ns) {
+        into->jitter_ns = from->jitter_ns;
+    }
+}
+
+double recv_stats_pps(const struct recv_stats *const stats) {
+    if (stats->last_ns <= stats->first_ns) {
+        return 0.0;
+    }
+    // (The first packet opens the interval; the others fall into it.)
+    return (double)(stats->packets - 1) * 1e9
+        / (double)(stats->last_ns - stats->first_ns);
+}
+
+void recv_stats_report(
+    const char *const label, const struct recv_stats *const stats
+) {
+    const uint64_t expected = stats->packets + stats->lost;
+
+    logger(LOG_INFO,
+        "%s: received %llu packets (%llu bytes) in %.3f s;\n"
+        "  %.0f pkts/s, %llu lost (%.4f%%), %llu duplicates, "
+        "%llu too late to tell, %llu dropped by the kernel;\n"
+        "  %llu loss bursts (longest: %llu), %llu reordered (by up to "
+        "%llu), %.3f us of jitter.",
+        label,
+        (unsigned long long)stats->packets,
+        (unsigned long long)stats->bytes,
+        (double)(stats->last_ns - stats->first_ns) / 1e9,
+        recv_stats_pps(stats),
+        (unsigned long long)stats->lost,
+        (expected > 0)
+            ? 100.0 * (double)stats->lost / (double)expected : 0.0,
+        (unsigned long long)stats->duplicates,
+        (unsigned long long)stats->late,
+        (unsigned long long)stats->dropped,
+        (unsigned long long)stats->loss_bursts,
+        (unsigned long long)stats->longest_burst,
+        (unsigned long long)stats->reordered,
+        (unsigned long long)stats->reorder_depth,
+        stats->jitter_ns / 1e3
+    );
+}
+
+
+void echo_stats_merge(
+    struct echo_stats *const into, const struct echo_stats *const from
+) {
+    into->sent += from->sent;
+    into->errors += from->errors;
+    into->untracked += from->untracked;
+    into->received += from->received;
+    into->lost += from->lost;
+    into->unmatched += from->unmatched;
+    histogram_merge(&into->rtts, &from->rtts);
+}
+
+// The distribution of some delays (in nanoseconds), in microseconds
+static void report_latencies(
+    const char *const label,
+    const char *const what,
+    const char *const of,
+    const struct histogram *const delays
+) {
+    logger(LOG_INFO,
+        "%s: %s (us) of %llu %s:\n"
+        "  min %.1f, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f,"
+        " mean %.1f.",
+        label, what, (unsigned long long)delays->count, of,
+        (double)delays->min / 1e3,
+        (double)histogram_percentile(delays, 50.0) / 1e3,
+        (double)histogram_percentile(delays, 99.0) / 1e3,
+        (double)histogram_percentile(delays, 99.9) / 1e3,
+        (double)delays->max / 1e3,
+        histogram_mean(delays) / 1e3
+    );
+}
+
+// (Most of them are those of packets.)
+static void report_delays(
+    const char *const label,
+    const char *const what,
+    const struct histogram *const delays
+) {
+    report_latencies(label, what, "packets", delays);
+}
+
+void echo_stats_report(
+    const char *const label, const struct echo_stats *const stats
+) {
+    const struct histogram *const rtts = &stats->rtts;
+
+    logger(LOG_INFO,
+        "%s: sent %llu echo requests; %llu replies, %llu lost "
+        "(%.4f%%),\n  %llu late or duplicated.",
+        label,
+        (unsigned long long)stats->sent,
+        (unsigned long long)stats->received,
+        (unsigned long long)stats->lost,
+        (stats->sent > 0)
+            ? 100.0 * (double)stats->lost / (double)stats->sent : 0.0,
+        (unsigned long long)stats->unmatched
+    );
+
+    if (rtts->count > 0) {
+        report_delays(label, "round-trip times", rtts);
+    }
+
+    if (stats->untracked > 0 || stats->errors > 0) {
+        logger(LOG_WARN,
+            "%s: %llu requests not sent (too many outstanding), "
+            "%llu errors.",
+            label,
+            (unsigned long long)stats->untracked,
+            (unsigned long long)stats->errors
+        );
+    }
+}
+
+void syn_stats_merge(
+    struct syn_stats *const into, const struct syn_stats *const from
+) {
+    into->probes += from->probes;
+    into->untracked += from->untracked;
+    into->syn_acks += from->syn_acks;
+    into->rsts += from->rsts;
+    into->unanswered += from->unanswered;
+    into->unmatched += from->unmatched;
+    histogram_merge(&into->syn_ack_rtts, &from->syn_ack_rtts);
+    histogram_merge(&into->rst_rtts, &from->rst_rtts);
+}
+
+void syn_stats_report(
+    const char *const label, const struct syn_stats *const stats
+) {
+    const double probes = (stats->probes > 0) ? (double)stats->probes : 1.0;
+
+    logger(LOG_INFO,
+        "%s: %llu SYNs tracked; %llu SYN-ACKs (%.4f%%), %llu RSTs "
+        "(%.4f%%),\n  %llu unanswered (%.4f%%), %llu unmatched answers.",
+        label,
+        (unsigned long long)stats->probes,
+        (unsigned long long)stats->syn_acks,
+        100.0 * (double)stats->syn_acks / probes,
+        (unsigned long long)stats->rsts,
+        100.0 * (double)stats->rsts / probes,
+        (unsigned long long)stats->unanswered,
+        100.0 * (double)stats->unanswered / probes,
+        (unsigned long long)stats->unmatched
+    );
+
+    if (stats->syn_ack_rtts.count > 0) {
+        report_delays(label, "SYN to SYN-ACK", &stats->syn_ack_rtts);
+    }
+    if (stats->rst_rtts.count > 0) {
+        report_delays(label, "SYN to RST", &stats->rst_rtts);
+    }
+
+    if (stats->untracked > 0) {
+        logger(LOG_WARN,
+            "%s: %llu SYNs went untracked (too many outstanding).",
+            label, (unsigned long long)stats->untracked);
+    }
+}
+
+void conn_stats_merge(
+    struct conn_stats *const into, const struct conn_stats *const from
+) {
+    into->attempts += from->attempts;
+    into->established += from->established;
+    into->responses += from->responses;
+    into->refused += from->refused;
+    into->timeouts += from->timeouts;
+    into->unanswered += from->unanswered;
+    into->closed += from->closed;
+    into->unreachable += from->unreachable;
+    into->exhausted += from->exhausted;
+    into->other += from->other;
+    // (As with stats_merge().)
+    if (from->elapsed_ns > into->elapsed_ns) {
+        into->elapsed_ns = from->elapsed_ns;
+    }
+    histogram_merge(&into->handshakes, &from->handshakes);
+    histogram_merge(&into->first_bytes, &from->first_bytes);
+}
+
+void conn_stats_report(
+    const char *const label, const struct conn_stats *const stats
+) {
+    const double seconds = (double)stats->elapsed_ns / 1e9;
+    const double attempts =
+        (stats->attempts > 0) ? (double)stats->attempts : 1.0;
+
+    logger(LOG_INFO,
+        "%s: %llu connections in %.3f s; %llu established (%.4f%%),\n"
+        "  %.1f conn/s; %llu responses.",
+        label,
+        (unsigned long long)stats->attempts, seconds,
+        (unsigned long long)stats->established,
+        100.0 * (double)stats->established / attempts,
+        (seconds > 0.0) ? (double)stats->established / seconds : 0.0,
+        (unsigned long long)stats->responses
+    );
+
+    if (stats->handshakes.count > 0) {
+        report_latencies(label, "handshake latencies", "connections",
+            &stats->handshakes);
+    }
+    if (stats->first_bytes.count > 0) {
+        report_latencies(label, "request to first byte", "connections",
+            &stats->first_bytes);
+    }
+
+    const uint64_t failed = stats->refused + stats->timeouts
+        + stats->unanswered + stats->closed + stats->unreachable
+        + stats->exhausted + stats->other;
+    if (failed > 0) {
+        logger(LOG_WARN,
+            "%s: %llu failed: %llu refused, %llu timed out, %llu "
+            "unanswered,\n  %llu closed by the server, %llu "
+            "unreachable, %llu out of local resources,\n  %llu other.",
+            label,
+            (unsigned long long)failed,
+            (unsigned long long)stats->refused,
+            (unsigned long long)stats->timeouts,
+            (unsigned long long)stats->unanswered,
+            (unsigned long long)stats->closed,
+            (unsigned long long)stats->unreachable,
+            (unsigned long long)stats->exhausted,
+            (unsigned long long)stats->other
+        );
+    }
+}
+
+void dns_stats_merge(
+    struct dns_stats *const into, const struct dns_stats *const from
+) {
+    into->sent += from->sent;
+    into->errors += from->errors;
+    into->untracked += from->untracked;
+    into->responses += from->responses;
+    into->lost += from->lost;
+    into->unmatched += from->unmatched;
+    into->truncated += from->truncated;
+    for (unsigned int i = 0; i < DNS_NUM_RCODES; i++) {
+        into->rcodes[i] += from->rcodes[i];
+    }
+    // (As with stats_merge().)
+    if (from->elapsed_ns > into->elapsed_ns) {
+        into->elapsed_ns = from->elapsed_ns;
+    }
+    histogram_merge(&into->latencies, &from->latencies);
+}
+
+// Names of the RCODEs (RFC 1035 and 2136); the rest are unassigned.
+static const char *const DNS_RCODE_NAMES[] = {
+    "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED",
+    "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH", "NOTZONE"
+};
+#define DNS_NUM_RCODE_NAMES \
+    (sizeof (DNS_RCODE_NAMES) / sizeof (DNS_RCODE_NAMES[0]))
+
+void dns_stats_report(
+    const char *const label, const struct dns_stats *const stats
+) {
+    const double seconds = (double)stats->elapsed_ns / 1e9;
+
+    logger(LOG_INFO,
+        "%s: sent %llu queries in %.3f s (%.0f per second);\n"
+        "  %llu responses (%.0f per second), %llu lost (%.4f%%), "
+        "%llu late or duplicated.",
+        label,
+        (unsigned long long)stats->sent, seconds,
+        (seconds > 0.0) ? (double)stats->sent / seconds : 0.0,
+        (unsigned long long)stats->responses,
+        (seconds > 0.0) ? (double)stats->responses / seconds : 0.0,
+        (unsigned long long)stats->lost,
+        (stats->sent > 0)
+            ? 100.0 * (double)stats->lost / (double)stats->sent : 0.0,
+        (unsigned long long)stats->unmatched
+    );
+
+    if (stats->responses > 0) {
+        // Only the RCODEs that came back at all
+        char breakdown[DNS_NUM_RCODES * 32] = "";
+        size_t length = 0;
+        for (unsigned int i = 0; i < DNS_NUM_RCODES; i++) {
+            if (stats->rcodes[i] == 0) {
+                continue;
+            }
+            char name[16];
+            if (i < DNS_NUM_RCODE_NAMES) {
+                snprintf(name, sizeof (name), "%s", DNS_RCODE_NAMES[i]);
+            }
+            else {
+                snprintf(name, sizeof (name), "RCODE%u", i);
+            }
+            const int written = snprintf(breakdown + length,
+                sizeof (breakdown) - length, "%s%s %llu (%.2f%%)",
+                (length > 0) ? ", " : "", name,
+                (unsigned long long)stats->rcodes[i],
+                100.0 * (double)stats->rcodes[i]
+                    / (double)stats->responses);
+            // (Whatever did not fit got cut off; stop there.)
+            if (written < 0
+                || (size_t)written >= sizeof (breakdown) - length
+            ) {
+                break;
+            }
+            length += (size_t)written;
+        }
+        logger(LOG_INFO, "%s: %s; %llu truncated.", label, breakdown,
+            (unsigned long long)stats->truncated);
+
+        report_latencies(label, "response times", "responses",
+            &stats->latencies);
+    }
+
+    if (stats->untracked > 0 || stats->errors > 0) {
+        logger(LOG_WARN,
+            "%s: %llu queries not sent (too many outstanding), "
+            "%llu failed to send.",
+            label,
+            (unsigned long long)stats->untracked,
+            (unsigned long long)stats->errors
+        );
+    }
+}
+
+void tstamp_stats_report(
+    const char *const label, const struct tstamp_stats *const stats
+) {
+    logger(LOG_INFO,
+        "%s: %llu packets sampled; %llu without a timestamp from the "
+        "driver.",
+        label,
+        (unsigned long long)stats->samples,
+        (unsigned long long)stats->incomplete
+    );
+
+    if (stats->to_qdisc.count > 0) {
+        report_delays(label, "syscall to qdisc", &stats->to_qdisc);
+    }
+    if (stats->to_driver.count > 0) {
+        report_delays(label, "syscall to driver", &stats->to_driver);
+    }
+    // (Only with a NIC clock that tracks the system's; see tstamp.c.)
+    if (stats->to_wire.count > 0) {
+        report_delays(label, "syscall to wire (NIC clock)",
+            &stats->to_wire);
+    }
+}
+
+void twamp_stats_report(
+    const char *const label, const struct twamp_stats *const stats
+) {
+    const uint64_t lost = (stats->sent > stats->received)
+        ? stats->sent - stats->received : 0;
+    // (Only those sent up to the latest reflected one can be told
+    // apart; the rest may still have been on their way either way.)
+    const uint64_t lost_there = (stats->sent_before > stats->reflected)
+        ? stats->sent_before - stats->reflected : 0;
+    const uint64_t lost_back = (stats->reflected > stats->received)
+        ? stats->reflected - stats->received : 0;
+
+    logger(LOG_INFO,
+        "%s: sent %llu test packets; %llu reflected back, %llu lost "
+        "(%.4f%%):\n  %llu on the way there, %llu on the way back, "
+        "%llu after the last reply.",
+        label,
+        (unsigned long long)stats->sent,
+        (unsigned long long)stats->received,
+        (unsigned long long)lost,
+        (stats->sent > 0)
+            ? 100.0 * (double)lost / (double)stats->sent : 0.0,
+        (unsigned long long)lost_there,
+        (unsigned long long)lost_back,
+        (unsigned long long)(stats->sent - stats->sent_before)
+    );
+
+    if (stats->rtts.count > 0) {
+        report_delays(label, "round-trip delays", &stats->rtts);
+    }
+    if (stats->forward.count > 0) {
+        report_delays(label, "one-way delays there", &stats->forward);
+        report_delays(label, "one-way delays back", &stats->backward);
+    }
+
+    if (stats->unsynced > 0 || stats->errors > 0) {
+        logger(LOG_WARN,
+            "%s: %llu negative one-way delays (the clocks are out of "
+            "sync), %llu errors.",
+            label,
+            (unsigned long long)stats->unsynced,
+            (unsigned long long)stats->errors
+        );
+    }
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: stats.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,200 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// stats.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef STATS_H
+#define STATS_H
+
+
+#include "./cmdline/logger.h"
+#include "./utils/histogram.h"
+
+#include <stdint.h>
+
+
+// NOTE: Every thread keeps its own copy of these counters and only
+// the main thread merges them (after joining); this way, the sending
+// loop never touches a shared cache line or an atomic variable.
+typedef struct send_stats {
+    uint64_t packets;    // Packets accepted by the kernel
+    uint64_t bytes;      // Bytes (L3 and up) accepted by the kernel
+    uint64_t dropped;    // Packets refused due to full socket buffers
+    uint64_t errors;     // Failed syscalls for any other reason
+    uint64_t missed;     // Dropped by the qdisc for their launch time
+    uint64_t elapsed_ns; // Wall-clock duration of the measurement
+    // Between the starts of consecutive batches (i.e., syscalls); it
+    // shows how faithfully the pacer could shape the traffic.
+    struct histogram gaps;
+} send_stats_t;
+
+// Likewise, of the receiving loops of a "--sink" (except for `lost`,
+// which only the merged sequence numbers of all threads can tell.)
+typedef struct recv_stats {
+    uint64_t packets;    // Distinct test packets of the run
+    uint64_t bytes;      // Their bytes (L3 and up)
+    uint64_t duplicates; // Test packets that were received before
+    uint64_t late;       // Behind the whole window (and counted lost)
+    uint64_t lost;       // Missing from the sequences received
+    uint64_t dropped;    // By the kernel, for lack of buffer space
+    uint64_t reordered;  // Received after a later one (of its thread)
+    uint64_t reorder_depth; // Most sequence numbers that one was late
+    uint64_t loss_bursts;   // Runs of consecutive lost packets
+    uint64_t longest_burst; // Packets
+    double jitter_ns;    // Interarrival jitter (RFC 3550), the highest
+                         // of those of the sending threads
+    uint64_t first_ns;   // When the first test packet was received
+    uint64_t last_ns;    // When the last test packet was received
+} recv_stats_t;
+
+// Of an ICMP echo probe ("--icmp"), whose sending and receiving
+// threads each keep their own counters, too.
+typedef struct echo_stats {
+    uint64_t sent;       // Echo requests accepted by the kernel
+    uint64_t errors;     // Failed syscalls
+    uint64_t untracked;  // Requests not sent, for lack of a table slot
+    uint64_t received;   // Replies matched to an outstanding request
+    uint64_t lost;       // Requests left without a reply in time
+    uint64_t unmatched;  // Replies to no outstanding request (i.e.,
+                         // late or duplicated ones)
+    struct histogram rtts; // Of the matched replies (in nanoseconds)
+} echo_stats_t;
+
+// Of the answers to the SYNs of "--responses", which the sending
+// threads track (each counting its own) and a thread of its own
+// matches the SYN-ACKs and RSTs of the destination to.
+typedef struct syn_stats {
+    uint64_t probes;     // SYNs accepted by the kernel and tracked
+    uint64_t untracked;  // SYNs sent without a table slot for them
+    uint64_t syn_acks;   // Answers that accepted the connection
+    uint64_t rsts;       // And those that refused it
+    uint64_t unanswered; // SYNs left without an answer in time (or
+                         // superseded by one of the same port and
+                         // sequence number)
+    uint64_t unmatched;  // Answers to no tracked SYN (i.e., late,
+                         // retransmitted, or of other connections)
+    struct histogram syn_ack_rtts; // Handshake latencies (nanoseconds)
+    struct histogram rst_rtts;
+} syn_stats_t;
+
+// Of the real connections of "--connect"; every thread counts its own.
+typedef struct conn_stats {
+    uint64_t attempts;    // Connections started (i.e., connect() calls)
+    uint64_t established; // Handshakes completed
+    uint64_t responses;   // Requests that got a first byte back
+    // Why the rest failed:
+    uint64_t refused;     // An RST in answer to the SYN
+    uint64_t timeouts;    // No handshake in time
+    uint64_t unanswered;  // No response (to a request) in time
+    uint64_t closed;      // Closed or reset by the server before that
+    uint64_t unreachable; // ICMP errors (host or network unreachable)
+    uint64_t exhausted;   // Out of local ports, descriptors or memory
+    uint64_t other;       // Any other error
+    uint64_t elapsed_ns;  // Wall-clock duration of the measurement
+    struct histogram handshakes;  // From connect() on (nanoseconds)
+    struct histogram first_bytes; // From the request on
+} conn_stats_t;
+
+// Of the queries of "--dns"; the sending threads count what they sent,
+// and the receiving thread what came back.
+#define DNS_NUM_RCODES 16 // (Those of the header; EDNS adds more bits.)
+typedef struct dns_stats {
+    uint64_t sent;        // Queries accepted by the kernel
+    uint64_t errors;      // Queries the kernel did not take
+    uint64_t untracked;   // Queries not sent, for lack of a table slot
+    uint64_t responses;   // Matched to an outstanding query
+    uint64_t lost;        // Queries left without a response in time
+    uint64_t unmatched;   // Responses to no outstanding query (i.e.,
+                          // late or duplicated ones)
+    uint64_t truncated;   // Responses with the TC bit set
+    uint64_t rcodes[DNS_NUM_RCODES]; // Of the matched responses
+    uint64_t elapsed_ns;  // Wall-clock duration of the sending
+    struct histogram latencies; // Of the matched responses
+} dns_stats_t;
+
+// Of the packets sampled for kernel TX timestamps ("--tx-timestamps");
+// each delay is from just before the syscall that sent the packet.
+typedef struct tstamp_stats {
+    uint64_t samples;     // Packets sent with a timestamping request
+    uint64_t incomplete;  // Of which no software SND timestamp came back
+    uint64_t missed;      // Dropped by the qdisc for their launch time
+    struct histogram to_qdisc;   // SCM_TSTAMP_SCHED (nanoseconds)
+    struct histogram to_driver;  // SCM_TSTAMP_SND
+    struct histogram to_wire;    // SCM_TSTAMP_SND, from the NIC
+} tstamp_stats_t;
+
+// Of a TWAMP-light Session-Sender ("--twamp"); the losses each way
+// follow from the sequence numbers of the reflector, which counts the
+// test packets that reached it.
+typedef struct twamp_stats {
+    uint64_t sent;          // Test packets accepted by the kernel
+    uint64_t errors;        // Failed syscalls
+    uint64_t received;      // Reflected test packets
+    uint64_t reflected;     // By the reflector, as of the latest one
+    uint64_t sent_before;   // By us, as of that same one
+    uint64_t unsynced;      // Of negative one-way delays (the clocks
+                            // of the two ends are out of sync)
+    struct histogram rtts;      // Round trips (minus the turnaround)
+    struct histogram forward;   // One-way delays there (nanoseconds)
+    struct histogram backward;  // And back
+} twamp_stats_t;
+
+void stats_merge(
+    struct send_stats *const into, const struct send_stats *const from
+);
+double stats_pps(const struct send_stats *const stats);
+double stats_mbps(const struct send_stats *const stats);
+void stats_report(
+    const char *const label, const struct send_stats *const stats
+);
+
+void recv_stats_merge(
+    struct recv_stats *const into, const struct recv_stats *const from
+);
+double recv_stats_pps(const struct recv_stats *const stats);
+void recv_stats_report(
+    const char *const label, const struct recv_stats *const stats
+);
+
+void echo_stats_merge(
+    struct echo_stats *const into, const struct echo_stats *const from
+);
+void echo_stats_report(
+    const char *const label, const struct echo_stats *const stats
+);
+
+void syn_stats_merge(
+    struct syn_stats *const into, const struct syn_stats *const from
+);
+void syn_stats_report(
+    const char *const label, const struct syn_stats *const stats
+);
+
+void conn_stats_merge(
+    struct conn_stats *const into, const struct conn_stats *const from
+);
+void conn_stats_report(
+    const char *const label, const struct conn_stats *const stats
+);
+
+void dns_stats_merge(
+    struct dns_stats *const into, const struct dns_stats *const from
+);
+void dns_stats_report(
+    const char *const label, const struct dns_stats *const stats
+);
+
+void tstamp_stats_report(
+    const char *const label, const struct tstamp_stats *const stats
+);
+void twamp_stats_report(
+    const char *const label, const struct twamp_stats *const stats
+);
+
+
+#endif // STATS_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: stats.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,521 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// tstamp.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: SO_TIMESTAMPING (and its error queue) is a Linux extension.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "tstamp.h"
+
+
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+// What the draining thread knows of the sample in flight; the kernel
+// tells the timestamps of one packet apart from those of the last by
+// their key (SOF_TIMESTAMPING_OPT_ID), which counts the timestamped
+// packets of the socket.
+typedef struct sample {
+    bool keyed;           // Its first timestamp came back
+    uint32_t key;
+    bool had_last;        // (A hardware timestamp may trail the rest.)
+    uint32_t last_key;
+    uint64_t last_sent_ns;
+} sample_t;
+
+static uint64_t timespec_ns(const struct timespec *const time) {
+    return (uint64_t)time->tv_sec * NSEC_PER_SEC + (uint64_t)time->tv_nsec;
+}
+
+static void record_delay(
+    struct histogram *const delays,
+    const uint64_t sent_ns,
+    const uint64_t stamp_ns
+) {
+    if (stamp_ns != 0 && stamp_ns >= sent_ns) {
+        histogram_record(delays, stamp_ns - sent_ns);
+    }
+}
+
+// A hardware timestamp, on the system's clock (or 0: none).
+static uint64_t hardware_stamp_ns(
+    const struct tstamp_sampler *const sampler,
+    const struct timespec *const stamp
+) {
+    const uint64_t stamp_ns = timespec_ns(stamp);
+    if (!sampler->hardware || stamp_ns == 0) {
+        return 0;
+    }
+    return stamp_ns - (uint64_t)sampler->clock_offset_ns;
+}
+
+// Lets the next sample go, remembering this one's key.
+static void finish_sample(
+    struct tstamp_sampler *const sampler, struct sample *const sample
+) {
+    if (sample->keyed) {
+        sample->had_last = true;
+        sample->last_key = sample->key;
+        sample->last_sent_ns = LOAD_ACQUIRE(&sampler->sent_ns);
+    }
+    sample->keyed = false;
+
+    int expected = 1;
+    (void)COMPARE_EXCHANGE(&sampler->pending, &expected, 0);
+}
+
+static void handle_stamp(
+    struct tstamp_sampler *const sampler,
+    struct sample *const sample,
+    const struct sock_extended_err *const error,
+    const struct scm_timestamping *const stamps
+) {
+    struct tstamp_stats *const stats = &sampler->stats;
+    const uint64_t software_ns = timespec_ns(&stamps->ts[0]);
+    const uint64_t hardware_ns =
+        hardware_stamp_ns(sampler, &stamps->ts[2]);
+    const uint32_t key = error->ee_data;
+
+    if (sample->had_last && key == sample->last_key) {
+        if (error->ee_info == SCM_TSTAMP_SND) {
+            record_delay(&stats->to_wire,
+                sample->last_sent_ns, hardware_ns);
+        }
+        return;
+    }
+    if (!LOAD_ACQUIRE(&sampler->pending)) {
+        return;
+    }
+    if (!sample->keyed) {
+        sample->keyed = true;
+        sample->key = key;
+    }
+    else if (key != sample->key) {
+        return;
+    }
+
+    const uint64_t sent_ns = LOAD_ACQUIRE(&sampler->sent_ns);
+    if (error->ee_info == SCM_TSTAMP_SCHED) {
+        record_delay(&stats->to_qdisc, sent_ns, software_ns);
+    }
+    else if (error->ee_info == SCM_TSTAMP_SND) {
+        record_delay(&stats->to_wire, sent_ns, hardware_ns);
+        if (software_ns != 0) {
+            record_delay(&stats->to_driver, sent_ns, software_ns);
+            finish_sample(sampler, sample);
+        }
+    }
+}
+
+// Reads everything off the error queue.
+static void drain_errors(
+    struct tstamp_sampler *const sampler, struct sample *const sample
+) {
+    uint8_t data[64];
+    union {
+        size_t align;
+        uint8_t bytes[CMSG_SPACE(sizeof (struct sock_extended_err) + 64)
+            + CMSG_SPACE(sizeof (struct scm_timestamping))];
+    } control;
+
+    for (;;) {
+        struct iovec iov = {.iov_base = data, .iov_len = sizeof (data)};
+        struct msghdr message = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.bytes,
+            .msg_controllen = sizeof (control.bytes)
+        };
+
+        if (recvmsg(sampler->socket, &message,
+            MSG_ERRQUEUE | MSG_DONTWAIT) < 0
+        ) {
+            break;
+        }
+
+        struct sock_extended_err error = {0};
+        struct scm_timestamping stamps;
+        bool stamped = false;
+        for (struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header != NULL;
+            header = CMSG_NXTHDR(&message, header)
+        ) {
+            if (header->cmsg_level == SOL_SOCKET
+                && header->cmsg_type == SCM_TIMESTAMPING
+            ) {
+                memcpy(&stamps, CMSG_DATA(header), sizeof (stamps));
+                stamped = true;
+            }
+            else if ((header->cmsg_level == SOL_IP
+                    && header->cmsg_type == IP_RECVERR)
+                || (header->cmsg_level == SOL_IPV6
+                    && header->cmsg_type == IPV6_RECVERR)
+                || (header->cmsg_level == SOL_PACKET
+                    && header->cmsg_type == PACKET_TX_TIMESTAMP)
+            ) {
+                memcpy(&error, CMSG_DATA(header), sizeof (error));
+            }
+        }
+
+        if (error.ee_origin == SO_EE_ORIGIN_TXTIME) {
+            sampler->stats.missed++;
+        }
+        else if (error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING
+            && stamped
+        ) {
+            handle_stamp(sampler, sample, &error, &stamps);
+        }
+    }
+}
+
+// Thread callback
+static int drain_loop(void *arg) {
+    struct tstamp_sampler *const sampler = (struct tstamp_sampler *)arg;
+    // (The error queue raises POLLERR, which needs no asking for.)
+    struct pollfd poll_info = {.fd = sampler->socket, .events = 0};
+    struct sample sample = {0};
+
+    for (;;) {
+        const bool done = LOAD_ACQUIRE(&sampler->done);
+        (void)poll(&poll_info, 1, TSTAMP_POLL_TIMEOUT);
+        drain_errors(sampler, &sample);
+
+        // The driver may not timestamp at all (or the packet may have
+        // been dropped on the way).
+        if (LOAD_ACQUIRE(&sampler->pending)
+            && clock_now_ns() - LOAD_ACQUIRE(&sampler->claimed_ns)
+                >= TSTAMP_TIMEOUT_NS
+        ) {
+            sampler->stats.incomplete++;
+            finish_sample(sampler, &sample);
+        }
+        if (done) {
+            break;
+        }
+    }
+
+    return thrd_success;
+}
+
+// Finds the interface that the packets leave through: that of "--eth",
+// or else the one with the source address of the route to the (outer)
+// destination.
+static int find_interface(
+    const struct ProgramArgs *const program_args,
+    char name[IF_NAMESIZE]
+) {
+    if (program_args->protocols.l2 == PROTO_L2_ETH) {
+        snprintf(name, IF_NAMESIZE, "%s",
+            program_args->eth_misc.interface);
+        return 0;
+    }
+
+    const bool tunnel = program_args->tunnel.kind != TUNNEL_NONE;
+    const bool ipv6 = !tunnel
+        && program_args->protocols.l3 == PROTO_L3_IPV6;
+    uint32_t saddr = 0;
+    uint8_t saddr6[16] = {0};
+    if (ipv6
+        ? resolve_source_address6(program_args->ipv6.daddr.octets,
+            saddr6) != 0
+        : resolve_source_address(tunnel
+            ? program_args->tunnel.daddr.address
+            : program_args->ipv4->daddr.address, &saddr) != 0
+    ) {
+        return 1;
+    }
+
+    struct ifaddrs *addresses;
+    if (getifaddrs(&addresses) != 0) {
+        logger(LOG_ERROR,
+            "Failed to list the interfaces: %s", strerror(errno));
+        return 1;
+    }
+    int status = 1;
+    for (const struct ifaddrs *entry = addresses; entry != NULL;
+        entry = entry->ifa_next
+    ) {
+        const struct sockaddr *const address = entry->ifa_addr;
+        if (address == NULL) {
+            continue;
+        }
+        if ((ipv6 && address->sa_family == AF_INET6
+                && memcmp(&((const struct sockaddr_in6 *)address)
+                    ->sin6_addr, saddr6, sizeof (saddr6)) == 0)
+            || (!ipv6 && address->sa_family == AF_INET
+                && ntohl(((const struct sockaddr_in *)address)
+                    ->sin_addr.s_addr) == saddr)
+        ) {
+            snprintf(name, IF_NAMESIZE, "%s", entry->ifa_name);
+            status = 0;
+            break;
+        }
+    }
+    freeifaddrs(addresses);
+
+    if (status != 0) {
+        logger(LOG_ERROR, "Failed to find the outgoing interface.");
+    }
+    return status;
+}
+
+// How far the PTP hardware clock `index` (i.e., the NIC's) is ahead of
+// CLOCK_REALTIME, going by the reading of it that took the least time
+// between two readings of the latter.
+static int measure_clock_offset(const int index, int64_t *const offset_ns) {
+    char path[32];
+    snprintf(path, sizeof (path), "/dev/ptp%d", index);
+    const int descriptor = open(path, O_RDONLY);
+    if (descriptor == -1) {
+        return 1;
+    }
+    // (FD_TO_CLOCKID() of the kernel's testptp.c)
+    const clockid_t clock =
+        (clockid_t)(((unsigned int)~descriptor << 3) | 3);
+
+    int status = 1;
+    uint64_t best_window_ns = UINT64_MAX;
+    for (unsigned int i = 0; i < TSTAMP_CLOCK_READS; i++) {
+        struct timespec before, nic, after;
+        clock_gettime(CLOCK_REALTIME, &before);
+        if (clock_gettime(clock, &nic) != 0) {
+            break;
+        }
+        clock_gettime(CLOCK_REALTIME, &after);
+
+        const uint64_t before_ns = timespec_ns(&before);
+        const uint64_t window_ns = timespec_ns(&after) - before_ns;
+        if (window_ns < best_window_ns) {
+            best_window_ns = window_ns;
+            *offset_ns = (int64_t)(timespec_ns(&nic)
+                - (before_ns + window_ns / 2));
+            status = 0;
+        }
+    }
+
+    close(descriptor);
+    return status;
+}
+
+// Turns on the hardware TX timestamps of the interface (as ptp4l would;
+// the driver only takes them once told to), and checks that its clock
+// compares with the system's; otherwise, the software ones must do.
+static void enable_hardware(struct tstamp_sampler *const sampler) {
+    const int control = socket(AF_INET, SOCK_DGRAM, 0);
+    if (control == -1) {
+        return;
+    }
+    struct ifreq request = {0};
+    snprintf(request.ifr_name, sizeof (request.ifr_name), "%s",
+        sampler->interface);
+
+    struct ethtool_ts_info info = {.cmd = ETHTOOL_GET_TS_INFO};
+    request.ifr_data = (void *)&info;
+    if (ioctl(control, SIOCETHTOOL, &request) != 0
+        || !(info.so_timestamping & SOF_TIMESTAMPING_TX_HARDWARE)
+        || !(info.tx_types & (1u << HWTSTAMP_TX_ON))
+        || info.phc_index < 0
+    ) {
+        logger(LOG_INFO,
+            "%s does not timestamp packets in hardware.",
+            sampler->interface);
+        close(control);
+        return;
+    }
+
+    // (Whatever the RX timestamps are set to stays as it is.)
+    struct hwtstamp_config config = {.rx_filter = HWTSTAMP_FILTER_NONE};
+    request.ifr_data = (void *)&config;
+    const bool known = ioctl(control, SIOCGHWTSTAMP, &request) == 0;
+    if (known) {
+        sampler->config = config;
+    }
+    if (config.tx_type != HWTSTAMP_TX_ON) {
+        config.tx_type = HWTSTAMP_TX_ON;
+        request.ifr_data = (void *)&config;
+        if (ioctl(control, SIOCSHWTSTAMP, &request) != 0) {
+            logger(LOG_WARN,
+                "Failed to turn on the hardware timestamps of %s: %s",
+                sampler->interface, strerror(errno));
+            close(control);
+            return;
+        }
+        sampler->restore_config = known;
+    }
+    close(control);
+
+    // NOTE: ptp4l (and phc2sys, unless told otherwise) keep the NIC's
+    // clock in TAI, which is ahead of UTC by the offset that they also
+    // tell the kernel.
+    int64_t offset_ns;
+    struct timespec tai, real;
+    clock_gettime(CLOCK_TAI, &tai);
+    clock_gettime(CLOCK_REALTIME, &real);
+    // (Whole seconds, whatever passed between the two readings.)
+    const uint64_t tai_offset_s = (timespec_ns(&tai) - timespec_ns(&real)
+        + NSEC_PER_SEC / 2) / NSEC_PER_SEC;
+    const int64_t tai_offset_ns = (int64_t)(tai_offset_s * NSEC_PER_SEC);
+    if (measure_clock_offset(info.phc_index, &offset_ns) != 0) {
+        logger(LOG_WARN,
+            "Failed to read the clock of %s (/dev/ptp%d).",
+            sampler->interface, info.phc_index);
+        return;
+    }
+    if (llabs(offset_ns) <= (long long)TSTAMP_MAX_CLOCK_OFFSET_NS) {
+        sampler->clock_offset_ns = 0;
+    }
+    else if (tai_offset_ns != 0 && llabs(offset_ns - tai_offset_ns)
+        <= (long long)TSTAMP_MAX_CLOCK_OFFSET_NS
+    ) {
+        sampler->clock_offset_ns = tai_offset_ns;
+    }
+    else {
+        logger(LOG_WARN,
+            "The clock of %s is %.6f s off the system's; not reporting "
+            "the delays to the wire\n  (keep the two in sync, e.g., "
+            "with \"phc2sys -s %s -c CLOCK_REALTIME -O 0\").",
+            sampler->interface, (double)offset_ns / 1e9,
+            sampler->interface);
+        return;
+    }
+
+    sampler->hardware = true;
+    logger(LOG_INFO,
+        "Timestamping in hardware, too, on %s.", sampler->interface);
+}
+
+// Puts the hardware timestamps of the interface back as they were.
+static void restore_hardware(struct tstamp_sampler *const sampler) {
+    const int control = socket(AF_INET, SOCK_DGRAM, 0);
+    if (control == -1) {
+        return;
+    }
+    struct ifreq request = {0};
+    snprintf(request.ifr_name, sizeof (request.ifr_name), "%s",
+        sampler->interface);
+    request.ifr_data = (void *)&sampler->config;
+    if (ioctl(control, SIOCSHWTSTAMP, &request) != 0) {
+        logger(LOG_WARN,
+            "Failed to restore the hardware timestamps of %s: %s",
+            sampler->interface, strerror(errno));
+    }
+    close(control);
+}
+#endif
+
+int tstamp_start(
+    struct tstamp_sampler *const sampler,
+    const struct ProgramArgs *const program_args
+) {
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+    memset(sampler, 0, sizeof (*sampler));
+    sampler->socket = program_args->socket;
+
+    // (Only reporting flags; the samples ask for timestamps themselves.)
+    const unsigned int flags = SOF_TIMESTAMPING_SOFTWARE
+        | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_OPT_ID
+        | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (setsockopt(sampler->socket, SOL_SOCKET, SO_TIMESTAMPING,
+        &flags, sizeof (flags)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to enable SO_TIMESTAMPING: %s", strerror(errno));
+        return 1;
+    }
+
+    if (find_interface(program_args, sampler->interface) != 0) {
+        return 1;
+    }
+    enable_hardware(sampler);
+
+    if (thrd_create(&sampler->thread, drain_loop, sampler)
+        != thrd_success
+    ) {
+        logger(LOG_ERROR, "Failed to spawn the timestamping thread.");
+        if (sampler->restore_config) {
+            restore_hardware(sampler);
+        }
+        return 1;
+    }
+
+    return 0;
+#else
+    (void)sampler;
+    (void)program_args;
+    logger(LOG_ERROR,
+        "TX timestamps (SO_TIMESTAMPING) require Linux and C11 "
+        "threads.");
+    return 1;
+#endif
+}
+
+void tstamp_stop(struct tstamp_sampler *const sampler) {
+#if defined(__linux__) && __STDC_VERSION__ >= 201112L \
+    && !defined(__STDC_NO_THREADS__)
+    // (Any sample still in flight gets its own timeout to come back.)
+    const uint64_t until_ns = clock_now_ns() + TSTAMP_TIMEOUT_NS;
+    while (LOAD_ACQUIRE(&sampler->pending) && clock_now_ns() < until_ns) {
+        sleep_until_ns(clock_now_ns() + TSTAMP_POLL_TIMEOUT
+            * NSEC_PER_MSEC);
+    }
+
+    STORE_RELEASE(&sampler->done, 1);
+    thrd_join(sampler->thread, NULL);
+
+    // Further packets need not be reported.
+    const unsigned int flags = 0;
+    (void)setsockopt(sampler->socket, SOL_SOCKET, SO_TIMESTAMPING,
+        &flags, sizeof (flags));
+    if (sampler->restore_config) {
+        restore_hardware(sampler);
+    }
+#else
+    (void)sampler;
+#endif
+}
+
+size_t tstamp_prepare(
+    struct tstamp_sampler *const sampler, uint8_t *const control
+) {
+#if defined(__linux__)
+    struct cmsghdr *const message = (struct cmsghdr *)control;
+    message->cmsg_level = SOL_SOCKET;
+    message->cmsg_type = SO_TIMESTAMPING;
+    message->cmsg_len = CMSG_LEN(sizeof (uint32_t));
+    const uint32_t flags = SOF_TIMESTAMPING_TX_SCHED
+        | SOF_TIMESTAMPING_TX_SOFTWARE
+        | (sampler->hardware ? SOF_TIMESTAMPING_TX_HARDWARE : 0);
+    memcpy(CMSG_DATA(message), &flags, sizeof (flags));
+
+    // (Nothing else touches the sample until its packet is sent.)
+    sampler->stats.samples++;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    STORE_RELEASE(&sampler->sent_ns,
+        (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec);
+
+    return CMSG_SPACE(sizeof (uint32_t));
+#else
+    (void)sampler;
+    (void)control;
+    return 0;
+#endif
+}
+
+void tstamp_sent(struct tstamp_sampler *const sampler, const bool sent) {
+    if (sent) {
+        return;
+    }
+    sampler->stats.samples--;
+    int expected = 1;
+    (void)COMPARE_EXCHANGE(&sampler->pending, &expected, 0);
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: tstamp.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,136 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// tstamp.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef TSTAMP_H
+#define TSTAMP_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./utils/clock.h"
+#include "./utils/intrins.h"
+#include "socket.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <fcntl.h>
+#   include <poll.h>
+#   include <unistd.h>
+#   include <sys/ioctl.h>
+#   include <sys/socket.h>
+#   include <net/if.h>
+#   include <netinet/in.h>
+#   if defined(__linux__)
+#       include <ifaddrs.h>
+#       include <linux/errqueue.h>
+#       include <linux/ethtool.h>
+#       include <linux/if_packet.h>
+#       include <linux/net_tstamp.h>
+#       include <linux/sockios.h>
+#   endif
+#endif
+
+// Room for the one control message (SO_TIMESTAMPING) of a sample.
+#define TSTAMP_CONTROL_SIZE 24
+// How long a sample may wait for its timestamps before it is given up
+// on (and the next one may go).
+#define TSTAMP_TIMEOUT_NS (100 * NSEC_PER_MSEC)
+// Milliseconds to wait for timestamps before checking for the end.
+#define TSTAMP_POLL_TIMEOUT 10
+// How closely the NIC's clock must track the system's (or its TAI) for
+// its timestamps to be compared with those of the syscalls, and how
+// many readings of it to take the tightest of.
+#define TSTAMP_MAX_CLOCK_OFFSET_NS (20 * NSEC_PER_USEC)
+#define TSTAMP_CLOCK_READS 8
+
+
+// NOTE: Every packet could get timestamped, but then the error queue
+// (which shares the receive buffer of the socket) would fill up at a
+// few hundred thousand packets per second; instead, the sending loops
+// only ask for the timestamps of one packet every so often, through a
+// control message of its own.  All of the threads share one socket
+// (and its error queue), so only one sample is in flight at a time;
+// that spares matching timestamps to the thread that sent them.
+typedef struct tstamp_sampler {
+    int socket;
+    int pending;          // A sample is in flight (claimed by a thread)
+    uint64_t sent_ns;     // Its send time (CLOCK_REALTIME, like those
+                          // of the kernel)
+    uint64_t claimed_ns;  // When it was claimed (clock_now_ns())
+    int done;
+    int status;
+    struct tstamp_stats stats;
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    thrd_t thread;
+#endif
+    // Hardware timestamps, if the egress interface takes them and its
+    // clock tracks the system's (minus `clock_offset_ns`: 0, or the
+    // TAI offset with ptp4l's default); see tstamp_start().
+    bool hardware;
+    int64_t clock_offset_ns;
+#if defined(__linux__)
+    char interface[IF_NAMESIZE];
+    bool restore_config;            // To `config`, once done
+    struct hwtstamp_config config;  // Of the interface, as it was
+#endif
+} tstamp_sampler_t;
+
+// Enables the reporting of TX timestamps on the socket of
+// `program_args` (without requesting any yet), and spawns the thread
+// that drains them from its error queue; with "--txtime", that thread
+// counts the packets that missed their launch times, too.  Where the
+// egress interface can, it gets to timestamp the packets in hardware
+// (SIOCSHWTSTAMP, until tstamp_stop()).
+int tstamp_start(
+    struct tstamp_sampler *const sampler,
+    const struct ProgramArgs *const program_args
+);
+
+// Stops the thread, after giving the last sample its chance.
+void tstamp_stop(struct tstamp_sampler *const sampler);
+
+// Takes the (single) sample in flight for a sending loop; on success,
+// the loop must send one packet with the control message of
+// tstamp_prepare(), and then call tstamp_sent().
+static inline bool tstamp_claim(struct tstamp_sampler *const sampler) {
+    int expected = 0;
+    if (LOAD_ACQUIRE(&sampler->pending) != 0
+        || !COMPARE_EXCHANGE(&sampler->pending, &expected, 1)
+    ) {
+        return false;
+    }
+    STORE_RELEASE(&sampler->claimed_ns, clock_now_ns());
+    return true;
+}
+
+// Writes the control message that asks for the TX timestamps of one
+// packet into `control` (of TSTAMP_CONTROL_SIZE bytes, aligned like a
+// cmsghdr), and notes the send time; returns its length.
+size_t tstamp_prepare(
+    struct tstamp_sampler *const sampler, uint8_t *const control
+);
+
+// Gives up on the sample if its packet did not get sent after all.
+void tstamp_sent(struct tstamp_sampler *const sampler, const bool sent);
+
+
+#endif // TSTAMP_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: tstamp.h
+// ---------------------------------------------------------------------
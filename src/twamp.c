@@ -0,0 +1,524 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// twamp.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: Like sendmmsg() (see packet.c), recvmmsg() is only declared
+// under _GNU_SOURCE; so are IP_RECVTTL and IPV6_RECVHOPLIMIT.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "twamp.h"
+
+
+// Error Estimate of our timestamps: not known to be synchronized,
+// and good to about a microsecond (1 * 2^(12 - 32) seconds).
+#define ERROR_ESTIMATE ((12 << TWAMP_ERROR_SCALE_SHIFT) | 1)
+
+// (For the SO_TIMESTAMPNS and the TTL of a packet; aligned like a
+// cmsghdr.)
+typedef union control_buffer {
+    size_t align;
+    uint8_t data[CMSG_SPACE(sizeof (struct timespec))
+        + CMSG_SPACE(sizeof (int))];
+} control_buffer_t;
+
+typedef struct twamp_sender {
+    const struct ProgramArgs *program_args;
+    int socket;
+    int done;               // Set once no more packets are awaited
+    struct twamp_stats stats;
+} twamp_sender_t;
+
+// The timestamps are of the wall clock, as those of the other end
+// would be; SO_TIMESTAMPNS is, too.
+static uint64_t realtime_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+static void write_u32(uint8_t *const at, const uint32_t value) {
+    const uint32_t word = htonl(value);
+    memcpy(at, &word, sizeof (word));
+}
+
+static uint32_t read_u32(const uint8_t *const at) {
+    uint32_t word;
+    memcpy(&word, at, sizeof (word));
+    return ntohl(word);
+}
+
+static void write_u16(uint8_t *const at, const uint16_t value) {
+    const uint16_t word = htons(value);
+    memcpy(at, &word, sizeof (word));
+}
+
+// Unix time (in nanoseconds) to an NTP timestamp, and back
+static void write_timestamp(uint8_t *const at, const uint64_t time_ns) {
+    const uint64_t fraction_ns = time_ns % NSEC_PER_SEC;
+    write_u32(at, (uint32_t)(time_ns / NSEC_PER_SEC + TWAMP_NTP_OFFSET));
+    write_u32(at + 4, (uint32_t)((fraction_ns << 32) / NSEC_PER_SEC));
+}
+
+static uint64_t read_timestamp(const uint8_t *const at) {
+    const uint64_t seconds = read_u32(at);
+    const uint64_t fraction = read_u32(at + 4);
+    if (seconds < TWAMP_NTP_OFFSET) {
+        return 0;
+    }
+    return (seconds - TWAMP_NTP_OFFSET) * NSEC_PER_SEC
+        + ((fraction * NSEC_PER_SEC) >> 32);
+}
+
+// When the kernel received a packet (or, without SO_TIMESTAMPNS, when
+// we got to it), and the TTL (or hop limit) that it arrived with.
+static uint64_t receive_info(
+    struct msghdr *const msg, uint8_t *const ttl
+) {
+    uint64_t time_ns = 0;
+
+    for (struct cmsghdr *control = CMSG_FIRSTHDR(msg); control != NULL;
+        control = CMSG_NXTHDR(msg, control)
+    ) {
+        int value;
+        if (control->cmsg_level == SOL_SOCKET
+            && control->cmsg_type == SCM_TIMESTAMPNS
+        ) {
+            struct timespec time;
+            memcpy(&time, CMSG_DATA(control), sizeof (time));
+            time_ns = (uint64_t)time.tv_sec * NSEC_PER_SEC
+                + (uint64_t)time.tv_nsec;
+        }
+        else if ((control->cmsg_level == IPPROTO_IP
+                && control->cmsg_type == IP_TTL)
+            || (control->cmsg_level == IPPROTO_IPV6
+                && control->cmsg_type == IPV6_HOPLIMIT)
+        ) {
+            memcpy(&value, CMSG_DATA(control), sizeof (value));
+            *ttl = (uint8_t)value;
+        }
+    }
+
+    return (time_ns != 0) ? time_ns : realtime_ns();
+}
+
+// A UDP socket, bound to the source address (if any was given) and
+// `port`, that gets receive timestamps (and TTLs) from the kernel.
+static int open_socket(
+    const struct ProgramArgs *const program_args, const uint16_t port
+) {
+    const bool ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6;
+    const int socket_descriptor =
+        socket(ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+    if (socket_descriptor == -1) {
+        logger(LOG_ERROR,
+            "Failed to create a UDP socket: %s", strerror(errno));
+        return -1;
+    }
+
+    const int enable = 1;
+    if (setsockopt(socket_descriptor, SOL_SOCKET, SO_TIMESTAMPNS,
+            &enable, sizeof (enable)) != 0
+    ) {
+        logger(LOG_WARN,
+            "Failed to enable receive timestamps (%s); falling back "
+            "to the userspace clock.", strerror(errno));
+    }
+    (void)setsockopt(socket_descriptor,
+        ipv6 ? IPPROTO_IPV6 : IPPROTO_IP,
+        ipv6 ? IPV6_RECVHOPLIMIT : IP_RECVTTL, &enable, sizeof (enable));
+
+    int status;
+    if (ipv6) {
+        struct sockaddr_in6 source = {
+            .sin6_family = AF_INET6, .sin6_port = htons(port)
+        };
+        if (program_args->ipv6_misc.override_source) {
+            memcpy(&source.sin6_addr, program_args->ipv6.saddr.octets,
+                sizeof (source.sin6_addr));
+        }
+        status = bind(socket_descriptor,
+            (const struct sockaddr *)&source, sizeof (source));
+    }
+    else {
+        struct sockaddr_in source = {
+            .sin_family = AF_INET, .sin_port = htons(port)
+        };
+        if (program_args->ipv4_misc.override_source) {
+            source.sin_addr.s_addr =
+                htonl(program_args->ipv4->saddr.address);
+        }
+        status = bind(socket_descriptor,
+            (const struct sockaddr *)&source, sizeof (source));
+    }
+    if (status != 0) {
+        logger(LOG_ERROR,
+            "Failed to bind the UDP socket: %s", strerror(errno));
+        close(socket_descriptor);
+        return -1;
+    }
+
+    return socket_descriptor;
+}
+
+// Accounts for one reflected test packet that arrived at `t4_ns`.
+static void account_reflected(
+    struct twamp_stats *const stats,
+    const uint8_t *const packet,
+    const uint64_t t4_ns
+) {
+    const uint64_t t1_ns = read_timestamp(packet + TWAMP_SENDER_TIMESTAMP);
+    const uint64_t t2_ns = read_timestamp(packet + TWAMP_RECEIVE_TIMESTAMP);
+    const uint64_t t3_ns = read_timestamp(packet + TWAMP_TIMESTAMP);
+    const uint64_t reflected = (uint64_t)read_u32(packet + TWAMP_SEQ) + 1;
+
+    stats->received++;
+    if (reflected > stats->reflected) {
+        stats->reflected = reflected;
+        stats->sent_before =
+            (uint64_t)read_u32(packet + TWAMP_SENDER_SEQ) + 1;
+    }
+
+    // The turnaround (T3 - T2) is on the reflector's clock alone, and
+    // the round trip (T4 - T1) on ours; so neither needs them in sync.
+    const int64_t round_trip = (int64_t)(t4_ns - t1_ns);
+    const int64_t turnaround = (int64_t)(t3_ns - t2_ns);
+    if (round_trip >= turnaround && turnaround >= 0) {
+        histogram_record(&stats->rtts,
+            (uint64_t)(round_trip - turnaround));
+    }
+
+    const int64_t there = (int64_t)(t2_ns - t1_ns);
+    const int64_t back = (int64_t)(t4_ns - t3_ns);
+    if (there < 0 || back < 0) {
+        stats->unsynced++;
+        return;
+    }
+    histogram_record(&stats->forward, (uint64_t)there);
+    histogram_record(&stats->backward, (uint64_t)back);
+}
+
+// Thread callback
+static int sender_receive_loop(void *arg) {
+    struct twamp_sender *const sender = (struct twamp_sender *)arg;
+    struct pollfd poll_info = {.fd = sender->socket, .events = POLLIN};
+    uint8_t buffer[IP_PKT_MTU];
+    control_buffer_t control;
+    struct iovec iov = {.iov_base = buffer, .iov_len = sizeof (buffer)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+
+    while (!LOAD_ACQUIRE(&sender->done)) {
+        if (poll(&poll_info, 1, TWAMP_POLL_TIMEOUT) <= 0) {
+            continue;
+        }
+
+        for (;;) {
+            msg.msg_control = control.data;
+            msg.msg_controllen = sizeof (control.data);
+            const ssize_t length =
+                recvmsg(sender->socket, &msg, MSG_DONTWAIT);
+            if (length < 0) {
+                break;
+            }
+            if ((size_t)length < TWAMP_REFLECTED_SIZE) {
+                continue;
+            }
+
+            uint8_t ttl;
+            const uint64_t t4_ns = receive_info(&msg, &ttl);
+            account_reflected(&sender->stats, buffer, t4_ns);
+        }
+    }
+
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    return thrd_success;
+#else
+    return 0;
+#endif
+}
+
+// Sends the test packets, paced, until the duration elapses (or until
+// interrupted).
+static void sender_send_loop(
+    struct twamp_sender *const sender,
+    uint8_t *const packet,
+    const size_t length
+) {
+    const struct ProgramArgs *const program_args = sender->program_args;
+    struct twamp_stats *const stats = &sender->stats;
+    const bool paced = program_args->traffic.rate > 0;
+
+    struct pacer pacer;
+    pacer_start(&pacer,
+        paced ? program_args->traffic.shape : SHAPE_CONSTANT,
+        paced ? program_args->traffic.rate : TWAMP_DEFAULT_RATE,
+        paced ? program_args->traffic.interval_ns : NSEC_PER_SEC);
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? pacer.start_ns + program_args->traffic.duration * NSEC_PER_SEC
+        : 0;
+
+    for (uint32_t seq = 0; !sending_stopped(); seq++) {
+        (void)pacer_acquire(&pacer, 1);
+        if (sending_stopped()
+            || (deadline_ns != 0 && clock_now_ns() >= deadline_ns)
+        ) {
+            break;
+        }
+        pacer_consume(&pacer, 1);
+
+        write_u32(packet + TWAMP_SEQ, seq);
+        write_timestamp(packet + TWAMP_TIMESTAMP, realtime_ns());
+        if (send(sender->socket, packet, length, 0) < 0) {
+            stats->errors++;
+            continue;
+        }
+        stats->sent++;
+    }
+}
+
+int run_twamp_sender(const struct ProgramArgs *const program_args) {
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+    const bool ipv6 = program_args->protocols.l3 == PROTO_L3_IPV6;
+    const size_t length = TWAMP_TEST_SIZE + program_args->twamp.padding;
+    struct twamp_sender sender = {.program_args = program_args};
+    uint8_t packet[IP_PKT_MTU] = {0};
+
+    sender.socket = open_socket(program_args,
+        program_args->udp_misc.override_sport
+            ? program_args->udp.sport : 0);
+    if (sender.socket == -1) {
+        return 1;
+    }
+
+    // (So that only the reflector's packets come in.)
+    struct sockaddr_storage reflector = {0};
+    socklen_t reflector_length;
+    if (ipv6) {
+        struct sockaddr_in6 *const address =
+            (struct sockaddr_in6 *)&reflector;
+        address->sin6_family = AF_INET6;
+        address->sin6_port = htons(program_args->twamp.port);
+        memcpy(&address->sin6_addr, program_args->ipv6.daddr.octets,
+            sizeof (address->sin6_addr));
+        reflector_length = sizeof (*address);
+    }
+    else {
+        struct sockaddr_in *const address =
+            (struct sockaddr_in *)&reflector;
+        address->sin_family = AF_INET;
+        address->sin_port = htons(program_args->twamp.port);
+        address->sin_addr.s_addr =
+            htonl(program_args->ipv4->daddr.address);
+        reflector_length = sizeof (*address);
+    }
+    if (connect(sender.socket,
+            (const struct sockaddr *)&reflector, reflector_length) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to connect to the reflector: %s", strerror(errno));
+        close(sender.socket);
+        return 1;
+    }
+
+    write_u16(packet + TWAMP_ERROR_ESTIMATE, ERROR_ESTIMATE);
+
+    thrd_t receiver;
+    if (thrd_create(&receiver, sender_receive_loop, &sender)
+        != thrd_success
+    ) {
+        logger(LOG_ERROR, "Failed to spawn the receiving thread.");
+        close(sender.socket);
+        return 1;
+    }
+
+    logger(LOG_INFO,
+        "Sending TWAMP-light test packets (%zu bytes) to port %u...",
+        length, (unsigned int)program_args->twamp.port);
+    sender_send_loop(&sender, packet, length);
+
+    // Give the last test packets their chance to come back.
+    sleep_until_ns(clock_now_ns() + TWAMP_DRAIN_NS);
+    STORE_RELEASE(&sender.done, 1);
+    thrd_join(receiver, NULL);
+
+    twamp_stats_report("TWAMP", &sender.stats);
+
+    close(sender.socket);
+    return 0;
+#else
+    (void)program_args;
+    logger(LOG_ERROR,
+        "\"--twamp\" needs a thread of its own for the reflected "
+        "packets.");
+    return 1;
+#endif
+}
+
+#if defined(__linux__)
+// The next sequence number of each sender that a reflector knows of
+typedef struct session {
+    struct sockaddr_storage peer;
+    socklen_t peer_length;
+    uint32_t next_seq;
+    uint64_t last_seen;   // (In test packets reflected overall)
+} session_t;
+
+static uint32_t next_session_seq(
+    struct session *const sessions,
+    unsigned int *const num_sessions,
+    const struct sockaddr_storage *const peer,
+    const socklen_t peer_length,
+    const uint64_t now
+) {
+    struct session *oldest = &sessions[0];
+
+    for (unsigned int i = 0; i < *num_sessions; i++) {
+        if (sessions[i].peer_length == peer_length
+            && memcmp(&sessions[i].peer, peer, peer_length) == 0
+        ) {
+            sessions[i].last_seen = now;
+            return sessions[i].next_seq++;
+        }
+        if (sessions[i].last_seen < oldest->last_seen) {
+            oldest = &sessions[i];
+        }
+    }
+
+    struct session *const session = (*num_sessions < TWAMP_MAX_SESSIONS)
+        ? &sessions[(*num_sessions)++] : oldest;
+    memset(session, 0, sizeof (*session));
+    memcpy(&session->peer, peer, peer_length);
+    session->peer_length = peer_length;
+    session->next_seq = 1;
+    session->last_seen = now;
+    return 0;
+}
+#endif
+
+int run_twamp_reflector(const struct ProgramArgs *const program_args) {
+#if defined(__linux__)
+    const int socket_descriptor =
+        open_socket(program_args, program_args->twamp.port);
+    if (socket_descriptor == -1) {
+        return 1;
+    }
+
+    static uint8_t buffers[TWAMP_BATCH_SIZE][IP_PKT_MTU];
+    static struct session sessions[TWAMP_MAX_SESSIONS];
+    unsigned int num_sessions = 0;
+    struct mmsghdr msgs[TWAMP_BATCH_SIZE];
+    struct iovec iov[TWAMP_BATCH_SIZE];
+    struct sockaddr_storage peers[TWAMP_BATCH_SIZE];
+    control_buffer_t controls[TWAMP_BATCH_SIZE];
+    uint64_t reflected = 0;
+    uint64_t errors = 0;
+
+    const uint64_t deadline_ns = (program_args->traffic.duration > 0)
+        ? clock_now_ns() + program_args->traffic.duration * NSEC_PER_SEC
+        : 0;
+    struct pollfd poll_info = {.fd = socket_descriptor, .events = POLLIN};
+
+    logger(LOG_INFO, "Reflecting TWAMP-light test packets on port %u...",
+        (unsigned int)program_args->twamp.port);
+
+    while (!sending_stopped()
+        && (deadline_ns == 0 || clock_now_ns() < deadline_ns)
+    ) {
+        if (poll(&poll_info, 1, TWAMP_POLL_TIMEOUT) <= 0) {
+            continue;
+        }
+
+        for (unsigned int i = 0; i < TWAMP_BATCH_SIZE; i++) {
+            iov[i] = (struct iovec){
+                .iov_base = buffers[i], .iov_len = sizeof (buffers[i])
+            };
+            msgs[i].msg_hdr = (struct msghdr){
+                .msg_name = &peers[i],
+                .msg_namelen = sizeof (peers[i]),
+                .msg_iov = &iov[i],
+                .msg_iovlen = 1,
+                .msg_control = controls[i].data,
+                .msg_controllen = sizeof (controls[i].data)
+            };
+        }
+        const int received = recvmmsg(socket_descriptor, msgs,
+            TWAMP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        if (received <= 0) {
+            continue;
+        }
+
+        // Reflected in place: the sender's fields move behind ours (the
+        // padding, if any, stays where it was).
+        unsigned int num_replies = 0;
+        for (int i = 0; i < received; i++) {
+            uint8_t *const packet = buffers[i];
+            const size_t length = msgs[i].msg_len;
+            if (length < TWAMP_TEST_SIZE) {
+                continue;
+            }
+
+            uint8_t ttl = 255;
+            const uint64_t t2_ns = receive_info(&msgs[i].msg_hdr, &ttl);
+            uint8_t sender[TWAMP_TEST_SIZE];
+            memcpy(sender, packet, sizeof (sender));
+
+            memset(packet, 0, TWAMP_REFLECTED_SIZE);
+            write_u32(packet + TWAMP_SEQ, next_session_seq(sessions,
+                &num_sessions, &peers[i], msgs[i].msg_hdr.msg_namelen,
+                reflected));
+            write_u16(packet + TWAMP_ERROR_ESTIMATE, ERROR_ESTIMATE);
+            write_timestamp(packet + TWAMP_RECEIVE_TIMESTAMP, t2_ns);
+            memcpy(packet + TWAMP_SENDER_SEQ, sender + TWAMP_SEQ, 4);
+            memcpy(packet + TWAMP_SENDER_TIMESTAMP,
+                sender + TWAMP_TIMESTAMP, 8);
+            memcpy(packet + TWAMP_SENDER_ERROR_ESTIMATE,
+                sender + TWAMP_ERROR_ESTIMATE, 2);
+            packet[TWAMP_SENDER_TTL] = ttl;
+
+            iov[i].iov_len = (length > TWAMP_REFLECTED_SIZE)
+                ? length : TWAMP_REFLECTED_SIZE;
+            msgs[i].msg_hdr.msg_control = NULL;
+            msgs[i].msg_hdr.msg_controllen = 0;
+            msgs[num_replies++] = msgs[i];
+            reflected++;
+        }
+
+        // (One timestamp for the whole batch, as late as it gets.)
+        const uint64_t t3_ns = realtime_ns();
+        for (unsigned int i = 0; i < num_replies; i++) {
+            write_timestamp((uint8_t *)msgs[i].msg_hdr.msg_iov->iov_base
+                + TWAMP_TIMESTAMP, t3_ns);
+        }
+        unsigned int sent = 0;
+        while (sent < num_replies) {
+            const int result = sendmmsg(socket_descriptor,
+                msgs + sent, num_replies - sent, 0);
+            if (result <= 0) {
+                errors += num_replies - sent;
+                break;
+            }
+            sent += (unsigned int)result;
+        }
+    }
+
+    logger(LOG_INFO,
+        "Reflected %llu test packets for %u senders (%llu errors).",
+        (unsigned long long)reflected, num_sessions,
+        (unsigned long long)errors);
+
+    close(socket_descriptor);
+    return 0;
+#else
+    (void)program_args;
+    logger(LOG_ERROR, "\"--reflect\" is only supported on Linux.");
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: twamp.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,71 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// twamp.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef TWAMP_RUN_H
+#define TWAMP_RUN_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "./utils/clock.h"
+#include "./utils/intrins.h"
+#include "packet.h"
+#include "pacing.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#endif
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <poll.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#endif
+
+// Padding after each test packet: by default, just enough for the
+// reflected ones to be no longer (RFC 5357, section 4.1.2), and at
+// most what still lets those fit an IPv6 packet of IP_PKT_MTU bytes.
+#define TWAMP_DEFAULT_PADDING (TWAMP_REFLECTED_SIZE - TWAMP_TEST_SIZE)
+#define TWAMP_MAX_PADDING \
+    (IP_PKT_MTU - sizeof (struct ip6_hdr) - sizeof (struct udp_hdr) \
+        - TWAMP_REFLECTED_SIZE)
+// Test packets per second, unless "--rate" says otherwise.
+#define TWAMP_DEFAULT_RATE 1000
+// How long the sender waits for the last test packets to come back.
+#define TWAMP_DRAIN_NS NSEC_PER_SEC
+// Test packets received (and reflected) per syscall
+#define TWAMP_BATCH_SIZE 64
+// Senders a reflector keeps the sequence numbers of; the least
+// recently seen one makes way for a new one.
+#define TWAMP_MAX_SESSIONS 64
+// Milliseconds to wait for packets before checking for the end.
+#define TWAMP_POLL_TIMEOUT 100
+
+
+// Sends test packets to the reflector at "--rate" until the duration
+// elapses or stop_sending() gets called, while another thread takes
+// the reflected ones in; then reports the losses and delays each way.
+int run_twamp_sender(const struct ProgramArgs *const program_args);
+
+// Reflects the test packets of any sender until the duration elapses
+// or stop_sending() gets called.
+int run_twamp_reflector(const struct ProgramArgs *const program_args);
+
+
+#endif // TWAMP_RUN_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: twamp.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,323 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// txtime.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: CLOCK_TAI and SO_TXTIME are Linux extensions.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "txtime.h"
+
+
+#if defined(__linux__)
+#define NETLINK_BUFFER_SIZE 16384
+
+// Qdiscs that honor the launch times of SO_TXTIME against CLOCK_TAI.
+static const char *const TXTIME_QDISCS[] = {"etf", "taprio"};
+#define NUM_TXTIME_QDISCS \
+    (sizeof (TXTIME_QDISCS) / sizeof (TXTIME_QDISCS[0]))
+
+typedef union netlink_buffer {
+    struct nlmsghdr header;
+    uint8_t bytes[NETLINK_BUFFER_SIZE];
+} netlink_buffer_t;
+
+static void add_attribute(
+    struct nlmsghdr *const header,
+    const unsigned short type,
+    const void *const data, const size_t length
+) {
+    struct rtattr *const attribute = (struct rtattr *)(
+        (uint8_t *)header + NLMSG_ALIGN(header->nlmsg_len));
+
+    attribute->rta_type = type;
+    attribute->rta_len = (unsigned short)RTA_LENGTH(length);
+    memcpy(RTA_DATA(attribute), data, length);
+    header->nlmsg_len =
+        NLMSG_ALIGN(header->nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+}
+
+// Asks the routing table (over rtnetlink) for the outgoing interface
+// towards the (network-order) `daddr` of `family`; returns 0 if there
+// is none.
+static unsigned int egress_interface(
+    const int netlink, const int family,
+    const void *const daddr, const size_t daddr_length
+) {
+    static netlink_buffer_t buffer;
+    memset(&buffer, 0, sizeof (struct nlmsghdr) + 64);
+
+    buffer.header.nlmsg_len = NLMSG_LENGTH(sizeof (struct rtmsg));
+    buffer.header.nlmsg_type = RTM_GETROUTE;
+    buffer.header.nlmsg_flags = NLM_F_REQUEST;
+
+    struct rtmsg *const route =
+        (struct rtmsg *)NLMSG_DATA(&buffer.header);
+    route->rtm_family = (unsigned char)family;
+    route->rtm_dst_len = (unsigned char)(8 * daddr_length);
+
+    add_attribute(&buffer.header, RTA_DST, daddr, daddr_length);
+
+    if (send(netlink, &buffer, buffer.header.nlmsg_len, 0) < 0) {
+        return 0;
+    }
+    const ssize_t length = recv(netlink, &buffer, sizeof (buffer), 0);
+    if (length < 0) {
+        return 0;
+    }
+
+    size_t remaining = (size_t)length;
+    for (const struct nlmsghdr *message = &buffer.header;
+        NLMSG_OK(message, remaining);
+        message = NLMSG_NEXT(message, remaining)
+    ) {
+        if (message->nlmsg_type != RTM_NEWROUTE) {
+            continue;
+        }
+
+        const struct rtmsg *const reply = NLMSG_DATA(message);
+        size_t attributes_length = RTM_PAYLOAD(message);
+        for (const struct rtattr *attribute = RTM_RTA(reply);
+            RTA_OK(attribute, attributes_length);
+            attribute = RTA_NEXT(attribute, attributes_length)
+        ) {
+            if (attribute->rta_type == RTA_OIF) {
+                int interface;
+                memcpy(&interface, RTA_DATA(attribute),
+                    sizeof (interface));
+                return (unsigned int)interface;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Looks through every qdisc (including the children of, e.g., mqprio)
+// of `interface` for one that enforces launch times; returns its kind
+// or NULL.
+static const char *find_txtime_qdisc(
+    const int netlink, const unsigned int interface
+) {
+    static netlink_buffer_t buffer;
+    memset(&buffer, 0, sizeof (struct nlmsghdr) + 64);
+
+    buffer.header.nlmsg_len = NLMSG_LENGTH(sizeof (struct tcmsg));
+    buffer.header.nlmsg_type = RTM_GETQDISC;
+    buffer.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+
+    struct tcmsg *const qdisc =
+        (struct tcmsg *)NLMSG_DATA(&buffer.header);
+    qdisc->tcm_family = AF_UNSPEC;
+
+    if (send(netlink, &buffer, buffer.header.nlmsg_len, 0) < 0) {
+        return NULL;
+    }
+
+    const char *found = NULL;
+    for (;;) {
+        const ssize_t length = recv(netlink, &buffer, sizeof (buffer), 0);
+        if (length <= 0) {
+            return found;
+        }
+
+        size_t remaining = (size_t)length;
+        for (const struct nlmsghdr *message = &buffer.header;
+            NLMSG_OK(message, remaining);
+            message = NLMSG_NEXT(message, remaining)
+        ) {
+            if (message->nlmsg_type == NLMSG_DONE
+                || message->nlmsg_type == NLMSG_ERROR
+            ) {
+                return found;
+            }
+
+            const struct tcmsg *const reply = NLMSG_DATA(message);
+            if (message->nlmsg_type != RTM_NEWQDISC
+                || (unsigned int)reply->tcm_ifindex != interface
+            ) {
+                continue;
+            }
+
+            size_t attributes_length = TCA_PAYLOAD(message);
+            for (const struct rtattr *attribute = TCA_RTA(reply);
+                RTA_OK(attribute, attributes_length);
+                attribute = RTA_NEXT(attribute, attributes_length)
+            ) {
+                if (attribute->rta_type != TCA_KIND) {
+                    continue;
+                }
+                for (size_t i = 0; i < NUM_TXTIME_QDISCS; i++) {
+                    if (strcmp(RTA_DATA(attribute),
+                        TXTIME_QDISCS[i]) == 0
+                    ) {
+                        found = TXTIME_QDISCS[i];
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
+
+int txtime_setup(const struct ProgramArgs *const program_args) {
+#if defined(__linux__)
+    const int netlink = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (netlink == -1) {
+        logger(LOG_ERROR,
+            "Failed to open a netlink socket: %s", strerror(errno));
+        return 1;
+    }
+
+    // Frames (with "--eth") leave through the given interface instead,
+    // and a tunnel's packets head for its endpoint.
+    const bool tunnel = program_args->tunnel.kind != TUNNEL_NONE;
+    const uint32_t daddr = htonl(tunnel
+        ? program_args->tunnel.daddr.address
+        : program_args->ipv4->daddr.address);
+    const unsigned int interface =
+        (program_args->protocols.l2 == PROTO_L2_ETH)
+        ? if_nametoindex(program_args->eth_misc.interface)
+        : (program_args->protocols.l3 == PROTO_L3_IPV6 && !tunnel)
+        ? egress_interface(netlink, AF_INET6,
+            program_args->ipv6.daddr.octets, sizeof (ip6_addr_t))
+        : egress_interface(netlink, AF_INET, &daddr, sizeof (daddr));
+    const char *const qdisc =
+        (interface != 0) ? find_txtime_qdisc(netlink, interface) : NULL;
+    close(netlink);
+
+    char interface_name[IF_NAMESIZE] = "?";
+    if (interface != 0) {
+        (void)if_indextoname(interface, interface_name);
+    }
+
+    if (qdisc == NULL) {
+        const bool bypass = program_args->advanced.bypass_checks;
+        logger(bypass ? LOG_WARN : LOG_ERROR,
+            "There is no ETF (or taprio) qdisc on \"%s\", the way to the "
+            "destination;\n  launch times would silently be ignored.  "
+            "Set one up (e.g., \"tc qdisc\n  replace dev %s root etf "
+            "clockid CLOCK_TAI delta 200000\"), or\n  use "
+            "\"--bypass-checks\" to send anyway.",
+            interface_name, interface_name
+        );
+        if (!bypass) {
+            return 1;
+        }
+    }
+    else {
+        logger(LOG_INFO,
+            "Launch times will be enforced by the \"%s\" qdisc of "
+            "\"%s\".", qdisc, interface_name
+        );
+    }
+
+    const struct sock_txtime config = {
+        .clockid = CLOCK_TAI,
+        .flags = SOF_TXTIME_REPORT_ERRORS
+    };
+    if (setsockopt(program_args->socket, SOL_SOCKET, SO_TXTIME,
+        &config, sizeof (config)) != 0
+    ) {
+        logger(LOG_ERROR,
+            "Failed to enable SO_TXTIME: %s", strerror(errno));
+        return 1;
+    }
+
+    return 0;
+#else
+    (void)program_args;
+    logger(LOG_ERROR, "Launch times (SO_TXTIME) require Linux.");
+    return 1;
+#endif
+}
+
+int64_t txtime_clock_offset(void) {
+#if defined(__linux__)
+    // Bracketing the TAI reading between two of ours halves the
+    // error that the (non-atomic) pair of readings would have.
+    struct timespec tai;
+    const uint64_t before_ns = clock_now_ns();
+    (void)clock_gettime(CLOCK_TAI, &tai);
+    const uint64_t after_ns = clock_now_ns();
+
+    const uint64_t tai_ns =
+        (uint64_t)tai.tv_sec * NSEC_PER_SEC + (uint64_t)tai.tv_nsec;
+    return (int64_t)(tai_ns - (before_ns + (after_ns - before_ns) / 2));
+#else
+    return 0;
+#endif
+}
+
+size_t txtime_prepare(uint8_t *const control) {
+#if defined(__linux__)
+    struct cmsghdr *const message = (struct cmsghdr *)control;
+    message->cmsg_level = SOL_SOCKET;
+    message->cmsg_type = SCM_TXTIME;
+    message->cmsg_len = CMSG_LEN(sizeof (uint64_t));
+    txtime_set(control, 0);
+
+    return CMSG_SPACE(sizeof (uint64_t));
+#else
+    (void)control;
+    return 0;
+#endif
+}
+
+uint64_t txtime_drain_errors(const int socket_descriptor) {
+    uint64_t dropped = 0;
+#if defined(__linux__)
+    uint8_t data[64];
+    union {
+        struct cmsghdr align;
+        uint8_t bytes[CMSG_SPACE(sizeof (struct sock_extended_err) + 64)];
+    } control;
+
+    for (;;) {
+        struct iovec iov = {.iov_base = data, .iov_len = sizeof (data)};
+        struct msghdr message = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.bytes,
+            .msg_controllen = sizeof (control.bytes)
+        };
+
+        if (recvmsg(socket_descriptor, &message,
+            MSG_ERRQUEUE | MSG_DONTWAIT) < 0
+        ) {
+            break;
+        }
+
+        for (struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header != NULL;
+            header = CMSG_NXTHDR(&message, header)
+        ) {
+            struct sock_extended_err error;
+            if ((header->cmsg_level != SOL_IP
+                    || header->cmsg_type != IP_RECVERR)
+                && (header->cmsg_level != SOL_IPV6
+                    || header->cmsg_type != IPV6_RECVERR)
+                && (header->cmsg_level != SOL_PACKET
+                    || header->cmsg_type != PACKET_TX_TIMESTAMP)
+            ) {
+                continue;
+            }
+            memcpy(&error, CMSG_DATA(header), sizeof (error));
+            if (error.ee_origin == SO_EE_ORIGIN_TXTIME) {
+                dropped++;
+            }
+        }
+    }
+#else
+    (void)socket_descriptor;
+#endif
+    return dropped;
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: txtime.c
+// ---------------------------------------------------------------------
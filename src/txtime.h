@@ -0,0 +1,80 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// txtime.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+#pragma once
+#ifndef TXTIME_H
+#define TXTIME_H
+
+
+#include "./program.h"
+#include "./cmdline/logger.h"
+#include "pacing.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(_POSIX_C_SOURCE)
+#   include <unistd.h>
+#   include <sys/socket.h>
+#   include <sys/uio.h>
+#   include <arpa/inet.h>
+#   include <net/if.h>
+#   include <netinet/in.h>
+#   if defined(__linux__)
+#       include <linux/errqueue.h>
+#       include <linux/if_packet.h>
+#       include <linux/net_tstamp.h>
+#       include <linux/netlink.h>
+#       include <linux/rtnetlink.h>
+#   endif
+#endif
+
+// Room for the one control message (SCM_TXTIME) of every packet.
+#define TXTIME_CONTROL_SIZE 32
+#define TXTIME_DEFAULT_LEAD_US 500
+
+
+// NOTE: With SO_TXTIME, every packet carries its own launch time (as a
+// control message) and an ETF qdisc holds it back until then; this is
+// far more precise than waking up at the right time in userspace, as
+// the packets only need to be handed over somewhat ("lead") earlier.
+// The kernel ignores launch times on any other qdisc, so the qdisc of
+// the outgoing interface gets checked up front.
+//
+// Enables SO_TXTIME (against CLOCK_TAI) on the socket of `program_args`
+// after checking the qdisc; only warns on a missing qdisc if the user
+// bypassed checks.
+int txtime_setup(const struct ProgramArgs *const program_args);
+
+// Nanoseconds to add to a clock_now_ns() time to get CLOCK_TAI.
+int64_t txtime_clock_offset(void);
+
+// Writes the (constant) header of an SCM_TXTIME control message into
+// `control` (of TXTIME_CONTROL_SIZE bytes); returns its length.
+size_t txtime_prepare(uint8_t *const control);
+
+// Only patches the launch time (CLOCK_TAI) into a prepared message.
+static inline void txtime_set(
+    uint8_t *const control, const uint64_t launch_ns
+) {
+    memcpy(CMSG_DATA((struct cmsghdr *)control),
+        &launch_ns, sizeof (launch_ns));
+}
+
+// Counts (and discards) the packets that the qdisc dropped for having
+// missed, or having had an invalid, launch time.
+uint64_t txtime_drain_errors(const int socket_descriptor);
+
+
+#endif // TXTIME_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: txtime.h
+// ---------------------------------------------------------------------
@@ -0,0 +1,327 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// clock.c is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+
+// NOTE: CLOCK_MONOTONIC_COARSE is a Linux extension.
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "clock.h"
+#include "intrins.h"
+
+#include <errno.h>
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#   include <threads.h>
+#   define HAVE_TICKER 1
+#endif
+
+#if (defined (__GNUC__) || defined (__llvm__)) \
+    && (defined (__x86_64__) || defined (__i386__))
+#   include <cpuid.h>
+#   define HAVE_TSC 1
+#elif (defined (__GNUC__) || defined (__llvm__)) && defined (__aarch64__)
+#   define HAVE_CNTVCT 1
+#endif
+
+#define CLOCK_PAIR_TRIES 8
+#define CLOCK_OVERHEAD_ROUNDS 100000
+#define CLOCK_DRIFT_WINDOW_NS (100 * NSEC_PER_MSEC)
+
+
+// NOTE: Only clock_init() writes these, before any threads exist.
+static clock_source_t SOURCE = CLOCK_SOURCE_MONOTONIC;
+static uint64_t BASE_TICKS = 0;
+static uint64_t BASE_NS = 0;
+static double NS_PER_TICK = 0.0;
+static double COUNTER_HZ = 0.0;
+static bool TICKING = false;
+
+// NOTE: The ticker thread publishes the time as two halves (as 32-bit
+// targets, such as MIPS, may lack 64-bit atomics), under a sequence
+// number that is odd while they change; readers retry until they get
+// both halves of the same tick.
+static uint32_t TICK_SEQUENCE = 0;
+static uint32_t TICK_HIGH = 0;
+static uint32_t TICK_LOW = 0;
+
+static uint64_t read_monotonic_ns(void) {
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t read_coarse_ns(void) {
+#if defined(CLOCK_MONOTONIC_COARSE)
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+#else
+    return read_monotonic_ns();
+#endif
+}
+
+static inline uint64_t read_counter(void) {
+#if defined(HAVE_TSC)
+    return __builtin_ia32_rdtsc();
+#elif defined(HAVE_CNTVCT)
+    uint64_t ticks;
+    // Without the barrier, the read could be speculated ahead of the
+    // code that it is supposed to time.
+    __asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (ticks)
+        :: "memory");
+    return ticks;
+#else
+    return 0;
+#endif
+}
+
+static bool counter_usable(void) {
+#if defined(HAVE_TSC)
+    // CPUID.80000007H:EDX[8], "invariant TSC," guarantees a constant
+    // rate across frequency and sleep states (and, in practice, that
+    // the counters of all cores are in sync).
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (edx & (1U << 8)) != 0;
+#elif defined(HAVE_CNTVCT)
+    // Constant-rate by definition, and Linux lets userspace read it.
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Reads the counter and the system clock as closely together as we
+// can, attributing the clock reading to the middle of two counter
+// readings; of a few tries, the tightest pair (i.e., the one least
+// likely to have been interrupted) wins.
+static void read_pair(uint64_t *const ticks, uint64_t *const ns) {
+    uint64_t best_width = UINT64_MAX;
+
+    for (int i = 0; i < CLOCK_PAIR_TRIES; i++) {
+        const uint64_t before = read_counter();
+        const uint64_t now_ns = read_monotonic_ns();
+        const uint64_t after = read_counter();
+
+        if (after - before < best_width) {
+            best_width = after - before;
+            *ticks = before + (after - before) / 2;
+            *ns = now_ns;
+        }
+    }
+}
+
+#if defined(HAVE_TICKER)
+static void publish_tick(const uint64_t now_ns) {
+    const uint32_t sequence = TICK_SEQUENCE;
+    STORE_RELEASE(&TICK_SEQUENCE, sequence + 1);
+    STORE_RELEASE(&TICK_HIGH, (uint32_t)(now_ns >> 32));
+    STORE_RELEASE(&TICK_LOW, (uint32_t)now_ns);
+    STORE_RELEASE(&TICK_SEQUENCE, sequence + 2);
+}
+
+static uint64_t read_tick_ns(void) {
+    for (;;) {
+        const uint32_t sequence = LOAD_ACQUIRE(&TICK_SEQUENCE);
+        const uint32_t high = LOAD_ACQUIRE(&TICK_HIGH);
+        const uint32_t low = LOAD_ACQUIRE(&TICK_LOW);
+        if ((sequence & 1) == 0
+            && LOAD_ACQUIRE(&TICK_SEQUENCE) == sequence
+        ) {
+            return (uint64_t)high << 32 | low;
+        }
+        CPU_RELAX();
+    }
+}
+
+// Thread callback; runs until the program exits.
+static int tick_loop(void *arg) {
+    (void)arg;
+    const struct timespec period = {
+        .tv_sec = 0,
+        .tv_nsec = (long)CLOCK_TICK_NS
+    };
+
+    for (;;) {
+        (void)nanosleep(&period, NULL);
+        publish_tick(read_monotonic_ns());
+    }
+    return thrd_success;
+}
+#endif
+
+// Without a counter, every clock_gettime() may well be a syscall (see
+// clock.h); the coarse readings, at least, then come from a thread
+// that makes one every CLOCK_TICK_NS for everyone.
+static void start_ticker(void) {
+#if defined(HAVE_TICKER)
+    thrd_t ticker;
+    publish_tick(read_monotonic_ns());
+    if (thrd_create(&ticker, tick_loop, NULL) != thrd_success) {
+        return;
+    }
+    (void)thrd_detach(ticker);
+    TICKING = true;
+#endif
+}
+
+// Calibrates the counter, if there is a usable one; returns whether it
+// is now the source.
+static bool calibrate_counter(void) {
+    if (!counter_usable()) {
+        return false;
+    }
+
+    uint64_t start_ticks = 0, start_ns = 0, end_ticks = 0, end_ns = 0;
+    const struct timespec window = {
+        .tv_sec = 0,
+        .tv_nsec = (long)CLOCK_CALIBRATION_NS
+    };
+
+    read_pair(&start_ticks, &start_ns);
+    while (nanosleep(&window, NULL) != 0 && errno == EINTR) {
+        continue;
+    }
+    read_pair(&end_ticks, &end_ns);
+
+    if (end_ticks <= start_ticks || end_ns <= start_ns) {
+        return false;
+    }
+    const double hz = (double)(end_ticks - start_ticks) * 1e9
+        / (double)(end_ns - start_ns);
+    if (hz < CLOCK_MIN_COUNTER_HZ) {
+        return false;
+    }
+
+    COUNTER_HZ = hz;
+    NS_PER_TICK = 1e9 / hz;
+    BASE_TICKS = end_ticks;
+    BASE_NS = end_ns;
+#if defined(HAVE_TSC)
+    SOURCE = CLOCK_SOURCE_TSC;
+#elif defined(HAVE_CNTVCT)
+    SOURCE = CLOCK_SOURCE_CNTVCT;
+#endif
+    return true;
+}
+
+void clock_init(void) {
+    if (!calibrate_counter()) {
+        start_ticker();
+    }
+}
+
+uint64_t clock_now_ns(void) {
+    if (SOURCE == CLOCK_SOURCE_MONOTONIC) {
+        return read_monotonic_ns();
+    }
+
+    // NOTE: A double holds 53 bits of ticks exactly (i.e., years at
+    // GHz rates), which spares us a 128-bit multiplication; the delta
+    // is signed in case another core's counter lags slightly behind.
+    const int64_t delta = (int64_t)(read_counter() - BASE_TICKS);
+    return BASE_NS + (uint64_t)(int64_t)((double)delta * NS_PER_TICK);
+}
+
+uint64_t clock_coarse_ns(void) {
+    if (SOURCE != CLOCK_SOURCE_MONOTONIC) {
+        return clock_now_ns();
+    }
+#if defined(HAVE_TICKER)
+    if (TICKING) {
+        return read_tick_ns();
+    }
+#endif
+    return read_coarse_ns();
+}
+
+clock_source_t clock_source(void) {
+    return SOURCE;
+}
+
+const char *clock_source_name(void) {
+    switch (SOURCE) {
+        case CLOCK_SOURCE_TSC:
+            return "TSC";
+        case CLOCK_SOURCE_CNTVCT:
+            return "CNTVCT_EL0";
+        case CLOCK_SOURCE_MONOTONIC:
+        default:
+            return "CLOCK_MONOTONIC";
+    }
+}
+
+// Average cost of one reading, in nanoseconds.
+static double read_overhead_ns(uint64_t (*const read)(void)) {
+    volatile uint64_t sink = 0;
+
+    const uint64_t start_ns = read_monotonic_ns();
+    for (int i = 0; i < CLOCK_OVERHEAD_ROUNDS; i++) {
+        sink += read();
+    }
+    const uint64_t end_ns = read_monotonic_ns();
+
+    (void)sink;
+    return (double)(end_ns - start_ns) / CLOCK_OVERHEAD_ROUNDS;
+}
+
+void clock_print_diagnostics(FILE *const stream) {
+    fprintf(stream, "\nClock Diagnostics:\n");
+
+    if (SOURCE == CLOCK_SOURCE_MONOTONIC) {
+        fprintf(stream,
+            "  Clock Source         : %s%s\n", clock_source_name(),
+            TICKING ? " (coarse: cached by a thread)" : "");
+    }
+    else {
+        fprintf(stream,
+            "  Clock Source         : %s (%.3f MHz, calibrated)\n",
+            clock_source_name(), COUNTER_HZ / 1e6);
+    }
+    fprintf(stream,
+        "    Reading Overhead   : %.1f ns\n"
+        "    Coarse Overhead    : %.1f ns\n"
+        "    clock_gettime()    : %.1f ns\n",
+        read_overhead_ns(clock_now_ns),
+        read_overhead_ns(clock_coarse_ns),
+        read_overhead_ns(read_monotonic_ns)
+    );
+
+    if (SOURCE == CLOCK_SOURCE_MONOTONIC) {
+        return;
+    }
+
+    // How far the calibrated counter strays from the system clock
+    // (which NTP may be slewing) over a short window, and in total
+    // since the calibration.
+    const uint64_t start_ns = clock_now_ns();
+    const uint64_t start_reference_ns = read_monotonic_ns();
+    const struct timespec window = {
+        .tv_sec = 0,
+        .tv_nsec = (long)CLOCK_DRIFT_WINDOW_NS
+    };
+    while (nanosleep(&window, NULL) != 0 && errno == EINTR) {
+        continue;
+    }
+    const uint64_t end_ns = clock_now_ns();
+    const uint64_t end_reference_ns = read_monotonic_ns();
+
+    const double elapsed_ns = (double)(end_ns - start_ns);
+    const double reference_ns =
+        (double)(end_reference_ns - start_reference_ns);
+    fprintf(stream,
+        "    Drift              : %+.2f ppm (%+.1f us since startup)\n",
+        (elapsed_ns - reference_ns) / reference_ns * 1e6,
+        ((double)end_ns - (double)end_reference_ns) / 1e3
+    );
+}
+
+
+// ---------------------------------------------------------------------
+// END OF FILE: clock.c
+// ---------------------------------------------------------------------
@@ -0,0 +1,72 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// clock.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef CLOCK_H
+#define CLOCK_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+// How long clock_init() lets the CPU counter run against the system
+// clock; longer windows give a more precise frequency.
+#define CLOCK_CALIBRATION_NS (100 * NSEC_PER_MSEC)
+// Frequencies below this are implausible for a cycle counter.
+#define CLOCK_MIN_COUNTER_HZ 1000000.0
+// Without a counter, how often the ticker thread publishes the time for
+// clock_coarse_ns() to read.
+#define CLOCK_TICK_NS (4 * NSEC_PER_MSEC)
+
+
+typedef enum clock_source {
+    CLOCK_SOURCE_MONOTONIC = 0, // clock_gettime(); the default
+    CLOCK_SOURCE_TSC,           // x86 invariant time-stamp counter
+    CLOCK_SOURCE_CNTVCT         // ARMv8 virtual (generic timer) counter
+} clock_source_t;
+
+// NOTE: "now" gets read for every batch (and far more often while the
+// pacer spins), and clock_gettime() is only cheap if the kernel maps
+// it into userspace (vDSO); older (e.g., MIPS) kernels do not, which
+// turns every reading into a syscall.  Where the CPU has a constant-
+// rate counter that userspace may read, we read that instead, and
+// convert it to CLOCK_MONOTONIC nanoseconds with a factor calibrated
+// once at startup.
+//
+// Picks (and calibrates) a counter if there is a usable one; until
+// this gets called, or if there is none, CLOCK_MONOTONIC is used, and
+// a ticker thread (where there are C11 threads) caches it for the
+// coarse readings.  Must be called before any threads get spawned.
+void clock_init(void);
+
+// Nanoseconds on (or, with a counter, calibrated to) CLOCK_MONOTONIC.
+uint64_t clock_now_ns(void);
+
+// Same as clock_now_ns() with a counter; otherwise, the time that the
+// ticker thread last published (or, without one, that the kernel caches
+// at every tick: CLOCK_MONOTONIC_COARSE, where present), which is only
+// precise to a few milliseconds, but never costs a syscall.
+uint64_t clock_coarse_ns(void);
+
+clock_source_t clock_source(void);
+const char *clock_source_name(void);
+
+// Measures and prints the overhead of a reading and the drift of the
+// calibrated counter against CLOCK_MONOTONIC (for "--about").
+void clock_print_diagnostics(FILE *const stream);
+
+
+#endif // CLOCK_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: clock.h
+// ---------------------------------------------------------------------
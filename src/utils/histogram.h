@@ -0,0 +1,164 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// histogram.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Every power of two is split into this many linear sub-buckets, which
+// bounds the relative error of any recorded value to 1/16 (6.25%).
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1U << HISTOGRAM_SUB_BITS)
+// Values of 2^40 (i.e., ~18 minutes, in nanoseconds) and up all end up
+// in the last bucket; min/max/sum are still kept exact.
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS ( \
+    (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) \
+    * HISTOGRAM_SUB_BUCKETS \
+)
+
+
+// NOTE: This is a log-linear ("HDR") histogram: a fixed array of
+// counters whose width grows with the magnitude of the value.  It
+// costs one branch and a few shifts to record a value, never
+// allocates, and two of them can be merged by adding their counters,
+// which is how per-thread histograms get combined after a run.
+typedef struct histogram {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+static inline unsigned int histogram_msb(const uint64_t value) {
+#if defined (__GNUC__) || defined (__llvm__)
+    return 63U - (unsigned int)__builtin_clzll(value);
+#else
+    unsigned int msb = 0;
+    for (uint64_t v = value >> 1; v != 0; v >>= 1) {
+        msb++;
+    }
+    return msb;
+#endif
+}
+
+static inline unsigned int histogram_index(const uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (unsigned int)value;
+    }
+
+    const unsigned int msb = histogram_msb(value);
+    if (msb >= HISTOGRAM_MAX_BITS) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    const unsigned int shift = msb - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS
+        + (unsigned int)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// Smallest value that falls into the bucket at `index`.
+static inline uint64_t histogram_bucket_low(const unsigned int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    const unsigned int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    const uint64_t sub = index % HISTOGRAM_SUB_BUCKETS;
+    return (HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+static inline void histogram_reset(struct histogram *const histogram) {
+    memset(histogram, 0, sizeof (*histogram));
+}
+
+static inline void histogram_record(
+    struct histogram *const histogram, const uint64_t value
+) {
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->count++;
+    histogram->sum += value;
+    histogram->buckets[histogram_index(value)]++;
+}
+
+static inline void histogram_merge(
+    struct histogram *const into, const struct histogram *const from
+) {
+    if (from->count == 0) {
+        return;
+    }
+    if (into->count == 0 || from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+    into->count += from->count;
+    into->sum += from->sum;
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+}
+
+static inline double histogram_mean(
+    const struct histogram *const histogram
+) {
+    if (histogram->count == 0) {
+        return 0.0;
+    }
+    return (double)histogram->sum / (double)histogram->count;
+}
+
+// Value below which `percentile` (in [0, 100]) of the recorded values
+// fall; the midpoint of its bucket, clamped to the exact min/max.
+static inline uint64_t histogram_percentile(
+    const struct histogram *const histogram, const double percentile
+) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percentile / 100.0
+        * (double)histogram->count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            const uint64_t low = histogram_bucket_low(i);
+            const uint64_t high = (i + 1 < HISTOGRAM_BUCKETS)
+                ? histogram_bucket_low(i + 1) : histogram->max + 1;
+            const uint64_t middle = low + (high - low) / 2;
+
+            if (middle < histogram->min) {
+                return histogram->min;
+            }
+            return (middle > histogram->max) ? histogram->max : middle;
+        }
+    }
+
+    return histogram->max;
+}
+
+
+#endif // HISTOGRAM_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: histogram.h
+// ---------------------------------------------------------------------
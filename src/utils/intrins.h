@@ -24,6 +24,54 @@ _Pragma ("once")
     )
 #endif
 
+// Hint to the CPU (and to an SMT sibling) that we are busy-waiting.
+#if (defined (__GNUC__) || defined (__llvm__)) \
+    && (defined (__x86_64__) || defined (__i386__))
+#   define CPU_RELAX() __builtin_ia32_pause()
+#elif (defined (__GNUC__) || defined (__llvm__)) \
+    && (defined (__aarch64__) || defined (__arm__))
+#   define CPU_RELAX() __asm__ __volatile__ ("yield" ::: "memory")
+#elif defined(_MSC_VER)
+#   include <intrin.h>
+#   define CPU_RELAX() _mm_pause()
+#else
+#   define CPU_RELAX() ((void)0)
+#endif
+
+// For the "template" functions that get specialized by being inlined
+// with constant arguments; plain "inline" is only a suggestion.
+#if defined (__GNUC__) || defined (__llvm__)
+#   define ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#   define ALWAYS_INLINE __forceinline
+#else
+#   define ALWAYS_INLINE inline
+#endif
+
+// Loads and stores that order the other accesses around them; e.g.,
+// for the status words of a ring that is shared with the kernel.
+#if defined (__GNUC__) || defined (__llvm__)
+#   define LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#   define STORE_RELEASE(ptr, value) \
+        __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#else
+#   define LOAD_ACQUIRE(ptr) (*(ptr))
+#   define STORE_RELEASE(ptr, value) (*(ptr) = (value))
+#endif
+
+// Replaces `*ptr` with `desired` if (and only if) it still equals
+// `*expected`, as one atomic step, and evaluates to whether it did;
+// if not, `*expected` gets what `*ptr` was instead.
+#if defined (__GNUC__) || defined (__llvm__)
+#   define COMPARE_EXCHANGE(ptr, expected, desired) \
+        __atomic_compare_exchange_n((ptr), (expected), (desired), \
+            0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+#   define COMPARE_EXCHANGE(ptr, expected, desired) \
+        ((*(ptr) == *(expected)) ? (*(ptr) = (desired), 1) \
+            : (*(expected) = *(ptr), 0))
+#endif
+
 #endif // INTRINS_H
 
 // ---------------------------------------------------------------------
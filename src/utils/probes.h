@@ -0,0 +1,178 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// probes.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef PROBES_H
+#define PROBES_H
+
+
+#include "./intrins.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Keys of a slot, besides those of the probes (which are never either)
+#define PROBE_EMPTY 0
+#define PROBE_BUSY UINT64_MAX // Being filled in (by a sender)
+
+
+// NOTE: This is a table of the probes (e.g., echo requests or SYNs)
+// that are still awaiting their answers, keyed by whatever identifies
+// an answer with its probe; senders fill its slots, and the receiver
+// empties them as the answers come in.  A sender only ever takes a slot
+// back from the receiver once its probe has timed out.  Every one of
+// these hand-overs is a single compare-and-swap of the key, so nobody
+// ever waits for anybody else, and any number of senders may share it.
+// Probes stay within `max_probes` slots of where their key hashes to;
+// when those are all taken, the probe goes untracked.
+typedef struct probe_slot {
+    uint64_t key;
+    uint64_t sent_ns;
+} probe_slot_t;
+
+typedef struct probe_table {
+    struct probe_slot *slots;
+    uint64_t mask;           // Number of slots (a power of two), minus 1
+    unsigned int shift;      // 64 minus the bits of the number of slots
+    unsigned int max_probes;
+    uint64_t timeout_ns;     // Until a probe counts as unanswered
+} probe_table_t;
+
+typedef enum probe_result {
+    PROBE_TRACKED,
+    PROBE_REPLACED, // Tracked, in place of a timed-out probe
+    PROBE_FULL
+} probe_result_t;
+
+// Allocates a table of 2^`bits` slots; returns 0 on success.
+static inline int probe_table_init(
+    struct probe_table *const table,
+    const unsigned int bits,
+    const unsigned int max_probes,
+    const uint64_t timeout_ns
+) {
+    table->slots = calloc((size_t)1 << bits, sizeof (*table->slots));
+    table->mask = ((uint64_t)1 << bits) - 1;
+    table->shift = 64 - bits;
+    table->max_probes = max_probes;
+    table->timeout_ns = timeout_ns;
+    return (table->slots == NULL) ? 1 : 0;
+}
+
+static inline void probe_table_free(struct probe_table *const table) {
+    free(table->slots);
+    table->slots = NULL;
+}
+
+// The i-th slot that `key` may live in (Fibonacci hashing, which also
+// scatters keys that merely count up).
+static inline struct probe_slot *probe_slot(
+    const struct probe_table *const table,
+    const uint64_t key,
+    const unsigned int i
+) {
+    const uint64_t hash = (key * 0x9E3779B97F4A7C15ULL) >> table->shift;
+    return &table->slots[(hash + i) & table->mask];
+}
+
+// Claims a slot for the probe of `key`, sent at `now_ns`; the first
+// one that is free (or whose probe timed out) within reach.  A probe
+// of the same key (e.g., after its sequence number wrapped around)
+// would make the answers ambiguous, so it gets replaced, too.
+static inline probe_result_t probe_track(
+    struct probe_table *const table,
+    const uint64_t key,
+    const uint64_t now_ns
+) {
+    for (unsigned int i = 0; i < table->max_probes; i++) {
+        struct probe_slot *const slot = probe_slot(table, key, i);
+        uint64_t expected = LOAD_ACQUIRE(&slot->key);
+
+        if (expected != PROBE_EMPTY && expected != key
+            && (expected == PROBE_BUSY
+                || now_ns - LOAD_ACQUIRE(&slot->sent_ns)
+                    < table->timeout_ns)
+        ) {
+            continue;
+        }
+        // (If the receiver emptied it in the meantime, it is still
+        // good; if another sender took it, it is not.)
+        if (!COMPARE_EXCHANGE(&slot->key, &expected, PROBE_BUSY)
+            && (expected != PROBE_EMPTY
+                || !COMPARE_EXCHANGE(&slot->key, &expected, PROBE_BUSY))
+        ) {
+            continue;
+        }
+
+        STORE_RELEASE(&slot->sent_ns, now_ns);
+        STORE_RELEASE(&slot->key, key);
+        return (expected != PROBE_EMPTY) ? PROBE_REPLACED : PROBE_TRACKED;
+    }
+
+    return PROBE_FULL;
+}
+
+// Takes back the slot of a probe that could not be sent after all;
+// returns whether it had one.
+static inline bool probe_untrack(
+    struct probe_table *const table, const uint64_t key
+) {
+    for (unsigned int i = 0; i < table->max_probes; i++) {
+        struct probe_slot *const slot = probe_slot(table, key, i);
+        uint64_t expected = key;
+        if (COMPARE_EXCHANGE(&slot->key, &expected, PROBE_EMPTY)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Empties the slot of the probe that `key` answers, if it is still
+// awaiting one, and returns when that probe was sent.
+static inline bool probe_match(
+    struct probe_table *const table,
+    const uint64_t key,
+    uint64_t *const sent_ns
+) {
+    for (unsigned int i = 0; i < table->max_probes; i++) {
+        struct probe_slot *const slot = probe_slot(table, key, i);
+        if (LOAD_ACQUIRE(&slot->key) != key) {
+            continue;
+        }
+
+        // (Read before letting go of it; if a sender took it back in
+        // the meantime, the swap fails, and the answer is too late.)
+        const uint64_t sent = LOAD_ACQUIRE(&slot->sent_ns);
+        uint64_t expected = key;
+        if (!COMPARE_EXCHANGE(&slot->key, &expected, PROBE_EMPTY)) {
+            return false;
+        }
+        *sent_ns = sent;
+        return true;
+    }
+
+    return false;
+}
+
+// Probes still awaiting an answer (once nobody touches the table).
+static inline uint64_t probe_table_pending(
+    const struct probe_table *const table
+) {
+    uint64_t pending = 0;
+    for (uint64_t i = 0; i <= table->mask; i++) {
+        if (table->slots[i].key != PROBE_EMPTY) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+
+#endif // PROBES_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: probes.h
+// ---------------------------------------------------------------------
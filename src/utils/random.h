@@ -0,0 +1,51 @@
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: GPL-3.0-or-later
+// random.h is a part of Blitzping.
+// ---------------------------------------------------------------------
+
+_Pragma ("once")
+#ifndef RANDOM_H
+#define RANDOM_H
+
+
+#include <stdint.h>
+
+
+// NOTE: rand() is neither thread-safe (it shares one hidden state
+// across all threads) nor fast on embedded libcs; we do not need
+// cryptographic quality for spoofed ports and addresses, so each
+// thread carries its own Marsaglia xorshift state instead.
+typedef struct xorshift32 {
+    uint32_t state; // Must never be zero
+} xorshift32_t;
+
+static inline void xorshift32_seed(
+    struct xorshift32 *const rng, const uint32_t seed
+) {
+    // Zero is the only "stuck" state of xorshift.
+    rng->state = (seed != 0) ? seed : 0x9E3779B9u;
+}
+
+static inline uint32_t xorshift32_next(struct xorshift32 *const rng) {
+    uint32_t x = rng->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng->state = x;
+    return x;
+}
+
+// Uniform value in [0, range) without a division (Lemire's method);
+// a zero range returns zero.
+static inline uint32_t xorshift32_bounded(
+    struct xorshift32 *const rng, const uint32_t range
+) {
+    return (uint32_t)(((uint64_t)xorshift32_next(rng) * range) >> 32);
+}
+
+
+#endif // RANDOM_H
+
+// ---------------------------------------------------------------------
+// END OF FILE: random.h
+// ---------------------------------------------------------------------